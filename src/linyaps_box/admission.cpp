@@ -0,0 +1,258 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/admission.h"
+
+#include "linyaps_box/utils/log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <system_error>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+// NOTE: Slots might be released without notification if a launcher crashes,
+// and the pressure changes without notification.
+constexpr std::chrono::milliseconds poll_interval{ 50 };
+
+// Open the file at `path` and lock it by flock(2) without blocking,
+// returns an invalid file descriptor if it is locked by others.
+[[nodiscard]] linyaps_box::utils::file_descriptor try_lock(const std::filesystem::path &path,
+                                                           int flags)
+{
+    linyaps_box::utils::file_descriptor lock(::open(path.c_str(), flags | O_CLOEXEC, 0600));
+    if (lock.get() < 0) {
+        throw std::system_error(errno, std::generic_category(), "open " + path.string());
+    }
+
+    if (::flock(lock.get(), LOCK_EX | LOCK_NB) == 0) {
+        return lock;
+    }
+    if (errno != EWOULDBLOCK) {
+        throw std::system_error(errno, std::generic_category(), "flock " + path.string());
+    }
+    return {};
+}
+
+// A ticket is locked by flock(2) as long as its launcher waits,
+// so a ticket which is not locked is left by a launcher which crashed.
+class ticket_t
+{
+public:
+    ticket_t(const std::filesystem::path &queue, int priority)
+    {
+        static std::atomic<unsigned int> sequence{ 0 };
+
+        timespec now{};
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        auto ns = static_cast<unsigned long long>(now.tv_sec) * 1000000000ULL
+                + static_cast<unsigned long long>(now.tv_nsec);
+
+        // NOTE: Tickets are sorted by name, larger priority and earlier arrival first.
+        priority = std::clamp(priority, -999, 999);
+        char name[64];
+        std::snprintf(name,
+                      sizeof(name),
+                      "%04d-%020llu-%d-%u",
+                      999 - priority,
+                      ns,
+                      getpid(),
+                      sequence++);
+        this->path = queue / name;
+
+        // NOTE: The ticket is locked under a hidden name before it is queued,
+        // so it is never seen unlocked by others.
+        auto hidden = queue / ("." + std::string(name));
+        this->lock = try_lock(hidden, O_RDONLY | O_CREAT | O_EXCL);
+        if (this->lock.get() < 0) {
+            throw std::runtime_error("failed to lock admission ticket " + hidden.string());
+        }
+        std::filesystem::rename(hidden, this->path);
+    }
+
+    ticket_t(const ticket_t &) = delete;
+    ticket_t &operator=(const ticket_t &) = delete;
+
+    ~ticket_t()
+    {
+        std::error_code ec;
+        std::filesystem::remove(this->path, ec);
+    }
+
+    // Whether no live ticket is ahead of us, stale tickets are removed.
+    [[nodiscard]] bool is_head() const
+    {
+        auto name = this->path.filename().string();
+        for (const auto &entry : std::filesystem::directory_iterator(this->path.parent_path())) {
+            auto other = entry.path().filename().string();
+            if (other >= name || other.front() == '.') {
+                continue;
+            }
+
+            linyaps_box::utils::file_descriptor lock;
+            try {
+                lock = try_lock(entry.path(), O_RDONLY);
+            } catch (const std::system_error &e) {
+                // NOTE: The ticket is removed by its launcher meanwhile.
+                if (e.code().value() == ENOENT) {
+                    continue;
+                }
+                throw;
+            }
+            if (lock.get() < 0) {
+                return false;
+            }
+
+            LINYAPS_BOX_DEBUG() << "Remove stale admission ticket " << other;
+            std::error_code ec;
+            std::filesystem::remove(entry.path(), ec);
+        }
+        return true;
+    }
+
+private:
+    std::filesystem::path path;
+    linyaps_box::utils::file_descriptor lock;
+};
+
+[[nodiscard]] std::optional<double> read_pressure(const char *path)
+{
+    std::ifstream ifs(path);
+    std::string line;
+    if (!ifs || !std::getline(ifs, line)) {
+        return std::nullopt;
+    }
+
+    double avg10 = 0;
+    if (std::sscanf(line.c_str(), "some avg10=%lf", &avg10) != 1) {
+        return std::nullopt;
+    }
+    return avg10;
+}
+
+[[nodiscard]] bool under_pressure(const linyaps_box::admission::options_t &options)
+{
+    auto value = linyaps_box::admission::pressure();
+    if (value && *value >= options.pressure_threshold) {
+        LINYAPS_BOX_DEBUG() << "Pressure " << *value << " reaches threshold, admit one launch";
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+linyaps_box::admission::slot::slot(std::vector<std::filesystem::path> paths,
+                                   std::vector<utils::file_descriptor> locks)
+    : paths(std::move(paths))
+    , locks(std::move(locks))
+{
+}
+
+linyaps_box::admission::slot::~slot()
+{
+    this->release();
+}
+
+void linyaps_box::admission::slot::release()
+{
+    if (this->locks.empty()) {
+        return;
+    }
+
+    this->locks.clear();
+
+    // NOTE: Closing a writable file descriptor generates IN_CLOSE_WRITE,
+    // which wakes up the waiting launchers.
+    for (const auto &path : this->paths) {
+        utils::file_descriptor notify(::open(path.c_str(), O_WRONLY | O_CLOEXEC));
+    }
+}
+
+linyaps_box::admission::slot linyaps_box::admission::acquire(const std::filesystem::path &dir,
+                                                             const options_t &options)
+{
+    if (options.max_launches == 0) {
+        throw std::invalid_argument("admission control is disabled");
+    }
+
+    auto queue = dir / "queue";
+    std::filesystem::create_directories(queue);
+
+    utils::file_descriptor inotify(::inotify_init1(IN_CLOEXEC | IN_NONBLOCK));
+    if (inotify.get() < 0) {
+        throw std::system_error(errno, std::generic_category(), "inotify_init1");
+    }
+    if (::inotify_add_watch(inotify.get(), dir.c_str(), IN_CLOSE_WRITE) < 0
+        || ::inotify_add_watch(inotify.get(), queue.c_str(), IN_DELETE) < 0) {
+        throw std::system_error(errno, std::generic_category(), "inotify_add_watch");
+    }
+
+    ticket_t ticket(queue, options.priority);
+
+    auto begin = std::chrono::steady_clock::now();
+
+    while (true) {
+        if (ticket.is_head()) {
+            // NOTE: Under pressure a launch holds every slot, so it runs alone.
+            auto alone = under_pressure(options);
+
+            std::vector<std::filesystem::path> paths;
+            std::vector<utils::file_descriptor> locks;
+            for (unsigned int i = 0; i < options.max_launches; ++i) {
+                auto path = dir / ("slot-" + std::to_string(i));
+                auto lock = try_lock(path, O_RDONLY | O_CREAT);
+                if (lock.get() < 0) {
+                    if (alone) {
+                        break;
+                    }
+                    continue;
+                }
+
+                paths.push_back(std::move(path));
+                locks.push_back(std::move(lock));
+                if (!alone || locks.size() == options.max_launches) {
+                    LINYAPS_BOX_DEBUG()
+                            << "Launch admitted to " << paths.back() << " after "
+                            << std::chrono::duration<double, std::milli>(
+                                       std::chrono::steady_clock::now() - begin)
+                                       .count()
+                            << "ms";
+                    return slot(std::move(paths), std::move(locks));
+                }
+            }
+        }
+
+        pollfd fd{ inotify.get(), POLLIN, 0 };
+        auto ret = ::poll(&fd, 1, static_cast<int>(poll_interval.count()));
+        if (ret < 0 && errno != EINTR) {
+            throw std::system_error(errno, std::generic_category(), "poll");
+        }
+
+        alignas(inotify_event) char buffer[4096];
+        while (::read(inotify.get(), buffer, sizeof(buffer)) > 0) { }
+    }
+}
+
+std::optional<double> linyaps_box::admission::pressure()
+{
+    std::optional<double> result;
+    for (const auto *path : { "/proc/pressure/cpu", "/proc/pressure/io", "/proc/pressure/memory" }) {
+        auto value = read_pressure(path);
+        if (value) {
+            result = std::max(result.value_or(0), *value);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,64 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/utils/file_describer.h"
+
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+// Admission control limits concurrent launches of containers,
+// which compete for disk, CPU and kernel locks while mounting and running hooks.
+//
+// A launch holds one of the slot files in the admission directory with flock(2)
+// until the container is started, the lock is released even if the launcher crashes.
+// Waiting launches queue as ticket files named in priority and arrival order,
+// only the head of the queue takes a free slot.
+// Tickets are locked by flock(2) as well, unlocked ones are left by crashed launchers.
+
+namespace linyaps_box::admission {
+
+struct options_t
+{
+    // Maximum concurrent launches, 0 disables admission control.
+    unsigned int max_launches = 0;
+
+    // Launches with larger priority are admitted first, in range [-999, 999].
+    int priority = 0;
+
+    // Only one launch is admitted at a time while the pressure of CPU, IO or memory,
+    // the `some avg10` of /proc/pressure, reaches this percentage:
+    // it waits until every slot is free and holds all of them.
+    double pressure_threshold = 40;
+};
+
+// An admitted launch, the slot is released on destruction.
+class slot
+{
+public:
+    slot(slot &&) noexcept = default;
+    slot &operator=(slot &&) noexcept = default;
+    ~slot();
+
+    void release();
+
+private:
+    friend slot acquire(const std::filesystem::path &dir, const options_t &options);
+
+    slot(std::vector<std::filesystem::path> paths, std::vector<utils::file_descriptor> locks);
+
+    std::vector<std::filesystem::path> paths;
+    std::vector<utils::file_descriptor> locks;
+};
+
+// Wait until a launch is admitted in `dir`.
+slot acquire(const std::filesystem::path &dir, const options_t &options);
+
+// Returns the highest `some avg10` of CPU, IO and memory pressure,
+// or std::nullopt if PSI is not supported.
+std::optional<double> pressure();
+
+} // namespace linyaps_box::admission
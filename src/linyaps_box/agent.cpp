@@ -0,0 +1,508 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/agent.h"
+
+#include "linyaps_box/process.h"
+#include "linyaps_box/utils/log.h"
+#include "linyaps_box/utils/pidfd.h"
+#include "nlohmann/json.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <tuple>
+
+#include <sched.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::size_t spawn_stack_size = 64 * 1024;
+
+sockaddr_un socket_address(const std::filesystem::path &path)
+{
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.native().size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("control socket path is too long: " + path.string());
+    }
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+nlohmann::json to_json(const linyaps_box::config::process_t &process)
+{
+    nlohmann::json j = {
+        { "args", process.args },
+        { "env", process.env },
+        { "cwd", process.cwd.string() },
+        { "uid", process.uid },
+        { "gid", process.gid },
+        { "noNewPrivileges", process.no_new_privileges },
+        { "terminal", process.terminal },
+    };
+    if (process.apparmor_profile) {
+        j["apparmorProfile"] = *process.apparmor_profile;
+    }
+    if (process.additional_gids) {
+        j["additionalGids"] = *process.additional_gids;
+    }
+    if (process.umask) {
+        j["umask"] = *process.umask;
+    }
+    if (process.oom_score_adj) {
+        j["oomScoreAdj"] = *process.oom_score_adj;
+    }
+    return j;
+}
+
+linyaps_box::config::process_t process_from_json(const nlohmann::json &j)
+{
+    linyaps_box::config::process_t process;
+    process.args = j.at("args").get<std::vector<std::string>>();
+    process.env = j.at("env").get<std::map<std::string, std::string>>();
+    process.cwd = j.at("cwd").get<std::string>();
+    process.uid = j.at("uid").get<uid_t>();
+    process.gid = j.at("gid").get<gid_t>();
+    process.no_new_privileges = j.at("noNewPrivileges").get<bool>();
+    process.terminal = j.value("terminal", false);
+    if (j.contains("apparmorProfile")) {
+        process.apparmor_profile = j["apparmorProfile"].get<std::string>();
+    }
+    if (j.contains("additionalGids")) {
+        process.additional_gids = j["additionalGids"].get<std::vector<gid_t>>();
+    }
+    if (j.contains("umask")) {
+        process.umask = j["umask"].get<mode_t>();
+    }
+    if (j.contains("oomScoreAdj")) {
+        process.oom_score_adj = j["oomScoreAdj"].get<int>();
+    }
+    return process;
+}
+
+void send_message(const linyaps_box::utils::file_descriptor &socket,
+                  const nlohmann::json &message,
+                  const std::vector<int> &fds = {})
+{
+    auto data = message.dump();
+
+    iovec iov{ data.data(), data.size() };
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    std::vector<char> control;
+    if (!fds.empty()) {
+        control.resize(CMSG_SPACE(sizeof(int) * fds.size()));
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+
+        auto *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    }
+
+    while (::sendmsg(socket.get(), &msg, MSG_NOSIGNAL) < 0) {
+        if (errno == EINTR) {
+            continue;
+        }
+        throw std::system_error(errno, std::generic_category(), "sendmsg");
+    }
+}
+
+// Receive a message with at most 3 file descriptors attached,
+// returns std::nullopt if the peer closed the connection.
+std::optional<nlohmann::json>
+receive_message(const linyaps_box::utils::file_descriptor &socket,
+                std::vector<linyaps_box::utils::file_descriptor> &fds)
+{
+    constexpr std::size_t max_fds = 3;
+
+    // NOTE: A sequenced packet is received at once, peek its size first.
+    ssize_t size = -1;
+    do {
+        size = ::recv(socket.get(), nullptr, 0, MSG_PEEK | MSG_TRUNC);
+    } while (size < 0 && errno == EINTR);
+    if (size < 0) {
+        throw std::system_error(errno, std::generic_category(), "recv");
+    }
+
+    std::string data(size, '\0');
+    iovec iov{ data.data(), data.size() };
+    std::array<char, CMSG_SPACE(sizeof(int) * max_fds)> control{};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+
+    ssize_t ret = -1;
+    do {
+        ret = ::recvmsg(socket.get(), &msg, MSG_CMSG_CLOEXEC);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        throw std::system_error(errno, std::generic_category(), "recvmsg");
+    }
+
+    for (auto *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        auto count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (std::size_t i = 0; i < count; ++i) {
+            int fd = -1;
+            std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            fds.emplace_back(fd);
+        }
+    }
+
+    if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        throw std::runtime_error("control message truncated");
+    }
+
+    // NOTE: Empty messages are never sent.
+    if (ret == 0) {
+        return std::nullopt;
+    }
+
+    return nlohmann::json::parse(data);
+}
+
+struct spawn_args
+{
+    const linyaps_box::prepared_process *process;
+    std::array<int, 3> stdio;
+    int error;
+    const char *call;
+};
+
+// NOTE: This runs in a child created by vfork(2), sharing memory with the agent,
+// it must not allocate memory, see linyaps_box::prepared_process.
+int spawn_fn(void *data) noexcept
+{
+    auto &args = *static_cast<spawn_args *>(data);
+
+    // NOTE: Signals are blocked by init.
+    sigset_t mask;
+    sigemptyset(&mask);
+    if (sigprocmask(SIG_SETMASK, &mask, nullptr)) {
+        args.error = errno;
+        args.call = "sigprocmask";
+        _exit(-1);
+    }
+
+    for (int fd = 0; fd < 3; ++fd) {
+        if (::dup2(args.stdio[fd], fd) < 0) {
+            args.error = errno;
+            args.call = "dup2";
+            _exit(-1);
+        }
+    }
+
+    std::tie(args.error, args.call) = args.process->execute();
+    _exit(-1);
+}
+
+} // namespace
+
+linyaps_box::utils::file_descriptor linyaps_box::agent::listen(const std::filesystem::path &path)
+{
+    utils::file_descriptor socket(
+            ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0));
+    if (socket.get() < 0) {
+        throw std::system_error(errno, std::generic_category(), "socket");
+    }
+
+    auto addr = socket_address(path);
+    if (::unlink(path.c_str()) && errno != ENOENT) {
+        throw std::system_error(errno, std::generic_category(), "unlink " + path.string());
+    }
+    if (::bind(socket.get(), reinterpret_cast<sockaddr *>(&addr), sizeof(addr))) {
+        throw std::system_error(errno, std::generic_category(), "bind " + path.string());
+    }
+
+    // NOTE: Anyone who can connect is able to run processes in the container.
+    if (::chmod(path.c_str(), 0600)) {
+        throw std::system_error(errno, std::generic_category(), "chmod " + path.string());
+    }
+
+    if (::listen(socket.get(), SOMAXCONN)) {
+        throw std::system_error(errno, std::generic_category(), "listen");
+    }
+
+    return socket;
+}
+
+linyaps_box::agent::process::process(utils::file_descriptor connection,
+                                     pid_t pid,
+                                     utils::file_descriptor pidfd)
+    : connection_(std::move(connection))
+    , pid_(pid)
+    , pidfd_(std::move(pidfd))
+{
+}
+
+pid_t linyaps_box::agent::process::pid() const noexcept
+{
+    return this->pid_;
+}
+
+const linyaps_box::utils::file_descriptor &linyaps_box::agent::process::pidfd() const noexcept
+{
+    return this->pidfd_;
+}
+
+const linyaps_box::utils::file_descriptor &linyaps_box::agent::process::connection() const noexcept
+{
+    return this->connection_;
+}
+
+void linyaps_box::agent::process::kill(int signal)
+{
+    if (this->pidfd_.get() >= 0) {
+        utils::pidfd_send_signal(this->pidfd_, signal);
+        return;
+    }
+
+    send_message(this->connection_, { { "signal", signal } });
+}
+
+int linyaps_box::agent::process::wait()
+{
+    while (true) {
+        std::vector<utils::file_descriptor> fds;
+        auto message = receive_message(this->connection_, fds);
+        if (!message) {
+            throw std::runtime_error("agent closed the connection");
+        }
+        if (message->contains("exit")) {
+            return (*message)["exit"].get<int>();
+        }
+    }
+}
+
+bool linyaps_box::agent::is_listening(const std::filesystem::path &path)
+{
+    utils::file_descriptor connection(::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0));
+    if (connection.get() < 0) {
+        throw std::system_error(errno, std::generic_category(), "socket");
+    }
+
+    // NOTE: The agent drops the connection once it is closed without a message.
+    auto addr = socket_address(path);
+    if (::connect(connection.get(), reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0) {
+        return true;
+    }
+    if (errno == ECONNREFUSED || errno == ENOENT) {
+        return false;
+    }
+    throw std::system_error(errno, std::generic_category(), "connect " + path.string());
+}
+
+linyaps_box::agent::process linyaps_box::agent::spawn(const std::filesystem::path &path,
+                                                      const config::process_t &process,
+                                                      const std::array<int, 3> &stdio)
+{
+    utils::file_descriptor connection(::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0));
+    if (connection.get() < 0) {
+        throw std::system_error(errno, std::generic_category(), "socket");
+    }
+
+    // NOTE: The agent does not know fields which are not supported.
+    validate_process(process);
+    check_terminal(process, stdio[0]);
+
+    auto addr = socket_address(path);
+    if (::connect(connection.get(), reinterpret_cast<sockaddr *>(&addr), sizeof(addr))) {
+        throw std::system_error(errno, std::generic_category(), "connect " + path.string());
+    }
+
+    send_message(connection, to_json(process), { stdio.begin(), stdio.end() });
+
+    std::vector<utils::file_descriptor> fds;
+    auto reply = receive_message(connection, fds);
+    if (!reply) {
+        throw std::runtime_error("agent closed the connection");
+    }
+    if (reply->contains("error")) {
+        throw std::runtime_error("agent: " + (*reply)["error"].get<std::string>());
+    }
+
+    utils::file_descriptor pidfd;
+    if (!fds.empty()) {
+        pidfd = std::move(fds.front());
+    }
+
+    return agent::process(std::move(connection), (*reply).at("pid").get<pid_t>(), std::move(pidfd));
+}
+
+linyaps_box::agent::server::server(utils::file_descriptor listener,
+                                   exec_policy::policy_t policy,
+                                   features::set_t features)
+    : listener(std::move(listener))
+    , policy(std::move(policy))
+    , features(std::move(features))
+{
+}
+
+void linyaps_box::agent::server::watch(utils::epoll &epoll)
+{
+    epoll.add(this->listener, EPOLLIN);
+}
+
+bool linyaps_box::agent::server::handle(utils::epoll &epoll, const epoll_event &event)
+{
+    if (event.data.fd == this->listener.get()) {
+        this->accept(epoll);
+        return true;
+    }
+
+    auto it = this->connections.find(event.data.fd);
+    if (it == this->connections.end()) {
+        return false;
+    }
+
+    try {
+        this->receive(epoll, it->second);
+    } catch (const std::exception &e) {
+        LINYAPS_BOX_WARNING() << "Agent drops connection " << event.data.fd << ": " << e.what();
+        this->close(epoll, event.data.fd);
+    }
+
+    return true;
+}
+
+bool linyaps_box::agent::server::exited(utils::epoll &epoll, pid_t pid, int exit_code)
+{
+    auto it = std::find_if(this->connections.begin(),
+                           this->connections.end(),
+                           [pid](const auto &connection) {
+                               return connection.second.pid == pid;
+                           });
+    if (it == this->connections.end()) {
+        return false;
+    }
+
+    LINYAPS_BOX_DEBUG() << "Agent spawned process " << pid << " exited with " << exit_code;
+
+    try {
+        send_message(it->second.socket, { { "exit", exit_code } });
+    } catch (const std::exception &e) {
+        LINYAPS_BOX_WARNING() << "Agent failed to report exit of " << pid << ": " << e.what();
+    }
+
+    this->close(epoll, it->first);
+    return true;
+}
+
+void linyaps_box::agent::server::accept(utils::epoll &epoll)
+{
+    while (true) {
+        utils::file_descriptor socket(::accept4(this->listener.get(), nullptr, nullptr, SOCK_CLOEXEC));
+        if (socket.get() < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LINYAPS_BOX_WARNING() << "Agent failed to accept: " << strerror(errno);
+            }
+            return;
+        }
+
+        LINYAPS_BOX_DEBUG() << "Agent accepted connection " << socket.get();
+        epoll.add(socket, EPOLLIN);
+        auto fd = socket.get();
+        this->connections.emplace(fd, connection_t{ std::move(socket), -1 });
+    }
+}
+
+void linyaps_box::agent::server::receive(utils::epoll &epoll, connection_t &connection)
+{
+    std::vector<utils::file_descriptor> fds;
+    auto message = receive_message(connection.socket, fds);
+    if (!message) {
+        // NOTE: The spawned process keeps running without its client.
+        this->close(epoll, connection.socket.get());
+        return;
+    }
+
+    if (connection.pid != -1) {
+        auto signal = message->at("signal").get<int>();
+        LINYAPS_BOX_DEBUG() << "Agent forwards signal " << signal << " to " << connection.pid;
+        if (::kill(connection.pid, signal) && errno != ESRCH) {
+            throw std::system_error(errno, std::generic_category(), "kill");
+        }
+        return;
+    }
+
+    if (fds.size() != 3) {
+        throw std::runtime_error("stdio is required to spawn a process");
+    }
+
+    std::optional<prepared_process> process;
+    try {
+        auto config = process_from_json(*message);
+        exec_policy::check(this->policy, config);
+        check_terminal(config, fds[0].get());
+        process.emplace(config, this->policy.seccomp);
+    } catch (const std::exception &e) {
+        send_message(connection.socket, { { "error", e.what() } });
+        return;
+    }
+
+    // NOTE: vfork(2) saves copying the page tables of init,
+    // which costs the most of spawning a process.
+    spawn_args args{ &*process, { fds[0].get(), fds[1].get(), fds[2].get() }, 0, nullptr };
+    std::vector<char> stack(spawn_stack_size);
+    auto pid = ::clone(spawn_fn,
+                       stack.data() + stack.size(),
+                       CLONE_VM | CLONE_VFORK | SIGCHLD,
+                       &args);
+    if (pid < 0) {
+        send_message(connection.socket,
+                     { { "error", std::string("clone: ") + strerror(errno) } });
+        return;
+    }
+
+    // NOTE: The child failed before execve(2), it is reaped as others.
+    if (args.error != 0) {
+        send_message(connection.socket,
+                     { { "error", std::string(args.call) + ": " + strerror(args.error) } });
+        return;
+    }
+
+    LINYAPS_BOX_DEBUG() << "Agent spawned process " << pid;
+    connection.pid = pid;
+
+    utils::file_descriptor pidfd;
+    if (this->features.has(features::pidfd)) {
+        pidfd = utils::pidfd_open(pid);
+    }
+
+    if (pidfd.get() >= 0) {
+        send_message(connection.socket, { { "pid", pid } }, { pidfd.get() });
+    } else {
+        send_message(connection.socket, { { "pid", pid } });
+    }
+}
+
+void linyaps_box::agent::server::close(utils::epoll &epoll, int fd)
+{
+    auto it = this->connections.find(fd);
+    if (it == this->connections.end()) {
+        return;
+    }
+
+    epoll.remove(it->second.socket);
+    this->connections.erase(it);
+}
@@ -0,0 +1,109 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/config.h"
+#include "linyaps_box/exec_policy.h"
+#include "linyaps_box/features.h"
+#include "linyaps_box/utils/epoll.h"
+#include "linyaps_box/utils/file_describer.h"
+
+#include <array>
+#include <filesystem>
+#include <map>
+
+#include <sys/types.h>
+
+// The agent runs in the init process of a container,
+// it spawns processes in the container on requests from its control socket,
+// which saves joining the namespaces of the container for each process.
+//
+// The control socket is a SOCK_SEQPACKET unix socket, messages are JSON objects:
+// a client sends the process to spawn with its stdio attached by SCM_RIGHTS,
+// the agent replies with the PID and a pidfd attached if supported,
+// then with the exit code once the process exits.
+// The client might send a signal to the process until then.
+
+namespace linyaps_box::agent {
+
+// Create the control socket at `path` for the agent.
+utils::file_descriptor listen(const std::filesystem::path &path);
+
+// A process spawned by the agent of a container.
+class process
+{
+public:
+    // The PID in the PID namespace of the container.
+    [[nodiscard]] pid_t pid() const noexcept;
+
+    // It is -1 if pidfd is not supported.
+    [[nodiscard]] const utils::file_descriptor &pidfd() const noexcept;
+
+    // The connection to the agent, which becomes readable when the process exits.
+    [[nodiscard]] const utils::file_descriptor &connection() const noexcept;
+
+    void kill(int signal);
+
+    // Wait for the process, returns its exit code.
+    [[nodiscard]] int wait();
+
+private:
+    friend process spawn(const std::filesystem::path &path,
+                         const config::process_t &process,
+                         const std::array<int, 3> &stdio);
+
+    process(utils::file_descriptor connection, pid_t pid, utils::file_descriptor pidfd);
+
+    utils::file_descriptor connection_;
+    pid_t pid_;
+    utils::file_descriptor pidfd_;
+};
+
+// Whether an agent listens on `path`, which is false if the socket is left by a dead agent.
+[[nodiscard]] bool is_listening(const std::filesystem::path &path);
+
+// Ask the agent listening on `path` to spawn `process`,
+// with `stdio` as its stdin, stdout and stderr.
+process spawn(const std::filesystem::path &path,
+              const config::process_t &process,
+              const std::array<int, 3> &stdio);
+
+// The agent serving the control socket in the init process.
+// Requests less restricted than `policy` are denied,
+// and the seccomp filter of `policy` is installed to every spawned process.
+class server
+{
+public:
+    server(utils::file_descriptor listener,
+           exec_policy::policy_t policy,
+           features::set_t features);
+
+    void watch(utils::epoll &epoll);
+
+    // Handle an event of `epoll`, returns false if it is not for the agent.
+    bool handle(utils::epoll &epoll, const epoll_event &event);
+
+    // Report the exit of `pid` to its client,
+    // returns false if it is not spawned by the agent.
+    bool exited(utils::epoll &epoll, pid_t pid, int exit_code);
+
+private:
+    struct connection_t
+    {
+        utils::file_descriptor socket;
+        pid_t pid = -1;
+    };
+
+    void accept(utils::epoll &epoll);
+    void receive(utils::epoll &epoll, connection_t &connection);
+    void close(utils::epoll &epoll, int fd);
+
+    utils::file_descriptor listener;
+    exec_policy::policy_t policy;
+    features::set_t features;
+    std::map<int, connection_t> connections;
+};
+
+} // namespace linyaps_box::agent
@@ -4,10 +4,16 @@
 
 #include "linyaps_box/app.h"
 
+#include "linyaps_box/command/checkpoint.h"
+#include "linyaps_box/command/events.h"
 #include "linyaps_box/command/exec.h"
+#include "linyaps_box/command/features.h"
 #include "linyaps_box/command/kill.h"
 #include "linyaps_box/command/list.h"
+#include "linyaps_box/command/restore.h"
 #include "linyaps_box/command/run.h"
+#include "linyaps_box/command/run_many.h"
+#include "linyaps_box/impl/status_table.h"
 #include "linyaps_box/utils/log.h"
 
 #include <iostream>
@@ -47,6 +53,11 @@ try {
         return *options.return_code;
     }
 
+    // NOTE: Once created, commands on the root use the table, see impl::open_status_directory.
+    if (options.status_table && !impl::status_table::exists(options.root)) {
+        impl::status_table table(options.root);
+    }
+
     switch (options.command) {
     case command::options::command_t::list: {
         return command::list(options.root, options.list);
@@ -54,6 +65,9 @@ try {
     case command::options::command_t::run: {
         return command::run(options.root, options.run);
     }
+    case command::options::command_t::run_many: {
+        return command::run_many(options.root, options.run_many);
+    }
     case command::options::command_t::exec: {
         command::exec(options.root, options.exec);
         throw std::logic_error("unreachable");
@@ -61,6 +75,18 @@ try {
     case command::options::command_t::kill: {
         return command::kill(options.root, options.kill);
     }
+    case command::options::command_t::features: {
+        return command::features(options.root, options.features);
+    }
+    case command::options::command_t::checkpoint: {
+        return command::checkpoint(options.root, options.checkpoint);
+    }
+    case command::options::command_t::restore: {
+        return command::restore(options.root, options.restore);
+    }
+    case command::options::command_t::events: {
+        return command::events(options.root, options.events);
+    }
     case command::options::command_t::not_set:
     default: {
         throw std::logic_error("unreachable");
@@ -0,0 +1,351 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/checkpoint.h"
+
+#include "linyaps_box/utils/atomic_write.h"
+#include "linyaps_box/utils/digest.h"
+#include "linyaps_box/utils/file_describer.h"
+#include "linyaps_box/utils/log.h"
+#include "nlohmann/json.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <system_error>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr auto manifest_name = "ll-box.json";
+
+// NOTE: Bump it on any change of the manifest or of the digest.
+constexpr int manifest_version = 1;
+
+// The socket of `criu lazy-pages` appears in the image directory once it is ready.
+constexpr auto lazy_pages_socket = "lazy-pages.socket";
+
+// NOTE: The exit of the lazy-pages daemon is not notified by inotify, so it is checked
+// at this interval while waiting for its socket.
+constexpr auto lazy_pages_poll_interval = std::chrono::milliseconds(100);
+
+[[nodiscard]] bool is_bind_mount(const linyaps_box::config::mount_t &mount)
+{
+    return (mount.flags & MS_BIND) != 0 && mount.source && mount.destination
+            && mount.source->rfind("fd:", 0) != 0;
+}
+
+// NOTE: Bind mounts are external to the mount namespace of the container,
+// they are dumped with their destinations as keys and restored from the current sources.
+void add_external_mounts(std::vector<std::string> &args,
+                         const std::filesystem::path &bundle,
+                         const linyaps_box::config &config,
+                         bool restore)
+{
+    for (const auto &mount : config.mounts) {
+        if (!is_bind_mount(mount)) {
+            continue;
+        }
+
+        auto key = mount.destination->string();
+        args.emplace_back("--ext-mount-map");
+        args.push_back(key + ":" + (restore ? (bundle / *mount.source).string() : key));
+    }
+}
+
+void add_common_options(std::vector<std::string> &args,
+                        const std::filesystem::path &image,
+                        const linyaps_box::checkpoint::options_t &options)
+{
+    args.emplace_back("--images-dir");
+    args.push_back(image.string());
+    args.emplace_back("--ext-unix-sk");
+    args.emplace_back("--manage-cgroups=ignore");
+
+    if (options.tcp_established) {
+        args.emplace_back("--tcp-established");
+    }
+    if (options.file_locks) {
+        args.emplace_back("--file-locks");
+    }
+    if (geteuid() != 0) {
+        // NOTE: It requires CAP_CHECKPOINT_RESTORE, Linux 5.9 and criu 3.16.
+        args.emplace_back("--unprivileged");
+    }
+}
+
+[[nodiscard]] pid_t spawn_criu(const std::vector<std::string> &args)
+{
+    LINYAPS_BOX_DEBUG() << "Spawn criu" << [&args]() {
+        std::string result;
+        for (const auto &arg : args) {
+            result += " " + arg;
+        }
+        return result;
+    }();
+
+    std::vector<const char *> c_args;
+    c_args.reserve(args.size() + 1);
+    for (const auto &arg : args) {
+        c_args.push_back(arg.c_str());
+    }
+    c_args.push_back(nullptr);
+
+    auto pid = fork();
+    if (pid < 0) {
+        throw std::system_error(errno, std::generic_category(), "fork");
+    }
+
+    if (pid == 0) {
+        execvp(c_args[0], const_cast<char *const *>(c_args.data()));
+        std::cerr << "execvp: " << strerror(errno) << " errno=" << errno << std::endl;
+        _exit(1);
+    }
+
+    return pid;
+}
+
+void wait_criu(pid_t pid, const std::string &action)
+{
+    int status = 0;
+    while (::waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            throw std::system_error(errno, std::generic_category(), "waitpid");
+        }
+    }
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        return;
+    }
+
+    throw std::runtime_error("criu " + action + " failed, see the log in the image directory");
+}
+
+void kill_criu(pid_t pid) noexcept
+{
+    ::kill(pid, SIGKILL);
+    while (::waitpid(pid, nullptr, 0) < 0 && errno == EINTR) { }
+}
+
+// Wait for `criu lazy-pages` of `pid` to create its socket in `image`,
+// it is killed if it is not ready before `timeout`.
+void wait_lazy_pages(pid_t pid,
+                     const std::filesystem::path &image,
+                     std::chrono::milliseconds timeout)
+{
+    linyaps_box::utils::file_descriptor inotify(::inotify_init1(IN_CLOEXEC | IN_NONBLOCK));
+    if (inotify.get() < 0) {
+        throw std::system_error(errno, std::generic_category(), "inotify_init1");
+    }
+    if (::inotify_add_watch(inotify.get(), image.c_str(), IN_CREATE | IN_MOVED_TO) < 0) {
+        throw std::system_error(errno, std::generic_category(), "inotify_add_watch");
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!std::filesystem::exists(image / lazy_pages_socket)) {
+        if (::waitpid(pid, nullptr, WNOHANG) == pid) {
+            throw std::runtime_error("criu lazy-pages exited before it is ready");
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            kill_criu(pid);
+            throw std::runtime_error("criu lazy-pages is not ready in "
+                                     + std::to_string(timeout.count()) + "ms");
+        }
+
+        auto wait = std::min(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now),
+                             lazy_pages_poll_interval);
+        pollfd fd{ inotify.get(), POLLIN, 0 };
+        if (::poll(&fd, 1, static_cast<int>(wait.count())) < 0 && errno != EINTR) {
+            throw std::system_error(errno, std::generic_category(), "poll");
+        }
+
+        alignas(inotify_event) char buffer[4096];
+        while (::read(inotify.get(), buffer, sizeof(buffer)) > 0) { }
+    }
+}
+
+[[nodiscard]] bool is_terminal(pid_t pid)
+{
+    std::error_code ec;
+    auto target = std::filesystem::read_symlink(
+            std::filesystem::path("/proc") / std::to_string(pid) / "fd" / "0",
+            ec);
+    return !ec && target.string().rfind("/dev/pts/", 0) == 0;
+}
+
+} // namespace
+
+std::filesystem::path linyaps_box::checkpoint::config_path(const std::filesystem::path &bundle,
+                                                           const std::string &config)
+{
+    if (config.empty()) {
+        return std::filesystem::absolute(bundle / "config.json");
+    }
+    return std::filesystem::absolute(config);
+}
+
+std::string linyaps_box::checkpoint::digest(const std::filesystem::path &bundle_path,
+                                            const std::filesystem::path &config_path,
+                                            const config &config)
+{
+    utils::digest hash;
+    auto bundle = std::filesystem::canonical(bundle_path);
+
+    {
+        std::ifstream ifs(config_path, std::ios::binary);
+        if (!ifs) {
+            throw std::runtime_error("failed to open " + config_path.string());
+        }
+        std::string content{ std::istreambuf_iterator<char>(ifs),
+                             std::istreambuf_iterator<char>() };
+        hash.update(content);
+    }
+
+    // NOTE: Files changed in place inside the root filesystem are not detected,
+    // the bundle is expected to be replaced or remounted on update.
+    hash.update_stat(bundle / config.root.path);
+
+    for (const auto &mount : config.mounts) {
+        if (is_bind_mount(mount)) {
+            hash.update_stat(bundle / *mount.source);
+        }
+    }
+
+    return hash.hex();
+}
+
+bool linyaps_box::checkpoint::valid(const std::filesystem::path &image, const std::string &digest)
+try {
+    std::ifstream ifs(image / manifest_name);
+    if (!ifs) {
+        return false;
+    }
+
+    auto j = nlohmann::json::parse(ifs);
+    return j.value("version", 0) == manifest_version && j.at("digest") == digest;
+} catch (const std::exception &e) {
+    LINYAPS_BOX_WARNING() << "Ignore checkpoint manifest in " << image << ": " << e.what();
+    return false;
+}
+
+void linyaps_box::checkpoint::dump(pid_t pid,
+                                   const std::filesystem::path &bundle,
+                                   const config &config,
+                                   const std::filesystem::path &image,
+                                   const std::string &digest,
+                                   const options_t &options)
+{
+    std::filesystem::create_directories(image);
+
+    // NOTE: The manifest is removed first,
+    // so images are not restored if the dump fails in the middle.
+    std::filesystem::remove(image / manifest_name);
+
+    std::vector<std::string> args{ options.criu, "dump", "--tree", std::to_string(pid),
+                                   "--log-file", "dump.log" };
+    add_common_options(args, image, options);
+    add_external_mounts(args, bundle, config, false);
+
+    if (options.leave_running) {
+        args.emplace_back("--leave-running");
+    }
+    // NOTE: The process is gone after the dump without `--leave-running`.
+    auto shell_job = is_terminal(pid);
+    if (shell_job) {
+        args.emplace_back("--shell-job");
+    }
+
+    wait_criu(spawn_criu(args), "dump");
+
+    nlohmann::json j;
+    j["version"] = manifest_version;
+    j["digest"] = digest;
+    j["shellJob"] = shell_job;
+    utils::atomic_write(image / manifest_name, j.dump());
+}
+
+linyaps_box::checkpoint::restored_t
+linyaps_box::checkpoint::restore(const std::filesystem::path &bundle,
+                                 const config &config,
+                                 const std::filesystem::path &image,
+                                 const options_t &options)
+{
+    bool shell_job = false;
+    {
+        std::ifstream ifs(image / manifest_name);
+        shell_job = nlohmann::json::parse(ifs).value("shellJob", false);
+    }
+
+    auto pidfile = image / "restore.pid";
+    std::filesystem::remove(pidfile);
+
+    restored_t restored;
+    if (options.lazy_pages) {
+        std::filesystem::remove(image / lazy_pages_socket);
+
+        std::vector<std::string> args{ options.criu, "lazy-pages", "--log-file", "lazy-pages.log" };
+        add_common_options(args, image, options);
+        auto lazy_pages = spawn_criu(args);
+
+        // NOTE: The daemon is reaped here if it exited or timed out.
+        wait_lazy_pages(lazy_pages, image, options.lazy_pages_timeout);
+        restored.lazy_pages = lazy_pages;
+    }
+
+    // NOTE: The restored process tree is reparented to the runtime by `--restore-sibling`,
+    // namespaces and mounts of the container are recreated by criu from the images.
+    std::vector<std::string> args{ options.criu,
+                                   "restore",
+                                   "--root",
+                                   (bundle / config.root.path).string(),
+                                   "--restore-detached",
+                                   "--restore-sibling",
+                                   "--pidfile",
+                                   pidfile.string(),
+                                   "--log-file",
+                                   "restore.log" };
+    add_common_options(args, image, options);
+    add_external_mounts(args, bundle, config, true);
+
+    if (options.lazy_pages) {
+        args.emplace_back("--lazy-pages");
+    }
+    if (shell_job) {
+        args.emplace_back("--shell-job");
+    }
+
+    try {
+        wait_criu(spawn_criu(args), "restore");
+
+        std::ifstream ifs(pidfile);
+        if (!(ifs >> restored.pid) || restored.pid <= 0) {
+            throw std::runtime_error("invalid pidfile " + pidfile.string());
+        }
+    } catch (...) {
+        release(restored);
+        throw;
+    }
+
+    LINYAPS_BOX_DEBUG() << "Restored process " << restored.pid << " from " << image;
+    return restored;
+}
+
+void linyaps_box::checkpoint::release(const restored_t &restored) noexcept
+{
+    if (restored.lazy_pages > 0) {
+        kill_criu(restored.lazy_pages);
+    }
+}
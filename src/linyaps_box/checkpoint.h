@@ -0,0 +1,95 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/config.h"
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+#include <sys/types.h>
+
+// Checkpoint and restore of containers by the criu(8) binary,
+// so an application dumped at a ready point is relaunched
+// from its images instead of initializing again.
+//
+// An image directory holds the images of criu and a manifest,
+// which records the digest of the bundle it was dumped from.
+// Images of another bundle, or of the same bundle changed since the dump,
+// are stale and never restored.
+
+namespace linyaps_box::checkpoint {
+
+struct options_t
+{
+    // The criu binary, looked up in PATH.
+    std::string criu = "criu";
+
+    // Keep the container running after it is dumped.
+    bool leave_running = false;
+
+    // Checkpoint and restore established TCP connections.
+    bool tcp_established = false;
+
+    // Checkpoint and restore file locks.
+    bool file_locks = false;
+
+    // Restore memory pages on demand by `criu lazy-pages`,
+    // so the container resumes before all pages are read from the images.
+    bool lazy_pages = false;
+
+    // Bound the wait for `criu lazy-pages` to be ready, it is killed after that.
+    std::chrono::milliseconds lazy_pages_timeout = std::chrono::seconds(10);
+};
+
+struct restored_t
+{
+    // The restored container process.
+    pid_t pid = -1;
+    // The `criu lazy-pages` daemon serving memory pages of the container, or -1.
+    pid_t lazy_pages = -1;
+};
+
+// The configuration file of a container in `bundle`:
+// `config` if it is not empty, otherwise config.json of the bundle.
+// Checkpoint and restore resolve it the same way, so their digests match.
+[[nodiscard]] std::filesystem::path config_path(const std::filesystem::path &bundle,
+                                                const std::string &config);
+
+// The digest of the configuration, the root filesystem and the sources of bind mounts,
+// which changes if any of them is modified, replaced or touched.
+// The bundle is canonicalized first, so it does not depend on how it is referred to.
+[[nodiscard]] std::string digest(const std::filesystem::path &bundle,
+                                 const std::filesystem::path &config_path,
+                                 const config &config);
+
+// Whether `image` is dumped from a bundle of `digest`,
+// by a runtime writing the same format of the manifest.
+[[nodiscard]] bool valid(const std::filesystem::path &image, const std::string &digest);
+
+// Dump the process tree of `pid`, the process of the container created by `config`,
+// to `image`, which is marked with `digest` on success only.
+void dump(pid_t pid,
+          const std::filesystem::path &bundle,
+          const config &config,
+          const std::filesystem::path &image,
+          const std::string &digest,
+          const options_t &options);
+
+// Restore the process tree from `image` as a child of the calling process,
+// with bind mounts of `config` mapped to their sources.
+// The lazy-pages daemon is a child of the calling process as well,
+// which is reaped on failure, and by release() after the container process exited.
+[[nodiscard]] restored_t restore(const std::filesystem::path &bundle,
+                                 const config &config,
+                                 const std::filesystem::path &image,
+                                 const options_t &options);
+
+// Kill and reap the lazy-pages daemon of `restored` if any,
+// which is not needed once the container process exited.
+void release(const restored_t &restored) noexcept;
+
+} // namespace linyaps_box::checkpoint
@@ -0,0 +1,41 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/command/checkpoint.h"
+
+#include "linyaps_box/checkpoint.h"
+#include "linyaps_box/impl/status_table.h"
+#include "linyaps_box/utils/log.h"
+
+
+int linyaps_box::command::checkpoint(const std::filesystem::path &root,
+                                     const struct checkpoint_options &options)
+{
+    auto dir = impl::open_status_directory(root);
+
+    auto status = dir->read(options.ID);
+    if (status.status != container_status_t::runtime_status::RUNNING) {
+        throw std::runtime_error("container " + options.ID + " is not running");
+    }
+
+    auto config_path = linyaps_box::checkpoint::config_path(status.bundle, options.config);
+    auto container_config = config::parse_file(config_path);
+
+    linyaps_box::checkpoint::options_t checkpoint_options;
+    checkpoint_options.leave_running = options.leave_running;
+    checkpoint_options.tcp_established = options.tcp_established;
+    checkpoint_options.file_locks = options.file_locks;
+
+    linyaps_box::checkpoint::dump(
+            status.PID,
+            status.bundle,
+            container_config,
+            options.image_path,
+            linyaps_box::checkpoint::digest(status.bundle, config_path, container_config),
+            checkpoint_options);
+
+    LINYAPS_BOX_DEBUG() << "Container " << options.ID << " checkpointed to "
+                        << options.image_path;
+    return 0;
+}
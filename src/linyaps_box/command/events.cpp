@@ -0,0 +1,30 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/command/events.h"
+
+#include "linyaps_box/events.h"
+#include "linyaps_box/impl/status_table.h"
+
+#include <iostream>
+
+int linyaps_box::command::events(const std::filesystem::path &root,
+                                 const struct events_options &options)
+{
+    auto dir = impl::open_status_directory(root);
+
+    linyaps_box::events::monitor monitor(*dir);
+
+    // NOTE: Each line is flushed, as the reader waits for it.
+    while (std::cout) {
+        for (const auto &event : monitor.wait()) {
+            if (!options.ID.empty() && event.ID != options.ID) {
+                continue;
+            }
+            std::cout << linyaps_box::events::to_string(event) << std::endl;
+        }
+    }
+
+    return 0;
+}
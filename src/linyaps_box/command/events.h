@@ -0,0 +1,15 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/command/options.h"
+
+#include <filesystem>
+
+namespace linyaps_box::command {
+
+[[nodiscard]] int events(const std::filesystem::path &root, const events_options &options);
+
+} // namespace linyaps_box::command
@@ -4,14 +4,50 @@
 
 #include "linyaps_box/command/exec.h"
 
-#include "linyaps_box/impl/status_directory.h"
+#include "linyaps_box/impl/status_table.h"
 #include "linyaps_box/runtime.h"
 #include "linyaps_box/status_directory.h"
 
+extern char **environ;
+
+namespace {
+
+void parse_env(const std::string &env, std::map<std::string, std::string> &result)
+{
+    auto pos = env.find('=');
+    if (pos == std::string::npos) {
+        throw std::runtime_error("invalid env entry: " + env);
+    }
+    result[env.substr(0, pos)] = env.substr(pos + 1);
+}
+
+// Parse `UID[:GID]`, the GID defaults to the UID.
+void parse_user(const std::string &user, linyaps_box::config::process_t &process)
+{
+    auto pos = user.find(':');
+    std::size_t end = 0;
+    process.uid = std::stoul(user.substr(0, pos), &end);
+    if (end != user.substr(0, pos).size()) {
+        throw std::runtime_error("invalid user: " + user);
+    }
+
+    process.gid = process.uid;
+    if (pos == std::string::npos) {
+        return;
+    }
+
+    auto gid = user.substr(pos + 1);
+    process.gid = std::stoul(gid, &end);
+    if (end != gid.size()) {
+        throw std::runtime_error("invalid user: " + user);
+    }
+}
+
+} // namespace
+
 void linyaps_box::command::exec(const std::filesystem::path &root, const struct exec_options &opts)
 {
-    std::unique_ptr<status_directory> dir;
-    dir = std::make_unique<impl::status_directory>(root);
+    auto dir = impl::open_status_directory(root);
 
     runtime_t runtime(std::move(dir));
 
@@ -24,7 +60,25 @@ void linyaps_box::command::exec(const std::filesystem::path &root, const struct
     config::process_t proc;
     proc.cwd = opts.cwd;
     proc.args = opts.command;
-    // TODO
+
+    for (auto env = environ; *env != nullptr; ++env) {
+        parse_env(*env, proc.env);
+    }
+    for (const auto &env : opts.env) {
+        parse_env(env, proc.env);
+    }
+
+    // NOTE: The process runs as the container process unless another user is asked for.
+    auto policy = container->second.exec_policy();
+    proc.uid = policy.uid;
+    proc.gid = policy.gid;
+    if (!policy.additional_gids.empty()) {
+        proc.additional_gids = policy.additional_gids;
+    }
+    proc.no_new_privileges = policy.no_new_privileges;
+    if (!opts.user.empty()) {
+        parse_user(opts.user, proc);
+    }
 
     container->second.exec(proc);
 }
@@ -0,0 +1,34 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/command/features.h"
+
+#include "linyaps_box/features.h"
+#include "linyaps_box/impl/status_directory.h"
+
+#include <iomanip>
+#include <iostream>
+
+int linyaps_box::command::features(const std::filesystem::path &root,
+                                   const struct features_options &options)
+{
+    impl::status_directory dir(root);
+
+    linyaps_box::features::set_t set;
+    if (options.probe) {
+        set = linyaps_box::features::probe();
+    } else {
+        set = linyaps_box::features::load(dir.features_cache());
+    }
+
+    std::cout << std::left << std::setw(20) << "bootID" << set.boot_id << "\n"
+              << std::setw(20) << "kernelRelease" << set.kernel_release << "\n"
+              << std::setw(20) << "uid" << set.uid << "\n";
+    for (const auto &[feature, name] : linyaps_box::features::names()) {
+        std::cout << std::setw(20) << name << (set.has(feature) ? "yes" : "no") << "\n";
+    }
+    std::cout.flush();
+
+    return 0;
+}
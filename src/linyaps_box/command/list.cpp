@@ -5,19 +5,47 @@
 #include "linyaps_box/command/list.h"
 
 #include "linyaps_box/impl/json_printer.h"
-#include "linyaps_box/impl/status_directory.h"
+#include "linyaps_box/impl/status_table.h"
 #include "linyaps_box/impl/table_printer.h"
 #include "linyaps_box/runtime.h"
 
+#include <algorithm>
+#include <stdexcept>
+
 int linyaps_box::command::list(const std::filesystem::path &root,
                                const struct list_options &options)
 {
-    std::unique_ptr<status_directory> dir;
-    dir = std::make_unique<impl::status_directory>(root);
+    auto dir = impl::open_status_directory(root);
 
     runtime_t runtime(std::move(dir));
 
-    auto containers = runtime.containers();
+    std::vector<std::pair<std::string, std::string>> filters;
+    for (const auto &filter : options.filters) {
+        auto pos = filter.find('=');
+        if (pos == std::string::npos) {
+            throw std::runtime_error("invalid filter " + filter + ", KEY=VALUE is expected");
+        }
+        filters.emplace_back(filter.substr(0, pos), filter.substr(pos + 1));
+    }
+
+    // NOTE: States left by runtimes which were killed are listed once, then removed.
+    // Containers are looked up by the first filter, and checked by the others.
+    auto statuses = filters.empty()
+            ? runtime.snapshot(true)
+            : runtime.find(filters.front().first, filters.front().second, true);
+    statuses.erase(std::remove_if(statuses.begin(),
+                                  statuses.end(),
+                                  [&filters](const container_status_t &status) {
+                                      return std::any_of(
+                                              filters.begin(),
+                                              filters.end(),
+                                              [&status](const auto &filter) {
+                                                  auto it = status.annotations.find(filter.first);
+                                                  return it == status.annotations.end()
+                                                          || it->second != filter.second;
+                                              });
+                                  }),
+                   statuses.end());
 
     std::unique_ptr<printer> printer;
     if (options.output_format == list_options::output_format_t::json) {
@@ -26,11 +54,6 @@ int linyaps_box::command::list(const std::filesystem::path &root,
         printer = std::make_unique<impl::table_printer>();
     }
 
-    std::vector<container_status_t> statuses;
-    for (const auto &container : containers) {
-        statuses.push_back(container.second.status());
-    }
-
     printer->print_statuses(statuses);
     return 0;
 }
@@ -7,6 +7,7 @@
 #include "CLI/CLI.hpp"
 
 #include <csignal>
+#include <limits>
 
 #include <unistd.h>
 
@@ -30,6 +31,12 @@ linyaps_box::command::options linyaps_box::command::parse(int argc, char *argv[]
     app->add_option("--root", options.root, "Root directory for storage of container state")
             ->default_val(default_root);
 
+    app->add_flag("--status-table",
+                  options.status_table,
+                  "Store states of containers in a memory-mapped table under the root "
+                  "instead of a JSON file per container, "
+                  "later commands on the root use the table without this option");
+
     app->require_subcommand();
 
     auto cmd_list = app->add_subcommand("list", "List know containers");
@@ -44,6 +51,12 @@ linyaps_box::command::options linyaps_box::command::parse(int argc, char *argv[]
                             { "json", list_options::output_format_t::json },
                     }));
 
+    cmd_list->add_option("--filter",
+                         options.list.filters,
+                         "Only list containers with the annotation, "
+                         "looked up by the index of annotations, it can be repeated")
+            ->type_name("KEY=VALUE");
+
     auto cmd_run = app->add_subcommand("run", "Create and immediately start a container");
 
     cmd_run->add_option("CONTAINER", options.run.ID, "The container ID")->required();
@@ -51,8 +64,99 @@ linyaps_box::command::options linyaps_box::command::parse(int argc, char *argv[]
     cmd_run->add_option("-b,--bundle", options.run.bundle, "Path to the OCI bundle")
             ->default_val(".");
 
-    cmd_run->add_option("-f,--config", options.run.config, "Override the configuration file to use")
-            ->default_val("config.json");
+    auto *run_config = cmd_run->add_option("-f,--config",
+                                           options.run.config,
+                                           "Override the configuration file to use, "
+                                           "`-` reads it from stdin")
+                               ->default_val("config.json");
+
+    cmd_run->add_option("--config-fd",
+                        options.run.config_fd,
+                        "Read the configuration from the inherited file descriptor FD, "
+                        "which is closed after, a sealed memfd is mapped without a copy. "
+                        "Use `--config -` for stdin")
+            ->type_name("FD")
+            ->check(CLI::Range(3, std::numeric_limits<int>::max()))
+            ->excludes(run_config);
+
+    cmd_run->add_flag("--init",
+                      options.run.init,
+                      "Run an init inside the container that forwards signals and reaps processes");
+
+    cmd_run->add_flag("--control-socket",
+                      options.run.control_socket,
+                      "Serve a control socket by init inside the container, "
+                      "which `exec` uses to spawn processes without joining namespaces");
+
+    cmd_run->add_option("--rootfs-fd",
+                        options.run.rootfs_fd,
+                        "Use the inherited file descriptor FD as the root filesystem "
+                        "instead of `root.path` of the configuration")
+            ->type_name("FD")
+            ->check(CLI::NonNegativeNumber);
+
+    cmd_run->add_flag("--socket-activation",
+                      options.run.socket_activation,
+                      "Wait on sockets passed by LISTEN_FDS, "
+                      "start the container on the first connection and pass the sockets to it");
+
+    cmd_run->add_option("--idle-timeout",
+                        options.run.idle_timeout,
+                        "With --socket-activation, stop the container after no new or open "
+                        "connection for SECONDS and wait for the next one, 0 means never")
+            ->type_name("SECONDS")
+            ->default_val(0);
+
+    cmd_run->add_option("--stop-timeout",
+                        options.run.stop_timeout,
+                        "With --idle-timeout, kill the container if it does not exit "
+                        "in SECONDS after SIGTERM")
+            ->type_name("SECONDS")
+            ->default_val(10);
+
+    cmd_run->add_option("--start-timeout",
+                        options.run.start_timeout,
+                        "Kill the container if it is not started in SECONDS, "
+                        "including its hooks, 0 means never")
+            ->type_name("SECONDS")
+            ->default_val(0);
+
+    cmd_run->add_option("--max-launches",
+                        options.run.max_launches,
+                        "Wait until less than N containers are being launched "
+                        "with this option under the root, 0 means no limit")
+            ->type_name("N")
+            ->default_val(0);
+
+    cmd_run->add_option("--priority",
+                        options.run.priority,
+                        "With --max-launches, waiting launches with larger priority go first")
+            ->type_name("N")
+            ->default_val(0)
+            ->check(CLI::Range(-999, 999));
+
+    cmd_run->add_option("--pressure-threshold",
+                        options.run.pressure_threshold,
+                        "With --max-launches, launch one container at a time while "
+                        "the CPU, IO or memory pressure (avg10 of /proc/pressure) reaches PCT")
+            ->type_name("PCT")
+            ->default_val(40)
+            ->check(CLI::Range(0.0, 100.0));
+
+    auto cmd_run_many = app->add_subcommand(
+            "run-many", "Create and immediately start containers listed in a manifest");
+
+    cmd_run_many
+            ->add_option("MANIFEST",
+                         options.run_many.manifest,
+                         "Path to a JSON array of objects with `id`, `bundle`, "
+                         "and optional `config` and `init`")
+            ->required();
+
+    cmd_run_many->add_option("-j,--jobs",
+                             options.run_many.jobs,
+                             "Number of containers launched in parallel, "
+                             "defaults to the number of CPUs");
 
     auto cmd_exec = app->add_subcommand("exec", "Exec a command in a running container");
 
@@ -62,7 +166,13 @@ linyaps_box::command::options linyaps_box::command::parse(int argc, char *argv[]
                          "for example `1000` for UID=1000 "
                          "or `1000:1000` for UID=1000 and GID=1000")
             ->type_name("UID[:GID]");
-    cmd_exec->add_option("--cwd", options.exec.cwd, "Current working directory.");
+    cmd_exec->add_option("--cwd", options.exec.cwd, "Current working directory.")
+            ->default_val("/");
+    cmd_exec->add_option("-e,--env",
+                         options.exec.env,
+                         "Set an environment variable, "
+                         "the environment of ll-box is passed by default")
+            ->type_name("KEY=VALUE");
     cmd_exec->add_option("CONTAINER", options.exec.ID, "Container ID")->required();
     cmd_exec->add_option("COMMAND", options.exec.command, "Command to execute")->required();
 
@@ -80,6 +190,75 @@ linyaps_box::command::options linyaps_box::command::parse(int argc, char *argv[]
 
     cmd_kill->add_option("CONTAINER", options.kill.container, "The container ID")->required();
 
+    auto cmd_features = app->add_subcommand(
+            "features", "Show the kernel features the runtime chooses its strategy by");
+
+    cmd_features->add_flag("--probe",
+                           options.features.probe,
+                           "Probe the kernel again instead of reading the cache");
+
+    auto cmd_checkpoint = app->add_subcommand(
+            "checkpoint", "Checkpoint a running container to an image directory by criu");
+
+    cmd_checkpoint->add_option("CONTAINER", options.checkpoint.ID, "The container ID")->required();
+
+    cmd_checkpoint
+            ->add_option("--image-path",
+                         options.checkpoint.image_path,
+                         "Path of the image directory")
+            ->required();
+
+    cmd_checkpoint->add_option("-f,--config",
+                               options.checkpoint.config,
+                               "The configuration file the container was created with, "
+                               "defaults to config.json of its bundle");
+
+    cmd_checkpoint->add_flag("--leave-running",
+                             options.checkpoint.leave_running,
+                             "Leave the container running after checkpoint");
+
+    cmd_checkpoint->add_flag("--tcp-established",
+                             options.checkpoint.tcp_established,
+                             "Allow established TCP connections");
+
+    cmd_checkpoint->add_flag("--file-locks", options.checkpoint.file_locks, "Allow file locks");
+
+    auto cmd_restore = app->add_subcommand(
+            "restore",
+            "Restore a container from an image directory by criu, "
+            "or create and start it if the images are missing or stale");
+
+    cmd_restore->add_option("CONTAINER", options.restore.ID, "The container ID")->required();
+
+    cmd_restore->add_option("-b,--bundle", options.restore.bundle, "Path to the OCI bundle")
+            ->default_val(".");
+
+    cmd_restore->add_option("-f,--config",
+                            options.restore.config,
+                            "Override the configuration file to use, "
+                            "defaults to config.json of the bundle");
+
+    cmd_restore
+            ->add_option("--image-path", options.restore.image_path, "Path of the image directory")
+            ->required();
+
+    cmd_restore->add_flag("--lazy-pages",
+                          options.restore.lazy_pages,
+                          "Restore memory pages on demand, "
+                          "so the container resumes before all pages are read");
+
+    cmd_restore->add_flag("--tcp-established",
+                          options.restore.tcp_established,
+                          "Allow established TCP connections");
+
+    cmd_restore->add_flag("--file-locks", options.restore.file_locks, "Allow file locks");
+
+    auto cmd_events = app->add_subcommand(
+            "events",
+            "Stream lifecycle events of containers as JSON lines until interrupted");
+
+    cmd_events->add_option("CONTAINER", options.events.ID, "Only events of the container");
+
     // argv = app->ensure_utf8(argv);
 
     try {
@@ -92,10 +271,20 @@ linyaps_box::command::options linyaps_box::command::parse(int argc, char *argv[]
         options.command = options::command_t::list;
     } else if (cmd_run->parsed()) {
         options.command = options::command_t::run;
+    } else if (cmd_run_many->parsed()) {
+        options.command = options::command_t::run_many;
     } else if (cmd_exec->parsed()) {
         options.command = options::command_t::exec;
     } else if (cmd_kill->parsed()) {
         options.command = options::command_t::kill;
+    } else if (cmd_features->parsed()) {
+        options.command = options::command_t::features;
+    } else if (cmd_checkpoint->parsed()) {
+        options.command = options::command_t::checkpoint;
+    } else if (cmd_restore->parsed()) {
+        options.command = options::command_t::restore;
+    } else if (cmd_events->parsed()) {
+        options.command = options::command_t::events;
     }
 
     return options;
@@ -16,12 +16,16 @@ struct list_options
         table,
         json,
     } output_format = output_format_t::table;
+
+    // Only containers having all the annotations, in the form of KEY=VALUE.
+    std::vector<std::string> filters;
 };
 
 struct exec_options
 {
     std::string user;
     std::string cwd;
+    std::vector<std::string> env;
     std::string ID;
     std::vector<std::string> command;
 };
@@ -31,6 +35,55 @@ struct run_options
     std::string ID;
     std::string bundle;
     std::string config;
+    int config_fd = -1;
+    bool init = false;
+    bool control_socket = false;
+    int rootfs_fd = -1;
+    bool socket_activation = false;
+    unsigned int idle_timeout = 0;
+    unsigned int stop_timeout = 10;
+    unsigned int start_timeout = 0;
+    unsigned int max_launches = 0;
+    int priority = 0;
+    double pressure_threshold = 40;
+};
+
+struct run_many_options
+{
+    std::string manifest;
+    unsigned int jobs = 0;
+};
+
+struct features_options
+{
+    bool probe = false;
+};
+
+struct checkpoint_options
+{
+    std::string ID;
+    std::string config;
+    std::string image_path;
+    bool leave_running = false;
+    bool tcp_established = false;
+    bool file_locks = false;
+};
+
+struct restore_options
+{
+    std::string ID;
+    std::string bundle;
+    std::string config;
+    std::string image_path;
+    bool lazy_pages = false;
+    bool tcp_established = false;
+    bool file_locks = false;
+};
+
+struct events_options
+{
+    // Only events of the container if it is not empty.
+    std::string ID;
 };
 
 struct kill_options
@@ -46,16 +99,27 @@ struct options
         list,
         exec,
         run,
+        run_many,
         kill,
+        features,
+        checkpoint,
+        restore,
+        events,
     } command;
 
     std::filesystem::path root;
+    bool status_table = false;
     std::optional<int> return_code;
 
     list_options list;
     exec_options exec;
     run_options run;
+    run_many_options run_many;
     kill_options kill;
+    features_options features;
+    checkpoint_options checkpoint;
+    restore_options restore;
+    events_options events;
 };
 
 // This function parses the command line arguments.
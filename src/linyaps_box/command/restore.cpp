@@ -0,0 +1,127 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/command/restore.h"
+
+#include "linyaps_box/checkpoint.h"
+#include "linyaps_box/command/run.h"
+#include "linyaps_box/events.h"
+#include "linyaps_box/exec_policy.h"
+#include "linyaps_box/impl/status_table.h"
+#include "linyaps_box/utils/log.h"
+#include "linyaps_box/utils/start_time.h"
+
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+int linyaps_box::command::restore(const std::filesystem::path &root,
+                                  const struct restore_options &options)
+{
+    auto config_path = linyaps_box::checkpoint::config_path(options.bundle, options.config);
+    auto container_config = config::parse_file(config_path);
+
+    auto digest = linyaps_box::checkpoint::digest(options.bundle, config_path, container_config);
+    if (!linyaps_box::checkpoint::valid(options.image_path, digest)) {
+        // NOTE: Stale images are left as they are, the next checkpoint dumps over them.
+        LINYAPS_BOX_DEBUG() << "Images " << options.image_path
+                            << " are missing or stale, create the container";
+
+        run_options run_options;
+        run_options.ID = options.ID;
+        run_options.bundle = options.bundle;
+        run_options.config = config_path;
+        return run(root, run_options);
+    }
+
+    auto dir = impl::open_status_directory(root);
+    check_new_id(*dir, options.ID);
+
+    auto publish = [&dir, &options](events::event_t event) {
+        event.ID = options.ID;
+        events::publish(dir->events_journal(), event);
+    };
+
+    container_status_t status;
+    auto remove = [&dir, &options, &publish, &status]() {
+        dir->remove(options.ID);
+        publish(events::state_changed(status, std::nullopt));
+    };
+
+    status.ID = options.ID;
+    status.PID = getpid();
+    status.start_time = utils::process_start_time(status.PID).value_or(0);
+    status.status = container_status_t::runtime_status::CREATING;
+    status.bundle = std::filesystem::canonical(options.bundle);
+    status.created = ""; // FIXME
+    status.owner = getuid();
+    status.annotations = container_config.annotations;
+    status.runtime_pid = status.PID;
+    status.runtime_start_time = status.start_time;
+    dir->write(status);
+    publish(events::state_changed(std::nullopt, status));
+
+    // NOTE: CRIU restores the seccomp filter of the processes,
+    // but processes executed in the restored container need the policy as well.
+    try {
+        exec_policy::write(dir->exec_policy(options.ID),
+                           exec_policy::from_config(container_config, dir->seccomp_cache()));
+    } catch (...) {
+        remove();
+        throw;
+    }
+
+    linyaps_box::checkpoint::options_t checkpoint_options;
+    checkpoint_options.lazy_pages = options.lazy_pages;
+    checkpoint_options.tcp_established = options.tcp_established;
+    checkpoint_options.file_locks = options.file_locks;
+
+    auto previous = status;
+    linyaps_box::checkpoint::restored_t restored;
+    try {
+        restored = linyaps_box::checkpoint::restore(options.bundle,
+                                                    container_config,
+                                                    options.image_path,
+                                                    checkpoint_options);
+        status.PID = restored.pid;
+        status.start_time = utils::process_start_time(status.PID).value_or(0);
+    } catch (...) {
+        remove();
+        throw;
+    }
+
+    status.status = container_status_t::runtime_status::RUNNING;
+    dir->write(status);
+    publish(events::state_changed(previous, status));
+
+    int wstatus = 0;
+    while (::waitpid(status.PID, &wstatus, 0) < 0) {
+        if (errno != EINTR) {
+            linyaps_box::checkpoint::release(restored);
+            remove();
+            throw std::system_error(errno, std::generic_category(), "waitpid");
+        }
+    }
+    linyaps_box::checkpoint::release(restored);
+
+    auto exit_code = WIFSIGNALED(wstatus) ? 128 + WTERMSIG(wstatus) : WEXITSTATUS(wstatus);
+
+    events::event_t exit;
+    exit.type = "exit";
+    exit.fields["exitCode"] = exit_code;
+    if (WIFSIGNALED(wstatus)) {
+        exit.fields["signal"] = WTERMSIG(wstatus);
+    }
+    publish(std::move(exit));
+
+    // NOTE: The state is stopped before it is removed, as containers created by ll-box are.
+    previous = status;
+    status.status = container_status_t::runtime_status::STOPPED;
+    dir->write(status);
+    publish(events::state_changed(previous, status));
+
+    remove();
+
+    return exit_code;
+}
@@ -4,14 +4,413 @@
 
 #include "linyaps_box/command/run.h"
 
-#include "linyaps_box/impl/status_directory.h"
+#include "linyaps_box/admission.h"
+#include "linyaps_box/config_cache.h"
+#include "linyaps_box/impl/status_table.h"
 #include "linyaps_box/runtime.h"
 #include "linyaps_box/status_directory.h"
+#include "linyaps_box/utils/epoll.h"
+#include "linyaps_box/utils/log.h"
+#include "linyaps_box/utils/signalfd.h"
+
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// The whole of `str` as a number in `base`, std::nullopt if it is malformed or out of range.
+template<typename T>
+[[nodiscard]] std::optional<T> parse_number(std::string_view str, int base = 10)
+{
+    T value{};
+    const auto *end = str.data() + str.size();
+    auto [ptr, ec] = std::from_chars(str.data(), end, value, base);
+    if (ec != std::errc() || ptr != end) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+struct listen_fds_t
+{
+    std::vector<linyaps_box::utils::file_descriptor> fds;
+    std::optional<std::string> names;
+};
+
+// Take the sockets passed by socket activation, see sd_listen_fds(3).
+listen_fds_t take_listen_fds()
+{
+    const char *pid = getenv("LISTEN_PID");
+    const char *fds = getenv("LISTEN_FDS");
+    if (pid == nullptr || fds == nullptr) {
+        throw std::runtime_error("socket activation requires LISTEN_PID and LISTEN_FDS");
+    }
+
+    if (parse_number<pid_t>(pid) != getpid()) {
+        throw std::runtime_error("LISTEN_PID does not match the runtime");
+    }
+
+    auto count = parse_number<unsigned int>(fds);
+    if (!count) {
+        throw std::runtime_error(std::string("invalid LISTEN_FDS: ") + fds);
+    }
+    if (*count == 0) {
+        throw std::runtime_error("no socket passed by LISTEN_FDS");
+    }
+
+    listen_fds_t result;
+    if (const char *names = getenv("LISTEN_FDNAMES")) {
+        result.names = names;
+    }
+
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+
+    // NOTE: The sockets are passed to the container process only,
+    // hooks should not inherit them.
+    for (unsigned int fd = 3; fd < 3 + *count; ++fd) {
+        auto flags = fcntl(fd, F_GETFD);
+        if (flags < 0 || fcntl(fd, F_SETFD, flags | FD_CLOEXEC) < 0) {
+            throw std::system_error(errno, std::generic_category(), "fcntl");
+        }
+        result.fds.emplace_back(fd);
+    }
+
+    return result;
+}
+
+// Connections accepted by the container from `listen_fd`, which are listed in /proc
+// of `pid` as connected sockets with the address of the listening socket.
+// Returns std::nullopt if they can not be counted.
+std::optional<std::size_t> count_connections(const linyaps_box::utils::file_descriptor &listen_fd,
+                                             pid_t pid)
+{
+    sockaddr_storage address{};
+    socklen_t length = sizeof(address);
+    if (::getsockname(listen_fd.get(), reinterpret_cast<sockaddr *>(&address), &length)) {
+        return std::nullopt;
+    }
+
+    auto net = std::filesystem::path("/proc") / std::to_string(pid) / "net";
+    std::size_t count = 0;
+
+    if (address.ss_family == AF_UNIX) {
+        const auto &unix_address = reinterpret_cast<const sockaddr_un &>(address);
+        auto path_length = length - offsetof(sockaddr_un, sun_path);
+        if (path_length == 0) {
+            return std::nullopt;
+        }
+
+        // NOTE: Abstract addresses are listed with a leading `@`.
+        std::string path(unix_address.sun_path, path_length);
+        if (path[0] == '\0') {
+            path[0] = '@';
+        } else {
+            path.resize(std::strlen(path.c_str()));
+        }
+
+        std::ifstream ifs(net / "unix");
+        std::string line;
+        std::getline(ifs, line);
+        while (std::getline(ifs, line)) {
+            // Num RefCount Protocol Flags Type St Inode Path
+            std::istringstream fields(line);
+            std::string num, ref_count, protocol, flags, type, state, inode, name;
+            if (!(fields >> num >> ref_count >> protocol >> flags >> type >> state >> inode
+                  >> name)) {
+                continue;
+            }
+            // NOTE: 03 is SS_CONNECTED, the listening socket is SS_UNCONNECTED.
+            if (name == path && state == "03") {
+                ++count;
+            }
+        }
+
+        return ifs.eof() ? std::optional<std::size_t>(count) : std::nullopt;
+    }
+
+    std::uint16_t port = 0;
+    const char *table = nullptr;
+    if (address.ss_family == AF_INET) {
+        port = ntohs(reinterpret_cast<const sockaddr_in &>(address).sin_port);
+        table = "tcp";
+    } else if (address.ss_family == AF_INET6) {
+        port = ntohs(reinterpret_cast<const sockaddr_in6 &>(address).sin6_port);
+        table = "tcp6";
+    } else {
+        return std::nullopt;
+    }
+
+    std::ifstream ifs(net / table);
+    std::string line;
+    std::getline(ifs, line);
+    while (std::getline(ifs, line)) {
+        // sl local_address rem_address st ...
+        std::istringstream fields(line);
+        std::string sl, local, remote, state;
+        if (!(fields >> sl >> local >> remote >> state)) {
+            continue;
+        }
+        // NOTE: Lines with a malformed local address are skipped.
+        auto colon = local.rfind(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        // NOTE: 01 is TCP_ESTABLISHED.
+        auto local_port = std::string_view(local).substr(colon + 1);
+        if (parse_number<std::uint16_t>(local_port, 16) == port && state == "01") {
+            ++count;
+        }
+    }
+
+    return ifs.eof() ? std::optional<std::size_t>(count) : std::nullopt;
+}
+
+// Whether any connection accepted by the container is still open,
+// a container busy on long connections is not idle even if no new connection arrives.
+bool has_connections(const listen_fds_t &listen_fds, pid_t pid)
+{
+    for (const auto &fd : listen_fds.fds) {
+        auto count = count_connections(fd, pid);
+        if (!count) {
+            LINYAPS_BOX_WARNING() << "Failed to count connections of fd " << fd.get()
+                                  << ", assume it is active";
+            return true;
+        }
+        if (*count != 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Start the container on the first connection and wait for it,
+// it is stopped by SIGTERM after `idle_timeout` without a new or open connection,
+// and killed if it does not exit in `stop_timeout`.
+// The configuration is `config` if any, otherwise it is loaded from `options.config` every time.
+// Returns the exit code of the container if it should not be started again.
+std::optional<int> serve(linyaps_box::runtime_t &runtime,
+                         const linyaps_box::runtime_t::create_container_options_t &options,
+                         const std::optional<linyaps_box::config> &config,
+                         const listen_fds_t &listen_fds,
+                         std::chrono::seconds idle_timeout,
+                         std::chrono::seconds stop_timeout,
+                         linyaps_box::utils::epoll &epoll,
+                         const linyaps_box::utils::file_descriptor &signal_fd)
+{
+    LINYAPS_BOX_DEBUG() << "Wait for connections";
+
+    for (const auto &event : epoll.wait()) {
+        if (event.data.fd == signal_fd.get()) {
+            while (auto info = linyaps_box::utils::read_signal(signal_fd)) {
+                LINYAPS_BOX_DEBUG() << "Signal " << info->ssi_signo << " received, stop waiting";
+            }
+            return 0;
+        }
+    }
+
+    LINYAPS_BOX_DEBUG() << "Connection received, start container " << options.ID;
+
+    auto container =
+            config ? runtime.create_container(options, *config) : runtime.create_container(options);
+    auto process = container.get_config().process;
+    process.env["LISTEN_FDS"] = std::to_string(listen_fds.fds.size());
+    if (listen_fds.names) {
+        process.env["LISTEN_FDNAMES"] = *listen_fds.names;
+    }
+
+    auto running = container.start(process);
+
+    if (running.pidfd().get() == -1) {
+        LINYAPS_BOX_WARNING() << "Idle timeout requires pidfd support";
+        auto exit_code = running.wait();
+        return exit_code ? std::optional<int>(exit_code) : std::nullopt;
+    }
+
+    // NOTE: Connections are accepted by the container,
+    // edge triggered events notify new connections arriving at the sockets.
+    epoll.add(running.pidfd(), EPOLLIN);
+    for (const auto &fd : listen_fds.fds) {
+        epoll.modify(fd, EPOLLIN | EPOLLET);
+    }
+
+    auto last_activity = std::chrono::steady_clock::now();
+    std::optional<std::chrono::steady_clock::time_point> idle;
+    bool signaled = false;
+    std::optional<int> exit_code;
+
+    while (!exit_code) {
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+        if (idle) {
+            deadline = *idle + stop_timeout;
+        } else if (idle_timeout.count() != 0 && !signaled) {
+            deadline = last_activity + idle_timeout;
+        }
+
+        auto events = epoll.wait(deadline);
+        if (events.empty()) {
+            if (idle) {
+                LINYAPS_BOX_WARNING() << "Container " << options.ID << " did not stop, kill it";
+                running.kill(SIGKILL);
+                continue;
+            }
+
+            if (has_connections(listen_fds, running.pid())) {
+                last_activity = std::chrono::steady_clock::now();
+                continue;
+            }
+
+            LINYAPS_BOX_DEBUG() << "Container " << options.ID << " is idle, stop it";
+            idle = std::chrono::steady_clock::now();
+            running.kill(SIGTERM);
+            continue;
+        }
+
+        for (const auto &event : events) {
+            if (event.data.fd == running.pidfd().get()) {
+                epoll.remove(running.pidfd());
+                exit_code = running.wait();
+                break;
+            }
+
+            if (event.data.fd == signal_fd.get()) {
+                while (auto info = linyaps_box::utils::read_signal(signal_fd)) {
+                    LINYAPS_BOX_DEBUG() << "Forward signal " << info->ssi_signo;
+                    signaled = true;
+                    running.kill(info->ssi_signo);
+                }
+                continue;
+            }
+
+            last_activity = std::chrono::steady_clock::now();
+        }
+    }
+
+    for (const auto &fd : listen_fds.fds) {
+        epoll.modify(fd, EPOLLIN);
+    }
+
+    if (signaled || (!idle && *exit_code != 0)) {
+        return exit_code;
+    }
+
+    LINYAPS_BOX_DEBUG() << "Container " << options.ID << " exited with " << *exit_code;
+    return std::nullopt;
+}
+
+// Launches of a single instance application are serialized by a lock in the status directory,
+// so a launch finds the instance started by another one instead of starting its own.
+linyaps_box::utils::file_descriptor lock_single_instance(const std::filesystem::path &root,
+                                                         const std::string &key)
+{
+    std::string name;
+    for (auto c : key) {
+        if (std::isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '-' || c == '_') {
+            name += c;
+            continue;
+        }
+        char escaped[4];
+        std::snprintf(escaped, sizeof(escaped), "%%%02X", static_cast<unsigned char>(c));
+        name += escaped;
+    }
+
+    auto dir = root / "single-instance";
+    std::filesystem::create_directories(dir);
+
+    auto path = dir / (name + ".lock");
+    linyaps_box::utils::file_descriptor lock(
+            ::open(path.c_str(), O_RDONLY | O_CREAT | O_CLOEXEC, 0600));
+    if (lock.get() < 0) {
+        throw std::system_error(errno, std::generic_category(), "open " + path.string());
+    }
+
+    while (::flock(lock.get(), LOCK_EX)) {
+        if (errno != EINTR) {
+            throw std::system_error(errno, std::generic_category(), "flock");
+        }
+    }
+
+    return lock;
+}
+
+int run_socket_activated(linyaps_box::runtime_t &runtime,
+                         linyaps_box::runtime_t::create_container_options_t options,
+                         const std::optional<linyaps_box::config> &config,
+                         std::chrono::seconds idle_timeout,
+                         std::chrono::seconds stop_timeout)
+{
+    auto listen_fds = take_listen_fds();
+
+    options.preserve_fds = listen_fds.fds.size();
+    if (options.rootfs_fd >= 3
+        && static_cast<std::size_t>(options.rootfs_fd) < 3 + options.preserve_fds) {
+        throw std::invalid_argument("--rootfs-fd " + std::to_string(options.rootfs_fd)
+                                    + " is one of the sockets passed by LISTEN_FDS");
+    }
+    options.forward_signals = false;
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    for (auto signal : { SIGTERM, SIGINT, SIGHUP, SIGQUIT }) {
+        sigaddset(&signals, signal);
+    }
+
+    sigset_t old_signals;
+    auto ret = pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+    if (ret) {
+        throw std::system_error(ret, std::generic_category(), "pthread_sigmask");
+    }
+
+    auto signal_fd = linyaps_box::utils::signalfd(signals);
+
+    linyaps_box::utils::epoll epoll;
+    epoll.add(signal_fd, EPOLLIN);
+    for (const auto &fd : listen_fds.fds) {
+        epoll.add(fd, EPOLLIN);
+    }
+
+    std::optional<int> exit_code;
+    while (!exit_code) {
+        exit_code = serve(runtime,
+                          options,
+                          config,
+                          listen_fds,
+                          idle_timeout,
+                          stop_timeout,
+                          epoll,
+                          signal_fd);
+    }
+
+    ret = pthread_sigmask(SIG_SETMASK, &old_signals, nullptr);
+    if (ret) {
+        throw std::system_error(ret, std::generic_category(), "pthread_sigmask");
+    }
+
+    return *exit_code;
+}
+
+} // namespace
 
 int linyaps_box::command::run(const std::filesystem::path &root, const struct run_options &options)
 {
-    std::unique_ptr<status_directory> dir;
-    dir = std::make_unique<impl::status_directory>(root);
+    auto dir = impl::open_status_directory(root);
+    auto cache = dir->config_cache();
 
     runtime_t runtime(std::move(dir));
 
@@ -19,7 +418,64 @@ int linyaps_box::command::run(const std::filesystem::path &root, const struct ru
     create_container_options.bundle = options.bundle;
     create_container_options.config = options.config;
     create_container_options.ID = options.ID;
+    create_container_options.init = options.init;
+    create_container_options.control_socket = options.control_socket;
+    create_container_options.rootfs_fd = options.rootfs_fd;
+    create_container_options.start_timeout = std::chrono::seconds(options.start_timeout);
+
+    // NOTE: A configuration from stdin or an inherited fd can be read only once,
+    // and the inherited fd is closed, as the container should not inherit it.
+    // Options reject stdio as the inherited fd, stdin is read by `--config -`.
+    std::optional<config> fd_config;
+    if (options.config_fd >= 0) {
+        fd_config = config_cache::load(cache, options.config_fd);
+        ::close(options.config_fd);
+    } else if (options.config == "-") {
+        fd_config = config_cache::load(cache, STDIN_FILENO);
+    }
+
+    if (options.socket_activation) {
+        return run_socket_activated(runtime,
+                                    create_container_options,
+                                    fd_config,
+                                    std::chrono::seconds(options.idle_timeout),
+                                    std::chrono::seconds(options.stop_timeout));
+    }
+
+    auto container_config =
+            fd_config ? std::move(*fd_config) : config_cache::load(cache, options.config);
+
+    utils::file_descriptor instance_lock;
+    if (auto it = container_config.annotations.find(single_instance_annotation);
+        it != container_config.annotations.end()) {
+        instance_lock = lock_single_instance(root, it->second);
+
+        if (auto instance = runtime.find_single_instance(it->second)) {
+            auto pid = instance->spawn(container_config.process);
+            LINYAPS_BOX_DEBUG() << "Delegate to container " << instance->id() << " as process "
+                                << pid;
+            return 0;
+        }
+    }
+
+    // NOTE: Only the launch, which mounts and runs hooks, is admitted,
+    // the slot is released once the container process is started.
+    std::optional<admission::slot> slot;
+    if (options.max_launches != 0) {
+        admission::options_t admission_options;
+        admission_options.max_launches = options.max_launches;
+        admission_options.priority = options.priority;
+        admission_options.pressure_threshold = options.pressure_threshold;
+
+        slot = admission::acquire(root / "admission", admission_options);
+    }
+
+    auto container = runtime.create_container(create_container_options, std::move(container_config));
+    auto running = container.start(container.get_config().process);
+    if (slot) {
+        slot->release();
+    }
+    instance_lock = utils::file_descriptor();
 
-    auto container = runtime.create_container(create_container_options);
-    return container.run(container.get_config().process);
+    return running.wait();
 }
@@ -0,0 +1,437 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/command/run_many.h"
+
+#include "linyaps_box/config_cache.h"
+#include "linyaps_box/impl/status_table.h"
+#include "linyaps_box/runtime.h"
+#include "linyaps_box/utils/epoll.h"
+#include "linyaps_box/utils/log.h"
+#include "linyaps_box/utils/signalfd.h"
+#include "nlohmann/json.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+
+namespace {
+
+using duration_t = std::chrono::duration<double, std::milli>;
+
+struct manifest_entry_t
+{
+    std::string ID;
+    std::filesystem::path bundle;
+    std::filesystem::path config;
+    bool init = false;
+};
+
+// The manifest is a JSON array of objects like
+// { "id": "app", "bundle": "/path/to/bundle", "config": "config.json", "init": false },
+// `config` is relative to `bundle` and defaults to config.json.
+std::vector<manifest_entry_t> read_manifest(const std::filesystem::path &path)
+{
+    std::ifstream ifs(path);
+    if (!ifs) {
+        throw std::runtime_error("failed to open manifest " + path.string());
+    }
+
+    auto j = nlohmann::json::parse(ifs);
+    if (!j.is_array()) {
+        throw std::runtime_error("manifest must be an array");
+    }
+
+    std::vector<manifest_entry_t> entries;
+    std::set<std::string> IDs;
+    for (const auto &item : j) {
+        manifest_entry_t entry;
+        entry.ID = item.at("id").get<std::string>();
+        entry.bundle = std::filesystem::absolute(item.at("bundle").get<std::string>());
+        entry.config = entry.bundle / item.value("config", std::string("config.json"));
+        entry.init = item.value("init", false);
+
+        if (!IDs.insert(entry.ID).second) {
+            throw std::runtime_error("duplicated container ID " + entry.ID);
+        }
+
+        entries.push_back(std::move(entry));
+    }
+
+    return entries;
+}
+
+// Configurations shared by all containers of a batch,
+// each configuration file is loaded once, see linyaps_box::config_cache.
+class config_loader
+{
+public:
+    explicit config_loader(std::filesystem::path cache)
+        : cache(std::move(cache))
+    {
+    }
+
+    std::shared_ptr<const linyaps_box::config> get(const std::filesystem::path &path)
+    {
+        auto key = std::filesystem::weakly_canonical(path);
+
+        std::promise<std::shared_ptr<const linyaps_box::config>> promise;
+        std::shared_future<std::shared_ptr<const linyaps_box::config>> future;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            auto it = this->configs.find(key);
+            if (it != this->configs.end()) {
+                future = it->second;
+            } else {
+                this->configs.emplace(key, promise.get_future().share());
+            }
+        }
+
+        if (future.valid()) {
+            return future.get();
+        }
+
+        try {
+            promise.set_value(std::make_shared<const linyaps_box::config>(
+                    linyaps_box::config_cache::load(this->cache, key)));
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->configs.at(key).get();
+    }
+
+private:
+    std::filesystem::path cache;
+    std::mutex mutex;
+    std::map<std::filesystem::path,
+             std::shared_future<std::shared_ptr<const linyaps_box::config>>>
+            configs;
+};
+
+struct result_t
+{
+    std::optional<std::chrono::steady_clock::time_point> started;
+    std::optional<duration_t> latency;
+    std::optional<int> exit_code;
+    std::string error;
+};
+
+struct launched_t
+{
+    std::size_t index;
+    std::unique_ptr<linyaps_box::container> container;
+    std::optional<linyaps_box::running_container> process;
+};
+
+[[nodiscard]] duration_t percentile(const std::vector<duration_t> &sorted, unsigned int p)
+{
+    assert(!sorted.empty());
+    auto rank = (sorted.size() * p + 99) / 100;
+    return sorted[std::max<std::size_t>(rank, 1) - 1];
+}
+
+void print_results(const std::vector<manifest_entry_t> &entries,
+                   const std::vector<result_t> &results,
+                   duration_t elapsed)
+{
+    std::vector<duration_t> latencies;
+
+    std::cout << std::left << std::setw(24) << "ID" << std::setw(16) << "LATENCY(ms)"
+              << "RESULT" << std::endl;
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        const auto &result = results[i];
+
+        std::stringstream latency;
+        if (result.latency) {
+            latencies.push_back(*result.latency);
+            latency << std::fixed << std::setprecision(1) << result.latency->count();
+        } else {
+            latency << "-";
+        }
+
+        std::cout << std::left << std::setw(24) << entries[i].ID << std::setw(16)
+                  << latency.str();
+        if (!result.error.empty()) {
+            std::cout << "error: " << result.error;
+        } else if (result.exit_code) {
+            std::cout << "exited with " << *result.exit_code;
+        }
+        std::cout << std::endl;
+    }
+
+    std::cout << std::fixed << std::setprecision(1) << "Launched " << latencies.size() << "/"
+              << entries.size() << " containers in " << elapsed.count() << "ms ("
+              << latencies.size() / (elapsed.count() / 1000) << " containers/s)";
+
+    if (!latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        std::cout << ", latency p50=" << percentile(latencies, 50).count()
+                  << "ms p90=" << percentile(latencies, 90).count()
+                  << "ms p99=" << percentile(latencies, 99).count()
+                  << "ms max=" << latencies.back().count() << "ms";
+    }
+
+    std::cout << std::endl;
+}
+
+} // namespace
+
+int linyaps_box::command::run_many(const std::filesystem::path &root,
+                                   const struct run_many_options &options)
+{
+    auto entries = read_manifest(options.manifest);
+    if (entries.empty()) {
+        return 0;
+    }
+
+    auto dir = impl::open_status_directory(root);
+    config_loader configs(dir->config_cache());
+
+    runtime_t runtime(std::move(dir));
+
+    std::vector<result_t> results(entries.size());
+
+    // NOTE: Signals are blocked before starting workers so that they inherit the mask,
+    // the main thread forwards them to all running containers.
+    sigset_t signals;
+    sigemptyset(&signals);
+    for (auto signal : { SIGTERM, SIGINT, SIGHUP, SIGQUIT }) {
+        sigaddset(&signals, signal);
+    }
+
+    sigset_t old_signals;
+    auto ret = pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+    if (ret) {
+        throw std::system_error(ret, std::generic_category(), "pthread_sigmask");
+    }
+
+    auto signal_fd = utils::signalfd(signals);
+    utils::file_descriptor event_fd(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    if (event_fd.get() < 0) {
+        throw std::system_error(errno, std::generic_category(), "eventfd");
+    }
+
+    auto notify = [&event_fd]() {
+        uint64_t value = 1;
+        if (::write(event_fd.get(), &value, sizeof(value)) < 0) {
+            LINYAPS_BOX_ERR() << "write eventfd: " << strerror(errno);
+        }
+    };
+
+    std::mutex mutex;
+    std::vector<launched_t> launched;
+    std::atomic<std::size_t> next{ 0 };
+    std::atomic<std::size_t> finished{ 0 };
+    std::atomic<bool> stopping{ false };
+
+    // Each worker parses and launches one container at a time,
+    // so the mounts of a container overlap the parsing and hooks of others.
+    auto worker = [&]() {
+        for (auto index = next++; index < entries.size(); index = next++) {
+            const auto &entry = entries[index];
+            auto &result = results[index];
+
+            if (stopping) {
+                result.error = "cancelled";
+                ++finished;
+                notify();
+                continue;
+            }
+
+            auto begin = std::chrono::steady_clock::now();
+            try {
+                auto config = configs.get(entry.config);
+
+                runtime_t::create_container_options_t create_container_options;
+                create_container_options.bundle = entry.bundle;
+                create_container_options.config = entry.config;
+                create_container_options.ID = entry.ID;
+                create_container_options.init = entry.init;
+                create_container_options.forward_signals = false;
+
+                launched_t item{ index, {}, {} };
+                item.container = std::make_unique<container>(
+                        runtime.create_container(create_container_options, *config));
+                item.process.emplace(item.container->start(item.container->get_config().process));
+
+                result.started = std::chrono::steady_clock::now();
+                result.latency = *result.started - begin;
+                LINYAPS_BOX_DEBUG() << "Container " << entry.ID << " started in "
+                                    << result.latency->count() << "ms";
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    launched.push_back(std::move(item));
+                }
+                notify();
+            } catch (const std::exception &e) {
+                result.error = e.what();
+                ++finished;
+                notify();
+            }
+        }
+    };
+
+    auto jobs = options.jobs ? options.jobs : std::max(std::thread::hardware_concurrency(), 1U);
+    jobs = std::min<std::size_t>(jobs, entries.size());
+
+    auto begin = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < jobs; ++i) {
+        workers.emplace_back(worker);
+    }
+
+    utils::epoll epoll;
+    epoll.add(signal_fd, EPOLLIN);
+    epoll.add(event_fd, EPOLLIN);
+
+    // Running containers by the pid of their container processes.
+    std::map<pid_t, launched_t> running;
+    std::map<int, pid_t> pidfds;
+    std::vector<std::thread> reapers;
+
+    // NOTE: Waiting for a container runs its poststop hooks and removes its status,
+    // which is done by a thread, so exits of other containers are not delayed.
+    auto reap = [&](std::map<pid_t, launched_t>::iterator it) {
+        auto item = std::move(it->second);
+        running.erase(it);
+
+        if (item.process->pidfd().get() != -1) {
+            pidfds.erase(item.process->pidfd().get());
+            epoll.remove(item.process->pidfd());
+        }
+
+        reapers.emplace_back([&results, &finished, &notify, item = std::move(item)]() mutable {
+            auto &result = results[item.index];
+            try {
+                result.exit_code = item.process->wait();
+            } catch (const std::exception &e) {
+                result.error = e.what();
+            }
+            item.process.reset();
+            item.container.reset();
+            ++finished;
+            notify();
+        });
+    };
+
+    // NOTE: Without pidfd, container processes are polled,
+    // as SIGCHLD is read by the monitors of containers being launched.
+    constexpr std::chrono::milliseconds poll_interval{ 100 };
+
+    while (finished < entries.size()) {
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+        if (running.size() != pidfds.size()) {
+            deadline = std::chrono::steady_clock::now() + poll_interval;
+        }
+
+        for (const auto &event : epoll.wait(deadline)) {
+            if (event.data.fd == event_fd.get()) {
+                uint64_t value = 0;
+                [[maybe_unused]] auto n = ::read(event_fd.get(), &value, sizeof(value));
+
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto &item : launched) {
+                    auto pid = item.process->pid();
+                    if (auto fd = item.process->pidfd().get(); fd != -1) {
+                        epoll.add(item.process->pidfd(), EPOLLIN);
+                        pidfds.emplace(fd, pid);
+                    }
+                    running.emplace(pid, std::move(item));
+                }
+                launched.clear();
+                continue;
+            }
+
+            if (event.data.fd == signal_fd.get()) {
+                while (auto info = utils::read_signal(signal_fd)) {
+                    LINYAPS_BOX_DEBUG() << "Forward signal " << info->ssi_signo
+                                        << " to all containers";
+                    stopping = true;
+                    for (auto &item : running)
+                        try {
+                            item.second.process->kill(info->ssi_signo);
+                        } catch (const std::system_error &e) {
+                            LINYAPS_BOX_WARNING() << "Failed to forward signal to "
+                                                  << entries[item.second.index].ID << ": "
+                                                  << e.what();
+                        }
+                }
+                continue;
+            }
+
+            auto pidfd = pidfds.find(event.data.fd);
+            if (pidfd == pidfds.end()) {
+                continue;
+            }
+
+            reap(running.find(pidfd->second));
+        }
+
+        for (auto it = running.begin(); it != running.end();) {
+            auto current = it++;
+            if (current->second.process->pidfd().get() != -1) {
+                continue;
+            }
+
+            siginfo_t info{};
+            if (::waitid(P_PID, current->first, &info, WEXITED | WNOHANG | WNOWAIT) < 0) {
+                throw std::system_error(errno, std::generic_category(), "waitid");
+            }
+            if (info.si_pid != 0) {
+                reap(current);
+            }
+        }
+    }
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    for (auto &reaper : reapers) {
+        reaper.join();
+    }
+
+    ret = pthread_sigmask(SIG_SETMASK, &old_signals, nullptr);
+    if (ret) {
+        throw std::system_error(ret, std::generic_category(), "pthread_sigmask");
+    }
+
+    // NOTE: Throughput is measured until the last container started,
+    // not until all containers exited.
+    auto end = begin;
+    for (const auto &result : results) {
+        if (result.started) {
+            end = std::max(end, *result.started);
+        }
+    }
+
+    print_results(entries, results, end - begin);
+
+    return std::all_of(results.cbegin(),
+                       results.cend(),
+                       [](const result_t &result) {
+                           return result.error.empty() && result.exit_code == 0;
+                       })
+            ? 0
+            : 1;
+}
@@ -0,0 +1,13 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/command/options.h"
+
+namespace linyaps_box::command {
+
+int run_many(const std::filesystem::path &root, const run_many_options &options);
+
+} // namespace linyaps_box::command
@@ -8,10 +8,1050 @@
 #include "linyaps_box/utils/semver.h"
 #include "nlohmann/json.hpp"
 
+#include <fstream>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace {
 
-static std::tuple<unsigned long, unsigned long, std::string>
-parse_mount_options(const std::vector<std::string> options)
+// The parser populating linyaps_box::config from SAX events of nlohmann::json in one pass,
+// without building a document. Type errors are reported with the JSON pointer of the value.
+class config_handler
+{
+public:
+    enum class node_t {
+        skip,
+        root,
+        process,
+        console_size,
+        user,
+        additional_gids,
+        env,
+        args,
+        linux,
+        namespaces,
+        namespace_,
+        id_mappings,
+        id_mapping,
+        seccomp,
+        seccomp_architectures,
+        seccomp_flags,
+        seccomp_syscalls,
+        seccomp_syscall,
+        seccomp_names,
+        seccomp_args,
+        seccomp_arg,
+        hooks,
+        hook_list,
+        hook,
+        hook_args,
+        hook_env,
+        mounts,
+        mount,
+        mount_options,
+        root_fs,
+        annotations,
+        sysctl,
+    };
+
+    enum class type_t { any, boolean, number, string, object, array };
+
+    struct field_t
+    {
+        type_t type;
+        node_t child;
+        // The array or object accepts null as if it were absent.
+        bool nullable;
+    };
+
+    // Returns the type of the value of `key` in `parent`, or of elements if `parent` is an array.
+    [[nodiscard]] static field_t field(node_t parent, const std::string &key)
+    {
+        constexpr field_t skip{ type_t::any, node_t::skip, false };
+
+        switch (parent) {
+        case node_t::root:
+            if (key == "ociVersion") {
+                return { type_t::string, node_t::skip, false };
+            }
+            if (key == "process") {
+                return { type_t::object, node_t::process, false };
+            }
+            if (key == "linux") {
+                return { type_t::object, node_t::linux, true };
+            }
+            if (key == "hooks") {
+                return { type_t::object, node_t::hooks, true };
+            }
+            if (key == "mounts") {
+                return { type_t::array, node_t::mounts, true };
+            }
+            if (key == "root") {
+                return { type_t::object, node_t::root_fs, false };
+            }
+            if (key == "annotations") {
+                return { type_t::object, node_t::annotations, false };
+            }
+            return skip;
+        case node_t::process:
+            if (key == "terminal" || key == "noNewPrivileges") {
+                return { type_t::boolean, node_t::skip, false };
+            }
+            if (key == "consoleSize") {
+                return { type_t::object, node_t::console_size, false };
+            }
+            if (key == "cwd") {
+                return { type_t::string, node_t::skip, false };
+            }
+            if (key == "env") {
+                return { type_t::array, node_t::env, false };
+            }
+            if (key == "args") {
+                return { type_t::array, node_t::args, false };
+            }
+            if (key == "oomScoreAdj") {
+                return { type_t::number, node_t::skip, false };
+            }
+            if (key == "user") {
+                return { type_t::object, node_t::user, false };
+            }
+            return skip;
+        case node_t::console_size:
+            // NOTE: Checked by result(), as consoleSize is ignored without terminal.
+            return skip;
+        case node_t::user:
+            if (key == "uid" || key == "gid" || key == "umask") {
+                return { type_t::number, node_t::skip, false };
+            }
+            if (key == "additionalGids") {
+                return { type_t::array, node_t::additional_gids, false };
+            }
+            return skip;
+        case node_t::linux:
+            if (key == "namespaces") {
+                return { type_t::array, node_t::namespaces, true };
+            }
+            if (key == "uidMappings" || key == "gidMappings") {
+                return { type_t::array, node_t::id_mappings, true };
+            }
+            if (key == "seccomp") {
+                return { type_t::object, node_t::seccomp, true };
+            }
+            if (key == "sysctl") {
+                return { type_t::object, node_t::sysctl, false };
+            }
+            return skip;
+        case node_t::seccomp:
+            if (key == "defaultAction") {
+                return { type_t::string, node_t::skip, false };
+            }
+            if (key == "defaultErrnoRet") {
+                return { type_t::number, node_t::skip, false };
+            }
+            if (key == "architectures") {
+                return { type_t::array, node_t::seccomp_architectures, false };
+            }
+            if (key == "flags") {
+                return { type_t::array, node_t::seccomp_flags, false };
+            }
+            if (key == "syscalls") {
+                return { type_t::array, node_t::seccomp_syscalls, true };
+            }
+            return skip;
+        case node_t::seccomp_syscall:
+            if (key == "names") {
+                return { type_t::array, node_t::seccomp_names, false };
+            }
+            if (key == "action") {
+                return { type_t::string, node_t::skip, false };
+            }
+            if (key == "errnoRet") {
+                return { type_t::number, node_t::skip, false };
+            }
+            if (key == "args") {
+                return { type_t::array, node_t::seccomp_args, true };
+            }
+            return skip;
+        case node_t::seccomp_arg:
+            if (key == "index" || key == "value" || key == "valueTwo") {
+                return { type_t::number, node_t::skip, false };
+            }
+            if (key == "op") {
+                return { type_t::string, node_t::skip, false };
+            }
+            return skip;
+        case node_t::namespace_:
+            if (key == "type" || key == "path") {
+                return { type_t::string, node_t::skip, false };
+            }
+            return skip;
+        case node_t::id_mapping:
+            if (key == "hostID" || key == "containerID" || key == "size") {
+                return { type_t::number, node_t::skip, false };
+            }
+            return skip;
+        case node_t::hooks:
+            if (hook_stage(key) >= 0) {
+                return { type_t::array, node_t::hook_list, true };
+            }
+            return skip;
+        case node_t::hook:
+            if (key == "path" || key == "entry") {
+                return { type_t::string, node_t::skip, false };
+            }
+            if (key == "args") {
+                return { type_t::array, node_t::hook_args, false };
+            }
+            if (key == "env") {
+                return { type_t::array, node_t::hook_env, false };
+            }
+            if (key == "timeout") {
+                return { type_t::number, node_t::skip, false };
+            }
+            return skip;
+        case node_t::mount:
+            if (key == "source" || key == "destination" || key == "type") {
+                return { type_t::string, node_t::skip, false };
+            }
+            if (key == "options") {
+                return { type_t::array, node_t::mount_options, false };
+            }
+            return skip;
+        case node_t::root_fs:
+            if (key == "path") {
+                return { type_t::string, node_t::skip, false };
+            }
+            if (key == "readonly") {
+                return { type_t::boolean, node_t::skip, false };
+            }
+            return skip;
+        case node_t::annotations:
+        case node_t::sysctl:
+        case node_t::env:
+        case node_t::args:
+        case node_t::hook_args:
+        case node_t::hook_env:
+        case node_t::mount_options:
+        case node_t::seccomp_architectures:
+        case node_t::seccomp_flags:
+        case node_t::seccomp_names:
+            return { type_t::string, node_t::skip, false };
+        case node_t::seccomp_syscalls:
+            return { type_t::object, node_t::seccomp_syscall, false };
+        case node_t::seccomp_args:
+            return { type_t::object, node_t::seccomp_arg, false };
+        case node_t::additional_gids:
+            return { type_t::number, node_t::skip, false };
+        case node_t::namespaces:
+            return { type_t::object, node_t::namespace_, false };
+        case node_t::id_mappings:
+            return { type_t::object, node_t::id_mapping, false };
+        case node_t::hook_list:
+            return { type_t::object, node_t::hook, false };
+        case node_t::mounts:
+            return { type_t::object, node_t::mount, false };
+        case node_t::skip:
+            return skip;
+        }
+
+        return skip;
+    }
+
+    // The index of the stage in config::hooks_t, or -1 for unknown ones.
+    [[nodiscard]] static int hook_stage(const std::string &key)
+    {
+        static const char *const stages[] = { "prestart",       "createRuntime",
+                                              "createContainer", "startContainer",
+                                              "poststart",      "poststop" };
+        for (int i = 0; i < static_cast<int>(std::size(stages)); ++i) {
+            if (key == stages[i]) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    bool null() { return this->value(type_t::any, "null", [](const frame_t &) { }); }
+
+    bool boolean(bool val)
+    {
+        return this->value(type_t::boolean, "boolean", [this, val](const frame_t &frame) {
+            this->on_boolean(frame, val);
+        });
+    }
+
+    bool number_integer(nlohmann::json::number_integer_t val)
+    {
+        return this->value(type_t::number, "number", [this, val](const frame_t &frame) {
+            this->on_number(frame, static_cast<long long>(val));
+        });
+    }
+
+    bool number_unsigned(nlohmann::json::number_unsigned_t val)
+    {
+        return this->value(type_t::number, "number", [this, val](const frame_t &frame) {
+            this->on_number(frame, static_cast<long long>(val));
+        });
+    }
+
+    bool number_float(nlohmann::json::number_float_t val, const nlohmann::json::string_t &)
+    {
+        return this->value(type_t::number, "number", [this, val](const frame_t &frame) {
+            this->on_number(frame, static_cast<long long>(val));
+        });
+    }
+
+    bool string(nlohmann::json::string_t &val)
+    {
+        return this->value(type_t::string, "string", [this, &val](const frame_t &frame) {
+            this->on_string(frame, val);
+        });
+    }
+
+    bool binary(nlohmann::json::binary_t &)
+    {
+        return this->value(type_t::any, "binary", [](const frame_t &) { });
+    }
+
+    bool start_object(std::size_t)
+    {
+        if (this->stack.empty()) {
+            this->stack.push_back({ node_t::root, {}, 0 });
+            return true;
+        }
+
+        auto child = this->container(type_t::object, "object");
+        this->stack.push_back({ child, {}, 0 });
+        this->begin(child);
+        return true;
+    }
+
+    bool key(nlohmann::json::string_t &val)
+    {
+        this->stack.back().key = std::move(val);
+        return true;
+    }
+
+    bool end_object()
+    {
+        auto frame = std::move(this->stack.back());
+        this->stack.pop_back();
+        this->end(frame.node);
+        this->next();
+        return true;
+    }
+
+    bool start_array(std::size_t)
+    {
+        if (this->stack.empty()) {
+            throw this->type_error("object", "array");
+        }
+
+        auto child = this->container(type_t::array, "array");
+        this->stack.push_back({ child, {}, 0 });
+        this->begin(child);
+        return true;
+    }
+
+    bool end_array()
+    {
+        auto frame = std::move(this->stack.back());
+        this->stack.pop_back();
+        this->end(frame.node);
+        this->next();
+        return true;
+    }
+
+    template<typename Exception>
+    bool parse_error(std::size_t, const std::string &, const Exception &ex)
+    {
+        throw ex;
+    }
+
+    [[nodiscard]] linyaps_box::config result()
+    {
+        if (!this->oci_version) {
+            throw std::runtime_error(missing("/ociVersion", "string"));
+        }
+        auto semver = linyaps_box::utils::semver(*this->oci_version);
+        if (!linyaps_box::utils::semver("1.2.0").is_compatible_with(semver)) {
+            throw std::runtime_error("unsupported OCI version: " + semver.to_string());
+        }
+
+        if (!this->has_cwd) {
+            throw std::runtime_error(missing("/process/cwd", "string"));
+        }
+        if (!this->has_args) {
+            throw std::runtime_error(missing("/process/args", "array"));
+        }
+        if (!this->has_uid) {
+            throw std::runtime_error(missing("/process/user/uid", "number"));
+        }
+        if (!this->has_gid) {
+            throw std::runtime_error(missing("/process/user/gid", "number"));
+        }
+        if (!this->has_root_path) {
+            throw std::runtime_error(missing("/root/path", "string"));
+        }
+
+        // NOTE: consoleSize is ignored without terminal, which might come after it.
+        if (this->cfg.process.terminal && this->console) {
+            if (!this->console_error.empty()) {
+                throw std::runtime_error(this->console_error);
+            }
+            this->cfg.process.console = *this->console;
+        }
+
+        if (!this->has_namespaces) {
+            LINYAPS_BOX_WARNING() << "No namespaces found";
+        }
+        if (!this->has_uid_mappings) {
+            LINYAPS_BOX_WARNING() << "No uidMappings found";
+        }
+        if (!this->has_gid_mappings) {
+            LINYAPS_BOX_WARNING() << "No gidMappings found";
+        }
+
+        return std::move(this->cfg);
+    }
+
+private:
+    struct frame_t
+    {
+        node_t node;
+        std::string key;
+        std::size_t index;
+    };
+
+    // Messages of type errors are the ones of nlohmann::json built with JSON_DIAGNOSTICS,
+    // e.g. "[json.exception.type_error.302] (/process/cwd) type must be string, but is number".
+    [[nodiscard]] static std::string
+    type_message(const std::string &pointer, const char *expected, const char *actual)
+    {
+        std::string message = "[json.exception.type_error.302] ";
+        if (!pointer.empty()) {
+            message += "(" + pointer + ") ";
+        }
+        return message + "type must be " + expected + ", but is " + actual;
+    }
+
+    [[nodiscard]] static std::string missing(const std::string &pointer, const char *expected)
+    {
+        return type_message(pointer, expected, "null");
+    }
+
+    // The JSON pointer of the current value.
+    [[nodiscard]] std::string pointer() const
+    {
+        std::string result;
+        for (const auto &frame : this->stack) {
+            result += "/";
+            if (is_array(frame.node)) {
+                result += std::to_string(frame.index);
+                continue;
+            }
+            for (auto c : frame.key) {
+                if (c == '~') {
+                    result += "~0";
+                } else if (c == '/') {
+                    result += "~1";
+                } else {
+                    result += c;
+                }
+            }
+        }
+        return result;
+    }
+
+    [[nodiscard]] std::runtime_error type_error(const char *expected, const char *actual) const
+    {
+        return std::runtime_error(type_message(this->pointer(), expected, actual));
+    }
+
+    [[nodiscard]] static bool is_array(node_t node)
+    {
+        switch (node) {
+        case node_t::additional_gids:
+        case node_t::env:
+        case node_t::args:
+        case node_t::namespaces:
+        case node_t::id_mappings:
+        case node_t::hook_list:
+        case node_t::hook_args:
+        case node_t::hook_env:
+        case node_t::mounts:
+        case node_t::mount_options:
+        case node_t::seccomp_architectures:
+        case node_t::seccomp_flags:
+        case node_t::seccomp_syscalls:
+        case node_t::seccomp_names:
+        case node_t::seccomp_args:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    [[nodiscard]] static const char *type_name(type_t type)
+    {
+        switch (type) {
+        case type_t::boolean:
+            return "boolean";
+        case type_t::number:
+            return "number";
+        case type_t::string:
+            return "string";
+        case type_t::object:
+            return "object";
+        case type_t::array:
+            return "array";
+        case type_t::any:
+            break;
+        }
+        return "any";
+    }
+
+    [[nodiscard]] const frame_t &parent() const { return this->stack.back(); }
+
+    // Advance the index of the parent array after a value.
+    void next()
+    {
+        if (!this->stack.empty() && is_array(this->stack.back().node)) {
+            ++this->stack.back().index;
+        }
+    }
+
+    template<typename Fn>
+    bool value(type_t type, const char *name, Fn &&fn)
+    {
+        if (this->stack.empty()) {
+            throw this->type_error("object", name);
+        }
+
+        const auto &frame = this->parent();
+        if (frame.node == node_t::console_size) {
+            if (this->on_console_size(frame, type, name)) {
+                fn(frame);
+            }
+            this->next();
+            return true;
+        }
+        if (type != type_t::string && skip_annotation(frame, name)) {
+            this->next();
+            return true;
+        }
+
+        auto expected = field(frame.node, frame.key);
+        if (expected.type != type_t::any && expected.type != type) {
+            if (type != type_t::any || !expected.nullable) {
+                throw this->type_error(type_name(expected.type), name);
+            }
+            // NOTE: null is iterated as an empty array, and linux.seccomp is absent.
+            this->present(expected.child, frame.key);
+        } else if (expected.type != type_t::any) {
+            fn(frame);
+        }
+
+        this->next();
+        return true;
+    }
+
+    [[nodiscard]] node_t container(type_t type, const char *name)
+    {
+        const auto &frame = this->parent();
+        if (frame.node == node_t::console_size) {
+            this->on_console_size(frame, type, name);
+            return node_t::skip;
+        }
+        if (skip_annotation(frame, name)) {
+            return node_t::skip;
+        }
+
+        auto expected = field(frame.node, frame.key);
+        if (expected.type == type_t::any) {
+            return node_t::skip;
+        }
+        if (expected.type != type) {
+            throw this->type_error(type_name(expected.type), name);
+        }
+        return expected.child;
+    }
+
+    // NOTE: Annotations of other types than string are skipped instead of failing the
+    // configuration, as the document parser ignored annotations.
+    [[nodiscard]] static bool skip_annotation(const frame_t &frame, const char *name)
+    {
+        if (frame.node != node_t::annotations) {
+            return false;
+        }
+        LINYAPS_BOX_WARNING() << "Skip annotation " << frame.key << ": type must be string, but is "
+                              << name;
+        return true;
+    }
+
+    // Mark containers of which the absence is warned as present.
+    void present(node_t node, const std::string &key)
+    {
+        if (node == node_t::namespaces) {
+            this->has_namespaces = true;
+        } else if (node == node_t::id_mappings) {
+            (key == "uidMappings" ? this->has_uid_mappings : this->has_gid_mappings) = true;
+        }
+    }
+
+    void begin(node_t node)
+    {
+        // NOTE: The parent frame is below the new one.
+        const auto &frame = this->stack[this->stack.size() - 2];
+
+        switch (node) {
+        case node_t::console_size:
+            this->console.emplace();
+            this->console_error.clear();
+            this->has_height = false;
+            this->has_width = false;
+            break;
+        case node_t::env:
+            this->cfg.process.env.clear();
+            break;
+        case node_t::args:
+            this->cfg.process.args.clear();
+            this->has_args = true;
+            break;
+        case node_t::additional_gids:
+            this->cfg.process.additional_gids.emplace();
+            break;
+        case node_t::namespaces:
+            this->cfg.namespaces.clear();
+            this->present(node, frame.key);
+            break;
+        case node_t::namespace_:
+            this->cfg.namespaces.emplace_back();
+            this->has_type = false;
+            break;
+        case node_t::id_mappings:
+            this->mappings = frame.key == "uidMappings" ? &this->cfg.uid_mappings
+                                                        : &this->cfg.gid_mappings;
+            this->mappings->clear();
+            this->present(node, frame.key);
+            break;
+        case node_t::id_mapping:
+            this->mappings->emplace_back();
+            this->has_host_id = false;
+            this->has_container_id = false;
+            this->has_size = false;
+            break;
+        case node_t::seccomp:
+            this->cfg.seccomp.emplace();
+            this->has_default_action = false;
+            break;
+        case node_t::seccomp_architectures:
+            this->cfg.seccomp->architectures.clear();
+            break;
+        case node_t::seccomp_flags:
+            this->cfg.seccomp->flags.clear();
+            break;
+        case node_t::seccomp_syscalls:
+            this->cfg.seccomp->syscalls.clear();
+            break;
+        case node_t::seccomp_syscall:
+            this->cfg.seccomp->syscalls.emplace_back();
+            this->has_names = false;
+            this->has_action = false;
+            break;
+        case node_t::seccomp_names:
+            this->cfg.seccomp->syscalls.back().names.clear();
+            this->has_names = true;
+            break;
+        case node_t::seccomp_args:
+            this->cfg.seccomp->syscalls.back().args.clear();
+            break;
+        case node_t::seccomp_arg:
+            this->cfg.seccomp->syscalls.back().args.emplace_back();
+            this->has_index = false;
+            this->has_value = false;
+            this->has_op = false;
+            break;
+        case node_t::hook_list:
+            this->hooks = this->select_hooks(frame.key);
+            this->hooks->clear();
+            break;
+        case node_t::hook:
+            this->hooks->emplace_back();
+            this->has_path = false;
+            this->has_hook_args = false;
+            break;
+        case node_t::hook_args:
+            this->hooks->back().args.clear();
+            this->has_hook_args = true;
+            break;
+        case node_t::hook_env:
+            this->hooks->back().env.clear();
+            break;
+        case node_t::mounts:
+            this->cfg.mounts.clear();
+            break;
+        case node_t::mount:
+            this->cfg.mounts.emplace_back();
+            this->has_type = false;
+            break;
+        case node_t::mount_options:
+            this->mount_options.clear();
+            break;
+        case node_t::annotations:
+            this->cfg.annotations.clear();
+            break;
+        case node_t::sysctl:
+            this->cfg.sysctl.clear();
+            break;
+        default:
+            break;
+        }
+    }
+
+    void end(node_t node)
+    {
+        switch (node) {
+        case node_t::console_size:
+            if (!this->has_height) {
+                this->console_error = missing(this->pointer() + "/height", "number");
+            } else if (!this->has_width) {
+                this->console_error = missing(this->pointer() + "/width", "number");
+            }
+            break;
+        case node_t::namespace_:
+            if (!this->has_type) {
+                throw std::runtime_error("property `type` is REQUIRED for linux namespaces");
+            }
+            break;
+        case node_t::id_mapping:
+            if (!this->has_host_id) {
+                throw std::runtime_error(missing(this->pointer() + "/hostID", "number"));
+            }
+            if (!this->has_container_id) {
+                throw std::runtime_error(missing(this->pointer() + "/containerID", "number"));
+            }
+            if (!this->has_size) {
+                throw std::runtime_error(missing(this->pointer() + "/size", "number"));
+            }
+            break;
+        case node_t::seccomp:
+            if (!this->has_default_action) {
+                throw std::runtime_error(missing(this->pointer() + "/defaultAction", "string"));
+            }
+            break;
+        case node_t::seccomp_syscall:
+            if (!this->has_names) {
+                throw std::runtime_error(missing(this->pointer() + "/names", "array"));
+            }
+            if (!this->has_action) {
+                throw std::runtime_error(missing(this->pointer() + "/action", "string"));
+            }
+            break;
+        case node_t::seccomp_arg:
+            if (!this->has_index) {
+                throw std::runtime_error(missing(this->pointer() + "/index", "number"));
+            }
+            if (!this->has_value) {
+                throw std::runtime_error(missing(this->pointer() + "/value", "number"));
+            }
+            if (!this->has_op) {
+                throw std::runtime_error(missing(this->pointer() + "/op", "string"));
+            }
+            break;
+        case node_t::hook:
+            if (!this->has_path) {
+                throw std::runtime_error(missing(this->pointer() + "/path", "string"));
+            }
+            if (!this->has_hook_args) {
+                throw std::runtime_error(missing(this->pointer() + "/args", "array"));
+            }
+            break;
+        case node_t::mount:
+            if (!this->has_type) {
+                throw std::runtime_error(missing(this->pointer() + "/type", "string"));
+            }
+            break;
+        case node_t::mount_options: {
+            auto &mount = this->cfg.mounts.back();
+            std::tie(mount.flags, mount.propagation_flags, mount.data) =
+                    linyaps_box::config::mount_t::parse_options(this->mount_options);
+        } break;
+        default:
+            break;
+        }
+    }
+
+    [[nodiscard]] std::vector<linyaps_box::config::hooks_t::hook_t> *
+    select_hooks(const std::string &key)
+    {
+        auto &hooks = this->cfg.hooks;
+        std::vector<linyaps_box::config::hooks_t::hook_t> *lists[] = {
+            &hooks.prestart,        &hooks.create_runtime, &hooks.create_container,
+            &hooks.start_container, &hooks.poststart,      &hooks.poststop,
+        };
+        return lists[hook_stage(key)];
+    }
+
+    static void add_env(std::map<std::string, std::string> &env, const std::string &e)
+    {
+        auto pos = e.find('=');
+        if (pos == std::string::npos) {
+            throw std::runtime_error("invalid env entry: " + e);
+        }
+        env[e.substr(0, pos)] = e.substr(pos + 1);
+    }
+
+    void on_boolean(const frame_t &frame, bool val)
+    {
+        switch (frame.node) {
+        case node_t::process:
+            if (frame.key == "terminal") {
+                this->cfg.process.terminal = val;
+            } else {
+                this->cfg.process.no_new_privileges = val;
+            }
+            break;
+        case node_t::root_fs:
+            this->cfg.root.readonly = val;
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Returns whether the value is a number of consoleSize,
+    // errors are kept until terminal is known.
+    bool on_console_size(const frame_t &frame, type_t type, const char *name)
+    {
+        if (frame.key != "height" && frame.key != "width") {
+            return false;
+        }
+        (frame.key == "height" ? this->has_height : this->has_width) = true;
+        if (type != type_t::number) {
+            this->console_error = this->type_error("number", name).what();
+            return false;
+        }
+        return true;
+    }
+
+    void on_number(const frame_t &frame, long long val)
+    {
+        switch (frame.node) {
+        case node_t::process:
+            this->cfg.process.oom_score_adj = static_cast<int>(val);
+            break;
+        case node_t::console_size:
+            (frame.key == "height" ? this->console->height : this->console->width) =
+                    static_cast<uint>(val);
+            break;
+        case node_t::user:
+            if (frame.key == "uid") {
+                this->cfg.process.uid = static_cast<uid_t>(val);
+                this->has_uid = true;
+            } else if (frame.key == "gid") {
+                this->cfg.process.gid = static_cast<gid_t>(val);
+                this->has_gid = true;
+            } else {
+                this->cfg.process.umask = static_cast<mode_t>(val);
+            }
+            break;
+        case node_t::additional_gids:
+            this->cfg.process.additional_gids->push_back(static_cast<gid_t>(val));
+            break;
+        case node_t::id_mapping: {
+            auto &mapping = this->mappings->back();
+            if (frame.key == "hostID") {
+                mapping.host_id = static_cast<uid_t>(val);
+                this->has_host_id = true;
+            } else if (frame.key == "containerID") {
+                mapping.container_id = static_cast<uid_t>(val);
+                this->has_container_id = true;
+            } else {
+                mapping.size = static_cast<size_t>(val);
+                this->has_size = true;
+            }
+        } break;
+        case node_t::seccomp:
+            this->cfg.seccomp->default_errno_ret = static_cast<uint>(val);
+            break;
+        case node_t::seccomp_syscall:
+            this->cfg.seccomp->syscalls.back().errno_ret = static_cast<uint>(val);
+            break;
+        case node_t::seccomp_arg: {
+            auto &arg = this->cfg.seccomp->syscalls.back().args.back();
+            if (frame.key == "index") {
+                arg.index = static_cast<uint>(val);
+                this->has_index = true;
+            } else if (frame.key == "value") {
+                arg.value = static_cast<std::uint64_t>(val);
+                this->has_value = true;
+            } else {
+                arg.value_two = static_cast<std::uint64_t>(val);
+            }
+        } break;
+        case node_t::hook: {
+            auto &hook = this->hooks->back();
+            hook.timeout = static_cast<int>(val);
+            if (*hook.timeout <= 0) {
+                throw std::runtime_error("hook timeout must be greater than zero");
+            }
+        } break;
+        default:
+            break;
+        }
+    }
+
+    void on_string(const frame_t &frame, std::string &val)
+    {
+        switch (frame.node) {
+        case node_t::root:
+            this->oci_version = std::move(val);
+            break;
+        case node_t::process:
+            this->cfg.process.cwd = std::move(val);
+            this->has_cwd = true;
+            break;
+        case node_t::env:
+            add_env(this->cfg.process.env, val);
+            break;
+        case node_t::args:
+            this->cfg.process.args.push_back(std::move(val));
+            break;
+        case node_t::namespace_: {
+            auto &ns = this->cfg.namespaces.back();
+            if (frame.key == "path") {
+                ns.path = std::move(val);
+                break;
+            }
+
+            using type_t = linyaps_box::config::namespace_t::type_t;
+            if (val == "pid") {
+                ns.type = type_t::PID;
+            } else if (val == "network") {
+                ns.type = type_t::NET;
+            } else if (val == "ipc") {
+                ns.type = type_t::IPC;
+            } else if (val == "uts") {
+                ns.type = type_t::UTS;
+            } else if (val == "mount") {
+                ns.type = type_t::MOUNT;
+            } else if (val == "user") {
+                ns.type = type_t::USER;
+            } else if (val == "cgroup") {
+                ns.type = type_t::CGROUP;
+            } else {
+                throw std::runtime_error("unsupported namespace type: " + val);
+            }
+            this->has_type = true;
+        } break;
+        case node_t::seccomp:
+            this->cfg.seccomp->default_action = std::move(val);
+            this->has_default_action = true;
+            break;
+        case node_t::seccomp_architectures:
+            this->cfg.seccomp->architectures.push_back(std::move(val));
+            break;
+        case node_t::seccomp_flags:
+            this->cfg.seccomp->flags.push_back(std::move(val));
+            break;
+        case node_t::seccomp_syscall:
+            this->cfg.seccomp->syscalls.back().action = std::move(val);
+            this->has_action = true;
+            break;
+        case node_t::seccomp_names:
+            this->cfg.seccomp->syscalls.back().names.push_back(std::move(val));
+            break;
+        case node_t::seccomp_arg:
+            this->cfg.seccomp->syscalls.back().args.back().op = std::move(val);
+            this->has_op = true;
+            break;
+        case node_t::hook:
+            if (frame.key == "path") {
+                this->hooks->back().path = std::move(val);
+                this->has_path = true;
+            } else {
+                this->hooks->back().entry = std::move(val);
+            }
+            break;
+        case node_t::hook_args:
+            this->hooks->back().args.push_back(std::move(val));
+            break;
+        case node_t::hook_env:
+            add_env(this->hooks->back().env, val);
+            break;
+        case node_t::mount: {
+            auto &mount = this->cfg.mounts.back();
+            if (frame.key == "source") {
+                mount.source = std::move(val);
+            } else if (frame.key == "destination") {
+                mount.destination = std::move(val);
+            } else {
+                mount.type = std::move(val);
+                this->has_type = true;
+            }
+        } break;
+        case node_t::mount_options:
+            this->mount_options.push_back(std::move(val));
+            break;
+        case node_t::root_fs:
+            this->cfg.root.path = std::move(val);
+            this->has_root_path = true;
+            break;
+        case node_t::annotations:
+            this->cfg.annotations[frame.key] = std::move(val);
+            break;
+        case node_t::sysctl:
+            this->cfg.sysctl[frame.key] = std::move(val);
+            break;
+        default:
+            break;
+        }
+    }
+
+    linyaps_box::config cfg;
+    std::vector<frame_t> stack;
+
+    std::optional<std::string> oci_version;
+    std::optional<linyaps_box::config::process_t::console_t> console;
+    std::vector<linyaps_box::config::id_mapping_t> *mappings = nullptr;
+    std::vector<linyaps_box::config::hooks_t::hook_t> *hooks = nullptr;
+    std::vector<std::string> mount_options;
+    std::string console_error;
+
+    bool has_cwd = false;
+    bool has_args = false;
+    bool has_uid = false;
+    bool has_gid = false;
+    bool has_root_path = false;
+    bool has_namespaces = false;
+    bool has_uid_mappings = false;
+    bool has_gid_mappings = false;
+    bool has_height = false;
+    bool has_width = false;
+    bool has_type = false;
+    bool has_host_id = false;
+    bool has_container_id = false;
+    bool has_size = false;
+    bool has_path = false;
+    bool has_hook_args = false;
+    bool has_default_action = false;
+    bool has_names = false;
+    bool has_action = false;
+    bool has_index = false;
+    bool has_value = false;
+    bool has_op = false;
+};
+
+
+} // namespace
+
+std::tuple<unsigned long, unsigned long, std::string>
+linyaps_box::config::mount_t::parse_options(const std::vector<std::string> &options)
 {
     const static std::map<std::string, unsigned long> propagation_flags_map{
         { "rprivate", MS_PRIVATE | MS_REC },       { "private", MS_PRIVATE },
@@ -73,7 +1113,7 @@ parse_mount_options(const std::vector<std::string> options)
             continue;
         }
         if (auto it = propagation_flags_map.find(opt); it != propagation_flags_map.end()) {
-            propagation_flags &= it->second;
+            propagation_flags |= it->second;
             continue;
         }
         data << "," << opt;
@@ -86,206 +1126,57 @@ parse_mount_options(const std::vector<std::string> options)
     return { flags, propagation_flags, str };
 }
 
-const auto ptr = ""_json_pointer;
-
-static linyaps_box::config parse_1_2_0(const nlohmann::json &j)
+linyaps_box::config linyaps_box::config::parse(std::istream &is)
 {
-    auto semver = linyaps_box::utils::semver(j[ptr / "ociVersion"].get<std::string>());
-    if (!linyaps_box::utils::semver("1.2.0").is_compatible_with(semver)) {
-        throw std::runtime_error("unsupported OCI version: " + semver.to_string());
-    }
-
-    linyaps_box::config cfg;
-
-    {
-        if (j.contains(ptr / "process" / "terminal")) {
-            cfg.process.terminal = j[ptr / "process" / "terminal"].get<bool>();
-        }
-
-        // https://github.com/opencontainers/runtime-spec/blob/09fcb39bb7185b46dfb206bc8f3fea914c674779/config.md?plain=1#L245
-        if (cfg.process.terminal && j.contains(ptr / "process" / "consoleSize")) {
-            cfg.process.console.height = j[ptr / "process" / "consoleSize" / "height"].get<uint>();
-            cfg.process.console.width = j[ptr / "process" / "consoleSize" / "width"].get<uint>();
-        }
-
-        cfg.process.cwd = j[ptr / "process" / "cwd"].get<std::string>();
-
-        if (j.contains(ptr / "process" / "env")) {
-            auto env = j[ptr / "process" / "env"].get<std::vector<std::string>>();
-            for (const auto &e : env) {
-                auto pos = e.find('=');
-                if (pos == std::string::npos) {
-                    throw std::runtime_error("invalid env entry: " + e);
-                }
-                cfg.process.env[e.substr(0, pos)] = e.substr(pos + 1);
-            }
-        }
-
-        cfg.process.args = j[ptr / "process" / "args"].get<std::vector<std::string>>();
-
-        // TODO: rlimits
-
-        // TODO: apparmorProfile
-
-        if (j.contains(ptr / "process" / "noNewPrivileges")) {
-            cfg.process.no_new_privileges = j[ptr / "process" / "noNewPrivileges"].get<bool>();
-        }
-
-        if (j.contains(ptr / "process" / "oomScoreAdj")) {
-            cfg.process.oom_score_adj = j[ptr / "process" / "oomScoreAdj"].get<int>();
-        }
-
-        cfg.process.uid = j[ptr / "process" / "user" / "uid"].get<uid_t>();
-        cfg.process.gid = j[ptr / "process" / "user" / "gid"].get<gid_t>();
-        if (j.contains(ptr / "process" / "user" / "umask")) {
-            cfg.process.umask = j[ptr / "process" / "user" / "umask"].get<mode_t>();
-        }
-        if (j.contains(ptr / "process" / "user" / "additionalGids")) {
-            cfg.process.additional_gids =
-                    j[ptr / "process" / "user" / "additionalGids"].get<std::vector<gid_t>>();
-        }
-    }
-
-    if (j.contains(ptr / "linux" / "namespaces")) {
-        for (const auto &ns : j[ptr / "linux" / "namespaces"]) {
-            linyaps_box::config::namespace_t n;
-            if (!ns.contains("type")) {
-                throw std::runtime_error("property `type` is REQUIRED for linux namespaces");
-            }
-
-            auto type = ns["type"].get<std::string>();
-            if (type == "pid") {
-                n.type = linyaps_box::config::namespace_t::type_t::PID;
-            } else if (type == "network") {
-                n.type = linyaps_box::config::namespace_t::type_t::NET;
-            } else if (type == "ipc") {
-                n.type = linyaps_box::config::namespace_t::type_t::IPC;
-            } else if (type == "uts") {
-                n.type = linyaps_box::config::namespace_t::type_t::UTS;
-            } else if (type == "mount") {
-                n.type = linyaps_box::config::namespace_t::type_t::MOUNT;
-            } else if (type == "user") {
-                n.type = linyaps_box::config::namespace_t::type_t::USER;
-            } else if (type == "cgroup") {
-                n.type = linyaps_box::config::namespace_t::type_t::CGROUP;
-            } else {
-                throw std::runtime_error("unsupported namespace type: " + type);
-            }
+    config_handler handler;
+    nlohmann::json::sax_parse(is, &handler);
+    return handler.result();
+}
 
-            if (ns.contains("path")) {
-                n.path = ns["path"].get<std::string>();
-            }
+linyaps_box::config linyaps_box::config::parse(std::string_view source)
+{
+    config_handler handler;
+    nlohmann::json::sax_parse(source.begin(), source.end(), &handler);
+    return handler.result();
+}
 
-            cfg.namespaces.push_back(n);
-        }
-    } else {
-        LINYAPS_BOX_WARNING() << "No namespaces found";
+linyaps_box::config linyaps_box::config::parse_file(const std::filesystem::path &path)
+{
+    auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "open " + path.string());
     }
 
-    if (j.contains(ptr / "linux" / "uidMappings")) {
-        std::vector<linyaps_box::config::id_mapping_t> uid_mappings;
-        for (const auto &m : j[ptr / "linux" / "uidMappings"]) {
-            linyaps_box::config::id_mapping_t id_mapping;
-            id_mapping.host_id = m["hostID"].get<uid_t>();
-            id_mapping.container_id = m["containerID"].get<uid_t>();
-            id_mapping.size = m["size"].get<size_t>();
-            uid_mappings.push_back(id_mapping);
-        }
-        cfg.uid_mappings = uid_mappings;
-    } else {
-        LINYAPS_BOX_WARNING() << "No uidMappings found";
+    struct stat st{};
+    if (::fstat(fd, &st)) {
+        auto err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "fstat " + path.string());
     }
 
-    if (j.contains(ptr / "linux" / "gidMappings")) {
-        std::vector<linyaps_box::config::id_mapping_t> gid_mappings;
-        for (const auto &m : j[ptr / "linux" / "gidMappings"]) {
-            linyaps_box::config::id_mapping_t id_mapping;
-            id_mapping.host_id = m["hostID"].get<uid_t>();
-            id_mapping.container_id = m["containerID"].get<uid_t>();
-            id_mapping.size = m["size"].get<size_t>();
-            gid_mappings.push_back(id_mapping);
-        }
-        cfg.gid_mappings = gid_mappings;
-    } else {
-        LINYAPS_BOX_WARNING() << "No gidMappings found";
+    // NOTE: mmap rejects empty files, which are invalid documents anyway.
+    if (st.st_size == 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        std::ifstream ifs(path);
+        return parse(ifs);
     }
 
-    if (j.contains(ptr / "hooks")) {
-        auto hooks = j[ptr / "hooks"];
-        auto get_hooks =
-                [&](const std::string &key) -> std::vector<linyaps_box::config::hooks_t::hook_t> {
-            std::vector<linyaps_box::config::hooks_t::hook_t> result;
-            if (!hooks.contains(key)) {
-                return result;
-            }
-
-            for (const auto &h : hooks[key]) {
-                linyaps_box::config::hooks_t::hook_t hook;
-                hook.path = h["path"].get<std::string>();
-                hook.args = h["args"].get<std::vector<std::string>>();
-                if (h.contains("env")) {
-                    for (const auto &e : h["env"].get<std::vector<std::string>>()) {
-                        auto pos = e.find('=');
-                        if (pos == std::string::npos) {
-                            throw std::runtime_error("invalid env entry: " + e);
-                        }
-                        hook.env[e.substr(0, pos)] = e.substr(pos + 1);
-                    }
-                }
-                if (h.contains("timeout")) {
-                    hook.timeout = h["timeout"].get<int>();
-                }
-                result.push_back(hook);
-            }
-
-            return result;
-        };
-
-        cfg.hooks.prestart = get_hooks("prestart");
-        cfg.hooks.create_runtime = get_hooks("createRuntime");
-        cfg.hooks.create_container = get_hooks("createContainer");
-        cfg.hooks.start_container = get_hooks("startContainer");
-        cfg.hooks.poststart = get_hooks("poststart");
-        cfg.hooks.poststop = get_hooks("poststop");
+    auto size = static_cast<std::size_t>(st.st_size);
+    auto *addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    auto err = errno;
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        throw std::system_error(err, std::generic_category(), "mmap " + path.string());
     }
 
-    if (j.contains(ptr / "mounts")) {
-        std::vector<linyaps_box::config::mount_t> mounts;
-        for (const auto &m : j[ptr / "mounts"]) {
-            linyaps_box::config::mount_t mount;
-            if (m.contains("source")) {
-                mount.source = m["source"].get<std::string>();
-            }
-            if (m.contains("destination")) {
-                mount.destination = m["destination"].get<std::string>();
-            }
-            mount.type = m["type"].get<std::string>();
-
-            const auto it = m.find("options");
-            if (it != m.end()) {
-                auto options = it->get<std::vector<std::string>>();
-                std::tie(mount.flags, mount.propagation_flags, mount.data) =
-                        parse_mount_options(options);
-            }
+    ::madvise(addr, size, MADV_SEQUENTIAL);
 
-            mounts.push_back(mount);
-        }
-        cfg.mounts = mounts;
+    try {
+        auto config = parse(std::string_view(static_cast<const char *>(addr), size));
+        ::munmap(addr, size);
+        return config;
+    } catch (...) {
+        ::munmap(addr, size);
+        throw;
     }
-
-    cfg.root.path = j[ptr / "root" / "path"].get<std::string>();
-
-    if (j.contains(ptr / "root" / "readonly")) {
-        cfg.root.readonly = j[ptr / "root" / "readonly"].get<bool>();
-    }
-
-    return cfg;
-}
-
-} // namespace
-
-linyaps_box::config linyaps_box::config::parse(std::istream &is)
-{
-    auto j = nlohmann::json::parse(is);
-    return parse_1_2_0(j);
 }
@@ -6,9 +6,12 @@
 
 #include <sys/mount.h>
 
+#include <cstdint>
 #include <filesystem>
 #include <map>
 #include <optional>
+#include <string_view>
+#include <tuple>
 #include <vector>
 
 #include <sys/resource.h>
@@ -18,8 +21,15 @@ namespace linyaps_box {
 
 struct config
 {
+    // Parse the configuration from SAX events, without building a JSON document.
     static config parse(std::istream &is);
 
+    // Same as parse, on a document in memory.
+    static config parse(std::string_view source);
+
+    // Same as parse, reading the file by mmap(2).
+    static config parse_file(const std::filesystem::path &path);
+
     struct process_t
     {
         bool terminal = false;
@@ -110,6 +120,40 @@ struct config
     std::vector<id_mapping_t> uid_mappings;
     std::vector<id_mapping_t> gid_mappings;
 
+    // linux.seccomp, actions, architectures, flags and operators are kept as in the
+    // configuration and resolved when the filter is compiled, see linyaps_box/seccomp.h.
+    struct seccomp_t
+    {
+        std::string default_action;
+        std::optional<uint> default_errno_ret;
+        std::vector<std::string> architectures;
+        std::vector<std::string> flags;
+
+        struct syscall_t
+        {
+            std::vector<std::string> names;
+            std::string action;
+            std::optional<uint> errno_ret;
+
+            struct arg_t
+            {
+                uint index = 0;
+                std::uint64_t value = 0;
+                std::uint64_t value_two = 0;
+                std::string op;
+            };
+
+            std::vector<arg_t> args;
+        };
+
+        std::vector<syscall_t> syscalls;
+    };
+
+    std::optional<seccomp_t> seccomp;
+
+    // linux.sysctl, validated and written by linyaps_box/sysctl.h.
+    std::map<std::string, std::string> sysctl;
+
     struct hooks_t
     {
         struct hook_t
@@ -117,7 +161,10 @@ struct config
             std::filesystem::path path;
             std::vector<std::string> args;
             std::map<std::string, std::string> env;
-            int timeout;
+            std::optional<int> timeout;
+            // The symbol called in-process if `path` is a shared object of a plugin hook,
+            // see linyaps_box/plugin.h.
+            std::optional<std::string> entry;
         };
 
         std::vector<hook_t> prestart;
@@ -132,11 +179,15 @@ struct config
 
     struct mount_t
     {
+        // Split mount options to flags, propagation flags and data of mount(2).
+        static std::tuple<unsigned long, unsigned long, std::string>
+        parse_options(const std::vector<std::string> &options);
+
         std::optional<std::string> source;
         std::optional<std::filesystem::path> destination;
         std::string type;
-        unsigned long flags;
-        unsigned long propagation_flags;
+        unsigned long flags = 0;
+        unsigned long propagation_flags = 0;
         std::string data;
     };
 
@@ -149,6 +200,9 @@ struct config
     };
 
     root_t root;
+
+    // Annotations of other types than string are skipped with a warning.
+    std::map<std::string, std::string> annotations;
 };
 
 } // namespace linyaps_box
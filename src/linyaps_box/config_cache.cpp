@@ -0,0 +1,707 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/config_cache.h"
+
+#include "linyaps_box/utils/atomic_write.h"
+#include "linyaps_box/utils/digest.h"
+#include "linyaps_box/utils/file_describer.h"
+#include "linyaps_box/utils/log.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char magic[8] = { 'L', 'L', 'B', 'O', 'X', 'C', 'F', 'G' };
+
+// NOTE: Bump it on any change of linyaps_box::config or of the encoding below,
+// or if configurations are parsed differently.
+constexpr std::uint32_t format_version = 3;
+
+constexpr auto extension = ".bin";
+
+// Entries beyond it are evicted, the oldest first.
+constexpr std::size_t max_entries = 64;
+
+// All integers are in the byte order of the host, entries are not shared between hosts.
+struct header_t
+{
+    char magic[8];
+    std::uint32_t version;
+    // A cheap guard against entries of a runtime with another layout of config.
+    std::uint32_t config_size;
+    std::uint64_t source_size;
+    std::uint64_t payload_size;
+    std::uint64_t checksum;
+};
+
+class writer
+{
+public:
+    void integer(std::uint64_t value) { this->bytes(&value, sizeof(value)); }
+
+    void boolean(bool value) { this->integer(value ? 1 : 0); }
+
+    void string(std::string_view value)
+    {
+        this->integer(value.size());
+        this->bytes(value.data(), value.size());
+    }
+
+    void strings(const std::vector<std::string> &values)
+    {
+        this->integer(values.size());
+        for (const auto &value : values) {
+            this->string(value);
+        }
+    }
+
+    void map(const std::map<std::string, std::string> &values)
+    {
+        this->integer(values.size());
+        for (const auto &[key, value] : values) {
+            this->string(key);
+            this->string(value);
+        }
+    }
+
+    template<typename T>
+    void optional_integer(const std::optional<T> &value)
+    {
+        this->boolean(value.has_value());
+        if (value) {
+            this->integer(static_cast<std::uint64_t>(*value));
+        }
+    }
+
+    void optional_string(const std::optional<std::string> &value)
+    {
+        this->boolean(value.has_value());
+        if (value) {
+            this->string(*value);
+        }
+    }
+
+    void bytes(const void *data, std::size_t size)
+    {
+        this->buffer.append(static_cast<const char *>(data), size);
+    }
+
+    [[nodiscard]] std::string &data() { return this->buffer; }
+
+private:
+    std::string buffer;
+};
+
+// Every read is checked against the end of the entry, which might be truncated or corrupted.
+class reader
+{
+public:
+    reader(const char *begin, const char *end)
+        : cur(begin)
+        , end(end)
+    {
+    }
+
+    [[nodiscard]] std::uint64_t integer()
+    {
+        std::uint64_t value = 0;
+        std::memcpy(&value, this->take(sizeof(value)), sizeof(value));
+        return value;
+    }
+
+    [[nodiscard]] bool boolean() { return this->integer() != 0; }
+
+    [[nodiscard]] std::string string()
+    {
+        auto size = this->integer();
+        const auto *data = this->take(size);
+        return { data, static_cast<std::size_t>(size) };
+    }
+
+    [[nodiscard]] std::vector<std::string> strings()
+    {
+        std::vector<std::string> values(this->count());
+        for (auto &value : values) {
+            value = this->string();
+        }
+        return values;
+    }
+
+    [[nodiscard]] std::map<std::string, std::string> map()
+    {
+        std::map<std::string, std::string> values;
+        for (auto n = this->count(); n > 0; --n) {
+            auto key = this->string();
+            values.emplace_hint(values.end(), std::move(key), this->string());
+        }
+        return values;
+    }
+
+    template<typename T>
+    [[nodiscard]] std::optional<T> optional_integer()
+    {
+        if (!this->boolean()) {
+            return std::nullopt;
+        }
+        return static_cast<T>(this->integer());
+    }
+
+    [[nodiscard]] std::optional<std::string> optional_string()
+    {
+        if (!this->boolean()) {
+            return std::nullopt;
+        }
+        return this->string();
+    }
+
+    // The number of elements of a sequence, each of which takes 8 bytes at least,
+    // so a corrupted count never allocates more than the entry.
+    [[nodiscard]] std::size_t count()
+    {
+        auto n = this->integer();
+        if (n > static_cast<std::uint64_t>(this->end - this->cur) / sizeof(std::uint64_t)) {
+            throw std::runtime_error("invalid count");
+        }
+        return static_cast<std::size_t>(n);
+    }
+
+    const char *take(std::uint64_t size)
+    {
+        if (size > static_cast<std::uint64_t>(this->end - this->cur)) {
+            throw std::runtime_error("truncated");
+        }
+        const auto *data = this->cur;
+        this->cur += size;
+        return data;
+    }
+
+    [[nodiscard]] bool done() const { return this->cur == this->end; }
+
+private:
+    const char *cur;
+    const char *end;
+};
+
+void write_hooks(writer &w, const std::vector<linyaps_box::config::hooks_t::hook_t> &hooks)
+{
+    w.integer(hooks.size());
+    for (const auto &hook : hooks) {
+        w.string(hook.path.native());
+        w.strings(hook.args);
+        w.map(hook.env);
+        w.optional_integer(hook.timeout);
+        w.optional_string(hook.entry);
+    }
+}
+
+[[nodiscard]] std::vector<linyaps_box::config::hooks_t::hook_t> read_hooks(reader &r)
+{
+    std::vector<linyaps_box::config::hooks_t::hook_t> hooks(r.count());
+    for (auto &hook : hooks) {
+        hook.path = r.string();
+        hook.args = r.strings();
+        hook.env = r.map();
+        hook.timeout = r.optional_integer<int>();
+        hook.entry = r.optional_string();
+    }
+    return hooks;
+}
+
+void write_mappings(writer &w, const std::vector<linyaps_box::config::id_mapping_t> &mappings)
+{
+    w.integer(mappings.size());
+    for (const auto &mapping : mappings) {
+        w.integer(mapping.host_id);
+        w.integer(mapping.container_id);
+        w.integer(mapping.size);
+    }
+}
+
+[[nodiscard]] std::vector<linyaps_box::config::id_mapping_t> read_mappings(reader &r)
+{
+    std::vector<linyaps_box::config::id_mapping_t> mappings(r.count());
+    for (auto &mapping : mappings) {
+        mapping.host_id = static_cast<uid_t>(r.integer());
+        mapping.container_id = static_cast<uid_t>(r.integer());
+        mapping.size = static_cast<size_t>(r.integer());
+    }
+    return mappings;
+}
+
+void write_seccomp(writer &w, const linyaps_box::config::seccomp_t &seccomp)
+{
+    w.string(seccomp.default_action);
+    w.optional_integer(seccomp.default_errno_ret);
+    w.strings(seccomp.architectures);
+    w.strings(seccomp.flags);
+
+    w.integer(seccomp.syscalls.size());
+    for (const auto &syscall : seccomp.syscalls) {
+        w.strings(syscall.names);
+        w.string(syscall.action);
+        w.optional_integer(syscall.errno_ret);
+        w.integer(syscall.args.size());
+        for (const auto &arg : syscall.args) {
+            w.integer(arg.index);
+            w.integer(arg.value);
+            w.integer(arg.value_two);
+            w.string(arg.op);
+        }
+    }
+}
+
+[[nodiscard]] linyaps_box::config::seccomp_t read_seccomp(reader &r)
+{
+    linyaps_box::config::seccomp_t seccomp;
+    seccomp.default_action = r.string();
+    seccomp.default_errno_ret = r.optional_integer<uint>();
+    seccomp.architectures = r.strings();
+    seccomp.flags = r.strings();
+
+    seccomp.syscalls.resize(r.count());
+    for (auto &syscall : seccomp.syscalls) {
+        syscall.names = r.strings();
+        syscall.action = r.string();
+        syscall.errno_ret = r.optional_integer<uint>();
+        syscall.args.resize(r.count());
+        for (auto &arg : syscall.args) {
+            arg.index = static_cast<uint>(r.integer());
+            arg.value = r.integer();
+            arg.value_two = r.integer();
+            arg.op = r.string();
+        }
+    }
+    return seccomp;
+}
+
+void write_config(writer &w, const linyaps_box::config &config)
+{
+    const auto &process = config.process;
+    w.boolean(process.terminal);
+    w.integer(process.console.height);
+    w.integer(process.console.width);
+    w.string(process.cwd.native());
+    w.map(process.env);
+    w.strings(process.args);
+
+    w.boolean(process.rlimits.has_value());
+    if (process.rlimits) {
+        w.bytes(&*process.rlimits, sizeof(*process.rlimits));
+    }
+    w.optional_string(process.apparmor_profile);
+
+    const auto &capabilities = process.capabilities;
+    for (const auto *value : { &capabilities.effective,
+                               &capabilities.bounding,
+                               &capabilities.inheritable,
+                               &capabilities.permitted,
+                               &capabilities.ambient }) {
+        w.optional_integer(*value);
+    }
+
+    w.boolean(process.no_new_privileges);
+    w.optional_integer(process.oom_score_adj);
+    w.integer(process.uid);
+    w.integer(process.gid);
+    w.optional_integer(process.umask);
+    w.boolean(process.additional_gids.has_value());
+    if (process.additional_gids) {
+        w.integer(process.additional_gids->size());
+        for (auto gid : *process.additional_gids) {
+            w.integer(gid);
+        }
+    }
+
+    w.integer(config.namespaces.size());
+    for (const auto &ns : config.namespaces) {
+        w.integer(ns.type);
+        w.string(ns.path.native());
+    }
+
+    write_mappings(w, config.uid_mappings);
+    write_mappings(w, config.gid_mappings);
+
+    w.boolean(config.seccomp.has_value());
+    if (config.seccomp) {
+        write_seccomp(w, *config.seccomp);
+    }
+
+    w.map(config.sysctl);
+
+    for (const auto *hooks : { &config.hooks.prestart,
+                               &config.hooks.create_runtime,
+                               &config.hooks.create_container,
+                               &config.hooks.start_container,
+                               &config.hooks.poststart,
+                               &config.hooks.poststop }) {
+        write_hooks(w, *hooks);
+    }
+
+    w.integer(config.mounts.size());
+    for (const auto &mount : config.mounts) {
+        w.optional_string(mount.source);
+        w.boolean(mount.destination.has_value());
+        if (mount.destination) {
+            w.string(mount.destination->native());
+        }
+        w.string(mount.type);
+        w.integer(mount.flags);
+        w.integer(mount.propagation_flags);
+        w.string(mount.data);
+    }
+
+    w.string(config.root.path.native());
+    w.boolean(config.root.readonly);
+
+    w.map(config.annotations);
+}
+
+[[nodiscard]] linyaps_box::config read_config(reader &r)
+{
+    linyaps_box::config config;
+
+    auto &process = config.process;
+    process.terminal = r.boolean();
+    process.console.height = static_cast<uint>(r.integer());
+    process.console.width = static_cast<uint>(r.integer());
+    process.cwd = r.string();
+    process.env = r.map();
+    process.args = r.strings();
+
+    if (r.boolean()) {
+        process.rlimits.emplace();
+        std::memcpy(&*process.rlimits, r.take(sizeof(*process.rlimits)), sizeof(*process.rlimits));
+    }
+    process.apparmor_profile = r.optional_string();
+
+    auto &capabilities = process.capabilities;
+    for (auto *value : { &capabilities.effective,
+                         &capabilities.bounding,
+                         &capabilities.inheritable,
+                         &capabilities.permitted,
+                         &capabilities.ambient }) {
+        *value = r.optional_integer<int>();
+    }
+
+    process.no_new_privileges = r.boolean();
+    process.oom_score_adj = r.optional_integer<int>();
+    process.uid = static_cast<uid_t>(r.integer());
+    process.gid = static_cast<gid_t>(r.integer());
+    process.umask = r.optional_integer<mode_t>();
+    if (r.boolean()) {
+        process.additional_gids.emplace(r.count());
+        for (auto &gid : *process.additional_gids) {
+            gid = static_cast<gid_t>(r.integer());
+        }
+    }
+
+    config.namespaces.resize(r.count());
+    for (auto &ns : config.namespaces) {
+        ns.type = static_cast<linyaps_box::config::namespace_t::type_t>(r.integer());
+        ns.path = r.string();
+    }
+
+    config.uid_mappings = read_mappings(r);
+    config.gid_mappings = read_mappings(r);
+
+    if (r.boolean()) {
+        config.seccomp = read_seccomp(r);
+    }
+
+    config.sysctl = r.map();
+
+    for (auto *hooks : { &config.hooks.prestart,
+                         &config.hooks.create_runtime,
+                         &config.hooks.create_container,
+                         &config.hooks.start_container,
+                         &config.hooks.poststart,
+                         &config.hooks.poststop }) {
+        *hooks = read_hooks(r);
+    }
+
+    config.mounts.resize(r.count());
+    for (auto &mount : config.mounts) {
+        mount.source = r.optional_string();
+        if (r.boolean()) {
+            mount.destination = r.string();
+        }
+        mount.type = r.string();
+        mount.flags = static_cast<unsigned long>(r.integer());
+        mount.propagation_flags = static_cast<unsigned long>(r.integer());
+        mount.data = r.string();
+    }
+
+    config.root.path = r.string();
+    config.root.readonly = r.boolean();
+
+    config.annotations = r.map();
+
+    return config;
+}
+
+// The content of a configuration, mapped if it can not be changed, otherwise read.
+class source_t
+{
+public:
+    source_t(int fd, const std::string &name)
+    {
+        struct stat st{};
+        if (::fstat(fd, &st)) {
+            throw std::system_error(errno, std::generic_category(), "fstat " + name);
+        }
+
+        if (!S_ISREG(st.st_mode)) {
+            this->read(fd, name, false);
+            return;
+        }
+
+        // NOTE: A memfd sealed against writing and shrinking can not change under the mapping,
+        // other files are read, as a truncated file raises SIGBUS on access.
+        constexpr auto seals = F_SEAL_WRITE | F_SEAL_SHRINK;
+        auto ret = ::fcntl(fd, F_GET_SEALS);
+        if (ret < 0 || (ret & seals) != seals || st.st_size == 0) {
+            this->read(fd, name, true);
+            return;
+        }
+
+        auto size = static_cast<std::size_t>(st.st_size);
+        auto *addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "mmap " + name);
+        }
+
+        this->addr = addr;
+        this->size = size;
+    }
+
+    source_t(const source_t &) = delete;
+    source_t &operator=(const source_t &) = delete;
+    source_t(source_t &&) = delete;
+    source_t &operator=(source_t &&) = delete;
+
+    ~source_t()
+    {
+        if (this->addr != nullptr) {
+            ::munmap(this->addr, this->size);
+        }
+    }
+
+    [[nodiscard]] std::string_view view() const
+    {
+        if (this->addr != nullptr) {
+            return { static_cast<const char *>(this->addr), this->size };
+        }
+        return this->buffer;
+    }
+
+private:
+    // Regular files are read from the beginning, others from the current offset.
+    void read(int fd, const std::string &name, bool regular)
+    {
+        char buffer[16384];
+        off_t offset = 0;
+        while (true) {
+            auto n = regular ? ::pread(fd, buffer, sizeof(buffer), offset)
+                             : ::read(fd, buffer, sizeof(buffer));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "read " + name);
+            }
+            if (n == 0) {
+                break;
+            }
+            this->buffer.append(buffer, static_cast<std::size_t>(n));
+            offset += n;
+        }
+    }
+
+    void *addr = nullptr;
+    std::size_t size = 0;
+    std::string buffer;
+};
+
+// Returns std::nullopt if the entry does not exist or is invalid, the latter is removed.
+[[nodiscard]] std::optional<linyaps_box::config> read_entry(const std::filesystem::path &entry,
+                                                            std::string_view source)
+{
+    auto fd = ::open(entry.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            LINYAPS_BOX_WARNING() << "Failed to open config cache " << entry << ": "
+                                  << std::strerror(errno);
+        }
+        return std::nullopt;
+    }
+
+    struct stat st{};
+    void *addr = MAP_FAILED;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        addr = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+
+    std::optional<linyaps_box::config> result;
+    if (addr != MAP_FAILED) {
+        result = linyaps_box::config_cache::decode(addr,
+                                                   static_cast<std::size_t>(st.st_size),
+                                                   source);
+        ::munmap(addr, static_cast<std::size_t>(st.st_size));
+    }
+
+    if (!result) {
+        LINYAPS_BOX_WARNING() << "Remove invalid config cache " << entry;
+        std::error_code ec;
+        std::filesystem::remove(entry, ec);
+    }
+
+    return result;
+}
+
+void evict(const std::filesystem::path &cache)
+{
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> entries;
+    for (const auto &entry : std::filesystem::directory_iterator(cache)) {
+        if (entry.path().extension() == extension) {
+            entries.emplace_back(entry.last_write_time(), entry.path());
+        }
+    }
+
+    if (entries.size() <= max_entries) {
+        return;
+    }
+
+    std::sort(entries.begin(), entries.end());
+    for (std::size_t i = 0; i < entries.size() - max_entries; ++i) {
+        std::error_code ec;
+        std::filesystem::remove(entries[i].second, ec);
+    }
+}
+
+[[nodiscard]] linyaps_box::config load_source(const std::filesystem::path &cache,
+                                              std::string_view source,
+                                              const std::string &name)
+{
+    linyaps_box::utils::digest key;
+    key.update(source.data(), source.size());
+    auto entry = cache / (key.hex() + extension);
+
+    if (auto config = read_entry(entry, source)) {
+        LINYAPS_BOX_DEBUG() << "Load " << name << " from config cache " << entry;
+        return std::move(*config);
+    }
+
+    auto config = linyaps_box::config::parse(source);
+
+    try {
+        std::filesystem::create_directories(cache);
+        linyaps_box::utils::atomic_write(entry, linyaps_box::config_cache::compile(config, source));
+        evict(cache);
+    } catch (const std::exception &e) {
+        LINYAPS_BOX_WARNING() << "Failed to write config cache " << entry << ": " << e.what();
+    }
+
+    return config;
+}
+
+} // namespace
+
+std::string linyaps_box::config_cache::compile(const config &config, std::string_view source)
+{
+    writer payload;
+    write_config(payload, config);
+
+    utils::digest checksum;
+    checksum.update(source.data(), source.size());
+    checksum.update(payload.data().data(), payload.data().size());
+
+    header_t header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = format_version;
+    header.config_size = sizeof(linyaps_box::config);
+    header.source_size = source.size();
+    header.payload_size = payload.data().size();
+    header.checksum = checksum.sum();
+
+    writer w;
+    w.bytes(&header, sizeof(header));
+    w.bytes(source.data(), source.size());
+    w.bytes(payload.data().data(), payload.data().size());
+    return std::move(w.data());
+}
+
+std::optional<linyaps_box::config>
+linyaps_box::config_cache::decode(const void *data, std::size_t size, std::string_view source)
+try {
+    reader r(static_cast<const char *>(data), static_cast<const char *>(data) + size);
+
+    header_t header{};
+    std::memcpy(&header, r.take(sizeof(header)), sizeof(header));
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != format_version
+        || header.config_size != sizeof(linyaps_box::config)
+        || header.source_size != source.size()) {
+        return std::nullopt;
+    }
+
+    // NOTE: Digests might collide, the content is compared as well.
+    const auto *cached_source = r.take(header.source_size);
+    if (std::memcmp(cached_source, source.data(), source.size()) != 0) {
+        return std::nullopt;
+    }
+
+    const auto *payload = r.take(header.payload_size);
+    if (!r.done()) {
+        return std::nullopt;
+    }
+
+    utils::digest checksum;
+    checksum.update(cached_source, header.source_size);
+    checksum.update(payload, header.payload_size);
+    if (checksum.sum() != header.checksum) {
+        return std::nullopt;
+    }
+
+    reader payload_reader(payload, payload + header.payload_size);
+    auto config = read_config(payload_reader);
+    if (!payload_reader.done()) {
+        return std::nullopt;
+    }
+
+    return config;
+} catch (const std::exception &e) {
+    LINYAPS_BOX_DEBUG() << "Invalid config cache entry: " << e.what();
+    return std::nullopt;
+}
+
+linyaps_box::config linyaps_box::config_cache::load(const std::filesystem::path &cache,
+                                                    const std::filesystem::path &path)
+{
+    utils::file_descriptor fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd.get() < 0) {
+        throw std::system_error(errno, std::generic_category(), "open " + path.string());
+    }
+
+    source_t source(fd.get(), path.string());
+    fd = utils::file_descriptor();
+    return load_source(cache, source.view(), path.string());
+}
+
+linyaps_box::config linyaps_box::config_cache::load(const std::filesystem::path &cache, int fd)
+{
+    auto name = "fd " + std::to_string(fd);
+    source_t source(fd, name);
+    return load_source(cache, source.view(), name);
+}
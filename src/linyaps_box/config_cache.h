@@ -0,0 +1,44 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/config.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// A cache of compiled configurations, for launchers writing the same config.json
+// on every launch of an application.
+//
+// An entry is named by the digest of the content of config.json,
+// and holds a copy of the content followed by the parsed configuration
+// in a binary form without pointers, with mount options resolved to flags.
+// A hit maps the entry and decodes it, without parsing JSON.
+//
+// Entries are checked against the format version, the content they are compiled from
+// and a checksum, entries failing any check are removed and the configuration is parsed again.
+
+namespace linyaps_box::config_cache {
+
+// Load the configuration at `path`, from the entry in `cache` if any,
+// otherwise it is parsed and stored to `cache`, failures of which are logged only.
+[[nodiscard]] config load(const std::filesystem::path &cache, const std::filesystem::path &path);
+
+// Same as load, reading the configuration from `fd` to the end, or all of a regular file.
+// A memfd sealed against writing and shrinking is mapped instead, without a copy.
+[[nodiscard]] config load(const std::filesystem::path &cache, int fd);
+
+// The entry of `config` parsed from `source`.
+[[nodiscard]] std::string compile(const config &config, std::string_view source);
+
+// Decode the entry of `size` bytes at `data`,
+// returns std::nullopt if it is invalid or not compiled from `source`.
+[[nodiscard]] std::optional<config>
+decode(const void *data, std::size_t size, std::string_view source);
+
+} // namespace linyaps_box::config_cache
@@ -4,6 +4,18 @@
 
 #include "linyaps_box/container.h"
 
+#include "linyaps_box/agent.h"
+#include "linyaps_box/config_cache.h"
+#include "linyaps_box/events.h"
+#include "linyaps_box/exec_policy.h"
+#include "linyaps_box/features.h"
+#include "linyaps_box/hook_cache.h"
+#include "linyaps_box/init.h"
+#include "linyaps_box/plugin_loader.h"
+#include "linyaps_box/process.h"
+#include "linyaps_box/seccomp.h"
+#include "linyaps_box/sysctl.h"
+#include "linyaps_box/utils/epoll.h"
 #include "linyaps_box/utils/file_describer.h"
 #include "linyaps_box/utils/fstat.h"
 #include "linyaps_box/utils/inspect.h"
@@ -11,7 +23,10 @@
 #include "linyaps_box/utils/mkdir.h"
 #include "linyaps_box/utils/mknod.h"
 #include "linyaps_box/utils/open_file.h"
+#include "linyaps_box/utils/pidfd.h"
+#include "linyaps_box/utils/signalfd.h"
 #include "linyaps_box/utils/socketpair.h"
+#include "linyaps_box/utils/start_time.h"
 #include "linyaps_box/utils/touch.h"
 
 #include <linux/magic.h>
@@ -20,21 +35,39 @@
 #include <sys/syscall.h> /* Definition of SYS_* constants */
 #include <sys/sysmacros.h>
 
+#include <algorithm>
 #include <cassert>
-#include <fstream>
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <set>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 
 #include <dirent.h>
-#include <grp.h>
 #include <signal.h>
 #include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#ifndef OPEN_TREE_CLONE
+#define OPEN_TREE_CLONE 1
+#endif
+#ifndef OPEN_TREE_CLOEXEC
+#define OPEN_TREE_CLOEXEC O_CLOEXEC
+#endif
+#ifndef MOVE_MOUNT_F_EMPTY_PATH
+#define MOVE_MOUNT_F_EMPTY_PATH 0x00000004
+#endif
+#ifndef MOVE_MOUNT_T_EMPTY_PATH
+#define MOVE_MOUNT_T_EMPTY_PATH 0x00000040
+#endif
+#ifndef AT_RECURSIVE
+#define AT_RECURSIVE 0x8000
+#endif
+
 namespace {
 
 enum class sync_message : uint8_t {
@@ -86,8 +119,21 @@ public:
     }
 };
 
-static void execute_hook(const linyaps_box::config::hooks_t::hook_t &hook)
+// NOTE: The runtime blocks signals it handles by signalfd,
+// processes forked by ll-box should not inherit that mask.
+static void reset_signal_mask()
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    if (sigprocmask(SIG_SETMASK, &mask, nullptr)) {
+        throw std::system_error(errno, std::generic_category(), "sigprocmask");
+    }
+}
+
+[[nodiscard]] static pid_t spawn_hook(const linyaps_box::config::hooks_t::hook_t &hook)
 {
+    LINYAPS_BOX_DEBUG() << "Spawn hook " << hook.path;
+
     auto pid = fork();
     if (pid < 0) {
         throw std::system_error(errno, std::generic_category(), "fork");
@@ -95,11 +141,15 @@ static void execute_hook(const linyaps_box::config::hooks_t::hook_t &hook)
 
     if (pid == 0) {
         [&]() noexcept {
+            // NOTE: `args` of hook has the same semantics as argv of execv(3),
+            // which contains argv[0].
             std::vector<const char *> c_args;
-            c_args.push_back(hook.path.c_str());
             for (const auto &arg : hook.args) {
                 c_args.push_back(arg.c_str());
             }
+            if (c_args.empty()) {
+                c_args.push_back(hook.path.c_str());
+            }
             c_args.push_back(nullptr);
 
             std::vector<std::string> envs;
@@ -111,39 +161,110 @@ static void execute_hook(const linyaps_box::config::hooks_t::hook_t &hook)
             for (const auto &env : envs) {
                 c_env.push_back(env.c_str());
             }
+            c_env.push_back(nullptr);
+
+            try {
+                reset_signal_mask();
+            } catch (const std::exception &e) {
+                std::cerr << e.what() << std::endl;
+                _exit(1);
+            }
 
-            execvpe(c_args[0],
-                    const_cast<char *const *>(c_args.data()),
-                    const_cast<char *const *>(c_env.data()));
+            // NOTE: Paths of hooks are absolute, checked by resolve_hooks.
+            execve(hook.path.c_str(),
+                   const_cast<char *const *>(c_args.data()),
+                   const_cast<char *const *>(c_env.data()));
 
-            std::cerr << "execvp: " << strerror(errno) << " errno=" << errno << std::endl;
-            exit(1);
+            std::cerr << "execve: " << strerror(errno) << " errno=" << errno << std::endl;
+            _exit(1);
         }();
     }
 
-    int status = 0;
+    return pid;
+}
 
-    pid_t ret = -1;
-    while (ret == -1) {
-        ret = waitpid(pid, &status, 0);
-        if (ret != -1) {
-            break;
-        }
-        if (errno == EINTR && errno == EAGAIN) {
+[[nodiscard]] static linyaps_box::plugin::entries_t
+load_plugins(const linyaps_box::container &container)
+{
+    auto directory = container.get_options().plugin_dir;
+    if (directory.empty()) {
+        directory = linyaps_box::plugin::default_directory();
+    }
+
+    return linyaps_box::plugin::load(container.get_config(), directory);
+}
+
+static void check_hook_result(const linyaps_box::config::hooks_t::hook_t &hook,
+                              const siginfo_t &info)
+{
+    if (info.si_code == CLD_EXITED && info.si_status == 0) {
+        return;
+    }
+
+    std::stringstream message;
+    message << "hook " << hook.path;
+    if (info.si_code == CLD_EXITED) {
+        message << " exited with " << info.si_status;
+    } else {
+        message << " terminated by signal " << info.si_status;
+    }
+
+    throw std::runtime_error(std::move(message).str());
+}
+
+[[nodiscard]] static siginfo_t wait_process(pid_t pid)
+{
+    siginfo_t info{};
+    while (::waitid(P_PID, pid, &info, WEXITED) < 0) {
+        if (errno == EINTR) {
             continue;
         }
         throw std::system_error(errno,
                                 std::generic_category(),
-                                (std::stringstream() << "waitpid " << pid).str());
+                                (std::stringstream() << "waitid " << pid).str());
     }
+    return info;
+}
 
-    if (WIFEXITED(status)) {
-        return;
+// Wait `pid` for at most `timeout` seconds, it will be killed after that.
+// Returns false if the process was killed because of timeout.
+[[nodiscard]] static bool wait_process_with_timeout(pid_t pid,
+                                                    int timeout,
+                                                    const linyaps_box::features::set_t &features)
+{
+    if (!features.has(linyaps_box::features::pidfd)) {
+        LINYAPS_BOX_WARNING() << "pidfd is not supported, hook timeout is ignored";
+        return true;
+    }
+
+    auto pidfd = linyaps_box::utils::pidfd_open(pid);
+
+    linyaps_box::utils::epoll epoll;
+    epoll.add(pidfd, EPOLLIN);
+    if (!epoll.wait(std::chrono::steady_clock::now() + std::chrono::seconds(timeout)).empty()) {
+        return true;
+    }
+
+    if (::kill(pid, SIGKILL) && errno != ESRCH) {
+        throw std::system_error(errno, std::generic_category(), "kill");
+    }
+    return false;
+}
+
+static void execute_hook(const linyaps_box::config::hooks_t::hook_t &hook,
+                         const linyaps_box::features::set_t &features)
+{
+    auto pid = spawn_hook(hook);
+
+    if (hook.timeout && !wait_process_with_timeout(pid, *hook.timeout, features)) {
+        [[maybe_unused]] auto info = wait_process(pid);
+        throw std::runtime_error((std::stringstream()
+                                  << "hook " << hook.path << " timed out after "
+                                  << *hook.timeout << " seconds")
+                                         .str());
     }
 
-    throw std::runtime_error((std::stringstream() << "hook terminated by signal" << WTERMSIG(status)
-                                                  << " with " << WEXITSTATUS(status))
-                                     .str());
+    check_hook_result(hook, wait_process(pid));
 }
 
 struct clone_fn_args
@@ -151,8 +272,65 @@ struct clone_fn_args
     const linyaps_box::container *container;
     const linyaps_box::config::process_t *process;
     linyaps_box::utils::file_descriptor socket;
+    int control_socket;
+    const linyaps_box::features::set_t *features;
+
+    // Mount the root filesystem of `options.rootfs_fd` in a new mount namespace
+    // unshared in the container process, see enter_rootfs.
+    bool unshare_mount = false;
+    // Detached mount trees of `fd:N` bind mount sources, in the order of mounts,
+    // or -1 for other mounts.
+    std::vector<linyaps_box::utils::file_descriptor> mount_trees;
+    // File descriptors inherited from the caller, closed after pivot_root(2).
+    std::set<unsigned int> inherited_fds;
+
+    // The root filesystem in the container mount namespace if `options.rootfs_fd` is set.
+    linyaps_box::utils::file_descriptor rootfs;
+
+    // Memoized hooks and the cache directory opened in the runtime namespace,
+    // which is not reachable by path after pivot_root(2), see linyaps_box::hook_cache.
+    linyaps_box::hook_cache::declarations_t memoized_hooks;
+    linyaps_box::utils::file_descriptor hook_cache;
+
+    // Entries of plugin hooks loaded before clone(2), see linyaps_box/plugin.h.
+    linyaps_box::plugin::entries_t plugins;
+
+    // The user, no_new_privileges and the filter of linux.seccomp of the container process,
+    // compiled or loaded from the cache before clone(2), see linyaps_box::exec_policy.
+    linyaps_box::exec_policy::policy_t exec_policy;
 };
 
+[[nodiscard]] static linyaps_box::utils::file_descriptor duplicate_fd(int fd)
+{
+    auto ret = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (ret < 0) {
+        throw std::system_error(errno, std::generic_category(), "fcntl F_DUPFD_CLOEXEC");
+    }
+    return linyaps_box::utils::file_descriptor(ret);
+}
+
+// A bind mount source `fd:N` refers to the file descriptor N inherited from the caller.
+[[nodiscard]] static std::optional<int> inherited_source_fd(const std::filesystem::path &source)
+{
+    const auto &value = source.native();
+    if (value.rfind("fd:", 0) != 0) {
+        return std::nullopt;
+    }
+
+    std::size_t pos = 0;
+    int fd = -1;
+    try {
+        fd = std::stoi(value.substr(3), &pos);
+    } catch (const std::exception &) {
+        pos = 0;
+    }
+    if (pos == 0 || pos != value.size() - 3 || fd < 0) {
+        throw std::invalid_argument("invalid mount source " + value);
+    }
+
+    return fd;
+}
+
 // NOTE: All function in this namespace are running in the container namespace.
 namespace container_ns {
 
@@ -380,7 +558,8 @@ static void do_propagation_mount(const linyaps_box::utils::file_descriptor &dest
 }
 
 static void do_bind_mount(const linyaps_box::utils::file_descriptor &root,
-                          const linyaps_box::config::mount_t &mount)
+                          const linyaps_box::config::mount_t &mount,
+                          linyaps_box::utils::file_descriptor tree)
 {
     assert(mount.flags & MS_BIND);
     assert(mount.source.has_value());
@@ -393,7 +572,15 @@ static void do_bind_mount(const linyaps_box::utils::file_descriptor &root,
     if (mount.flags & MS_NOSYMFOLLOW) {
         open_flag |= O_NOFOLLOW;
     }
-    auto source_fd = linyaps_box::utils::open(mount.source.value(), open_flag);
+    bool detached = tree.get() >= 0;
+    linyaps_box::utils::file_descriptor source_fd;
+    if (detached) {
+        source_fd = std::move(tree);
+    } else {
+        // NOTE: `fd:N` sources are always detached, see prepare_inherited_fds.
+        assert(!inherited_source_fd(mount.source.value()));
+        source_fd = linyaps_box::utils::open(mount.source.value(), open_flag);
+    }
     auto source_stat = linyaps_box::utils::lstat(source_fd);
 
     linyaps_box::utils::file_descriptor destination_fd;
@@ -406,11 +593,24 @@ static void do_bind_mount(const linyaps_box::utils::file_descriptor &root,
 
     auto bind_flags = mount.flags & (MS_BIND | MS_REC);
 
-    system_call_mount(source_fd.proc_path().c_str(),
-                      destination_fd.proc_path().c_str(),
-                      nullptr,
-                      bind_flags,
-                      nullptr);
+    if (detached) {
+        LINYAPS_BOX_DEBUG() << "Attach mount tree of " << mount.source.value();
+        auto ret = ::syscall(SYS_move_mount,
+                             source_fd.get(),
+                             "",
+                             destination_fd.get(),
+                             "",
+                             MOVE_MOUNT_F_EMPTY_PATH | MOVE_MOUNT_T_EMPTY_PATH);
+        if (ret < 0) {
+            throw std::system_error(errno, std::generic_category(), "move_mount");
+        }
+    } else {
+        system_call_mount(source_fd.proc_path().c_str(),
+                          destination_fd.proc_path().c_str(),
+                          nullptr,
+                          bind_flags,
+                          nullptr);
+    }
 
     if (S_ISDIR(source_stat.st_mode)) {
         destination_fd = ensure_mount_destination(root, mount);
@@ -430,10 +630,12 @@ static void do_bind_mount(const linyaps_box::utils::file_descriptor &root,
 }
 
 [[nodiscard]] static std::optional<delay_readonly_mount_t>
-do_mount(const linyaps_box::utils::file_descriptor &root, const linyaps_box::config::mount_t &mount)
+do_mount(const linyaps_box::utils::file_descriptor &root,
+         const linyaps_box::config::mount_t &mount,
+         linyaps_box::utils::file_descriptor tree)
 {
     if (mount.flags & MS_BIND) {
-        do_bind_mount(root, mount);
+        do_bind_mount(root, mount, std::move(tree));
         return std::nullopt;
     }
 
@@ -506,14 +708,16 @@ bool directory_is_empty(const std::filesystem::path &path)
 class mounter
 {
 public:
-    mounter(linyaps_box::utils::file_descriptor root)
+    mounter(linyaps_box::utils::file_descriptor root, bool mount_sysfs)
         : root(std::move(root))
+        , mount_sysfs(mount_sysfs)
     {
     }
 
-    void mount(const linyaps_box::config::mount_t &mount)
+    void mount(const linyaps_box::config::mount_t &mount,
+               linyaps_box::utils::file_descriptor tree = {})
     {
-        auto delay_mount = do_mount(root, mount);
+        auto delay_mount = do_mount(root, mount, std::move(tree));
         if (!delay_mount.has_value()) {
             return;
         }
@@ -532,6 +736,7 @@ public:
 
 private:
     linyaps_box::utils::file_descriptor root;
+    bool mount_sysfs;
     std::vector<delay_readonly_mount_t> remounts;
 
     // https://github.com/opencontainers/runtime-spec/blob/09fcb39bb7185b46dfb206bc8f3fea914c674779/config-linux.md#default-filesystems
@@ -573,20 +778,23 @@ private:
             mount.type = "sysfs";
             mount.destination = "/sys";
             mount.flags = MS_NOSUID | MS_NOEXEC | MS_NODEV;
-            try {
-                this->mount(mount);
-            } catch (const std::system_error &e) {
-                if (e.code().value() != EPERM) {
-                    throw;
+            if (this->mount_sysfs) {
+                try {
+                    this->mount(mount);
+                    break;
+                } catch (const std::system_error &e) {
+                    if (e.code().value() != EPERM) {
+                        throw;
+                    }
                 }
-
-                // NOTE: fallback to bind mount
-                mount.source = "/sys";
-                mount.type = "bind";
-                mount.destination = "/sys";
-                mount.flags = MS_BIND | MS_REC | MS_NOSUID | MS_NOEXEC | MS_NODEV;
-                this->mount(mount);
             }
+
+            // NOTE: fallback to bind mount
+            mount.source = "/sys";
+            mount.type = "bind";
+            mount.destination = "/sys";
+            mount.flags = MS_BIND | MS_REC | MS_NOSUID | MS_NOEXEC | MS_NODEV;
+            this->mount(mount);
         } while (0);
 
         do {
@@ -705,7 +913,28 @@ private:
     }
 };
 
-static void configure_mounts(const linyaps_box::container &container)
+// NOTE: sysfs can not be mounted in a user namespace
+// without a network namespace owned by it, or if the kernel does not allow that.
+[[nodiscard]] static bool can_mount_sysfs(const linyaps_box::container &container,
+                                          const linyaps_box::features::set_t &features)
+{
+    bool user = false;
+    bool net = false;
+    for (const auto &ns : container.get_config().namespaces) {
+        if (ns.type == linyaps_box::config::namespace_t::USER) {
+            user = true;
+        } else if (ns.type == linyaps_box::config::namespace_t::NET && ns.path.empty()) {
+            net = true;
+        }
+    }
+
+    if (!user) {
+        return true;
+    }
+    return net && features.has(linyaps_box::features::unprivileged_sysfs);
+}
+
+static void configure_mounts(const linyaps_box::container &container, clone_fn_args &args)
 {
     LINYAPS_BOX_DEBUG() << "Configure mounts";
 
@@ -716,14 +945,19 @@ static void configure_mounts(const linyaps_box::container &container)
 
     std::unique_ptr<mounter> m;
 
-    {
+    if (args.rootfs.get() >= 0) {
+        m = std::make_unique<mounter>(duplicate_fd(args.rootfs.get()),
+                                      can_mount_sysfs(container, *args.features));
+    } else {
         auto bundle = linyaps_box::utils::open(container.get_bundle(), O_PATH);
         m = std::make_unique<mounter>(
-                linyaps_box::utils::open(bundle, container.get_config().root.path, O_PATH));
+                linyaps_box::utils::open(bundle, container.get_config().root.path, O_PATH),
+                can_mount_sysfs(container, *args.features));
     }
 
-    for (const auto &mount : container.get_config().mounts) {
-        m->mount(mount);
+    const auto &mounts = container.get_config().mounts;
+    for (std::size_t i = 0; i < mounts.size(); ++i) {
+        m->mount(mounts[i], std::move(args.mount_trees[i]));
     }
 
     m->finalize();
@@ -731,65 +965,11 @@ static void configure_mounts(const linyaps_box::container &container)
     LINYAPS_BOX_DEBUG() << "Mounts configured";
 }
 
-[[noreturn]] static void execute_process(const linyaps_box::config::process_t &process)
-{
-    std::vector<const char *> c_args;
-    for (const auto &arg : process.args) {
-        c_args.push_back(arg.c_str());
-    }
-    c_args.push_back(nullptr);
-
-    std::vector<std::string> envs;
-    for (const auto &env : process.env) {
-        envs.push_back(env.first + "=" + env.second);
-    }
-    std::vector<const char *> c_env;
-    for (const auto &env : envs) {
-        c_env.push_back(env.c_str());
-    }
-    c_env.push_back(nullptr);
-
-    auto ret = chdir(process.cwd.c_str());
-    if (ret) {
-        throw std::system_error(errno, std::generic_category(), "chdir");
-    }
-
-    ret = setgid(process.uid);
-    if (ret) {
-        throw std::system_error(errno, std::generic_category(), "setgid");
-    }
-
-    if (process.additional_gids) {
-        ret = setgroups(process.additional_gids->size(), process.additional_gids->data());
-        if (ret) {
-            throw std::system_error(errno, std::generic_category(), "setgroups");
-        }
-    }
-
-    ret = setuid(process.uid);
-    if (ret) {
-        throw std::system_error(errno, std::generic_category(), "setuid");
-    }
-
-    LINYAPS_BOX_DEBUG() << "All opened file describers:\n" << linyaps_box::utils::inspect_fds();
-
-    LINYAPS_BOX_DEBUG() << "Execute container process";
-
-    execvpe(c_args[0],
-            const_cast<char *const *>(c_args.data()),
-            const_cast<char *const *>(c_env.data()));
-
-    throw std::system_error(errno, std::generic_category(), "execvpe");
-}
-
-static void wait_create_runtime_result(const linyaps_box::container &container,
-                                       linyaps_box::utils::file_descriptor &socket)
+// NOTE: This is requested even without prestart and createRuntime hooks,
+// as the runtime configures the host side (e.g. cgroup) while mounts are configured,
+// and the container process must not go further before that is finished.
+static void wait_create_runtime_result(linyaps_box::utils::file_descriptor &socket)
 {
-    if (container.get_config().hooks.prestart.empty()
-        && container.get_config().hooks.create_runtime.empty()) {
-        return;
-    }
-
     LINYAPS_BOX_DEBUG() << "Request execute createRuntime hooks";
 
     socket << std::byte(sync_message::REQUEST_CREATERUNTIME_HOOKS);
@@ -808,33 +988,112 @@ static void wait_create_runtime_result(const linyaps_box::container &container,
     throw unexpected_sync_message(sync_message::CREATE_RUNTIME_HOOKS_EXECUTED, message);
 }
 
-static void create_container_hooks(const linyaps_box::container &container,
-                                   linyaps_box::utils::file_descriptor &socket)
+// Execute a hook in the container namespace,
+// or copy its cached outputs if it is memoized and the inputs are not changed.
+static void execute_container_hook(const linyaps_box::config::hooks_t::hook_t &hook,
+                                   const char *stage,
+                                   const std::string &name,
+                                   const clone_fn_args &args)
+{
+    auto execute = [&]() {
+        if (!hook.entry) {
+            execute_hook(hook, *args.features);
+            return;
+        }
+
+        linyaps_box::plugin::call_context_t context;
+        context.stage = stage;
+        context.id = args.container->id();
+        context.bundle = std::filesystem::absolute(args.container->get_bundle());
+        context.pid = getpid();
+        linyaps_box::plugin::call(args.plugins.at(&hook), hook, context);
+    };
+
+    auto it = args.memoized_hooks.find(name);
+    if (it == args.memoized_hooks.end()) {
+        execute();
+        return;
+    }
+
+    // NOTE: It requires /proc after pivot_root(2),
+    // the hook is executed without the cache if the directory is not reachable.
+    auto cache = std::filesystem::path("/proc/self/fd") / std::to_string(args.hook_cache.get());
+    auto key = linyaps_box::hook_cache::key(hook, name, it->second);
+    if (linyaps_box::hook_cache::restore(cache, key, it->second)) {
+        LINYAPS_BOX_DEBUG() << "Hook " << name << " skipped, outputs restored from "
+                            << key.name;
+        return;
+    }
+
+    execute();
+    linyaps_box::hook_cache::store(cache, key, it->second);
+}
+
+static void create_container_hooks(const linyaps_box::container &container, clone_fn_args &args)
 {
-    if (container.get_config().hooks.create_container.empty()) {
+    const auto &hooks = container.get_config().hooks.create_container;
+    if (hooks.empty()) {
         return;
     }
 
     LINYAPS_BOX_DEBUG() << "Execute create container hooks";
 
-    for (const auto &hook : container.get_config().hooks.create_container) {
-        execute_hook(hook);
+    for (std::size_t i = 0; i < hooks.size(); ++i) {
+        execute_container_hook(hooks[i],
+                               "createContainer",
+                               "createContainer." + std::to_string(i),
+                               args);
     }
 
     LINYAPS_BOX_DEBUG() << "Create container hooks executed";
 
-    socket << std::byte(sync_message::CREATE_CONTAINER_HOOKS_EXECUTED);
+    args.socket << std::byte(sync_message::CREATE_CONTAINER_HOOKS_EXECUTED);
 
     LINYAPS_BOX_DEBUG() << "Sync message sent";
 }
 
-static void do_pivot_root(const linyaps_box::container &container)
+// NOTE: pivot_root(2) requires the new root to be a mount point,
+// open_tree(2) clones the root filesystem as a mount,
+// which is attached on top of it by move_mount(2),
+// so the root filesystem is not opened by path again.
+[[nodiscard]] static linyaps_box::utils::file_descriptor
+attach_rootfs(const linyaps_box::utils::file_descriptor &rootfs)
+{
+    auto ret = ::syscall(SYS_open_tree,
+                         rootfs.get(),
+                         "",
+                         OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC | AT_RECURSIVE | AT_EMPTY_PATH);
+    if (ret < 0) {
+        throw std::system_error(errno, std::generic_category(), "open_tree");
+    }
+    linyaps_box::utils::file_descriptor tree(static_cast<int>(ret));
+
+    ret = ::syscall(SYS_move_mount,
+                    tree.get(),
+                    "",
+                    rootfs.get(),
+                    "",
+                    MOVE_MOUNT_F_EMPTY_PATH | MOVE_MOUNT_T_EMPTY_PATH);
+    if (ret < 0) {
+        throw std::system_error(errno, std::generic_category(), "move_mount");
+    }
+
+    return tree;
+}
+
+static void do_pivot_root(const linyaps_box::container &container, const clone_fn_args &args)
 {
     const auto &config = container.get_config();
 
+    std::filesystem::path new_root_path = container.get_bundle() / config.root.path;
+
     auto old_root = linyaps_box::utils::open("/", O_DIRECTORY | O_PATH | O_CLOEXEC);
-    auto new_root = linyaps_box::utils::open((container.get_bundle() / config.root.path).c_str(),
-                                             O_DIRECTORY | O_PATH | O_CLOEXEC);
+    linyaps_box::utils::file_descriptor new_root;
+    if (args.rootfs.get() >= 0) {
+        new_root = duplicate_fd(args.rootfs.get());
+    } else {
+        new_root = linyaps_box::utils::open(new_root_path, O_DIRECTORY | O_PATH | O_CLOEXEC);
+    }
 
     int ret;
     ret = mount(nullptr, "/", nullptr, MS_REC | MS_PRIVATE, nullptr);
@@ -842,17 +1101,25 @@ static void do_pivot_root(const linyaps_box::container &container)
         throw std::system_error(errno, std::generic_category(), "mount");
     }
 
-    ret = mount(new_root.proc_path().c_str(),
-                new_root.proc_path().c_str(),
-                nullptr,
-                MS_BIND | MS_REC,
-                nullptr);
-    if (ret < 0) {
-        throw std::system_error(errno, std::generic_category(), "mount");
-    }
+    if (args.rootfs.get() >= 0
+        && args.features->has(linyaps_box::features::new_mount_api)) {
+        new_root = attach_rootfs(new_root);
+    } else {
+        if (args.rootfs.get() >= 0) {
+            new_root_path = std::filesystem::read_symlink(new_root.proc_path());
+        }
+
+        ret = mount(new_root.proc_path().c_str(),
+                    new_root.proc_path().c_str(),
+                    nullptr,
+                    MS_BIND | MS_REC,
+                    nullptr);
+        if (ret < 0) {
+            throw std::system_error(errno, std::generic_category(), "mount");
+        }
 
-    new_root = linyaps_box::utils::open((container.get_bundle() / config.root.path).c_str(),
-                                        O_DIRECTORY | O_PATH | O_CLOEXEC);
+        new_root = linyaps_box::utils::open(new_root_path, O_DIRECTORY | O_PATH | O_CLOEXEC);
+    }
 
     ret = fchdir(new_root.get());
     if (ret < 0) {
@@ -867,6 +1134,15 @@ static void do_pivot_root(const linyaps_box::container &container)
         throw std::system_error(errno, std::generic_category(), "pivot_root");
     }
 
+    // NOTE: The old root is stacked on the new root by pivot_root(2),
+    // but the working directory is still the new root.
+    // The loop below unmounts "." until it is not a mount point,
+    // which would detach the new root as well without changing into the old root first.
+    ret = fchdir(old_root.get());
+    if (ret < 0) {
+        throw std::system_error(errno, std::generic_category(), "fchdir");
+    }
+
     ret = umount2(".", MNT_DETACH);
     if (ret < 0) {
         throw std::system_error(errno, std::generic_category(), "umount2");
@@ -887,27 +1163,110 @@ static void do_pivot_root(const linyaps_box::container &container)
     return;
 }
 
-static void start_container_hooks(const linyaps_box::container &container,
-                                  linyaps_box::utils::file_descriptor &socket)
+static void start_container_hooks(const linyaps_box::container &container, clone_fn_args &args)
 {
-    if (container.get_config().hooks.start_container.empty()) {
+    const auto &hooks = container.get_config().hooks.start_container;
+    if (hooks.empty()) {
         return;
     }
 
     LINYAPS_BOX_DEBUG() << "Execute start container hooks";
 
-    for (const auto &hook : container.get_config().hooks.start_container) {
-        execute_hook(hook);
+    for (std::size_t i = 0; i < hooks.size(); ++i) {
+        execute_container_hook(hooks[i],
+                               "startContainer",
+                               "startContainer." + std::to_string(i),
+                               args);
     }
 
     LINYAPS_BOX_DEBUG() << "Start container hooks executed";
 
-    socket << std::byte(sync_message::START_CONTAINER_HOOKS_EXECUTED);
+    args.socket << std::byte(sync_message::START_CONTAINER_HOOKS_EXECUTED);
 
     LINYAPS_BOX_DEBUG() << "Sync message sent";
 }
 
-static void close_other_fds(const std::set<unsigned int> &except_fds)
+static void start_init(linyaps_box::utils::file_descriptor &socket,
+                       int control_socket,
+                       const linyaps_box::exec_policy::policy_t &policy,
+                       const linyaps_box::features::set_t &features)
+{
+    LINYAPS_BOX_DEBUG() << "Start init";
+
+    auto mask = linyaps_box::init::block_signals();
+
+    auto pid = fork();
+    if (pid < 0) {
+        throw std::system_error(errno, std::generic_category(), "fork");
+    }
+
+    if (pid == 0) {
+        if (sigprocmask(SIG_SETMASK, &mask, nullptr)) {
+            throw std::system_error(errno, std::generic_category(), "sigprocmask");
+        }
+        return;
+    }
+
+    {
+        // NOTE: The runtime waits the socket closed by execve of the container process,
+        // so init must not hold it.
+        [[maybe_unused]] auto closed = std::move(socket);
+    }
+
+    linyaps_box::init::run(pid,
+                           linyaps_box::utils::file_descriptor(control_socket),
+                           policy,
+                           features);
+}
+
+// NOTE: sd_listen_fds(3) checks LISTEN_PID, which is only known after fork of init.
+[[nodiscard]] static linyaps_box::config::process_t
+pass_preserved_fds(unsigned int preserve_fds, linyaps_box::config::process_t process)
+{
+    for (unsigned int fd = 3; fd < 3 + preserve_fds; ++fd) {
+        auto flags = fcntl(fd, F_GETFD);
+        if (flags < 0 || fcntl(fd, F_SETFD, flags & ~FD_CLOEXEC) < 0) {
+            throw std::system_error(errno, std::generic_category(), "fcntl");
+        }
+    }
+
+    if (preserve_fds > 0 && process.env.find("LISTEN_FDS") != process.env.end()) {
+        process.env["LISTEN_PID"] = std::to_string(getpid());
+    }
+
+    return process;
+}
+
+// NOTE: Used without close_range(2), which is much faster than closing one by one.
+static void close_fds_by_proc(const std::set<unsigned int> &except_fds)
+{
+    std::vector<int> fds;
+    {
+        auto *dir = ::opendir("/proc/self/fd");
+        if (dir == nullptr) {
+            throw std::system_error(errno, std::generic_category(), "opendir /proc/self/fd");
+        }
+
+        while (auto *entry = ::readdir(dir)) {
+            if (entry->d_name[0] == '.') {
+                continue;
+            }
+            auto fd = std::stoi(entry->d_name);
+            if (fd != ::dirfd(dir) && except_fds.count(static_cast<unsigned int>(fd)) == 0) {
+                fds.push_back(fd);
+            }
+        }
+
+        ::closedir(dir);
+    }
+
+    for (auto fd : fds) {
+        ::close(fd);
+    }
+}
+
+static void close_other_fds(const std::set<unsigned int> &except_fds,
+                            const linyaps_box::features::set_t &features)
 {
     LINYAPS_BOX_DEBUG() << "Close all fds excepts " << [&]() {
         std::stringstream ss;
@@ -917,13 +1276,18 @@ static void close_other_fds(const std::set<unsigned int> &except_fds)
         return ss.str();
     }();
 
+    if (!features.has(linyaps_box::features::close_range)) {
+        close_fds_by_proc(except_fds);
+        return;
+    }
+
     auto tmp = except_fds;
     tmp.insert(0);
     tmp.insert(~0U);
     for (auto fd = tmp.begin(); std::next(fd) != tmp.end(); fd++) {
         auto low = *fd + 1;
         auto high = *std::next(fd) - 1;
-        if (low >= high) {
+        if (low > high) {
             continue;
         }
         LINYAPS_BOX_DEBUG() << "close_range [" << low << ", " << high << "]";
@@ -934,6 +1298,44 @@ static void close_other_fds(const std::set<unsigned int> &except_fds)
     }
 }
 
+// NOTE: The file descriptor of the root filesystem refers to a mount
+// in the mount namespace of the caller, where mounts can not be configured.
+// But unshare(2) moves the working directory to the same place
+// in the new mount namespace, so enter it before that.
+static void enter_rootfs(const linyaps_box::container &container, clone_fn_args &args)
+{
+    auto rootfs_fd = container.get_options().rootfs_fd;
+    if (rootfs_fd < 0) {
+        return;
+    }
+
+    if (!args.unshare_mount) {
+        args.rootfs = duplicate_fd(rootfs_fd);
+        return;
+    }
+
+    if (::fchdir(rootfs_fd)) {
+        throw std::system_error(errno, std::generic_category(), "fchdir");
+    }
+
+    if (::unshare(CLONE_NEWNS)) {
+        throw std::system_error(errno, std::generic_category(), "unshare");
+    }
+
+    args.rootfs = linyaps_box::utils::open(".", O_DIRECTORY | O_PATH | O_CLOEXEC);
+}
+
+// The container process must not inherit file descriptors
+// of the root filesystem or mount sources outside the container.
+static void close_inherited_fds(clone_fn_args &args)
+{
+    for (auto fd : args.inherited_fds) {
+        ::close(static_cast<int>(fd));
+    }
+    args.inherited_fds.clear();
+    args.rootfs = linyaps_box::utils::file_descriptor();
+}
+
 static void signal_USR1_handler(int)
 {
     LINYAPS_BOX_DEBUG() << "Signal USR1 received";
@@ -941,6 +1343,14 @@ static void signal_USR1_handler(int)
 
 static int clone_fn(void *data) noexcept
 try {
+    // NOTE: The log lock is held by the thread called clone(2) in the runtime,
+    // this process is single threaded, so it is not needed anymore.
+    linyaps_box::utils::disable_log_lock();
+
+    // NOTE: The thread called clone(2) might block signals,
+    // the container process should not inherit that mask.
+    reset_signal_mask();
+
     if (getenv("LINYAPS_BOX_CONTAINER_PROCESS_TRACE_ME")) {
         auto ret = signal(SIGUSR1, signal_USR1_handler);
         if (ret == SIG_ERR) {
@@ -963,21 +1373,49 @@ try {
 
     auto &args = *static_cast<clone_fn_args *>(data);
 
+    auto &container = *args.container;
+
     assert(args.socket.get() >= 0);
-    close_other_fds(
-            { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, (unsigned int)(args.socket.get()) });
+    std::set<unsigned int> except_fds{ STDIN_FILENO,
+                                       STDOUT_FILENO,
+                                       STDERR_FILENO,
+                                       (unsigned int)(args.socket.get()) };
+    if (args.control_socket >= 0) {
+        except_fds.insert(args.control_socket);
+    }
+    for (unsigned int fd = 3; fd < 3 + container.get_options().preserve_fds; ++fd) {
+        except_fds.insert(fd);
+    }
+    for (const auto &tree : args.mount_trees) {
+        if (tree.get() >= 0) {
+            except_fds.insert(tree.get());
+        }
+    }
+    except_fds.insert(args.inherited_fds.cbegin(), args.inherited_fds.cend());
+    if (args.hook_cache.get() >= 0) {
+        except_fds.insert(args.hook_cache.get());
+    }
+    close_other_fds(except_fds, *args.features);
+
+    enter_rootfs(container, args);
 
-    auto &container = *args.container;
     auto &process = *args.process;
     auto &socket = args.socket;
 
     configure_container_namespaces(socket);
-    configure_mounts(container);
-    wait_create_runtime_result(container, socket);
-    create_container_hooks(container, socket);
-    do_pivot_root(container);
-    start_container_hooks(container, socket);
-    execute_process(process);
+    linyaps_box::sysctl::apply(container.get_config().sysctl);
+    configure_mounts(container, args);
+    wait_create_runtime_result(socket);
+    create_container_hooks(container, args);
+    do_pivot_root(container, args);
+    close_inherited_fds(args);
+    start_container_hooks(container, args);
+    args.hook_cache = linyaps_box::utils::file_descriptor();
+    if (container.get_options().init || args.control_socket >= 0) {
+        start_init(socket, args.control_socket, args.exec_policy, *args.features);
+    }
+    linyaps_box::execute_process(pass_preserved_fds(container.get_options().preserve_fds, process),
+                                 std::move(args.exec_policy.seccomp));
 } catch (const std::exception &e) {
     std::cerr << e.what() << std::endl;
     return -1;
@@ -1009,6 +1447,17 @@ generate_clone_flag(std::vector<linyaps_box::config::namespace_t> namespaces)
     int setted_namespaces = 0;
 
     for (const auto &ns : namespaces) {
+        if (setted_namespaces & ns.type) {
+            throw std::invalid_argument("duplicate namespace");
+        }
+        setted_namespaces |= ns.type;
+
+        // NOTE: Namespaces with path are joined by setns(2) instead.
+        if (!ns.path.empty()) {
+            LINYAPS_BOX_DEBUG() << "Skip namespace " << ns.type << " to join " << ns.path;
+            continue;
+        }
+
         switch (ns.type) {
         case linyaps_box::config::namespace_t::IPC: {
             flag |= CLONE_NEWIPC;
@@ -1042,11 +1491,6 @@ generate_clone_flag(std::vector<linyaps_box::config::namespace_t> namespaces)
             throw std::invalid_argument("invalid namespace");
         }
         }
-
-        if (setted_namespaces & ns.type) {
-            throw std::invalid_argument("duplicate namespace");
-        }
-        setted_namespaces |= ns.type;
     }
 
     LINYAPS_BOX_DEBUG() << "Clone flag=0x" << std::hex << flag;
@@ -1098,24 +1542,294 @@ private:
     void *stack_low;
 };
 
-static std::tuple<int, linyaps_box::utils::file_descriptor> start_container_process(
-        const linyaps_box::container &container, const linyaps_box::config::process_t &process)
+[[nodiscard]] static bool
+should_join_namespaces(const std::vector<linyaps_box::config::namespace_t> &namespaces)
 {
-    LINYAPS_BOX_DEBUG() << "All opened file describers before socketpair:\n"
-                        << linyaps_box::utils::inspect_fds();
-    auto sockets = linyaps_box::utils::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
-    LINYAPS_BOX_DEBUG() << "All opened file describers after socketpair:\n"
-                        << linyaps_box::utils::inspect_fds();
+    return std::any_of(namespaces.cbegin(),
+                       namespaces.cend(),
+                       [](const linyaps_box::config::namespace_t &ns) {
+                           return !ns.path.empty();
+                       });
+}
 
-    int clone_flag = runtime_ns::generate_clone_flag(container.get_config().namespaces);
+// Join namespaces with path, the user namespace goes first
+// as it grants capabilities over the others,
+// and the mount namespace goes last
+// as the paths of the others might not be accessible in it.
+static void join_namespaces(const std::vector<linyaps_box::config::namespace_t> &namespaces)
+{
+    std::vector<std::pair<int, linyaps_box::utils::file_descriptor>> fds;
+    for (const auto &ns : namespaces) {
+        if (ns.path.empty()) {
+            continue;
+        }
+        fds.emplace_back(ns.type, linyaps_box::utils::open(ns.path, O_RDONLY | O_CLOEXEC));
+    }
+
+    auto order = [](int type) {
+        if (type == CLONE_NEWUSER) {
+            return 0;
+        }
+        if (type == CLONE_NEWNS) {
+            return 2;
+        }
+        return 1;
+    };
+    std::stable_sort(fds.begin(), fds.end(), [&order](const auto &lhs, const auto &rhs) {
+        return order(lhs.first) < order(rhs.first);
+    });
+
+    for (const auto &[type, fd] : fds) {
+        LINYAPS_BOX_DEBUG() << "Join namespace " << type << " by " << fd.proc_path();
+        if (::setns(fd.get(), type)) {
+            throw std::system_error(errno, std::generic_category(), "setns");
+        }
+    }
+}
 
-    clone_fn_args args = { &container, &process, std::move(sockets.second) };
+struct join_fn_args
+{
+    clone_fn_args *clone_args;
+    int clone_flag;
+    int pid_pipe;
+};
 
-    LINYAPS_BOX_DEBUG() << "OCI runtime in runtime namespace: PID=" << getpid()
-                        << " PIDNS=" << linyaps_box::utils::get_pid_namespace();
+// The intermediate process joins namespaces with path,
+// then clones the container process into them with the other namespaces created.
+// setns(2) can not be done in the runtime itself,
+// it would move the runtime into these namespaces,
+// and it fails for user and mount namespaces in a multithreaded process.
+static int join_fn(join_fn_args &args) noexcept
+try {
+    linyaps_box::utils::disable_log_lock();
+
+    linyaps_box::utils::file_descriptor pid_pipe(args.pid_pipe);
+
+    join_namespaces(args.clone_args->container->get_config().namespaces);
 
+    // NOTE: CLONE_PARENT makes the container process a child of the runtime,
+    // which monitors it.
     child_stack stack;
-    int child_pid = clone(container_ns::clone_fn, stack.top(), clone_flag, (void *)&args);
+    auto pid = clone(container_ns::clone_fn,
+                     stack.top(),
+                     args.clone_flag | CLONE_PARENT,
+                     (void *)args.clone_args);
+    if (pid < 0) {
+        throw std::system_error(errno, std::generic_category(), "clone");
+    }
+
+    if (::write(pid_pipe.get(), &pid, sizeof(pid)) != sizeof(pid)) {
+        throw std::system_error(errno, std::generic_category(), "write");
+    }
+
+    return 0;
+} catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return -1;
+} catch (...) {
+    std::cerr << "Error: unknown" << std::endl;
+    return -1;
+}
+
+// The container process runs a lot of code before execve(2), which allocates memory
+// and writes logs. clone(2) does not run the fork handlers of glibc,
+// so a process cloned from a multithreaded runtime might inherit the locks of malloc
+// or stdio held by other threads, and deadlock on them.
+// In that case the container process is cloned by an intermediate process from fork(2),
+// which is single threaded and has these locks released.
+[[nodiscard]] static bool is_multithreaded()
+{
+    std::size_t threads = 0;
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it("/proc/self/task", ec), end; !ec && it != end;
+         it.increment(ec)) {
+        ++threads;
+    }
+
+    // NOTE: Assume the worst if it is unknown.
+    return ec || threads != 1;
+}
+
+[[nodiscard]] static pid_t clone_from_intermediate(clone_fn_args &clone_args, int clone_flag)
+{
+    int fds[2];
+    if (::pipe2(fds, O_CLOEXEC)) {
+        throw std::system_error(errno, std::generic_category(), "pipe2");
+    }
+    linyaps_box::utils::file_descriptor read_end(fds[0]);
+    linyaps_box::utils::file_descriptor write_end(fds[1]);
+
+    join_fn_args args = { &clone_args, clone_flag, write_end.get() };
+
+    int intermediate_pid = -1;
+    {
+        auto lock = linyaps_box::utils::lock_log();
+        intermediate_pid = fork();
+        if (intermediate_pid == 0) {
+            _exit(join_fn(args) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    if (intermediate_pid < 0) {
+        throw std::system_error(errno, std::generic_category(), "fork");
+    }
+
+    write_end = linyaps_box::utils::file_descriptor();
+
+    pid_t pid = -1;
+    ssize_t ret = -1;
+    do {
+        ret = ::read(read_end.get(), &pid, sizeof(pid));
+    } while (ret < 0 && errno == EINTR);
+
+    auto info = wait_process(intermediate_pid);
+    if (ret != sizeof(pid) || info.si_code != CLD_EXITED || info.si_status != 0) {
+        throw std::runtime_error("failed to clone the container process");
+    }
+
+    return pid;
+}
+
+[[nodiscard]] static bool is_inherited_fd(int fd)
+{
+    return fd >= 0 && ::fcntl(fd, F_GETFD) >= 0;
+}
+
+// Inherited file descriptors are closed after pivot_root(2),
+// so they must not be passed to the container process by `options.preserve_fds` as well.
+static void check_not_preserved(const linyaps_box::container &container,
+                                int fd,
+                                const std::string &what)
+{
+    auto preserve_fds = container.get_options().preserve_fds;
+    if (fd >= 3 && static_cast<unsigned int>(fd) < 3 + preserve_fds) {
+        throw std::invalid_argument(what + " " + std::to_string(fd)
+                                    + " overlaps preserved file descriptors 3 to "
+                                    + std::to_string(3 + preserve_fds - 1));
+    }
+}
+
+// Check file descriptors inherited from the caller, and clone `fd:N` bind sources
+// as detached mount trees, which can be attached in the container mount namespace.
+static void prepare_inherited_fds(const linyaps_box::container &container,
+                                  const linyaps_box::features::set_t &features,
+                                  clone_fn_args &args)
+{
+    const auto &config = container.get_config();
+
+    auto rootfs_fd = container.get_options().rootfs_fd;
+    if (rootfs_fd >= 0) {
+        check_not_preserved(container, rootfs_fd, "rootfs fd");
+        if (!is_inherited_fd(rootfs_fd)) {
+            throw std::system_error(errno, std::generic_category(), "rootfs fd");
+        }
+        args.inherited_fds.insert(rootfs_fd);
+
+        for (const auto &ns : config.namespaces) {
+            if (ns.type != linyaps_box::config::namespace_t::MOUNT) {
+                continue;
+            }
+            if (!ns.path.empty()) {
+                throw std::invalid_argument("rootfs fd can not be used in a joined mount namespace");
+            }
+            args.unshare_mount = true;
+        }
+    }
+
+    for (const auto &mount : config.mounts) {
+        auto &tree = args.mount_trees.emplace_back();
+
+        std::optional<int> fd;
+        if (mount.source) {
+            fd = inherited_source_fd(*mount.source);
+        }
+        if (!fd) {
+            continue;
+        }
+
+        if (!(mount.flags & MS_BIND)) {
+            throw std::invalid_argument("mount source " + *mount.source
+                                        + " is only supported by bind mounts");
+        }
+        check_not_preserved(container, *fd, "mount source");
+        if (!is_inherited_fd(*fd)) {
+            throw std::system_error(errno,
+                                    std::generic_category(),
+                                    "mount source " + *mount.source);
+        }
+        args.inherited_fds.insert(*fd);
+
+        // NOTE: Without the new mount API, the file descriptor refers to a mount outside
+        // the container mount namespace, which mount(2) refuses as a bind source,
+        // and opening its path again might resolve to another file than the caller opened.
+        if (!features.has(linyaps_box::features::new_mount_api)) {
+            throw std::invalid_argument("mount source " + *mount.source
+                                        + " requires open_tree(2) of Linux 5.2");
+        }
+
+        unsigned int flags = OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC | AT_EMPTY_PATH;
+        if (mount.flags & MS_REC) {
+            flags |= AT_RECURSIVE;
+        }
+        auto ret = ::syscall(SYS_open_tree, *fd, "", flags);
+        if (ret < 0) {
+            throw std::system_error(errno, std::generic_category(), "open_tree");
+        }
+        tree = linyaps_box::utils::file_descriptor(static_cast<int>(ret));
+    }
+}
+
+static std::tuple<int, linyaps_box::utils::file_descriptor>
+start_container_process(const linyaps_box::container &container,
+                        const linyaps_box::config::process_t &process,
+                        const linyaps_box::utils::file_descriptor &control_socket,
+                        const linyaps_box::features::set_t &features,
+                        const std::filesystem::path &hook_cache,
+                        const std::filesystem::path &seccomp_cache,
+                        const std::filesystem::path &exec_policy)
+{
+    linyaps_box::sysctl::validate(container.get_config());
+
+    LINYAPS_BOX_DEBUG() << "All opened file describers before socketpair:\n"
+                        << linyaps_box::utils::inspect_fds();
+    auto sockets = linyaps_box::utils::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    LINYAPS_BOX_DEBUG() << "All opened file describers after socketpair:\n"
+                        << linyaps_box::utils::inspect_fds();
+
+    int clone_flag = runtime_ns::generate_clone_flag(container.get_config().namespaces);
+
+    clone_fn_args args{};
+    args.container = &container;
+    args.process = &process;
+    args.socket = std::move(sockets.second);
+    args.control_socket = control_socket.get();
+    args.features = &features;
+    prepare_inherited_fds(container, features, args);
+    args.plugins = load_plugins(container);
+    args.memoized_hooks =
+            linyaps_box::hook_cache::parse(container.get_config(), container.get_bundle());
+    if (!args.memoized_hooks.empty()) {
+        std::filesystem::create_directories(hook_cache);
+        args.hook_cache = linyaps_box::utils::open(hook_cache, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    }
+    // NOTE: The policy is stored before clone(2), so no process is executed by `ll-box exec`
+    // in the container without it.
+    args.exec_policy = linyaps_box::exec_policy::from_config(container.get_config(), seccomp_cache);
+    linyaps_box::exec_policy::write(exec_policy, args.exec_policy);
+    if (args.unshare_mount) {
+        clone_flag &= ~CLONE_NEWNS;
+    }
+
+    LINYAPS_BOX_DEBUG() << "OCI runtime in runtime namespace: PID=" << getpid()
+                        << " PIDNS=" << linyaps_box::utils::get_pid_namespace();
+
+    int child_pid = -1;
+    if (should_join_namespaces(container.get_config().namespaces) || is_multithreaded()) {
+        child_pid = clone_from_intermediate(args, clone_flag);
+    } else {
+        child_stack stack;
+        auto lock = linyaps_box::utils::lock_log();
+        child_pid = clone(container_ns::clone_fn, stack.top(), clone_flag, (void *)&args);
+    }
     if (child_pid < 0) {
         throw std::runtime_error("clone failed");
     } else if (child_pid == 0) {
@@ -1161,6 +1875,7 @@ static void execute_user_namespace_helper(const std::vector<std::string> &args)
         }
 
         c_args.push_back(nullptr);
+        reset_signal_mask();
         execvp(c_args[0], const_cast<char *const *>(c_args.data()));
 
         throw std::system_error(errno, std::generic_category(), "execvp");
@@ -1234,27 +1949,56 @@ configure_uid_mapping(pid_t pid, const std::vector<linyaps_box::config::id_mappi
     execute_user_namespace_helper(args);
 }
 
-static void configure_container_cgroup(const linyaps_box::container &)
+// Check hooks before they are needed, so a bad hook stops the container
+// before it finished configuring mounts.
+// Paths of hooks are absolute as required by the OCI runtime spec, they are never searched in
+// PATH. Hooks executed in the container namespace are only checked for that.
+static void resolve_hooks(const linyaps_box::container &container)
 {
-    LINYAPS_BOX_DEBUG() << "Configure container cgroup";
-    // TODO
-}
-
-static void configure_container_namespaces(const linyaps_box::container &container,
-                                           linyaps_box::utils::file_descriptor &socket)
-{
-    LINYAPS_BOX_DEBUG()
-            << "Waiting OCI runtime in container namespace to request configure namespace";
+    const auto &hooks = container.get_config().hooks;
+    for (const auto *list : { &hooks.prestart,
+                              &hooks.create_runtime,
+                              &hooks.create_container,
+                              &hooks.start_container,
+                              &hooks.poststart,
+                              &hooks.poststop }) {
+        for (const auto &hook : *list) {
+            // NOTE: Plugin hooks are loaded before clone(2).
+            if (hook.entry) {
+                continue;
+            }
+            if (!hook.path.is_absolute()) {
+                throw std::invalid_argument("path of hook " + hook.path.string()
+                                            + " is not absolute");
+            }
+        }
+    }
 
-    std::byte byte;
-    socket >> byte;
-    {
-        auto message = sync_message(byte);
-        if (message != sync_message::REQUEST_CONFIGURE_NAMESPACE) {
-            throw unexpected_sync_message(sync_message::REQUEST_CONFIGURE_NAMESPACE, message);
+    for (const auto *list : { &hooks.prestart, &hooks.create_runtime }) {
+        for (const auto &hook : *list) {
+            if (!hook.entry && ::access(hook.path.c_str(), X_OK) != 0) {
+                throw std::system_error(errno,
+                                        std::generic_category(),
+                                        "hook " + hook.path.string());
+            }
         }
     }
+}
+
+// Prestart hooks are executed along with createRuntime hooks by default,
+// with this annotation set to "true", they are started once namespaces are configured,
+// in parallel with mounts, for hooks which do not depend on the mounts of the container.
+constexpr auto early_prestart_annotation = "org.openatom.linyaps.box.early-prestart";
+
+[[nodiscard]] static bool early_prestart(const linyaps_box::container &container)
+{
+    const auto &annotations = container.get_config().annotations;
+    auto it = annotations.find(early_prestart_annotation);
+    return it != annotations.end() && it->second == "true";
+}
 
+static void configure_container_namespaces(const linyaps_box::container &container, pid_t pid)
+{
     LINYAPS_BOX_DEBUG() << "Start configure namespaces";
 
     const auto &config = container.get_config();
@@ -1262,179 +2006,912 @@ static void configure_container_namespaces(const linyaps_box::container &contain
     if (std::find_if(config.namespaces.cbegin(),
                      config.namespaces.cend(),
                      [](const linyaps_box::config::namespace_t &ns) -> bool {
-                         return ns.type == linyaps_box::config::namespace_t::USER;
+                         // NOTE: A joined user namespace has its ID mappings already.
+                         return ns.type == linyaps_box::config::namespace_t::USER
+                                 && ns.path.empty();
                      })
         != config.namespaces.end()) {
-
-        auto pid = container.status().PID;
-
         configure_gid_mapping(pid, config.gid_mappings);
         configure_uid_mapping(pid, config.uid_mappings);
     }
 
-    configure_container_cgroup(container);
-
     LINYAPS_BOX_DEBUG() << "Container namespaces configured";
+}
 
-    byte = std::byte(sync_message::NAMESPACE_CONFIGURED);
-    socket << byte;
+[[nodiscard]] static int exit_code_of(const siginfo_t &info)
+{
+    if (info.si_code == CLD_EXITED) {
+        return info.si_status;
+    }
 
-    LINYAPS_BOX_DEBUG() << "Sync message sent";
+    // NOTE: Follow the convention of shells.
+    return 128 + info.si_status;
 }
 
-static void prestart_hooks(const linyaps_box::container &container)
+// Signals handled by the monitor through signalfd, which are blocked from before clone(2)
+// until the monitor is destroyed, so a signal sent to ll-box before the monitor exists
+// stays pending for it instead of terminating the runtime by its default action.
+class blocked_signals
 {
-    if (container.get_config().hooks.prestart.empty()) {
-        return;
+public:
+    blocked_signals(const linyaps_box::container &container,
+                    const linyaps_box::features::set_t &features)
+    {
+        sigemptyset(&this->signals);
+        // NOTE: Fallback to SIGCHLD if pidfd is not supported.
+        if (!features.has(linyaps_box::features::pidfd)) {
+            sigaddset(&this->signals, SIGCHLD);
+        }
+        if (container.get_options().forward_signals) {
+            for (auto signal : { SIGTERM, SIGINT, SIGHUP, SIGQUIT, SIGUSR1, SIGUSR2 }) {
+                sigaddset(&this->signals, signal);
+            }
+        }
+        if (sigisemptyset(&this->signals)) {
+            return;
+        }
+
+        auto ret = pthread_sigmask(SIG_BLOCK, &this->signals, &this->old_signals);
+        if (ret) {
+            throw std::system_error(ret, std::generic_category(), "pthread_sigmask");
+        }
+        this->blocked = true;
     }
 
-    LINYAPS_BOX_DEBUG() << "Execute prestart hooks";
+    blocked_signals(const blocked_signals &) = delete;
+    blocked_signals &operator=(const blocked_signals &) = delete;
 
-    for (const auto &hook : container.get_config().hooks.prestart) {
-        execute_hook(hook);
+    ~blocked_signals() noexcept
+    {
+        if (!this->blocked) {
+            return;
+        }
+
+        auto ret = pthread_sigmask(SIG_SETMASK, &this->old_signals, nullptr);
+        if (!ret) {
+            return;
+        }
+
+        std::cerr << "pthread_sigmask: " << strerror(ret) << std::endl;
+        assert(false);
     }
 
-    LINYAPS_BOX_DEBUG() << "Prestart hooks executed";
-}
+    [[nodiscard]] bool empty() const { return !this->blocked; }
+
+    [[nodiscard]] const sigset_t &get() const { return this->signals; }
 
-static void create_runtime_hooks(const linyaps_box::container &container,
-                                 linyaps_box::utils::file_descriptor &socket)
+private:
+    sigset_t signals;
+    sigset_t old_signals;
+    bool blocked = false;
+};
+
+// The monitor drives the runtime side of a container after it is cloned.
+// It waits on the sync socket, the container process, the running hook
+// and the signals sent to ll-box in a single epoll loop,
+// so a hanging hook or a crashed container process is noticed immediately.
+class monitor
 {
-    if (container.get_config().hooks.prestart.empty()
-        && container.get_config().hooks.create_runtime.empty()) {
-        return;
+public:
+    using status_callback_t = std::function<void(linyaps_box::container_status_t::runtime_status)>;
+    using event_callback_t = std::function<void(linyaps_box::events::event_t)>;
+
+    monitor(const linyaps_box::container &container,
+            const linyaps_box::features::set_t &features,
+            pid_t child_pid,
+            linyaps_box::utils::file_descriptor socket,
+            std::unique_ptr<blocked_signals> signals,
+            status_callback_t set_status,
+            event_callback_t publish)
+        : container(container)
+        , features(features)
+        , child_pid(child_pid)
+        , socket(std::move(socket))
+        , set_status(std::move(set_status))
+        , publish(std::move(publish))
+        , signals(std::move(signals))
+    {
+        // NOTE: Fallback to SIGCHLD if pidfd is not supported.
+        this->child_pidfd = open_pidfd(this->child_pid);
+        this->plugins = load_plugins(this->container);
+        if (auto timeout = this->container.get_options().start_timeout; timeout.count() > 0) {
+            this->start_deadline = this->created + timeout;
+        }
+
+        this->epoll.add(this->socket, EPOLLIN);
+        if (this->child_pidfd.get() != -1) {
+            this->epoll.add(this->child_pidfd, EPOLLIN);
+        }
+
+        if (this->signals->empty()) {
+            return;
+        }
+
+        this->signal_fd = linyaps_box::utils::signalfd(this->signals->get());
+        this->epoll.add(this->signal_fd, EPOLLIN);
     }
 
-    LINYAPS_BOX_DEBUG() << "Waiting request to execute create runtime hooks";
+    monitor(const monitor &) = delete;
+    monitor &operator=(const monitor &) = delete;
+    ~monitor() noexcept = default;
 
-    std::byte byte;
-    socket >> byte;
-    auto message = sync_message(byte);
-    if (message != sync_message::REQUEST_CREATERUNTIME_HOOKS) {
-        throw unexpected_sync_message(sync_message::REQUEST_CREATERUNTIME_HOOKS, message);
+    // Returns once the container process is running and poststart hooks are executed.
+    void start()
+    {
+        this->run_until([this]() {
+            return this->stage == stage_t::started && !this->hooks;
+        });
     }
 
-    LINYAPS_BOX_DEBUG() << "Execute prestart hooks";
+    // Returns the exit code of the container process.
+    [[nodiscard]] int wait()
+    {
+        // NOTE: The container process might have exited while the monitor was not running,
+        // and without pidfd its SIGCHLD might have been read by another monitor.
+        this->handle([this]() {
+            this->check_child();
+        });
+
+        this->run_until([]() {
+            return false;
+        });
 
-    for (const auto &hook : container.get_config().hooks.prestart) {
-        execute_hook(hook);
+        return *this->exit_code;
     }
 
-    LINYAPS_BOX_DEBUG() << "Prestart hooks executed";
+private:
+    enum class stage_t {
+        configure_namespace,
+        create_runtime,
+        create_container,
+        start_container,
+        started,
+    };
+
+    template<typename Pred>
+    void run_until(Pred &&done)
+    {
+        // NOTE: After an error, keep running until the container process exited.
+        while ((!this->exit_code || this->hooks) && (this->error || !done())) {
+            auto events = this->epoll.wait(this->deadline());
+            if (events.empty()) {
+                this->handle([this]() {
+                    this->on_deadline();
+                });
+                continue;
+            }
 
-    LINYAPS_BOX_DEBUG() << "Execute create runtime hooks";
+            for (const auto &event : events) {
+                this->handle([this, &event]() {
+                    this->on_event(event);
+                });
+            }
+        }
 
-    for (const auto &hook : container.get_config().hooks.create_runtime) {
-        execute_hook(hook);
+        if (this->error) {
+            std::rethrow_exception(this->error);
+        }
     }
 
-    LINYAPS_BOX_DEBUG() << "Create runtime hooks executed";
+    struct hook_process_t
+    {
+        const linyaps_box::config::hooks_t::hook_t *hook;
+        pid_t pid;
+        linyaps_box::utils::file_descriptor pidfd;
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+        bool timed_out = false;
+    };
+
+    struct timing_t
+    {
+        const char *name;
+        std::chrono::steady_clock::time_point begin;
+        std::optional<std::chrono::steady_clock::time_point> end;
+    };
 
-    socket << std::byte(sync_message::CREATE_RUNTIME_HOOKS_EXECUTED);
+    struct hook_chain_t
+    {
+        const char *name;
+        std::deque<const linyaps_box::config::hooks_t::hook_t *> pending;
+        bool fatal;
+        std::function<void()> on_finished;
+        std::optional<hook_process_t> current;
+    };
+
+    const linyaps_box::container &container;
+    const linyaps_box::features::set_t &features;
+    pid_t child_pid;
+    linyaps_box::utils::file_descriptor socket;
+    status_callback_t set_status;
+    event_callback_t publish;
+    std::optional<std::filesystem::path> cgroup;
+    std::optional<std::uint64_t> oom_kills;
+
+    std::unique_ptr<blocked_signals> signals;
+    linyaps_box::utils::file_descriptor signal_fd;
+    linyaps_box::utils::file_descriptor child_pidfd;
+    linyaps_box::utils::epoll epoll;
+    linyaps_box::plugin::entries_t plugins;
+
+    stage_t stage = stage_t::configure_namespace;
+    std::optional<hook_chain_t> hooks;
+    bool create_runtime_requested = false;
+    bool prestart_executed = false;
+    std::optional<int> exit_code;
+    std::exception_ptr error;
+
+    std::chrono::steady_clock::time_point created = std::chrono::steady_clock::now();
+    std::optional<std::chrono::steady_clock::time_point> start_deadline;
+    std::vector<timing_t> timings;
+
+    [[nodiscard]] linyaps_box::utils::file_descriptor open_pidfd(pid_t pid) const
+    {
+        if (!this->features.has(linyaps_box::features::pidfd)) {
+            return {};
+        }
+        return linyaps_box::utils::pidfd_open(pid);
+    }
+
+    // Any error stops the container, the monitor keeps running
+    // until the container process exited and the error is rethrown by run().
+    template<typename Fn>
+    void handle(Fn &&fn) noexcept
+    try {
+        fn();
+    } catch (...) {
+        if (!this->error) {
+            this->error = std::current_exception();
+        }
 
-    LINYAPS_BOX_DEBUG() << "Sync message sent";
-}
+        this->abort();
+    }
 
-static void wait_create_container_result(const linyaps_box::container &container,
-                                         linyaps_box::utils::file_descriptor &socket)
-{
-    if (container.get_config().hooks.create_container.empty()) {
-        return;
+    void abort() noexcept
+    {
+        if (this->hooks && this->hooks->current) {
+            ::kill(this->hooks->current->pid, SIGKILL);
+        }
+        if (this->hooks) {
+            this->hooks->pending.clear();
+            this->hooks->on_finished = nullptr;
+        }
+
+        if (this->exit_code) {
+            return;
+        }
+
+        LINYAPS_BOX_DEBUG() << "Kill container process " << this->child_pid;
+        ::kill(this->child_pid, SIGKILL);
     }
 
-    LINYAPS_BOX_DEBUG()
-            << "Waiting OCI runtime in container namespace send create container hooks result";
+    [[nodiscard]] std::optional<std::chrono::steady_clock::time_point> deadline() const
+    {
+        std::optional<std::chrono::steady_clock::time_point> hook_deadline;
+        if (this->hooks && this->hooks->current) {
+            hook_deadline = this->hooks->current->deadline;
+        }
 
-    std::byte byte;
-    socket >> byte;
-    auto message = sync_message(byte);
-    if (message == sync_message::CREATE_CONTAINER_HOOKS_EXECUTED) {
-        LINYAPS_BOX_DEBUG() << "Create container hooks executed";
-        return;
+        if (!hook_deadline || !this->start_deadline) {
+            return hook_deadline ? hook_deadline : this->start_deadline;
+        }
+
+        return std::min(*hook_deadline, *this->start_deadline);
     }
-    throw unexpected_sync_message(sync_message::CREATE_CONTAINER_HOOKS_EXECUTED, message);
-}
 
-static void wait_socket_close(linyaps_box::utils::file_descriptor &socket)
-try {
-    LINYAPS_BOX_DEBUG() << "All opened file describers:\n" << linyaps_box::utils::inspect_fds();
-    std::byte byte;
-    LINYAPS_BOX_DEBUG() << "Waiting socket close";
-    socket >> byte;
-} catch (const linyaps_box::utils::file_descriptor_closed_exception &e) {
-    LINYAPS_BOX_DEBUG() << "Socket closed";
-    return;
-}
+    void on_deadline()
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (this->start_deadline && *this->start_deadline <= now) {
+            this->start_deadline.reset();
+            throw std::runtime_error((std::stringstream()
+                                      << "container is not started in "
+                                      << this->container.get_options().start_timeout.count()
+                                      << " seconds")
+                                             .str());
+        }
 
-static void poststart_hooks(const linyaps_box::container &container)
-{
-    if (container.get_config().hooks.poststart.empty()) {
-        return;
+        if (!this->hooks) {
+            return;
+        }
+
+        auto &current = this->hooks->current;
+        if (!current || current->timed_out || !current->deadline || *current->deadline > now) {
+            return;
+        }
+
+        LINYAPS_BOX_WARNING() << "Hook " << current->hook->path << " timed out";
+
+        current->timed_out = true;
+        current->deadline.reset();
+        if (::kill(current->pid, SIGKILL) && errno != ESRCH) {
+            throw std::system_error(errno, std::generic_category(), "kill");
+        }
     }
 
-    for (const auto &hook : container.get_config().hooks.poststart) {
-        execute_hook(hook);
+    void on_event(const epoll_event &event)
+    {
+        if (event.data.fd == this->socket.get()) {
+            this->on_socket();
+            return;
+        }
+
+        if (event.data.fd == this->signal_fd.get()) {
+            this->on_signal();
+            return;
+        }
+
+        if (event.data.fd == this->child_pidfd.get()) {
+            this->check_child();
+            return;
+        }
+
+        this->check_hook();
     }
-}
 
-static void poststop_hooks(const linyaps_box::container &container) noexcept
-{
-    if (container.get_config().hooks.poststop.empty()) {
-        return;
+    [[nodiscard]] stage_t next_stage() const
+    {
+        const auto &hooks = this->container.get_config().hooks;
+
+        switch (this->stage) {
+        case stage_t::configure_namespace: {
+            return stage_t::create_runtime;
+        }
+        case stage_t::create_runtime: {
+            if (!hooks.create_container.empty()) {
+                return stage_t::create_container;
+            }
+        }
+            [[fallthrough]];
+        case stage_t::create_container: {
+            return stage_t::start_container;
+        }
+        case stage_t::start_container:
+        case stage_t::started: {
+            return stage_t::started;
+        }
+        }
+
+        throw std::logic_error("unknown stage");
     }
 
-    for (const auto &hook : container.get_config().hooks.poststart)
+    void on_socket()
+    {
+        std::byte byte;
         try {
-            execute_hook(hook);
+            this->socket >> byte;
+        } catch (const linyaps_box::utils::file_descriptor_closed_exception &) {
+            LINYAPS_BOX_DEBUG() << "Socket closed";
+            this->epoll.remove(this->socket);
+            this->socket = linyaps_box::utils::file_descriptor();
+
+            if (this->stage == stage_t::start_container) {
+                this->end_stage("container setup");
+                this->on_started();
+            }
+            return;
+        }
+
+        auto message = sync_message(byte);
+
+        switch (this->stage) {
+        case stage_t::configure_namespace: {
+            if (message != sync_message::REQUEST_CONFIGURE_NAMESPACE) {
+                throw unexpected_sync_message(sync_message::REQUEST_CONFIGURE_NAMESPACE, message);
+            }
+
+            this->begin_stage("namespaces");
+            configure_container_namespaces(this->container, this->child_pid);
+            this->socket << std::byte(sync_message::NAMESPACE_CONFIGURED);
+            LINYAPS_BOX_DEBUG() << "Sync message sent";
+            this->end_stage("namespaces");
+            this->begin_stage("mounts");
+            this->stage = this->next_stage();
+
+            this->configure_host();
+        } break;
+        case stage_t::create_runtime: {
+            if (message != sync_message::REQUEST_CREATERUNTIME_HOOKS) {
+                throw unexpected_sync_message(sync_message::REQUEST_CREATERUNTIME_HOOKS, message);
+            }
+
+            this->end_stage("mounts");
+            this->create_runtime_requested = true;
+            this->start_create_runtime_hooks();
+        } break;
+        case stage_t::create_container: {
+            if (message != sync_message::CREATE_CONTAINER_HOOKS_EXECUTED) {
+                throw unexpected_sync_message(sync_message::CREATE_CONTAINER_HOOKS_EXECUTED,
+                                              message);
+            }
+
+            LINYAPS_BOX_DEBUG() << "Create container hooks executed";
+            this->stage = this->next_stage();
+        } break;
+        case stage_t::start_container: {
+            if (message != sync_message::START_CONTAINER_HOOKS_EXECUTED) {
+                throw unexpected_sync_message(sync_message::START_CONTAINER_HOOKS_EXECUTED,
+                                              message);
+            }
+
+            LINYAPS_BOX_DEBUG() << "Start container hooks executed";
+        } break;
+        case stage_t::started: {
+            throw std::logic_error("unexpected sync message after container started");
+        }
+        }
+    }
+
+    // Work on the host side which only depends on namespaces of the container,
+    // it runs while the container process is configuring mounts.
+    // The container process waits for CREATE_RUNTIME_HOOKS_EXECUTED
+    // after mounts, which is not sent before this is finished.
+    void configure_host()
+    {
+        this->begin_stage("status");
+        this->set_status(linyaps_box::container_status_t::runtime_status::CREATED);
+        this->end_stage("status");
+
+        this->begin_stage("hook resolution");
+        resolve_hooks(this->container);
+        this->end_stage("hook resolution");
+
+        if (!early_prestart(this->container)) {
+            return;
+        }
+
+        std::deque<const linyaps_box::config::hooks_t::hook_t *> pending;
+        for (const auto &hook : this->container.get_config().hooks.prestart) {
+            pending.push_back(&hook);
+        }
+
+        this->begin_stage("prestart hooks");
+        this->start_hooks("prestart", std::move(pending), true, [this]() {
+            this->end_stage("prestart hooks");
+            this->prestart_executed = true;
+            this->start_create_runtime_hooks();
+        });
+    }
+
+    // createRuntime hooks depend on the mounts of the container,
+    // and on prestart hooks if they were started early.
+    void start_create_runtime_hooks()
+    {
+        if (!this->create_runtime_requested || this->hooks) {
+            return;
+        }
+
+        const auto &hooks = this->container.get_config().hooks;
+        std::deque<const linyaps_box::config::hooks_t::hook_t *> pending;
+        if (!this->prestart_executed) {
+            for (const auto &hook : hooks.prestart) {
+                pending.push_back(&hook);
+            }
+        }
+        for (const auto &hook : hooks.create_runtime) {
+            pending.push_back(&hook);
+        }
+
+        this->create_runtime_requested = false;
+        this->begin_stage("createRuntime hooks");
+        this->start_hooks("createRuntime", std::move(pending), true, [this]() {
+            this->end_stage("createRuntime hooks");
+            this->socket << std::byte(sync_message::CREATE_RUNTIME_HOOKS_EXECUTED);
+            LINYAPS_BOX_DEBUG() << "Sync message sent";
+            this->begin_stage("container setup");
+            this->stage = this->next_stage();
+        });
+    }
+
+    void begin_stage(const char *name)
+    {
+        this->timings.push_back({ name, std::chrono::steady_clock::now(), std::nullopt });
+    }
+
+    void end_stage(const char *name)
+    {
+        auto it = std::find_if(this->timings.rbegin(),
+                               this->timings.rend(),
+                               [name](const timing_t &timing) {
+                                   return timing.name == std::string_view(name);
+                               });
+        if (it == this->timings.rend()) {
+            return;
+        }
+
+        it->end = std::chrono::steady_clock::now();
+    }
+
+    void log_timings() const
+    {
+        LINYAPS_BOX_INFO() << "Stage timings of container " << this->container.get_options().ID
+                           << " in milliseconds since the container process was cloned:"
+                           << [this]() {
+                                  using milliseconds = std::chrono::duration<double, std::milli>;
+
+                                  std::stringstream ss;
+                                  for (const auto &timing : this->timings) {
+                                      ss << "\n\t" << timing.name << ": "
+                                         << milliseconds(timing.begin - this->created).count()
+                                         << " - ";
+                                      if (timing.end) {
+                                          ss << milliseconds(*timing.end - this->created).count();
+                                      } else {
+                                          ss << "unfinished";
+                                      }
+                                  }
+                                  return ss.str();
+                              }();
+    }
+
+    void on_started()
+    {
+        LINYAPS_BOX_DEBUG() << "Container process started";
+
+        this->stage = stage_t::started;
+        this->start_deadline.reset();
+        if (!this->exit_code) {
+            this->watch_oom_kills();
+            this->set_status(linyaps_box::container_status_t::runtime_status::RUNNING);
+        }
+
+        std::deque<const linyaps_box::config::hooks_t::hook_t *> pending;
+        for (const auto &hook : this->container.get_config().hooks.poststart) {
+            pending.push_back(&hook);
+        }
+
+        this->begin_stage("poststart hooks");
+        this->start_hooks("poststart", std::move(pending), false, [this]() {
+            this->end_stage("poststart hooks");
+            this->log_timings();
+        });
+    }
+
+    void on_signal()
+    {
+        while (auto info = linyaps_box::utils::read_signal(this->signal_fd)) {
+            if (info->ssi_signo == SIGCHLD) {
+                this->check_child();
+                this->check_hook();
+                continue;
+            }
+
+            if (this->exit_code) {
+                continue;
+            }
+
+            LINYAPS_BOX_DEBUG() << "Forward signal " << info->ssi_signo << " to container process";
+
+            if (this->child_pidfd.get() != -1) {
+                linyaps_box::utils::pidfd_send_signal(this->child_pidfd, info->ssi_signo);
+            } else if (::kill(this->child_pid, info->ssi_signo)) {
+                throw std::system_error(errno, std::generic_category(), "kill");
+            }
+        }
+    }
+
+    void check_child()
+    {
+        if (this->exit_code) {
+            return;
+        }
+
+        siginfo_t info{};
+        if (::waitid(P_PID, this->child_pid, &info, WEXITED | WNOHANG) < 0) {
+            throw std::system_error(errno, std::generic_category(), "waitid");
+        }
+
+        if (info.si_pid == 0) {
+            return;
+        }
+
+        this->exit_code = exit_code_of(info);
+
+        LINYAPS_BOX_DEBUG() << "Container process exited with " << *this->exit_code;
+
+        this->publish_exit(info);
+
+        if (this->child_pidfd.get() != -1) {
+            this->epoll.remove(this->child_pidfd);
+            this->child_pidfd = linyaps_box::utils::file_descriptor();
+        }
+
+        if (this->socket.get() != -1) {
+            this->epoll.remove(this->socket);
+            this->socket = linyaps_box::utils::file_descriptor();
+        }
+
+        this->set_status(linyaps_box::container_status_t::runtime_status::STOPPED);
+
+        if (this->stage != stage_t::started && !this->error) {
+            throw std::runtime_error((std::stringstream() << "container process exited with "
+                                                          << *this->exit_code << " before started")
+                                             .str());
+        }
+    }
+
+    void start_hooks(const char *name,
+                     std::deque<const linyaps_box::config::hooks_t::hook_t *> pending,
+                     bool fatal,
+                     std::function<void()> on_finished)
+    {
+        assert(!this->hooks);
+
+        LINYAPS_BOX_DEBUG() << "Execute " << name << " hooks";
+
+        this->hooks = hook_chain_t{ name, std::move(pending), fatal, std::move(on_finished), {} };
+        this->start_next_hook();
+    }
+
+    void start_next_hook()
+    {
+        auto &hooks = *this->hooks;
+        assert(!hooks.current);
+
+        if (hooks.pending.empty()) {
+            LINYAPS_BOX_DEBUG() << "All " << hooks.name << " hooks executed";
+
+            auto on_finished = std::move(hooks.on_finished);
+            this->hooks.reset();
+            if (on_finished) {
+                on_finished();
+            }
+            return;
+        }
+
+        const auto *hook = hooks.pending.front();
+        hooks.pending.pop_front();
+
+        // NOTE: Plugin hooks return immediately, they are called synchronously.
+        if (hook->entry) {
+            try {
+                linyaps_box::plugin::call_context_t context;
+                context.stage = hooks.name;
+                context.id = this->container.id();
+                context.bundle = std::filesystem::absolute(this->container.get_bundle());
+                context.pid = this->child_pid;
+                context.pidfd = this->child_pidfd.get();
+                linyaps_box::plugin::call(this->plugins.at(hook), *hook, context);
+            } catch (const std::exception &e) {
+                this->hook_failed(hooks, e);
+                if (hooks.fatal) {
+                    this->hooks.reset();
+                    throw;
+                }
+                LINYAPS_BOX_WARNING()
+                        << "Failed to execute " << hooks.name << " hook: " << e.what();
+            }
+
+            this->start_next_hook();
+            return;
+        }
+
+        hook_process_t process{ hook, spawn_hook(*hook), {}, {} };
+        process.pidfd = open_pidfd(process.pid);
+        if (process.pidfd.get() != -1) {
+            this->epoll.add(process.pidfd, EPOLLIN);
+        }
+        if (hook->timeout) {
+            process.deadline = std::chrono::steady_clock::now() + std::chrono::seconds(*hook->timeout);
+        }
+
+        hooks.current = std::move(process);
+    }
+
+    void check_hook()
+    {
+        if (!this->hooks || !this->hooks->current) {
+            return;
+        }
+
+        auto &hooks = *this->hooks;
+        auto &current = *hooks.current;
+
+        siginfo_t info{};
+        if (::waitid(P_PID, current.pid, &info, WEXITED | WNOHANG) < 0) {
+            throw std::system_error(errno, std::generic_category(), "waitid");
+        }
+
+        if (info.si_pid == 0) {
+            return;
+        }
+
+        if (current.pidfd.get() != -1) {
+            this->epoll.remove(current.pidfd);
+        }
+
+        auto process = std::move(current);
+        hooks.current.reset();
+
+        try {
+            if (process.timed_out) {
+                throw std::runtime_error((std::stringstream()
+                                          << "hook " << process.hook->path << " timed out after "
+                                          << *process.hook->timeout << " seconds")
+                                                 .str());
+            }
+            check_hook_result(*process.hook, info);
         } catch (const std::exception &e) {
-            std::cerr << "Error: " << e.what() << std::endl;
+            this->hook_failed(hooks, e);
+            if (hooks.fatal) {
+                this->hooks.reset();
+                throw;
+            }
+            LINYAPS_BOX_WARNING() << "Failed to execute " << hooks.name << " hook: " << e.what();
         }
-}
 
-[[nodiscard]] static int wait_container_process(pid_t pid)
-{
-    int status = 0;
+        this->start_next_hook();
+    }
 
-    pid_t ret = -1;
-    while (ret == -1) {
-        ret = waitpid(pid, &status, 0);
+    void hook_failed(const hook_chain_t &hooks, const std::exception &e)
+    {
+        linyaps_box::events::event_t event;
+        event.type = "hook-failed";
+        event.fields = { { "hook", hooks.name }, { "error", e.what() }, { "fatal", hooks.fatal } };
+        this->publish(std::move(event));
+    }
 
-        if (ret != -1) {
-            break;
+    // NOTE: The container is placed in its cgroup before it starts, e.g. by createRuntime hooks.
+    // Processes killed in a cgroup shared with the runtime are not necessarily of the container,
+    // so OOM kills are only reported for containers in their own cgroups.
+    void watch_oom_kills()
+    {
+        auto cgroup = linyaps_box::events::cgroup_of(this->child_pid);
+        if (!cgroup || cgroup == linyaps_box::events::cgroup_of(::getpid())) {
+            LINYAPS_BOX_DEBUG() << "OOM kills are not reported, the container has no own cgroup";
+            return;
         }
 
-        if (errno == EINTR || errno == EAGAIN) {
-            continue;
+        this->oom_kills = linyaps_box::events::oom_kills(*cgroup);
+        if (this->oom_kills) {
+            this->cgroup = std::move(cgroup);
         }
+    }
 
-        throw std::system_error(errno, std::generic_category(), "waitpid");
+    void publish_exit(const siginfo_t &info)
+    {
+        linyaps_box::events::event_t event;
+        event.type = "exit";
+        event.fields["exitCode"] = *this->exit_code;
+        if (info.si_code != CLD_EXITED) {
+            event.fields["signal"] = info.si_status;
+        }
+        this->publish(std::move(event));
+
+        // NOTE: The kernel counts processes killed by the OOM killer per cgroup only,
+        // the container is reported if it was killed by SIGKILL while the count of its own
+        // cgroup increased, see watch_oom_kills.
+        if (info.si_code != CLD_KILLED || info.si_status != SIGKILL || !this->cgroup
+            || !this->oom_kills) {
+            return;
+        }
+
+        auto kills = linyaps_box::events::oom_kills(*this->cgroup);
+        if (!kills || *kills <= *this->oom_kills) {
+            return;
+        }
+
+        LINYAPS_BOX_WARNING() << "Container process was killed by the OOM killer";
+        event = {};
+        event.type = "oom";
+        this->publish(std::move(event));
+    }
+};
+
+static void poststop_hooks(const linyaps_box::container &container,
+                           const linyaps_box::features::set_t &features,
+                           const monitor::event_callback_t &publish) noexcept
+{
+    if (container.get_config().hooks.poststop.empty()) {
+        return;
     }
-    return WEXITSTATUS(status);
+
+    linyaps_box::plugin::entries_t plugins;
+    try {
+        plugins = load_plugins(container);
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+    }
+
+    for (const auto &hook : container.get_config().hooks.poststop)
+        try {
+            if (!hook.entry) {
+                execute_hook(hook, features);
+                continue;
+            }
+
+            auto it = plugins.find(&hook);
+            if (it == plugins.end()) {
+                throw std::runtime_error("plugin hook " + *hook.entry + " is not loaded");
+            }
+
+            linyaps_box::plugin::call_context_t context;
+            context.stage = "poststop";
+            context.id = container.id();
+            context.bundle = std::filesystem::absolute(container.get_bundle());
+            linyaps_box::plugin::call(it->second, hook, context);
+        } catch (const std::exception &e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+
+            linyaps_box::events::event_t event;
+            event.type = "hook-failed";
+            event.fields = { { "hook", "poststop" }, { "error", e.what() }, { "fatal", false } };
+            publish(std::move(event));
+        }
 }
 
 } // namespace runtime_ns
 
 } // namespace
 
+struct linyaps_box::running_container::state
+{
+    state(linyaps_box::container &container,
+          const linyaps_box::features::set_t &features,
+          pid_t pid,
+          linyaps_box::utils::file_descriptor socket,
+          std::unique_ptr<runtime_ns::blocked_signals> signals,
+          runtime_ns::monitor::status_callback_t set_status,
+          runtime_ns::monitor::event_callback_t publish)
+        : container(container)
+        , pid(pid)
+        , monitor(container,
+                  features,
+                  pid,
+                  std::move(socket),
+                  std::move(signals),
+                  std::move(set_status),
+                  std::move(publish))
+    {
+        if (features.has(linyaps_box::features::pidfd)) {
+            this->pidfd = linyaps_box::utils::pidfd_open(pid);
+        }
+    }
+
+    linyaps_box::container &container;
+    pid_t pid;
+    linyaps_box::utils::file_descriptor pidfd;
+    runtime_ns::monitor monitor;
+    std::optional<int> exit_code;
+    bool waited = false;
+};
+
 linyaps_box::container::container(std::shared_ptr<status_directory> status_dir,
-                                  const std::string &id,
-                                  const std::filesystem::path &bundle,
-                                  const std::filesystem::path &config)
-    : container_ref(std::move(status_dir), id)
-    , bundle(bundle)
+                                  const create_container_options_t &options)
+    : container(status_dir,
+                options,
+                linyaps_box::config_cache::load(status_dir->config_cache(), options.config))
 {
-    std::ifstream ifs(config);
-    this->config = linyaps_box::config::parse(ifs);
+}
+
+linyaps_box::container::container(std::shared_ptr<status_directory> status_dir,
+                                  const create_container_options_t &options,
+                                  linyaps_box::config config)
+    : container_ref(std::move(status_dir), options.ID)
+    , bundle(options.bundle)
+    , config(std::move(config))
+    , options(options)
+{
+    if (this->config.annotations.count(single_instance_annotation) != 0) {
+        this->options.control_socket = true;
+    }
+
+    check_new_id(this->status_dir(), options.ID);
 
     {
         container_status_t status;
-        status.ID = id;
+        status.ID = options.ID;
         status.PID = getpid();
+        status.start_time = utils::process_start_time(status.PID).value_or(0);
         status.status = container_status_t::runtime_status::CREATING;
-        status.bundle = bundle;
+        // NOTE: `ll-box checkpoint` might run in another working directory.
+        status.bundle = std::filesystem::absolute(options.bundle);
         status.created = ""; // FIXME
         status.owner = getuid();
+        status.annotations = this->config.annotations;
+        status.runtime_pid = status.PID;
+        status.runtime_start_time = status.start_time;
         this->status_dir().write(status);
+        this->publish(events::state_changed(std::nullopt, status));
     }
 }
 
@@ -1448,36 +2925,179 @@ const std::filesystem::path &linyaps_box::container::get_bundle() const
     return this->bundle;
 }
 
-int linyaps_box::container::run(const config::process_t &process)
+const linyaps_box::create_container_options_t &linyaps_box::container::get_options() const
 {
-    auto [child_pid, socket] = runtime_ns::start_container_process(*this, process);
+    return this->options;
+}
 
-    {
-        auto status = this->status();
-        assert(status.status == container_status_t::runtime_status::CREATING);
+void linyaps_box::container::cleanup()
+{
+    const auto &features = features::load(this->status_dir().features_cache());
+    runtime_ns::poststop_hooks(*this, features, [this](events::event_t event) {
+        this->publish(std::move(event));
+    });
+
+    this->status_dir().remove(this->id_);
+
+    events::event_t event;
+    event.type = "deleted";
+    this->publish(std::move(event));
+}
+
+void linyaps_box::container::publish(events::event_t event) const
+{
+    event.ID = this->id_;
+    events::publish(this->status_dir().events_journal(), event);
+}
+
+linyaps_box::running_container linyaps_box::container::start(const config::process_t &process)
+{
+    pid_t child_pid = -1;
+    linyaps_box::utils::file_descriptor socket;
+    const features::set_t *features = nullptr;
+    std::unique_ptr<runtime_ns::blocked_signals> signals;
+    try {
+        // NOTE: The control socket is served by init of the container,
+        // the runtime closes it after clone(2).
+        linyaps_box::utils::file_descriptor control_socket;
+        if (this->options.control_socket) {
+            control_socket = agent::listen(this->status_dir().control_socket(this->id_));
+        }
+        features = &features::load(this->status_dir().features_cache());
+        signals = std::make_unique<runtime_ns::blocked_signals>(*this, *features);
+        std::tie(child_pid, socket) =
+                runtime_ns::start_container_process(*this,
+                                                    process,
+                                                    control_socket,
+                                                    *features,
+                                                    this->status_dir().hooks_cache(),
+                                                    this->status_dir().seccomp_cache(),
+                                                    this->status_dir().exec_policy(this->id_));
+    } catch (...) {
+        this->cleanup();
+        throw;
+    }
+
+    // NOTE: The start time is read once, the state is written on every change of the status.
+    auto set_status = [this,
+                       child_pid = child_pid,
+                       start_time = utils::process_start_time(child_pid).value_or(0)](
+                              container_status_t::runtime_status value) {
+        auto previous = this->status();
+        auto status = previous;
         status.PID = child_pid;
-        status.status = container_status_t::runtime_status::CREATED;
+        status.start_time = start_time;
+        status.status = value;
         this->status_dir().write(status);
+        this->publish(events::state_changed(previous, status));
+    };
+
+    std::unique_ptr<running_container::state> state;
+    try {
+        state = std::make_unique<running_container::state>(*this,
+                                                           *features,
+                                                           child_pid,
+                                                           std::move(socket),
+                                                           std::move(signals),
+                                                           set_status,
+                                                           [this](events::event_t event) {
+                                                               this->publish(std::move(event));
+                                                           });
+    } catch (...) {
+        ::kill(child_pid, SIGKILL);
+        [[maybe_unused]] auto info = wait_process(child_pid);
+        this->cleanup();
+        throw;
+    }
+
+    try {
+        state->monitor.start();
+    } catch (...) {
+        state->waited = true;
+        this->cleanup();
+        throw;
     }
 
-    runtime_ns::configure_container_namespaces(*this, socket);
-    runtime_ns::prestart_hooks(*this);
-    runtime_ns::create_runtime_hooks(*this, socket);
-    runtime_ns::wait_create_container_result(*this, socket);
-    runtime_ns::wait_socket_close(socket);
-    runtime_ns::poststart_hooks(*this);
-    auto container_process_exit_code = runtime_ns::wait_container_process(this->status().PID);
+    return running_container(std::move(state));
+}
 
-    {
-        auto status = this->status();
-        assert(status.status == container_status_t::runtime_status::STOPPED);
-        status.PID = child_pid;
-        this->status_dir().write(status);
+int linyaps_box::container::run(const config::process_t &process)
+{
+    return this->start(process).wait();
+}
+
+linyaps_box::running_container::running_container(std::unique_ptr<state> state)
+    : state_(std::move(state))
+{
+}
+
+linyaps_box::running_container::running_container(running_container &&) noexcept = default;
+
+linyaps_box::running_container::~running_container() noexcept
+{
+    if (!this->state_ || this->state_->waited) {
+        return;
     }
 
-    runtime_ns::poststop_hooks(*this);
+    try {
+        this->kill(SIGKILL);
+        [[maybe_unused]] auto exit_code = this->wait();
+    } catch (const std::exception &e) {
+        LINYAPS_BOX_ERR() << "Failed to stop container " << this->state_->container.get_options().ID
+                          << ": " << e.what();
+    }
+}
 
-    this->status_dir().remove(this->id_);
+pid_t linyaps_box::running_container::pid() const
+{
+    return this->state_->pid;
+}
+
+const linyaps_box::utils::file_descriptor &linyaps_box::running_container::pidfd() const
+{
+    return this->state_->pidfd;
+}
+
+linyaps_box::container_status_t linyaps_box::running_container::status() const
+{
+    return this->state_->container.status();
+}
+
+void linyaps_box::running_container::kill(int signal)
+{
+    if (this->state_->waited) {
+        throw std::system_error(ESRCH, std::generic_category(), "kill");
+    }
+
+    if (this->state_->pidfd.get() != -1) {
+        linyaps_box::utils::pidfd_send_signal(this->state_->pidfd, signal);
+        return;
+    }
+
+    if (::kill(this->state_->pid, signal)) {
+        throw std::system_error(errno, std::generic_category(), "kill");
+    }
+}
+
+int linyaps_box::running_container::wait()
+{
+    auto &state = *this->state_;
+    if (state.waited) {
+        if (!state.exit_code) {
+            throw std::logic_error("container process has been waited");
+        }
+        return *state.exit_code;
+    }
+
+    state.waited = true;
+    try {
+        state.exit_code = state.monitor.wait();
+    } catch (...) {
+        state.container.cleanup();
+        throw;
+    }
+
+    state.container.cleanup();
 
-    return container_process_exit_code;
+    return *state.exit_code;
 }
@@ -5,25 +5,147 @@
 #pragma once
 
 #include "linyaps_box/container_ref.h"
+#include "linyaps_box/events.h"
 #include "linyaps_box/status_directory.h"
+#include "linyaps_box/utils/file_describer.h"
+
+#include <chrono>
+#include <memory>
 
 namespace linyaps_box {
 
+// Containers with the same value of this annotation are instances of one application,
+// which handles later launches itself, usually by D-Bus activation.
+// A launch of it spawns its process in the running instance if there is one,
+// see runtime_t::find_single_instance.
+// Such containers serve a control socket, as if `control_socket` is set.
+constexpr auto single_instance_annotation = "org.openatom.linyaps.box.single-instance";
+
+struct create_container_options_t
+{
+    std::filesystem::path bundle;
+    std::filesystem::path config;
+    std::string ID;
+
+    // Run a minimal init as PID 1 of the container,
+    // which reaps zombies and forwards signals to the container process.
+    bool init = false;
+
+    // Forward SIGTERM, SIGINT, SIGHUP, SIGQUIT, SIGUSR1 and SIGUSR2
+    // received by the calling thread to the container process.
+    // The signals are blocked in the calling thread while the container is monitored,
+    // so a program launching containers from several threads should disable it.
+    bool forward_signals = true;
+
+    // Pass file descriptors from 3 to 3 + preserve_fds - 1 of the runtime
+    // to the container process, for example sockets passed by socket activation.
+    // LISTEN_PID is set to the container process if its environment has LISTEN_FDS.
+    unsigned int preserve_fds = 0;
+
+    // Serve a control socket in the status directory by init,
+    // on which processes are spawned in the container without joining its namespaces,
+    // see linyaps_box::agent. It implies `init`.
+    // It is set for containers with the single instance annotation.
+    bool control_socket = false;
+
+    // A file descriptor of the root filesystem opened by the caller,
+    // which is used instead of opening `root.path` of the configuration.
+    // Likewise, bind mounts with source `fd:N` use the file descriptor N of the caller,
+    // which requires the new mount API of Linux 5.2.
+    // These file descriptors are kept open by the caller and not passed to the container process,
+    // so they must not be in the range of `preserve_fds`.
+    int rootfs_fd = -1;
+
+    // Bound the whole setup of the container, from cloning the container process
+    // until it is started, including the prestart, createRuntime, createContainer
+    // and startContainer hooks. The container is killed if it is not started in time.
+    // Zero means no bound, hooks are still bound by their own `timeout`.
+    std::chrono::seconds start_timeout{ 0 };
+
+    // The directory of trusted plugins of plugin hooks, see linyaps_box/plugin_loader.h.
+    // Empty means plugin::default_directory().
+    std::filesystem::path plugin_dir;
+};
+
+class running_container;
+
+// NOTE: A container can be created and run by any thread,
+// different containers can be launched concurrently from different threads
+// as long as they do not share the same ID.
+// Launching containers concurrently requires pidfd support (Linux 5.3),
+// otherwise SIGCHLD is used to watch processes, which is process-wide.
+
 class container : public container_ref
 {
 public:
+    // Create a container with the configuration file at `options.config`.
+    container(std::shared_ptr<status_directory> status_dir,
+              const create_container_options_t &options);
+
+    // Create a container with an in-memory configuration,
+    // `options.config` is ignored.
     container(std::shared_ptr<status_directory> status_dir,
-              const std::string &id,
-              const std::filesystem::path &bundle,
-              const std::filesystem::path &config);
+              const create_container_options_t &options,
+              linyaps_box::config config);
 
     [[nodiscard]] const linyaps_box::config &get_config() const;
     [[nodiscard]] const std::filesystem::path &get_bundle() const;
+    [[nodiscard]] const create_container_options_t &get_options() const;
+
+    // Start `process` in the container, return once it is running,
+    // that is after the startContainer and poststart hooks are executed.
+    // The container must outlive the returned handle.
+    [[nodiscard]] running_container start(const config::process_t &process);
+
+    // Start `process` and wait for it, returns its exit code.
     [[nodiscard]] int run(const config::process_t &process);
 
 private:
+    friend class running_container;
+
+    void cleanup();
+
+    // Publish `event` of the container, see linyaps_box::events.
+    void publish(events::event_t event) const;
+
     std::filesystem::path bundle;
     linyaps_box::config config;
+    create_container_options_t options;
+};
+
+// The handle of a started container process.
+// If it is destroyed before wait(), the container process is killed and waited.
+// A handle must be used from the thread which started it if signals are forwarded.
+class running_container
+{
+public:
+    running_container(running_container &&) noexcept;
+    running_container &operator=(running_container &&) = delete;
+    ~running_container() noexcept;
+
+    [[nodiscard]] pid_t pid() const;
+
+    // A pidfd refers to the container process,
+    // which becomes readable when the process exits.
+    // It is -1 if pidfd is not supported.
+    [[nodiscard]] const utils::file_descriptor &pidfd() const;
+
+    [[nodiscard]] container_status_t status() const;
+
+    void kill(int signal);
+
+    // Wait for the container process, run poststop hooks and remove the status,
+    // returns the exit code of the container process.
+    [[nodiscard]] int wait();
+
+private:
+    friend class container;
+
+    struct state;
+
+    explicit running_container(std::unique_ptr<state> state);
+
+    std::unique_ptr<state> state_;
 };
 
 } // namespace linyaps_box
@@ -4,7 +4,150 @@
 
 #include "linyaps_box/container_ref.h"
 
+#include "linyaps_box/agent.h"
+#include "linyaps_box/features.h"
+#include "linyaps_box/init.h"
+#include "linyaps_box/process.h"
+#include "linyaps_box/utils/epoll.h"
+#include "linyaps_box/utils/file_describer.h"
+#include "linyaps_box/utils/log.h"
+#include "linyaps_box/utils/open_file.h"
+#include "linyaps_box/utils/pidfd.h"
+#include "linyaps_box/utils/signalfd.h"
+
+#include <cstdlib>
+#include <iostream>
+
+#include <sched.h>
 #include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+struct namespace_file_t
+{
+    int type;
+    const char *name;
+};
+
+// NOTE: The user namespace goes first as it grants capabilities over the others,
+// and the mount namespace goes last as the others are opened from /proc of the runtime.
+constexpr namespace_file_t namespace_files[] = {
+    { CLONE_NEWUSER, "user" }, { CLONE_NEWIPC, "ipc" },       { CLONE_NEWUTS, "uts" },
+    { CLONE_NEWNET, "net" },   { CLONE_NEWCGROUP, "cgroup" }, { CLONE_NEWPID, "pid" },
+    { CLONE_NEWNS, "mnt" },
+};
+
+[[nodiscard]] bool same_namespace(pid_t pid, const char *name)
+{
+    auto path = std::filesystem::path("/proc") / std::to_string(pid) / "ns" / name;
+
+    struct stat target{};
+    if (::stat(path.c_str(), &target)) {
+        // NOTE: The kernel does not support this type of namespace.
+        if (errno == ENOENT && ::access(("/proc/self/ns/" + std::string(name)).c_str(), F_OK)) {
+            return true;
+        }
+        throw std::system_error(errno, std::generic_category(), "stat " + path.string());
+    }
+
+    struct stat self{};
+    path = std::filesystem::path("/proc/self/ns") / name;
+    if (::stat(path.c_str(), &self)) {
+        throw std::system_error(errno, std::generic_category(), "stat " + path.string());
+    }
+
+    return target.st_dev == self.st_dev && target.st_ino == self.st_ino;
+}
+
+// Join the namespaces of `pid` which differ from ours,
+// joining a namespace we are already in fails for user namespace.
+void join_namespaces(pid_t pid, const linyaps_box::features::set_t &features)
+{
+    int flags = 0;
+    for (const auto &ns : namespace_files) {
+        if (!same_namespace(pid, ns.name)) {
+            flags |= ns.type;
+        }
+    }
+
+    if (flags == 0) {
+        return;
+    }
+
+    // NOTE: setns(2) with a pidfd (Linux 5.8) joins all namespaces at once,
+    // older kernels return EINVAL for it.
+    if (features.has(linyaps_box::features::pidfd)) {
+        auto pidfd = linyaps_box::utils::pidfd_open(pid);
+        if (::setns(pidfd.get(), flags) == 0) {
+            LINYAPS_BOX_DEBUG() << "Joined namespaces " << flags << " of " << pid << " by pidfd";
+            return;
+        }
+        if (errno != EINVAL) {
+            throw std::system_error(errno, std::generic_category(), "setns");
+        }
+    }
+
+    std::vector<std::pair<int, linyaps_box::utils::file_descriptor>> fds;
+    for (const auto &ns : namespace_files) {
+        if (flags & ns.type) {
+            fds.emplace_back(ns.type,
+                             linyaps_box::utils::open(std::filesystem::path("/proc")
+                                                              / std::to_string(pid) / "ns"
+                                                              / ns.name,
+                                                      O_RDONLY | O_CLOEXEC));
+        }
+    }
+
+    for (const auto &[type, fd] : fds) {
+        LINYAPS_BOX_DEBUG() << "Join namespace " << type << " by " << fd.proc_path();
+        if (::setns(fd.get(), type)) {
+            throw std::system_error(errno, std::generic_category(), "setns");
+        }
+    }
+}
+
+// Spawn `process` by the agent of the container,
+// forward signals to it and exit with its exit code.
+[[noreturn]] void exec_by_agent(const std::filesystem::path &control_socket,
+                                const linyaps_box::config::process_t &process)
+{
+    auto set = linyaps_box::init::forwarded_signals();
+    if (sigprocmask(SIG_BLOCK, &set, nullptr)) {
+        throw std::system_error(errno, std::generic_category(), "sigprocmask");
+    }
+    auto signal_fd = linyaps_box::utils::signalfd(set);
+
+    auto spawned = linyaps_box::agent::spawn(control_socket,
+                                             process,
+                                             { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO });
+    LINYAPS_BOX_DEBUG() << "Process " << spawned.pid() << " spawned by agent";
+
+    linyaps_box::utils::epoll epoll;
+    epoll.add(signal_fd, EPOLLIN);
+    epoll.add(spawned.connection(), EPOLLIN);
+
+    while (true) {
+        for (const auto &event : epoll.wait()) {
+            if (event.data.fd == spawned.connection().get()) {
+                std::exit(spawned.wait());
+            }
+
+            while (auto info = linyaps_box::utils::read_signal(signal_fd)) {
+                LINYAPS_BOX_DEBUG() << "Forward signal " << info->ssi_signo << " to "
+                                    << spawned.pid();
+                try {
+                    spawned.kill(info->ssi_signo);
+                } catch (const std::system_error &e) {
+                    LINYAPS_BOX_WARNING() << "Failed to forward signal: " << e.what();
+                }
+            }
+        }
+    }
+}
+
+} // namespace
 
 linyaps_box::container_ref::container_ref(std::shared_ptr<status_directory> status_dir,
                                           const std::string &id)
@@ -31,58 +174,77 @@ void linyaps_box::container_ref::kill(int signal)
                             (std::stringstream() << "kill " << signal << " " << pid).str());
 }
 
+pid_t linyaps_box::container_ref::spawn(const linyaps_box::config::process_t &process)
+{
+    auto control_socket = this->status_dir().control_socket(this->id_);
+    std::error_code ec;
+    if (!std::filesystem::is_socket(control_socket, ec)) {
+        throw std::runtime_error("container " + this->id_ + " has no control socket");
+    }
+
+    auto spawned = linyaps_box::agent::spawn(control_socket,
+                                             process,
+                                             { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO });
+    LINYAPS_BOX_DEBUG() << "Process " << spawned.pid() << " spawned by agent of " << this->id_;
+
+    // NOTE: The spawned process keeps running after the connection is closed.
+    return spawned.pid();
+}
+
+const std::string &linyaps_box::container_ref::id() const
+{
+    return this->id_;
+}
+
 void linyaps_box::container_ref::exec(const linyaps_box::config::process_t &process)
 {
-    auto target = std::to_string(this->status().PID);
-    auto wd = process.cwd.string();
-
-    std::vector<const char *> argv{
-        "nsenter",
-        "--target",
-        target.c_str(),
-        "--user",
-        "--mount",
-        "--pid",
-
-        // FIXME:
-        // Old nsenter command do not support --wdns,
-        // so we have to implement nsenter by ourself in the future.
-        "--wdns",
-        wd.c_str(),
-
-        "--preserve-credentials",
-        "--",
-    };
-
-    for (const auto &arg : process.args) {
-        argv.push_back(arg.c_str());
+    auto control_socket = this->status_dir().control_socket(this->id_);
+    std::error_code ec;
+    if (std::filesystem::is_socket(control_socket, ec)) {
+        exec_by_agent(control_socket, process);
     }
-    argv.push_back(nullptr);
-
-    // FIXME:
-    // We only handle the command arguments for now
-    // here are some other fields in process we need to consider:
-    // terminal
-    // console.height
-    // console.width
-    // cwd
-    // env
-    // rlimits
-    // apparmor_profile
-    // capabilities
-    // no_new_privileges
-    // oom_score_adj
-
-    ::execvp("nsenter", const_cast<char **>(argv.data()));
-
-    std::stringstream ss;
-
-    ss << "execvp nsenter with arguments:";
-    for (const auto &arg : argv) {
-        ss << " " << arg;
+
+    // NOTE: Checked before joining the namespaces, the process inherits our stdio.
+    linyaps_box::validate_process(process);
+    linyaps_box::check_terminal(process, STDIN_FILENO);
+    auto policy = this->exec_policy();
+    exec_policy::check(policy, process);
+
+    join_namespaces(this->status().PID, features::load(this->status_dir().features_cache()));
+
+    // NOTE: Joining a PID namespace only applies to children,
+    // we wait for the child and forward signals to it like init does.
+    auto mask = linyaps_box::init::block_signals();
+
+    auto pid = fork();
+    if (pid < 0) {
+        throw std::system_error(errno, std::generic_category(), "fork");
     }
 
-    throw std::system_error(errno, std::generic_category(), std::move(ss).str());
+    if (pid == 0) {
+        try {
+            if (sigprocmask(SIG_SETMASK, &mask, nullptr)) {
+                throw std::system_error(errno, std::generic_category(), "sigprocmask");
+            }
+            linyaps_box::execute_process(process, std::move(policy.seccomp));
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+        } catch (...) {
+            std::cerr << "unknown error" << std::endl;
+        }
+        _exit(-1);
+    }
+
+    linyaps_box::init::run(pid);
+}
+
+linyaps_box::exec_policy::policy_t linyaps_box::container_ref::exec_policy() const
+{
+    auto path = this->status_dir().exec_policy(this->id_);
+    if (!std::filesystem::exists(path)) {
+        throw std::runtime_error("container " + this->id_ + " has no exec policy");
+    }
+    return exec_policy::read(path);
 }
 
 linyaps_box::status_directory &linyaps_box::container_ref::status_dir() const
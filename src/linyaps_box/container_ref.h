@@ -6,6 +6,7 @@
 
 #include "linyaps_box/config.h"
 #include "linyaps_box/container_status.h"
+#include "linyaps_box/exec_policy.h"
 #include "linyaps_box/status_directory.h"
 
 namespace linyaps_box {
@@ -17,8 +18,28 @@ public:
 
     container_status_t status() const;
     void kill(int signal);
+
+    // Execute `process` in the container, which must not be less restricted than
+    // the container process, with its seccomp filter installed, see linyaps_box::exec_policy.
+    // The calling process stays outside to wait for it and forward signals,
+    // then exits with its exit code.
+    // The process is spawned by the agent of the container if it has a control socket,
+    // otherwise the calling process joins the namespaces of the container,
+    // which must be single threaded to join user and mount namespaces.
     [[noreturn]] void exec(const config::process_t &process);
 
+    // Spawn `process` in the container by its agent and return without waiting for it,
+    // the process inherits the stdio of the calling process.
+    // Returns the PID of the process in the PID namespace of the container.
+    // The container must have a control socket.
+    pid_t spawn(const config::process_t &process);
+
+    // The restrictions of processes executed in the container, see linyaps_box::exec_policy.
+    // Throws if the container has none.
+    [[nodiscard]] exec_policy::policy_t exec_policy() const;
+
+    [[nodiscard]] const std::string &id() const;
+
 protected:
     status_directory &status_dir() const;
     std::string id_;
@@ -3,3 +3,25 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
 
 #include "linyaps_box/container_status.h"
+
+#include "linyaps_box/utils/start_time.h"
+
+#include <csignal>
+
+bool linyaps_box::is_alive(const container_status_t &status)
+{
+    if (status.start_time == 0) {
+        return ::kill(status.PID, 0) == 0;
+    }
+
+    return utils::process_start_time(status.PID) == status.start_time;
+}
+
+bool linyaps_box::is_runtime_alive(const container_status_t &status)
+{
+    if (status.runtime_pid <= 0) {
+        return false;
+    }
+
+    return utils::process_start_time(status.runtime_pid) == status.runtime_start_time;
+}
@@ -4,10 +4,13 @@
 
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
 #include <map>
 #include <string>
 
+#include <sys/types.h>
+
 namespace linyaps_box {
 
 struct container_status_t
@@ -21,6 +24,23 @@ struct container_status_t
     std::string created;
     uid_t owner;
     std::map<std::string, std::string> annotations;
+
+    // The start time of PID, see linyaps_box::utils::process_start_time.
+    // It is recorded by the writer along with PID, 0 if it is unknown, as in older states.
+    std::uint64_t start_time = 0;
+
+    // The runtime process which created the container and removes the state when it exits,
+    // and its start time recorded along with it, 0 if it is unknown, as in older states.
+    pid_t runtime_pid = 0;
+    std::uint64_t runtime_start_time = 0;
 };
 
+// Whether the process of `status` is still running,
+// rather than exited with its PID reused by another process.
+[[nodiscard]] bool is_alive(const container_status_t &status);
+
+// Whether the runtime of `status` is still running, which removes the state by itself.
+// It is false for states of older versions, which have no runtime recorded.
+[[nodiscard]] bool is_runtime_alive(const container_status_t &status);
+
 } // namespace linyaps_box
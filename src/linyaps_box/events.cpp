@@ -0,0 +1,449 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/events.h"
+
+#include "linyaps_box/utils/log.h"
+#include "linyaps_box/utils/pidfd.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+std::string status_to_string(linyaps_box::container_status_t::runtime_status status)
+{
+    switch (status) {
+    case linyaps_box::container_status_t::runtime_status::CREATING:
+        return "creating";
+    case linyaps_box::container_status_t::runtime_status::CREATED:
+        return "created";
+    case linyaps_box::container_status_t::runtime_status::RUNNING:
+        return "running";
+    case linyaps_box::container_status_t::runtime_status::STOPPED:
+        return "stopped";
+    }
+
+    throw std::logic_error("unknown status");
+}
+
+nlohmann::json status_to_json(const linyaps_box::container_status_t &status)
+{
+    return nlohmann::json::object({
+            { "pid", status.PID },
+            { "status", status_to_string(status.status) },
+            { "bundle", status.bundle.string() },
+            { "created", status.created },
+            { "owner", status.owner },
+            { "annotations", status.annotations },
+    });
+}
+
+// Rename the journal `fd` refers to, unless another runtime did it.
+void rotate(const std::filesystem::path &journal,
+            const linyaps_box::utils::file_descriptor &fd,
+            std::size_t rotate_size)
+{
+    while (::flock(fd.get(), LOCK_EX)) {
+        if (errno != EINTR) {
+            throw std::system_error(errno, std::generic_category(), "flock");
+        }
+    }
+
+    struct stat current{};
+    struct stat opened{};
+    if (::stat(journal.c_str(), &current) == 0 && ::fstat(fd.get(), &opened) == 0
+        && current.st_dev == opened.st_dev && current.st_ino == opened.st_ino
+        && static_cast<std::size_t>(current.st_size) >= rotate_size) {
+        auto rotated = journal;
+        rotated += ".1";
+        if (::rename(journal.c_str(), rotated.c_str())) {
+            auto error = errno;
+            ::flock(fd.get(), LOCK_UN);
+            throw std::system_error(error, std::generic_category(), "rename");
+        }
+    }
+
+    ::flock(fd.get(), LOCK_UN);
+}
+
+[[nodiscard]] linyaps_box::utils::file_descriptor open_journal(const std::filesystem::path &journal)
+{
+    linyaps_box::utils::file_descriptor fd(
+            ::open(journal.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600));
+    if (fd.get() < 0) {
+        throw std::system_error(errno, std::generic_category(), "open " + journal.string());
+    }
+    return fd;
+}
+
+} // namespace
+
+std::string linyaps_box::events::to_string(const event_t &event)
+{
+    auto j = event.fields;
+    j["type"] = event.type;
+    j["id"] = event.ID;
+    return j.dump();
+}
+
+linyaps_box::events::event_t linyaps_box::events::from_string(std::string_view line)
+{
+    auto j = nlohmann::json::parse(line);
+
+    event_t event;
+    event.type = j.at("type").get<std::string>();
+    event.ID = j.at("id").get<std::string>();
+    j.erase("type");
+    j.erase("id");
+    event.fields = std::move(j);
+
+    return event;
+}
+
+linyaps_box::events::event_t
+linyaps_box::events::state_changed(const std::optional<container_status_t> &previous,
+                                   const std::optional<container_status_t> &current)
+{
+    event_t event;
+    if (!current) {
+        if (!previous) {
+            throw std::invalid_argument("neither previous nor current state is given");
+        }
+        event.type = "deleted";
+        event.ID = previous->ID;
+        return event;
+    }
+
+    event.ID = current->ID;
+    event.fields = status_to_json(*current);
+
+    if (!previous) {
+        event.type = "created";
+        return event;
+    }
+
+    auto old = status_to_json(*previous);
+    for (auto it = event.fields.begin(); it != event.fields.end();) {
+        if (it.key() != "status" && old.contains(it.key()) && old[it.key()] == it.value()) {
+            it = event.fields.erase(it);
+            continue;
+        }
+        ++it;
+    }
+
+    if (current->status == container_status_t::runtime_status::STOPPED) {
+        event.type = "stopped";
+    } else if (current->status == container_status_t::runtime_status::RUNNING
+               && previous->status != container_status_t::runtime_status::RUNNING) {
+        event.type = "started";
+    } else {
+        event.type = "updated";
+    }
+
+    return event;
+}
+
+void linyaps_box::events::publish(const std::filesystem::path &journal,
+                                  const event_t &event,
+                                  std::size_t rotate_size) noexcept
+try {
+    auto line = to_string(event) + "\n";
+
+    auto fd = open_journal(journal);
+    struct stat st{};
+    if (::fstat(fd.get(), &st)) {
+        throw std::system_error(errno, std::generic_category(), "fstat");
+    }
+    if (static_cast<std::size_t>(st.st_size) >= rotate_size) {
+        rotate(journal, fd, rotate_size);
+        fd = open_journal(journal);
+    }
+
+    // NOTE: Lines appended by a single write(2) are not interleaved with other runtimes.
+    ssize_t ret = 0;
+    do {
+        ret = ::write(fd.get(), line.data(), line.size());
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        throw std::system_error(errno, std::generic_category(), "write");
+    }
+    if (static_cast<std::size_t>(ret) != line.size()) {
+        throw std::runtime_error("short write");
+    }
+} catch (const std::exception &e) {
+    LINYAPS_BOX_WARNING() << "Failed to publish event " << event.type << " of container "
+                          << event.ID << ": " << e.what();
+}
+
+std::optional<std::filesystem::path> linyaps_box::events::cgroup_of(pid_t pid)
+{
+    std::ifstream ifs("/proc/" + std::to_string(pid) + "/cgroup");
+    std::string line;
+    while (std::getline(ifs, line)) {
+        // NOTE: The entry of cgroup v2 has the hierarchy ID 0 and no controllers.
+        if (line.rfind("0::/", 0) == 0) {
+            return std::filesystem::path("/sys/fs/cgroup") / line.substr(4);
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::optional<std::uint64_t> linyaps_box::events::oom_kills(const std::filesystem::path &cgroup)
+{
+    // NOTE: memory.events counts kills in descendant cgroups as well.
+    std::ifstream ifs(cgroup / "memory.events.local");
+    std::string key;
+    std::uint64_t value = 0;
+    while (ifs >> key >> value) {
+        if (key == "oom_kill") {
+            return value;
+        }
+    }
+
+    return std::nullopt;
+}
+
+linyaps_box::events::monitor::monitor(const status_directory &dir)
+    : journal_path(dir.events_journal())
+{
+    this->inotify = utils::file_descriptor(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+    if (this->inotify.get() < 0) {
+        throw std::system_error(errno, std::generic_category(), "inotify_init1");
+    }
+
+    // NOTE: The directory is watched, as the journal might not exist yet or be rotated.
+    if (::inotify_add_watch(this->inotify.get(),
+                            this->journal_path.parent_path().c_str(),
+                            IN_CREATE | IN_MODIFY | IN_MOVED_TO)
+        < 0) {
+        throw std::system_error(errno,
+                                std::generic_category(),
+                                "inotify_add_watch " + this->journal_path.parent_path().string());
+    }
+    this->epoll.add(this->inotify, EPOLLIN);
+
+    // NOTE: The journal is created if it does not exist yet, otherwise events published
+    // to it are missed if it is rotated before the monitor opens it.
+    this->journal = utils::file_descriptor(
+            ::open(this->journal_path.c_str(), O_RDONLY | O_CREAT | O_CLOEXEC, 0600));
+    if (this->journal.get() < 0) {
+        this->journal = utils::file_descriptor(
+                ::open(this->journal_path.c_str(), O_RDONLY | O_CLOEXEC));
+    }
+    if (this->journal.get() >= 0 && ::lseek(this->journal.get(), 0, SEEK_END) < 0) {
+        throw std::system_error(errno, std::generic_category(), "lseek");
+    }
+
+    for (const auto &status : dir.snapshot()) {
+        if (status.status == container_status_t::runtime_status::STOPPED) {
+            continue;
+        }
+
+        // NOTE: The process might exit and its PID be reused before the pidfd is opened.
+        this->watch_process(status.ID, status.PID);
+        if (!is_alive(status)) {
+            this->unwatch_process(status.ID);
+        }
+    }
+}
+
+std::vector<linyaps_box::events::event_t> linyaps_box::events::monitor::wait()
+{
+    std::vector<event_t> events;
+    while (events.empty()) {
+        for (const auto &event : this->epoll.wait()) {
+            if (event.data.fd == this->inotify.get()) {
+                this->follow_journal(events);
+                continue;
+            }
+
+            auto it = std::find_if(this->processes.begin(),
+                                   this->processes.end(),
+                                   [fd = event.data.fd](const auto &process) {
+                                       return process.second.pidfd.get() == fd;
+                                   });
+            if (it == this->processes.end()) {
+                continue;
+            }
+
+            // NOTE: The pidfd of the event might be closed above and its number reused.
+            pollfd pfd{ event.data.fd, POLLIN, 0 };
+            if (::poll(&pfd, 1, 0) <= 0) {
+                continue;
+            }
+
+            LINYAPS_BOX_DEBUG() << "Process " << it->second.pid << " of container " << it->first
+                                << " exited";
+
+            event_t stopped;
+            stopped.type = "stopped";
+            stopped.ID = it->first;
+            stopped.fields = { { "pid", it->second.pid }, { "status", "stopped" } };
+            events.push_back(std::move(stopped));
+
+            this->stopped.insert(it->first);
+            this->epoll.remove(it->second.pidfd);
+            this->processes.erase(it);
+        }
+    }
+
+    return events;
+}
+
+void linyaps_box::events::monitor::follow_journal(std::vector<event_t> &events)
+{
+    // NOTE: Events of the directory are only hints, the journal is read to its end anyway.
+    alignas(inotify_event) char buffer[4096];
+    while (true) {
+        auto size = ::read(this->inotify.get(), buffer, sizeof(buffer));
+        if (size < 0 && errno == EINTR) {
+            continue;
+        }
+        if (size < 0 && errno == EAGAIN) {
+            break;
+        }
+        if (size <= 0) {
+            throw std::system_error(errno, std::generic_category(), "read inotify");
+        }
+    }
+
+    this->read_journal(events);
+
+    // NOTE: A rotated journal is read to its end, then the new one from its start.
+    struct stat current{};
+    if (::stat(this->journal_path.c_str(), &current)) {
+        return;
+    }
+
+    struct stat opened{};
+    if (this->journal.get() >= 0 && ::fstat(this->journal.get(), &opened) == 0
+        && opened.st_dev == current.st_dev && opened.st_ino == current.st_ino) {
+        return;
+    }
+
+    // NOTE: Lines might be appended to the rotated journal since it was read above.
+    this->read_journal(events);
+
+    this->journal = utils::file_descriptor(
+            ::open(this->journal_path.c_str(), O_RDONLY | O_CLOEXEC));
+    this->pending.clear();
+    this->read_journal(events);
+}
+
+void linyaps_box::events::monitor::read_journal(std::vector<event_t> &events)
+{
+    if (this->journal.get() < 0) {
+        return;
+    }
+
+    char buffer[4096];
+    while (true) {
+        auto size = ::read(this->journal.get(), buffer, sizeof(buffer));
+        if (size < 0 && errno == EINTR) {
+            continue;
+        }
+        if (size < 0) {
+            throw std::system_error(errno, std::generic_category(), "read journal");
+        }
+        if (size == 0) {
+            break;
+        }
+        this->pending.append(buffer, static_cast<std::size_t>(size));
+    }
+
+    // NOTE: A line being appended is kept until it is complete.
+    std::size_t begin = 0;
+    for (auto end = this->pending.find('\n'); end != std::string::npos;
+         begin = end + 1, end = this->pending.find('\n', begin)) {
+        if (end == begin) {
+            continue;
+        }
+
+        try {
+            this->on_event(from_string(std::string_view(this->pending).substr(begin, end - begin)),
+                           events);
+        } catch (const std::exception &e) {
+            LINYAPS_BOX_WARNING() << "Skip an invalid event in " << this->journal_path << ": "
+                                  << e.what();
+        }
+    }
+    this->pending.erase(0, begin);
+}
+
+void linyaps_box::events::monitor::on_event(event_t event, std::vector<event_t> &events)
+{
+    if (event.type == "stopped" || event.type == "deleted") {
+        this->unwatch_process(event.ID);
+        // NOTE: The pidfd usually reports it before the runtime.
+        if (this->stopped.erase(event.ID) != 0 && event.type == "stopped") {
+            return;
+        }
+    } else if (event.type == "created" || event.type == "updated" || event.type == "started") {
+        if (event.type == "created") {
+            this->stopped.erase(event.ID);
+        }
+        auto pid = event.fields.find("pid");
+        if (pid != event.fields.end() && pid->is_number_integer()) {
+            this->watch_process(event.ID, pid->get<pid_t>());
+        }
+    }
+
+    events.push_back(std::move(event));
+}
+
+void linyaps_box::events::monitor::watch_process(const std::string &id, pid_t pid)
+{
+    auto it = this->processes.find(id);
+    if (it != this->processes.end()) {
+        if (it->second.pid == pid) {
+            return;
+        }
+        this->unwatch_process(id);
+    }
+
+    if (!this->pidfd_supported || pid <= 0) {
+        return;
+    }
+
+    utils::file_descriptor pidfd;
+    try {
+        pidfd = utils::pidfd_open(pid);
+    } catch (const std::system_error &e) {
+        if (e.code().value() == ENOSYS) {
+            LINYAPS_BOX_WARNING() << "pidfd is not supported, "
+                                     "containers of killed runtimes are not reported stopped";
+            this->pidfd_supported = false;
+            return;
+        }
+        // NOTE: The process exited already, its runtime reports it.
+        LINYAPS_BOX_DEBUG() << "Failed to watch process " << pid << " of container " << id
+                            << ": " << e.what();
+        return;
+    }
+
+    this->epoll.add(pidfd, EPOLLIN);
+    this->processes.emplace(id, process_t{ pid, std::move(pidfd) });
+}
+
+void linyaps_box::events::monitor::unwatch_process(const std::string &id)
+{
+    auto it = this->processes.find(id);
+    if (it == this->processes.end()) {
+        return;
+    }
+
+    this->epoll.remove(it->second.pidfd);
+    this->processes.erase(it);
+}
@@ -0,0 +1,118 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/container_status.h"
+#include "linyaps_box/status_directory.h"
+#include "linyaps_box/utils/epoll.h"
+#include "linyaps_box/utils/file_describer.h"
+#include "nlohmann/json.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Lifecycle events of containers, so a session manager notices containers
+// starting and exiting without polling the states.
+//
+// Runtimes append events to a journal of JSON lines in the status directory,
+// see status_directory::events_journal, which is rotated once it exceeds 1 MiB.
+// Empty lines in the journal are skipped.
+// State changes carry the changed fields only, other events are `exit`,
+// `oom` and `hook-failed`, which only the runtime knows.
+//
+// A monitor follows the journal by inotify(7) on the status directory,
+// and watches processes of containers by pidfds,
+// so a container is reported stopped even if its runtime was killed.
+
+namespace linyaps_box::events {
+
+// The journal is rotated to `<journal>.1` once it exceeds this size.
+constexpr std::size_t journal_rotate_size = 1024 * 1024;
+
+struct event_t
+{
+    // `created`, `updated`, `started`, `stopped`, `deleted`, `exit`, `oom` or `hook-failed`.
+    std::string type;
+    std::string ID;
+    // Other fields of the event, with the names of `ll-box list --format json`.
+    nlohmann::json fields = nlohmann::json::object();
+};
+
+// A single JSON line without the line break, e.g.
+// {"id":"app","pid":1234,"status":"running","type":"started"}.
+[[nodiscard]] std::string to_string(const event_t &event);
+
+// Throws if `line` is not an event.
+[[nodiscard]] event_t from_string(std::string_view line);
+
+// The event of a state written as `current` over `previous`,
+// which is std::nullopt if the state is new, `current` is std::nullopt if it is removed.
+// The status is always carried, other fields only if they changed.
+[[nodiscard]] event_t state_changed(const std::optional<container_status_t> &previous,
+                                    const std::optional<container_status_t> &current);
+
+// Append `event` to `journal` by a single write(2),
+// after rotating the journal if it exceeds `rotate_size`.
+// Failures are logged only, as events must not fail containers.
+void publish(const std::filesystem::path &journal,
+             const event_t &event,
+             std::size_t rotate_size = journal_rotate_size) noexcept;
+
+// The cgroup v2 directory of `pid` under /sys/fs/cgroup, std::nullopt without cgroup v2.
+[[nodiscard]] std::optional<std::filesystem::path> cgroup_of(pid_t pid);
+
+// The `oom_kill` counter in memory.events.local of `cgroup`, which excludes descendants,
+// std::nullopt if it is unavailable.
+[[nodiscard]] std::optional<std::uint64_t> oom_kills(const std::filesystem::path &cgroup);
+
+// Follow events published to the status directory after the monitor is created.
+// Create the monitor before taking a snapshot of the states, so no event is missed in between.
+class monitor
+{
+public:
+    explicit monitor(const status_directory &dir);
+
+    monitor(const monitor &) = delete;
+    monitor &operator=(const monitor &) = delete;
+    monitor(monitor &&) = delete;
+    monitor &operator=(monitor &&) = delete;
+    ~monitor() = default;
+
+    // Wait for events, returns at least one.
+    [[nodiscard]] std::vector<event_t> wait();
+
+private:
+    struct process_t
+    {
+        pid_t pid;
+        utils::file_descriptor pidfd;
+    };
+
+    void follow_journal(std::vector<event_t> &events);
+    void read_journal(std::vector<event_t> &events);
+    void on_event(event_t event, std::vector<event_t> &events);
+    void watch_process(const std::string &id, pid_t pid);
+    void unwatch_process(const std::string &id);
+
+    std::filesystem::path journal_path;
+    utils::file_descriptor inotify;
+    utils::file_descriptor journal;
+    std::string pending;
+    utils::epoll epoll;
+
+    std::map<std::string, process_t> processes;
+    // Containers reported stopped by their pidfds, of which the runtime reports it later.
+    std::set<std::string> stopped;
+    bool pidfd_supported = true;
+};
+
+} // namespace linyaps_box::events
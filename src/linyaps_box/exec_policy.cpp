@@ -0,0 +1,115 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/exec_policy.h"
+
+#include "linyaps_box/utils/atomic_write.h"
+#include "nlohmann/json.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+linyaps_box::exec_policy::policy_t
+linyaps_box::exec_policy::from_config(const config &config,
+                                      const std::filesystem::path &seccomp_cache)
+{
+    policy_t policy;
+    policy.uid = config.process.uid;
+    policy.gid = config.process.gid;
+    policy.additional_gids = config.process.additional_gids.value_or(std::vector<gid_t>{});
+    policy.no_new_privileges = config.process.no_new_privileges;
+
+    if (const auto &seccomp = config.seccomp) {
+#ifdef LINYAPS_BOX_ENABLE_SECCOMP
+        policy.seccomp = seccomp::load(seccomp_cache, *seccomp);
+#else
+        // NOTE: Running the container without the filter it asks for is not an option.
+        (void)seccomp;
+        (void)seccomp_cache;
+        throw std::runtime_error("linux.seccomp is not supported by this build");
+#endif
+    }
+
+    return policy;
+}
+
+void linyaps_box::exec_policy::check(const policy_t &policy, const config::process_t &process)
+{
+    if (policy.no_new_privileges && !process.no_new_privileges) {
+        throw std::runtime_error("process.noNewPrivileges is required by the container");
+    }
+
+    // NOTE: Root in the container might switch to any user anyway.
+    if (policy.uid == 0) {
+        return;
+    }
+
+    if (process.uid != policy.uid || process.gid != policy.gid) {
+        throw std::runtime_error("process.user " + std::to_string(process.uid) + ":"
+                                 + std::to_string(process.gid)
+                                 + " is not allowed, the container runs as "
+                                 + std::to_string(policy.uid) + ":"
+                                 + std::to_string(policy.gid));
+    }
+
+    for (auto gid : process.additional_gids.value_or(std::vector<gid_t>{})) {
+        if (gid != policy.gid
+            && std::find(policy.additional_gids.begin(), policy.additional_gids.end(), gid)
+                    == policy.additional_gids.end()) {
+            throw std::runtime_error("process.user.additionalGids " + std::to_string(gid)
+                                     + " is not allowed by the container");
+        }
+    }
+}
+
+void linyaps_box::exec_policy::write(const std::filesystem::path &path, const policy_t &policy)
+{
+    nlohmann::json j = {
+        { "uid", policy.uid },
+        { "gid", policy.gid },
+        { "additionalGids", policy.additional_gids },
+        { "noNewPrivileges", policy.no_new_privileges },
+    };
+
+    if (policy.seccomp) {
+        auto filter = nlohmann::json::array();
+        for (const auto &insn : policy.seccomp->filter) {
+            filter.push_back({ insn.code, insn.jt, insn.jf, insn.k });
+        }
+        j["seccomp"] = { { "flags", policy.seccomp->flags }, { "filter", std::move(filter) } };
+    }
+
+    utils::atomic_write(path, j.dump());
+}
+
+linyaps_box::exec_policy::policy_t linyaps_box::exec_policy::read(const std::filesystem::path &path)
+{
+    std::ifstream ifs(path);
+    if (!ifs) {
+        throw std::runtime_error("failed to open exec policy " + path.string());
+    }
+
+    auto j = nlohmann::json::parse(ifs);
+
+    policy_t policy;
+    policy.uid = j.at("uid").get<uid_t>();
+    policy.gid = j.at("gid").get<gid_t>();
+    policy.additional_gids = j.at("additionalGids").get<std::vector<gid_t>>();
+    policy.no_new_privileges = j.at("noNewPrivileges").get<bool>();
+
+    if (j.contains("seccomp")) {
+        const auto &seccomp = j["seccomp"];
+        seccomp::program_t program;
+        program.flags = seccomp.at("flags").get<unsigned int>();
+        for (const auto &insn : seccomp.at("filter")) {
+            program.filter.push_back({ insn.at(0).get<std::uint16_t>(),
+                                       insn.at(1).get<std::uint8_t>(),
+                                       insn.at(2).get<std::uint8_t>(),
+                                       insn.at(3).get<std::uint32_t>() });
+        }
+        policy.seccomp = std::move(program);
+    }
+
+    return policy;
+}
@@ -0,0 +1,51 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/config.h"
+#include "linyaps_box/seccomp.h"
+
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include <sys/types.h>
+
+// The restrictions of the container process, which processes executed in
+// a running container by `ll-box exec` or its agent must not escape:
+// the user, no_new_privileges and the seccomp filter of the container.
+//
+// The policy is taken when the container starts and stored in the status directory,
+// see status_directory::exec_policy, so it is enforced without the bundle.
+
+namespace linyaps_box::exec_policy {
+
+struct policy_t
+{
+    uid_t uid = 0;
+    gid_t gid = 0;
+    std::vector<gid_t> additional_gids;
+    bool no_new_privileges = false;
+    std::optional<seccomp::program_t> seccomp;
+};
+
+// The policy of the container process of `config`,
+// with linux.seccomp loaded from `seccomp_cache`, see seccomp::load.
+// It throws if `config` has linux.seccomp but the runtime is built without seccomp.
+[[nodiscard]] policy_t from_config(const config &config,
+                                   const std::filesystem::path &seccomp_cache);
+
+// Throws if `process` is less restricted than `policy`:
+// a container running as root might execute processes as any user,
+// otherwise the user must be the same, with no other additional groups,
+// and no_new_privileges must be kept if the container sets it.
+void check(const policy_t &policy, const config::process_t &process);
+
+void write(const std::filesystem::path &path, const policy_t &policy);
+
+// Throws if `path` does not exist, so processes are never executed without a policy.
+[[nodiscard]] policy_t read(const std::filesystem::path &path);
+
+} // namespace linyaps_box::exec_policy
@@ -0,0 +1,253 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/features.h"
+
+#include "linyaps_box/utils/atomic_write.h"
+#include "linyaps_box/utils/log.h"
+#include "nlohmann/json.hpp"
+
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <system_error>
+
+#include <sched.h>
+#include <sys/mount.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+[[nodiscard]] bool probe_new_mount_api()
+{
+#ifdef SYS_fsopen
+    return ::syscall(SYS_fsopen, nullptr, 0) >= 0 || errno != ENOSYS;
+#else
+    return false;
+#endif
+}
+
+[[nodiscard]] bool probe_close_range()
+{
+#ifdef SYS_close_range
+    return ::syscall(SYS_close_range, ~0U, 0U, 0U) >= 0 || errno != ENOSYS;
+#else
+    return false;
+#endif
+}
+
+[[nodiscard]] bool probe_pidfd()
+{
+#ifdef SYS_pidfd_open
+    auto fd = ::syscall(SYS_pidfd_open, getpid(), 0U);
+    if (fd >= 0) {
+        ::close(static_cast<int>(fd));
+        return true;
+    }
+    return errno != ENOSYS;
+#else
+    return false;
+#endif
+}
+
+[[nodiscard]] bool probe_unprivileged_sysfs()
+{
+    auto pid = fork();
+    if (pid < 0) {
+        throw std::system_error(errno, std::generic_category(), "fork");
+    }
+
+    if (pid == 0) {
+        if (::unshare(CLONE_NEWUSER | CLONE_NEWNS | CLONE_NEWNET)) {
+            _exit(1);
+        }
+        if (::mount(nullptr, "/", nullptr, MS_REC | MS_PRIVATE, nullptr)) {
+            _exit(1);
+        }
+        if (::mount("sysfs", "/sys", "sysfs", MS_NOSUID | MS_NOEXEC | MS_NODEV, nullptr)) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+
+    int status = 0;
+    while (::waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            throw std::system_error(errno, std::generic_category(), "waitpid");
+        }
+    }
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+[[nodiscard]] std::string read_boot_id()
+{
+    std::ifstream ifs("/proc/sys/kernel/random/boot_id");
+    std::string boot_id;
+    std::getline(ifs, boot_id);
+    return boot_id;
+}
+
+[[nodiscard]] std::string read_kernel_release()
+{
+    struct utsname buf{};
+    if (::uname(&buf)) {
+        throw std::system_error(errno, std::generic_category(), "uname");
+    }
+    return buf.release;
+}
+
+// Probe `features` only, returns the bits of those supported.
+[[nodiscard]] std::uint32_t probe_features(std::uint32_t features)
+{
+    const std::pair<linyaps_box::features::feature_t, bool (*)()> probes[] = {
+        { linyaps_box::features::new_mount_api, probe_new_mount_api },
+        { linyaps_box::features::close_range, probe_close_range },
+        { linyaps_box::features::unprivileged_sysfs, probe_unprivileged_sysfs },
+        { linyaps_box::features::pidfd, probe_pidfd },
+    };
+
+    std::uint32_t bits = 0;
+    for (const auto &[feature, fn] : probes) {
+        if ((features & feature) != 0 && fn()) {
+            bits |= feature;
+        }
+    }
+    return bits;
+}
+
+struct cached_t
+{
+    linyaps_box::features::set_t set;
+    // Features known by us but not in the cache, which was written by an older runtime.
+    std::uint32_t missing = 0;
+    // Features in the cache, including those known only by a newer runtime.
+    nlohmann::json features;
+};
+
+[[nodiscard]] std::optional<cached_t> read_cache(const std::filesystem::path &path,
+                                                 const linyaps_box::features::set_t &key)
+try {
+    std::ifstream ifs(path);
+    if (!ifs) {
+        return std::nullopt;
+    }
+
+    auto j = nlohmann::json::parse(ifs);
+    if (j.at("bootID") != key.boot_id || j.at("kernelRelease") != key.kernel_release
+        || j.at("uid") != key.uid) {
+        return std::nullopt;
+    }
+
+    cached_t result{ key, 0, j.at("features") };
+    for (const auto &[feature, name] : linyaps_box::features::names()) {
+        if (!result.features.contains(name)) {
+            result.missing |= feature;
+            continue;
+        }
+        if (result.features.value(name, false)) {
+            result.set.bits |= feature;
+        }
+    }
+    return result;
+} catch (const std::exception &e) {
+    LINYAPS_BOX_WARNING() << "Ignore features cache " << path << ": " << e.what();
+    return std::nullopt;
+}
+
+// NOTE: Features unknown to us in `features` are kept for the runtime which knows them.
+void write_cache(const std::filesystem::path &path,
+                 const linyaps_box::features::set_t &set,
+                 nlohmann::json features = nlohmann::json::object())
+{
+    for (const auto &[feature, name] : linyaps_box::features::names()) {
+        features[name] = set.has(feature);
+    }
+
+    nlohmann::json j;
+    j["bootID"] = set.boot_id;
+    j["kernelRelease"] = set.kernel_release;
+    j["uid"] = set.uid;
+    j["features"] = std::move(features);
+
+    std::filesystem::create_directories(path.parent_path());
+    linyaps_box::utils::atomic_write(path, j.dump());
+}
+
+} // namespace
+
+const std::vector<std::pair<linyaps_box::features::feature_t, const char *>> &
+linyaps_box::features::names()
+{
+    static const std::vector<std::pair<feature_t, const char *>> names{
+        { new_mount_api, "newMountAPI" },
+        { close_range, "closeRange" },
+        { unprivileged_sysfs, "unprivilegedSysfs" },
+        { pidfd, "pidfd" },
+    };
+    return names;
+}
+
+linyaps_box::features::set_t linyaps_box::features::probe()
+{
+    set_t result;
+    result.boot_id = read_boot_id();
+    result.kernel_release = read_kernel_release();
+    result.uid = geteuid();
+
+    std::uint32_t all = 0;
+    for (const auto &[feature, name] : names()) {
+        all |= feature;
+    }
+    result.bits = probe_features(all);
+
+    LINYAPS_BOX_DEBUG() << "Probed features 0x" << std::hex << result.bits;
+    return result;
+}
+
+const linyaps_box::features::set_t &linyaps_box::features::load(const std::filesystem::path &cache)
+{
+    static std::mutex mutex;
+    static std::map<std::filesystem::path, set_t> loaded;
+
+    std::lock_guard<std::mutex> guard(mutex);
+    if (auto it = loaded.find(cache); it != loaded.end()) {
+        return it->second;
+    }
+
+    set_t key;
+    key.boot_id = read_boot_id();
+    key.kernel_release = read_kernel_release();
+    key.uid = geteuid();
+
+    set_t result;
+    std::optional<nlohmann::json> merged;
+    if (auto cached = read_cache(cache, key); !cached) {
+        result = probe();
+        merged = nlohmann::json::object();
+    } else {
+        result = std::move(cached->set);
+        if (cached->missing != 0) {
+            LINYAPS_BOX_DEBUG() << "Probe features 0x" << std::hex << cached->missing
+                                << " missing in the cache";
+            result.bits |= probe_features(cached->missing);
+            merged = std::move(cached->features);
+        }
+    }
+
+    if (merged) {
+        try {
+            write_cache(cache, result, std::move(*merged));
+        } catch (const std::exception &e) {
+            LINYAPS_BOX_WARNING() << "Failed to write features cache " << cache << ": "
+                                  << e.what();
+        }
+    }
+
+    return loaded.emplace(cache, std::move(result)).first->second;
+}
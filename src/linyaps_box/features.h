@@ -0,0 +1,57 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+// Kernel features the runtime chooses its strategy by,
+// instead of trying a system call and falling back on failure.
+//
+// Probing runs a few system calls and forks a process,
+// so the result is cached in the status directory,
+// keyed by the boot ID, the kernel release and the effective UID.
+// Only features which decide a strategy are probed, add one with its user.
+
+namespace linyaps_box::features {
+
+enum feature_t : std::uint32_t {
+    // fsopen(2), fsmount(2), move_mount(2) and open_tree(2), Linux 5.2.
+    new_mount_api = 1U << 0,
+    // close_range(2), Linux 5.9.
+    close_range = 1U << 1,
+    // sysfs can be mounted in a new user namespace with a new network namespace.
+    unprivileged_sysfs = 1U << 2,
+    // pidfd_open(2), Linux 5.3.
+    pidfd = 1U << 3,
+};
+
+struct set_t
+{
+    std::uint32_t bits = 0;
+    std::string boot_id;
+    std::string kernel_release;
+    uid_t uid = -1;
+
+    [[nodiscard]] bool has(feature_t feature) const { return (bits & feature) != 0; }
+};
+
+// All features with their names, in the order of bits.
+[[nodiscard]] const std::vector<std::pair<feature_t, const char *>> &names();
+
+// Probe features of the running kernel, without the cache.
+[[nodiscard]] set_t probe();
+
+// Returns the features cached at `cache`, which is probed and written
+// if it does not exist or was written by another boot, kernel or user.
+// The result is also kept for the lifetime of the process.
+[[nodiscard]] const set_t &load(const std::filesystem::path &cache);
+
+} // namespace linyaps_box::features
@@ -0,0 +1,360 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/hook_cache.h"
+
+#include "linyaps_box/utils/digest.h"
+#include "linyaps_box/utils/log.h"
+#include "nlohmann/json.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <optional>
+
+#include <sys/mount.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr auto copy_options = std::filesystem::copy_options::recursive
+        | std::filesystem::copy_options::copy_symlinks;
+
+// The file in an entry with the full key, see key_t::content.
+constexpr auto key_file = "key.json";
+
+[[nodiscard]] std::filesystem::path normal(const std::filesystem::path &path)
+{
+    auto result = path.lexically_normal();
+    if (!result.has_filename() && result.has_relative_path()) {
+        result = result.parent_path();
+    }
+    return result;
+}
+
+// Whether `path` is strictly under `base`, both are normal.
+[[nodiscard]] bool is_under(const std::filesystem::path &path, const std::filesystem::path &base)
+{
+    auto [b, p] = std::mismatch(base.begin(), base.end(), path.begin(), path.end());
+    return b == base.end() && p != path.end();
+}
+
+[[nodiscard]] std::vector<std::filesystem::path> parse_paths(const nlohmann::json &j,
+                                                             const char *field)
+{
+    std::vector<std::filesystem::path> result;
+    for (const auto &value : j.at(field)) {
+        std::filesystem::path path = value.get<std::string>();
+        if (!path.is_absolute()) {
+            throw std::runtime_error(std::string(field) + " must be absolute paths");
+        }
+        result.push_back(normal(path));
+    }
+    return result;
+}
+
+// Throws if `output` of a hook of `stage` is outside of the container, see hook_cache.h.
+void check_output(const std::string &stage,
+                  const std::filesystem::path &output,
+                  const std::filesystem::path &bundle,
+                  const std::filesystem::path &rootfs,
+                  const std::vector<std::filesystem::path> &bind_mounts)
+{
+    // NOTE: The path of the output in the container, if it is in the root filesystem.
+    std::optional<std::filesystem::path> path = output;
+    if (stage == "createContainer") {
+        if (is_under(output, rootfs)) {
+            path = "/" / output.lexically_relative(rootfs);
+        } else if (is_under(output, bundle)) {
+            path.reset();
+        } else {
+            throw std::runtime_error("output " + output.string()
+                                     + " is not under the bundle or the root filesystem");
+        }
+    } else if (output == "/") {
+        throw std::runtime_error("output must not be the root filesystem");
+    }
+
+    if (!path) {
+        return;
+    }
+
+    for (const auto &destination : bind_mounts) {
+        if (*path == destination || is_under(*path, destination)) {
+            throw std::runtime_error("output " + output.string() + " is under bind mount "
+                                     + destination.string());
+        }
+    }
+}
+
+// NOTE: Outputs are checked lexically by parse,
+// a symlink in their parents might point outside of the container.
+void check_no_symlink(const std::filesystem::path &output)
+{
+    auto parent = output.parent_path();
+    if (std::filesystem::weakly_canonical(parent) != parent) {
+        throw std::runtime_error("output " + output.string() + " is reached through a symlink");
+    }
+}
+
+[[nodiscard]] std::string read_key(const std::filesystem::path &entry)
+{
+    std::ifstream ifs(entry / key_file, std::ios::binary);
+    return { std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>() };
+}
+
+[[nodiscard]] std::uintmax_t size_of(const std::filesystem::path &entry)
+{
+    std::uintmax_t size = 0;
+    std::error_code ec;
+    for (std::filesystem::recursive_directory_iterator it(entry, ec), end; !ec && it != end;
+         it.increment(ec)) {
+        if (it->is_regular_file(ec) && !it->is_symlink(ec)) {
+            size += it->file_size(ec);
+        }
+    }
+    return size;
+}
+
+// Remove least recently used entries other than `keep`, until the cache fits in `max_size`.
+void evict(const std::filesystem::path &cache, const std::string &keep, std::uintmax_t max_size)
+{
+    struct entry_t
+    {
+        std::filesystem::path path;
+        std::filesystem::file_time_type time;
+        std::uintmax_t size;
+    };
+
+    std::vector<entry_t> entries;
+    std::uintmax_t total = 0;
+    for (const auto &entry : std::filesystem::directory_iterator(cache)) {
+        if (entry.path().filename().string().rfind(".tmp-", 0) == 0) {
+            continue;
+        }
+
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(entry.path(), ec);
+        auto size = size_of(entry.path());
+        total += size;
+        entries.push_back({ entry.path(), time, size });
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs.time < rhs.time;
+    });
+
+    for (const auto &entry : entries) {
+        if (total <= max_size) {
+            break;
+        }
+        if (entry.path.filename() == keep) {
+            continue;
+        }
+
+        LINYAPS_BOX_DEBUG() << "Evict hook cache " << entry.path.filename();
+        std::error_code ec;
+        std::filesystem::remove_all(entry.path, ec);
+        total -= entry.size;
+    }
+}
+
+[[nodiscard]] const std::vector<linyaps_box::config::hooks_t::hook_t> *
+find_hooks(const linyaps_box::config &config, const std::string &stage)
+{
+    if (stage == "createContainer") {
+        return &config.hooks.create_container;
+    }
+    if (stage == "startContainer") {
+        return &config.hooks.start_container;
+    }
+    return nullptr;
+}
+
+// Entries of a hook share the prefix, which is the digest of the hook and its declaration,
+// followed by the digest of the current state of the inputs.
+[[nodiscard]] std::string entry_prefix(const std::string &key)
+{
+    return key.substr(0, key.find('-') + 1);
+}
+
+} // namespace
+
+linyaps_box::hook_cache::declarations_t
+linyaps_box::hook_cache::parse(const linyaps_box::config &config,
+                               const std::filesystem::path &bundle)
+{
+    declarations_t result;
+
+    auto bundle_path = normal(std::filesystem::absolute(bundle));
+    auto rootfs = normal(bundle_path / config.root.path);
+    std::vector<std::filesystem::path> bind_mounts;
+    for (const auto &mount : config.mounts) {
+        if ((mount.flags & MS_BIND) != 0 && mount.destination) {
+            bind_mounts.push_back(normal(*mount.destination));
+        }
+    }
+
+    for (const auto &[annotation, value] : config.annotations) {
+        if (annotation.rfind(annotation_prefix, 0) != 0) {
+            continue;
+        }
+
+        auto name = annotation.substr(std::char_traits<char>::length(annotation_prefix));
+        try {
+            auto dot = name.find('.');
+            if (dot == std::string::npos) {
+                throw std::runtime_error("expect STAGE.INDEX");
+            }
+
+            const auto *hooks = find_hooks(config, name.substr(0, dot));
+            if (hooks == nullptr) {
+                throw std::runtime_error("only createContainer and startContainer hooks "
+                                         "can be memoized");
+            }
+
+            std::size_t pos = 0;
+            auto index = std::stoul(name.substr(dot + 1), &pos);
+            if (pos != name.size() - dot - 1 || index >= hooks->size()) {
+                throw std::runtime_error("no such hook");
+            }
+
+            auto j = nlohmann::json::parse(value);
+            declaration_t declaration;
+            declaration.inputs = parse_paths(j, "inputs");
+            declaration.outputs = parse_paths(j, "outputs");
+            if (declaration.outputs.empty()) {
+                throw std::runtime_error("outputs must not be empty");
+            }
+            for (const auto &output : declaration.outputs) {
+                check_output(name.substr(0, dot), output, bundle_path, rootfs, bind_mounts);
+            }
+
+            result.emplace(std::move(name), std::move(declaration));
+        } catch (const std::exception &e) {
+            throw std::runtime_error("invalid annotation " + annotation + ": " + e.what());
+        }
+    }
+
+    return result;
+}
+
+linyaps_box::hook_cache::key_t
+linyaps_box::hook_cache::key(const config::hooks_t::hook_t &hook,
+                             const std::string &name,
+                             const declaration_t &declaration)
+{
+    auto strings = [](const std::vector<std::filesystem::path> &paths) {
+        std::vector<std::string> result;
+        for (const auto &path : paths) {
+            result.push_back(path.string());
+        }
+        return result;
+    };
+
+    nlohmann::json j = {
+        { "name", name },
+        { "path", hook.path.string() },
+        { "args", hook.args },
+        { "env", hook.env },
+        { "inputs", strings(declaration.inputs) },
+        { "outputs", strings(declaration.outputs) },
+    };
+
+    utils::digest id;
+    id.update(j.dump());
+
+    utils::digest state;
+    state.update_stat(hook.path);
+    for (const auto &input : declaration.inputs) {
+        state.update_stat(input);
+    }
+    j["state"] = state.hex();
+
+    return { id.hex() + "-" + state.hex(), j.dump() };
+}
+
+bool linyaps_box::hook_cache::restore(const std::filesystem::path &cache,
+                                      const key_t &key,
+                                      const declaration_t &declaration)
+try {
+    auto entry = cache / key.name;
+    if (!std::filesystem::is_directory(entry)) {
+        return false;
+    }
+
+    if (read_key(entry) != key.content) {
+        LINYAPS_BOX_WARNING() << "Ignore hook cache " << key.name << " of another key";
+        return false;
+    }
+
+    for (const auto &output : declaration.outputs) {
+        check_no_symlink(output);
+    }
+
+    for (std::size_t i = 0; i < declaration.outputs.size(); ++i) {
+        const auto &output = declaration.outputs[i];
+        std::filesystem::remove_all(output);
+        std::filesystem::create_directories(output.parent_path());
+        std::filesystem::copy(entry / std::to_string(i), output, copy_options);
+    }
+
+    // NOTE: The time of use, see evict.
+    std::filesystem::last_write_time(entry, std::filesystem::file_time_type::clock::now());
+
+    return true;
+} catch (const std::exception &e) {
+    LINYAPS_BOX_WARNING() << "Failed to restore cached outputs " << key.name << ": " << e.what();
+    return false;
+}
+
+void linyaps_box::hook_cache::store(const std::filesystem::path &cache,
+                                    const key_t &key,
+                                    const declaration_t &declaration,
+                                    std::uintmax_t max_size)
+{
+    auto entry = cache / key.name;
+    auto temporary = cache / (".tmp-" + key.name + "-" + std::to_string(getpid()));
+
+    try {
+        std::filesystem::create_directories(temporary);
+        for (std::size_t i = 0; i < declaration.outputs.size(); ++i) {
+            check_no_symlink(declaration.outputs[i]);
+            std::filesystem::copy(declaration.outputs[i],
+                                  temporary / std::to_string(i),
+                                  copy_options);
+        }
+        {
+            std::ofstream ofs(temporary / key_file, std::ios::binary);
+            ofs << key.content;
+            if (!ofs.flush()) {
+                throw std::runtime_error("failed to write " + (temporary / key_file).string());
+            }
+        }
+
+        // NOTE: The entry appears complete or not at all,
+        // a concurrent launch storing the same entry wins the race.
+        std::error_code ec;
+        std::filesystem::rename(temporary, entry, ec);
+        if (ec) {
+            std::filesystem::remove_all(temporary);
+            return;
+        }
+
+        auto prefix = entry_prefix(key.name);
+        for (const auto &other : std::filesystem::directory_iterator(cache)) {
+            auto name = other.path().filename().string();
+            if (name != key.name && name.rfind(prefix, 0) == 0) {
+                LINYAPS_BOX_DEBUG() << "Remove outdated hook cache " << name;
+                std::filesystem::remove_all(other.path(), ec);
+            }
+        }
+
+        evict(cache, key.name, max_size);
+    } catch (const std::exception &e) {
+        LINYAPS_BOX_WARNING() << "Failed to cache outputs " << key.name << ": " << e.what();
+        std::error_code ec;
+        std::filesystem::remove_all(temporary, ec);
+    }
+}
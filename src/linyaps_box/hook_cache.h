@@ -0,0 +1,86 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/config.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+// Memoization of createContainer and startContainer hooks,
+// which are pure functions of their inputs, for example generating ld.so.cache.
+//
+// A hook is memoized by an annotation named with the stage and its index,
+// for example `org.openatom.linyaps.box.hook-cache.createContainer.0`,
+// of which the value is a JSON object of absolute paths as seen by the hook:
+//
+//     {"inputs": ["/usr/lib", "/opt/apps"], "outputs": ["/etc/ld.so.cache"]}
+//
+// Outputs are replaced by cached copies, so they are restricted to the container:
+// outputs of createContainer hooks, which run before pivot_root(2),
+// must be under the bundle or the root filesystem,
+// and no output may be under the destination of a bind mount or reached through a symlink.
+//
+// The outputs are copied to the cache directory after the hook succeeded,
+// keyed by the path, args and env of the hook, its declaration
+// and the device, inode, size and times of the hook and its inputs.
+// The full key is stored in the entry and compared on restore,
+// so a collision of digests never restores the outputs of another hook.
+// Later launches with unchanged inputs copy the cached outputs instead of executing the hook.
+// Note that only the inputs themselves are checked, not the files in input directories.
+//
+// The cache is bounded by max_cache_size, least recently used entries are evicted.
+
+namespace linyaps_box::hook_cache {
+
+constexpr auto annotation_prefix = "org.openatom.linyaps.box.hook-cache.";
+
+constexpr std::uintmax_t max_cache_size = 64 * 1024 * 1024;
+
+struct declaration_t
+{
+    std::vector<std::filesystem::path> inputs;
+    std::vector<std::filesystem::path> outputs;
+};
+
+// Declarations keyed by the stage and the index of the hook, for example `createContainer.0`.
+using declarations_t = std::map<std::string, declaration_t>;
+
+// Parse the declarations in annotations of `config` of the container in `bundle`,
+// it throws std::runtime_error if one is malformed, refers to a missing hook,
+// or has outputs outside of the container.
+[[nodiscard]] declarations_t parse(const config &config, const std::filesystem::path &bundle);
+
+struct key_t
+{
+    // The name of the cache entry, digests of the hook and of the state of its inputs.
+    std::string name;
+    // The hook, its declaration and the state of its inputs, stored in the entry.
+    std::string content;
+};
+
+// The key of the cache entry of `hook` with the current state of its inputs.
+[[nodiscard]] key_t key(const config::hooks_t::hook_t &hook,
+                        const std::string &name,
+                        const declaration_t &declaration);
+
+// Copy the cached outputs of `key` in `cache` to their paths,
+// returns false if the entry does not exist, is not of `key`, or fails to be copied.
+[[nodiscard]] bool restore(const std::filesystem::path &cache,
+                           const key_t &key,
+                           const declaration_t &declaration);
+
+// Copy the outputs to the entry of `key` in `cache`,
+// which replaces other entries of the same hook and evicts entries beyond `max_size`,
+// failures are logged only.
+void store(const std::filesystem::path &cache,
+           const key_t &key,
+           const declaration_t &declaration,
+           std::uintmax_t max_size = max_cache_size);
+
+} // namespace linyaps_box::hook_cache
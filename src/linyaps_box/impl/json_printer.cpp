@@ -41,12 +41,29 @@ static nlohmann::json status_to_json(const linyaps_box::container_status_t &stat
 
 void linyaps_box::impl::json_printer::print_statuses(const std::vector<container_status_t> &status)
 {
-    nlohmann::json j = nlohmann::json::array();
-    for (const auto &s : status) {
-        j += status_to_json(s);
+    // NOTE: Statuses are written one by one, instead of building the whole array,
+    // the output is the same as dumping the array with an indent of 4.
+    if (status.empty()) {
+        std::cout << "[]" << std::endl;
+        return;
     }
 
-    std::cout << j.dump(4) << std::endl;
+    std::string buffer = "[\n";
+    for (std::size_t i = 0; i < status.size(); ++i) {
+        buffer += "    ";
+        for (auto c : status_to_json(status[i]).dump(4)) {
+            buffer += c;
+            if (c == '\n') {
+                buffer += "    ";
+            }
+        }
+        buffer += i + 1 < status.size() ? ",\n" : "\n";
+
+        std::cout << buffer;
+        buffer.clear();
+    }
+
+    std::cout << "]" << std::endl;
     return;
 }
 
@@ -5,40 +5,189 @@
 #include "linyaps_box/impl/status_directory.h"
 
 #include "linyaps_box/utils/atomic_write.h"
+#include "linyaps_box/utils/digest.h"
+#include "linyaps_box/utils/file_describer.h"
 #include "linyaps_box/utils/log.h"
 #include "nlohmann/json.hpp"
 
-#include <csignal>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <climits>
+#include <cstdio>
 #include <cstdlib>
 #include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <thread>
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
 #include <unistd.h>
 
 namespace {
 
-linyaps_box::container_status_t read_status(const std::filesystem::path &path)
+// Files parsed by each thread at least, fewer are not worth a thread.
+constexpr std::size_t files_per_thread = 64;
+
+linyaps_box::container_status_t parse_status(const nlohmann::json &j)
 {
-    nlohmann::json j;
-    {
-        std::ifstream istrm(path);
-        istrm >> j;
-    }
     linyaps_box::container_status_t ret{};
 
     ret.PID = j["pid"];
     ret.ID = j["id"];
     ret.status = j["status"];
-    if (kill(ret.PID, 0)) {
-        ret.status = linyaps_box::container_status_t::runtime_status::STOPPED;
-    }
     ret.bundle = std::string(j["bundle"]);
     ret.created = j["created"];
     ret.owner = j["owner"];
     ret.annotations = j["annotations"];
+    ret.start_time = j.value<std::uint64_t>("start_time", 0);
+    ret.runtime_pid = j.value<pid_t>("runtime_pid", 0);
+    ret.runtime_start_time = j.value<std::uint64_t>("runtime_start_time", 0);
+    if (!linyaps_box::is_alive(ret)) {
+        ret.status = linyaps_box::container_status_t::runtime_status::STOPPED;
+    }
 
     return ret;
 }
 
+linyaps_box::container_status_t read_status(const std::filesystem::path &path)
+{
+    nlohmann::json j;
+    {
+        std::ifstream istrm(path);
+        istrm >> j;
+    }
+    return parse_status(j);
+}
+
+// Read the file `name` under the directory `dirfd` at once.
+std::string read_file(int dirfd, const char *name)
+{
+    auto fd = ::openat(dirfd, name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "openat");
+    }
+
+    std::string content;
+    char buffer[4096];
+    while (true) {
+        auto size = ::read(fd, buffer, sizeof(buffer));
+        if (size < 0 && errno == EINTR) {
+            continue;
+        }
+        if (size < 0) {
+            auto error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "read");
+        }
+        if (size == 0) {
+            break;
+        }
+        content.append(buffer, static_cast<std::size_t>(size));
+    }
+
+    ::close(fd);
+    return content;
+}
+
+// Annotations of the state at `path`, empty if there is no valid state.
+std::map<std::string, std::string> read_annotations(const std::filesystem::path &path)
+try {
+    std::ifstream istrm(path);
+    if (!istrm) {
+        return {};
+    }
+
+    nlohmann::json j;
+    istrm >> j;
+    return j.at("annotations").get<std::map<std::string, std::string>>();
+} catch (const std::exception &e) {
+    LINYAPS_BOX_WARNING() << "Ignore annotations of " << path << ": " << e.what();
+    return {};
+}
+
+std::string escape(const std::string &value)
+{
+    std::string result;
+    for (auto c : value) {
+        if (std::isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '-' || c == '_') {
+            result += c;
+            continue;
+        }
+        char escaped[4];
+        std::snprintf(escaped, sizeof(escaped), "%%%02X", static_cast<unsigned char>(c));
+        result += escaped;
+    }
+    return result;
+}
+
+// The name of the index directory of the annotation `key` with `value`.
+std::string index_name(const std::string &key, const std::string &value)
+{
+    auto name = escape(key) + "=" + escape(value);
+    if (name.size() <= NAME_MAX) {
+        return name;
+    }
+
+    // NOTE: Collisions of digests only add entries which find() filters out.
+    linyaps_box::utils::digest digest;
+    digest.update(key);
+    digest.update(value);
+    return "%=" + digest.hex();
+}
+
+// Annotations in `lhs` but not in `rhs`.
+std::map<std::string, std::string> difference(const std::map<std::string, std::string> &lhs,
+                                              const std::map<std::string, std::string> &rhs)
+{
+    std::map<std::string, std::string> result;
+    std::set_difference(lhs.begin(),
+                        lhs.end(),
+                        rhs.begin(),
+                        rhs.end(),
+                        std::inserter(result, result.end()));
+    return result;
+}
+
+struct dir_closer
+{
+    void operator()(DIR *dir) const { ::closedir(dir); }
+};
+
+// Writers of states are serialized by flock(2) of the directory,
+// so annotations of a state are indexed by the state they are read from,
+// and a stale state is checked again right before it is removed.
+class directory_lock
+{
+public:
+    explicit directory_lock(const std::filesystem::path &path)
+        : fd(::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC))
+    {
+        if (this->fd.get() < 0) {
+            throw std::system_error(errno, std::generic_category(), "open " + path.string());
+        }
+
+        while (::flock(this->fd.get(), LOCK_EX)) {
+            if (errno != EINTR) {
+                throw std::system_error(errno, std::generic_category(), "flock " + path.string());
+            }
+        }
+    }
+
+private:
+    linyaps_box::utils::file_descriptor fd;
+};
+
+bool is_status_file(const std::string &name)
+{
+    constexpr std::string_view extension = ".json";
+    return name.size() > extension.size()
+            && name.compare(name.size() - extension.size(), extension.size(), extension) == 0;
+}
+
 } // namespace
 
 void linyaps_box::impl::status_directory::write(const container_status_t &status)
@@ -51,32 +200,94 @@ void linyaps_box::impl::status_directory::write(const container_status_t &status
             { "created", status.created },
             { "owner", status.owner },
             { "annotations", status.annotations },
+            { "start_time", status.start_time },
+            { "runtime_pid", status.runtime_pid },
+            { "runtime_start_time", status.runtime_start_time },
     });
 
-    utils::atomic_write(this->path / (status.ID + ".json"), j.dump());
+    auto file = this->status_file(status.ID);
+
+    directory_lock lock(this->path);
+    auto previous = read_annotations(file);
+
+    this->add_index(status.ID, previous, status.annotations);
+    utils::atomic_write(file, j.dump());
+    this->remove_index(status.ID, previous, status.annotations);
 }
 
 linyaps_box::container_status_t
 linyaps_box::impl::status_directory::read(const std::string &id) const
 {
-    return read_status(this->path / (id + ".json"));
+    return read_status(this->status_file(id));
 }
 
 void linyaps_box::impl::status_directory::remove(const std::string &id)
 {
-    std::filesystem::remove(this->path / (id + ".json"));
+    directory_lock lock(this->path);
+    this->remove_locked(id);
+}
+
+bool linyaps_box::impl::status_directory::remove_if(
+        const std::string &id, const std::function<bool(const container_status_t &)> &stale)
+{
+    directory_lock lock(this->path);
+
+    std::optional<container_status_t> status;
+    try {
+        status = read_status(this->status_file(id));
+    } catch (const std::exception &e) {
+        LINYAPS_BOX_DEBUG() << "Skip removing container " << id << ": " << e.what();
+        return false;
+    }
+
+    if (!stale(*status)) {
+        return false;
+    }
+
+    this->remove_locked(id);
+    return true;
+}
+
+void linyaps_box::impl::status_directory::remove_locked(const std::string &id)
+{
+    auto file = this->status_file(id);
+    auto previous = read_annotations(file);
+
+    std::filesystem::remove(file);
+    std::filesystem::remove(this->control_socket(id));
+    std::filesystem::remove(this->exec_policy(id));
+    this->remove_index(id, previous, {});
 }
 
 std::vector<std::string> linyaps_box::impl::status_directory::list() const
 {
+    // NOTE: The file of a container is named by its ID, so files are not parsed here.
     std::vector<std::string> ret;
     for (const auto &entry : std::filesystem::directory_iterator(this->path))
         try {
-            if (entry.is_regular_file() && entry.path().extension() != ".json") {
+            if (entry.is_socket() && entry.path().extension() == ".sock") {
+                continue;
+            }
+            if (entry.is_regular_file() && entry.path().extension() == ".policy") {
+                continue;
+            }
+            // NOTE: Directories such as `admission` and `cache` are not containers.
+            if (entry.is_directory()) {
+                continue;
+            }
+            // NOTE: Nor is the status table, see linyaps_box::impl::status_table.
+            if (entry.is_regular_file() && entry.path().extension() == ".table") {
+                continue;
+            }
+            // NOTE: Neither are the events journal and its rotated one.
+            auto journal = this->events_journal().filename().string();
+            if (entry.path().filename().string().rfind(journal, 0) == 0) {
+                continue;
+            }
+            if (!entry.is_regular_file() || entry.path().extension() != ".json") {
                 throw std::runtime_error("invalid extension");
             }
-            auto status = read_status(entry);
-            ret.push_back(status.ID);
+            ret.push_back(entry.path().stem());
         } catch (const std::exception &e) {
             LINYAPS_BOX_WARNING() << "Skip " << entry.path() << ": " << e.what();
             continue;
@@ -85,6 +296,225 @@ std::vector<std::string> linyaps_box::impl::status_directory::list() const
     return ret;
 }
 
+std::vector<linyaps_box::container_status_t>
+linyaps_box::impl::status_directory::snapshot() const
+{
+    std::unique_ptr<DIR, dir_closer> dir(::opendir(this->path.c_str()));
+    if (!dir) {
+        throw std::system_error(errno, std::generic_category(), "opendir " + this->path.string());
+    }
+
+    // NOTE: The types of entries are given by getdents(2) on most file systems,
+    // so only files which might be states are opened.
+    std::vector<std::string> names;
+    errno = 0;
+    while (auto *entry = ::readdir(dir.get())) {
+        if ((entry->d_type == DT_REG || entry->d_type == DT_UNKNOWN)
+            && is_status_file(entry->d_name)) {
+            names.emplace_back(entry->d_name);
+        }
+    }
+    if (errno != 0) {
+        throw std::system_error(errno, std::generic_category(), "readdir " + this->path.string());
+    }
+
+    std::vector<std::optional<container_status_t>> statuses(names.size());
+    std::atomic<std::size_t> next{ 0 };
+    auto worker = [&names, &statuses, &next, dirfd = ::dirfd(dir.get())]() {
+        for (auto i = next++; i < names.size(); i = next++)
+            try {
+                auto content = read_file(dirfd, names[i].c_str());
+                statuses[i] = parse_status(nlohmann::json::parse(content));
+            } catch (const std::exception &e) {
+                LINYAPS_BOX_WARNING() << "Skip " << names[i] << ": " << e.what();
+            }
+    };
+
+    auto jobs = std::min<std::size_t>(std::max(std::thread::hardware_concurrency(), 1U),
+                                      names.size() / files_per_thread);
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < jobs; ++i) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : workers) {
+        thread.join();
+    }
+
+    std::vector<container_status_t> ret;
+    ret.reserve(statuses.size());
+    for (auto &status : statuses) {
+        if (status) {
+            ret.push_back(std::move(*status));
+        }
+    }
+    std::sort(ret.begin(), ret.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs.ID < rhs.ID;
+    });
+
+    return ret;
+}
+
+std::vector<linyaps_box::container_status_t>
+linyaps_box::impl::status_directory::find(const std::string &key, const std::string &value) const
+{
+    std::vector<container_status_t> ret;
+
+    // NOTE: States written by older versions are not indexed until the index is built.
+    if (!this->build_index()) {
+        for (auto &status : this->snapshot()) {
+            auto it = status.annotations.find(key);
+            if (it != status.annotations.end() && it->second == value) {
+                ret.push_back(std::move(status));
+            }
+        }
+        return ret;
+    }
+
+    std::error_code ec;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(this->path / "index" / index_name(key, value), ec))
+        try {
+            auto status = this->read(entry.path().filename());
+            auto it = status.annotations.find(key);
+            if (it == status.annotations.end() || it->second != value) {
+                continue;
+            }
+            ret.push_back(std::move(status));
+        } catch (const std::exception &e) {
+            // NOTE: The container might be removed since the index was read.
+            LINYAPS_BOX_DEBUG() << "Skip " << entry.path() << ": " << e.what();
+        }
+
+    // NOTE: Nothing is indexed if the directory does not exist.
+    if (ec && ec != std::errc::no_such_file_or_directory) {
+        throw std::system_error(ec, "open index of annotation " + key);
+    }
+
+    std::sort(ret.begin(), ret.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs.ID < rhs.ID;
+    });
+
+    return ret;
+}
+
+bool linyaps_box::impl::status_directory::build_index() const
+{
+    auto built = this->path / "index" / ".built";
+    if (std::filesystem::exists(built)) {
+        return true;
+    }
+
+    try {
+        directory_lock lock(this->path);
+        if (std::filesystem::exists(built)) {
+            return true;
+        }
+
+        LINYAPS_BOX_DEBUG() << "Build the index of annotations in " << this->path;
+        for (const auto &status : this->snapshot()) {
+            this->add_index(status.ID, {}, status.annotations);
+        }
+
+        std::filesystem::create_directories(built.parent_path());
+        utils::atomic_write(built, "");
+    } catch (const std::exception &e) {
+        LINYAPS_BOX_DEBUG() << "Failed to build the index of annotations in " << this->path
+                            << ": " << e.what();
+        return false;
+    }
+
+    return true;
+}
+
+void linyaps_box::impl::status_directory::add_index(
+        const std::string &id,
+        const std::map<std::string, std::string> &previous,
+        const std::map<std::string, std::string> &current) const
+{
+    for (const auto &[key, value] : difference(current, previous)) {
+        auto dir = this->path / "index" / index_name(key, value);
+        auto entry = dir / id;
+
+        // NOTE: The directory might be removed by another runtime once it is empty,
+        // it is created again then.
+        for (int retry = 0;; ++retry) {
+            std::filesystem::create_directories(dir);
+
+            auto fd = ::open(entry.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);
+            if (fd >= 0) {
+                ::close(fd);
+                break;
+            }
+            if (errno != ENOENT || retry >= 3) {
+                throw std::system_error(errno, std::generic_category(), "open " + entry.string());
+            }
+        }
+    }
+}
+
+void linyaps_box::impl::status_directory::remove_index(
+        const std::string &id,
+        const std::map<std::string, std::string> &previous,
+        const std::map<std::string, std::string> &current) const
+{
+    for (const auto &[key, value] : difference(previous, current)) {
+        auto dir = this->path / "index" / index_name(key, value);
+
+        std::error_code ec;
+        std::filesystem::remove(dir / id, ec);
+        if (ec) {
+            LINYAPS_BOX_WARNING() << "Failed to remove " << (dir / id) << ": " << ec.message();
+            continue;
+        }
+
+        // NOTE: It fails if other containers have the annotation.
+        ::rmdir(dir.c_str());
+    }
+}
+
+std::filesystem::path
+linyaps_box::impl::status_directory::status_file(const std::string &id) const
+{
+    return this->path / (id + ".json");
+}
+
+std::filesystem::path
+linyaps_box::impl::status_directory::control_socket(const std::string &id) const
+{
+    return this->path / (id + ".sock");
+}
+
+std::filesystem::path linyaps_box::impl::status_directory::exec_policy(const std::string &id) const
+{
+    return this->path / (id + ".policy");
+}
+
+std::filesystem::path linyaps_box::impl::status_directory::features_cache() const
+{
+    return this->path / "cache" / "features.json";
+}
+
+std::filesystem::path linyaps_box::impl::status_directory::hooks_cache() const
+{
+    return this->path / "cache" / "hooks";
+}
+
+std::filesystem::path linyaps_box::impl::status_directory::config_cache() const
+{
+    return this->path / "cache" / "config";
+}
+
+std::filesystem::path linyaps_box::impl::status_directory::seccomp_cache() const
+{
+    return this->path / "cache" / "seccomp";
+}
+
+std::filesystem::path linyaps_box::impl::status_directory::events_journal() const
+{
+    return this->path / "events.jsonl";
+}
+
 linyaps_box::impl::status_directory::status_directory(const std::filesystem::path &path)
 {
     this->path = path;
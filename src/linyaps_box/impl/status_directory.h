@@ -7,6 +7,7 @@
 #include "linyaps_box/status_directory.h"
 
 #include <filesystem>
+#include <map>
 #include <vector>
 
 namespace linyaps_box::impl {
@@ -16,11 +17,50 @@ public:
     void write(const container_status_t &status);
     container_status_t read(const std::string &id) const;
     void remove(const std::string &id);
+    bool remove_if(const std::string &id,
+                   const std::function<bool(const container_status_t &)> &stale);
     std::vector<std::string> list() const;
+    std::vector<container_status_t> snapshot() const;
+    std::vector<container_status_t> find(const std::string &key, const std::string &value) const;
+    std::filesystem::path control_socket(const std::string &id) const;
+    std::filesystem::path exec_policy(const std::string &id) const;
+    std::filesystem::path features_cache() const;
+    std::filesystem::path hooks_cache() const;
+    std::filesystem::path config_cache() const;
+    std::filesystem::path seccomp_cache() const;
+    std::filesystem::path events_journal() const;
 
     status_directory(const std::filesystem::path &path);
 
+protected:
+    // The JSON file of the state of the container `id`.
+    [[nodiscard]] std::filesystem::path status_file(const std::string &id) const;
+
+    // The index of annotations has a directory for each pair of key and value under `index`,
+    // with an empty file named by the ID of each container having the annotation.
+    // Entries are added before a state is written and removed after,
+    // so the index has at least the containers, which find() checks by their states.
+    // States written before the index existed are indexed by build_index().
+
+    // Index all states once, which is marked by `index/.built`.
+    // Returns false if the index can not be built, e.g. the directory is read-only,
+    // then find() reads all states instead.
+    [[nodiscard]] bool build_index() const;
+
+    // Add entries of annotations in `current` but not in `previous` of the container `id`.
+    void add_index(const std::string &id,
+                   const std::map<std::string, std::string> &previous,
+                   const std::map<std::string, std::string> &current) const;
+
+    // Remove entries of annotations in `previous` but not in `current` of the container `id`.
+    void remove_index(const std::string &id,
+                      const std::map<std::string, std::string> &previous,
+                      const std::map<std::string, std::string> &current) const;
+
 private:
+    // Remove the state of the container `id` with the lock of the directory held.
+    void remove_locked(const std::string &id);
+
     std::filesystem::path path;
 };
 
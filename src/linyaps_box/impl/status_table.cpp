@@ -0,0 +1,629 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/impl/status_table.h"
+
+#include "linyaps_box/utils/digest.h"
+#include "linyaps_box/utils/log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char magic[8] = { 'L', 'L', 'B', 'O', 'X', 'S', 'T', 'S' };
+
+// NOTE: Bump it on any change of the layout or of the encoding below.
+constexpr std::uint32_t format_version = 3;
+
+constexpr auto table_name = "status.table";
+
+constexpr std::size_t header_size = 4096;
+constexpr std::size_t slot_size = 4096;
+constexpr std::uint32_t initial_slots = 64;
+
+// The whole capacity is mapped once, so the table is extended without remapping.
+constexpr std::uint32_t max_slots = 65536;
+
+// The header is followed by the keys of all slots, 0 for free slots,
+// so lookups scan a few pages instead of every slot.
+constexpr std::size_t index_size = max_slots * sizeof(std::uint64_t);
+constexpr std::size_t slots_offset = header_size + index_size;
+
+// Readers give up a slot which stays odd, for example if its writer died.
+constexpr int max_retries = 1000;
+
+// All integers are in the byte order of the host, the table is not shared between hosts.
+struct header_t
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t slot_size;
+    std::uint32_t capacity;
+    // Slots backed by the file, it is increased after the file is extended.
+    std::atomic<std::uint32_t> slot_count;
+};
+
+struct slot_t
+{
+    // Odd while the slot is being written.
+    std::atomic<std::uint32_t> sequence;
+    // The size of the encoded status, 0 if the slot is free.
+    std::atomic<std::uint32_t> size;
+    // The digest of the ID, the same as the index.
+    std::atomic<std::uint64_t> key;
+    char data[slot_size - 16];
+};
+
+static_assert(sizeof(header_t) <= header_size);
+static_assert(sizeof(slot_t) == slot_size);
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+
+// The digest of `id`, which is never 0.
+[[nodiscard]] std::uint64_t key_of(const std::string &id)
+{
+    linyaps_box::utils::digest digest;
+    digest.update(id);
+    return std::max<std::uint64_t>(digest.sum(), 1);
+}
+
+void put(std::string &out, std::uint32_t value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void put(std::string &out, std::uint64_t value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void put(std::string &out, const std::string &value)
+{
+    put(out, static_cast<std::uint32_t>(value.size()));
+    out.append(value);
+}
+
+class decoder
+{
+public:
+    explicit decoder(const std::string &data)
+        : data(data)
+    {
+    }
+
+    [[nodiscard]] std::uint32_t integer()
+    {
+        std::uint32_t value = 0;
+        this->take(&value, sizeof(value));
+        return value;
+    }
+
+    [[nodiscard]] std::uint64_t integer64()
+    {
+        std::uint64_t value = 0;
+        this->take(&value, sizeof(value));
+        return value;
+    }
+
+    [[nodiscard]] std::string string()
+    {
+        std::string value(this->integer(), '\0');
+        this->take(value.data(), value.size());
+        return value;
+    }
+
+private:
+    void take(void *out, std::size_t size)
+    {
+        if (size > this->data.size() - this->offset) {
+            throw std::runtime_error("truncated status");
+        }
+        std::memcpy(out, this->data.data() + this->offset, size);
+        this->offset += size;
+    }
+
+    const std::string &data;
+    std::size_t offset = 0;
+};
+
+// The ID is encoded first, so decode_id reads only it.
+[[nodiscard]] std::string encode(const linyaps_box::container_status_t &status)
+{
+    std::string out;
+    put(out, status.ID);
+    put(out, static_cast<std::uint32_t>(status.PID));
+    put(out, static_cast<std::uint32_t>(status.status));
+    put(out, status.bundle.string());
+    put(out, status.created);
+    put(out, static_cast<std::uint32_t>(status.owner));
+    put(out, status.start_time);
+    put(out, static_cast<std::uint32_t>(status.runtime_pid));
+    put(out, status.runtime_start_time);
+
+    put(out, static_cast<std::uint32_t>(status.annotations.size()));
+    for (const auto &[key, value] : status.annotations) {
+        put(out, key);
+        put(out, value);
+    }
+
+    return out;
+}
+
+[[nodiscard]] std::string decode_id(const std::string &data)
+{
+    decoder d(data);
+    return d.string();
+}
+
+[[nodiscard]] linyaps_box::container_status_t decode(const std::string &data)
+{
+    decoder d(data);
+
+    linyaps_box::container_status_t status{};
+    status.ID = d.string();
+    status.PID = static_cast<pid_t>(d.integer());
+    auto value = d.integer();
+    if (value > static_cast<std::uint32_t>(
+                linyaps_box::container_status_t::runtime_status::STOPPED)) {
+        throw std::runtime_error("invalid status " + std::to_string(value));
+    }
+    status.status = static_cast<linyaps_box::container_status_t::runtime_status>(value);
+    status.bundle = d.string();
+    status.created = d.string();
+    status.owner = static_cast<uid_t>(d.integer());
+    status.start_time = d.integer64();
+    status.runtime_pid = static_cast<pid_t>(d.integer());
+    status.runtime_start_time = d.integer64();
+
+    auto count = d.integer();
+    for (std::uint32_t i = 0; i < count; ++i) {
+        auto key = d.string();
+        status.annotations[key] = d.string();
+    }
+
+    return status;
+}
+
+[[nodiscard]] header_t &header_of(void *table)
+{
+    return *static_cast<header_t *>(table);
+}
+
+[[nodiscard]] std::atomic<std::uint64_t> &key_at(void *table, std::uint32_t index)
+{
+    return reinterpret_cast<std::atomic<std::uint64_t> *>(static_cast<char *>(table)
+                                                          + header_size)[index];
+}
+
+[[nodiscard]] slot_t &slot_of(void *table, std::uint32_t index)
+{
+    return *reinterpret_cast<slot_t *>(static_cast<char *>(table) + slots_offset
+                                       + static_cast<std::size_t>(index) * slot_size);
+}
+
+// Copy the encoded status in `slot` without locking,
+// returns std::nullopt if the slot is free, or not of `key` unless it is 0.
+// NOTE: The index is only a hint for readers, the slot is checked again here.
+[[nodiscard]] std::optional<std::string> copy_slot(const slot_t &slot, std::uint64_t key)
+{
+    for (int i = 0; i < max_retries; ++i) {
+        auto begin = slot.sequence.load(std::memory_order_acquire);
+        if ((begin & 1) != 0) {
+            sched_yield();
+            continue;
+        }
+
+        std::optional<std::string> result;
+        auto size = slot.size.load(std::memory_order_relaxed);
+        if (size != 0 && (key == 0 || slot.key.load(std::memory_order_relaxed) == key)) {
+            result.emplace(std::min<std::size_t>(size, sizeof(slot.data)), '\0');
+            std::memcpy(result->data(), slot.data, result->size());
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == begin) {
+            return result;
+        }
+    }
+
+    LINYAPS_BOX_WARNING() << "Skip a slot of the status table which is being written";
+    return std::nullopt;
+}
+
+// Write `data` to `slot` with the lock of the table held.
+void store(slot_t &slot, std::uint64_t key, const std::string &data)
+{
+    // NOTE: The sequence is already odd if a writer died while writing the slot.
+    auto sequence = slot.sequence.load(std::memory_order_relaxed) | 1;
+    slot.sequence.store(sequence, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.size.store(static_cast<std::uint32_t>(data.size()), std::memory_order_relaxed);
+    slot.key.store(key, std::memory_order_relaxed);
+    std::memcpy(slot.data, data.data(), data.size());
+
+    slot.sequence.store(sequence + 1, std::memory_order_release);
+}
+
+} // namespace
+
+class linyaps_box::impl::status_table::lock_guard
+{
+public:
+    explicit lock_guard(status_table &table)
+        : table(table)
+        , guard(table.mutex)
+    {
+        while (::flock(table.fd.get(), LOCK_EX)) {
+            if (errno != EINTR) {
+                throw std::system_error(errno, std::generic_category(), "flock");
+            }
+        }
+    }
+
+    lock_guard(const lock_guard &) = delete;
+    lock_guard &operator=(const lock_guard &) = delete;
+    lock_guard(lock_guard &&) = delete;
+    lock_guard &operator=(lock_guard &&) = delete;
+
+    ~lock_guard() { ::flock(this->table.fd.get(), LOCK_UN); }
+
+private:
+    status_table &table;
+    std::lock_guard<std::mutex> guard;
+};
+
+linyaps_box::impl::status_table::status_table(const std::filesystem::path &path)
+    : status_directory(path)
+{
+    auto table_path = path / table_name;
+    this->fd = utils::file_descriptor(::open(table_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600));
+    if (this->fd.get() < 0) {
+        throw std::system_error(errno, std::generic_category(), "open " + table_path.string());
+    }
+
+    lock_guard lock(*this);
+
+    struct stat st{};
+    if (::fstat(this->fd.get(), &st)) {
+        throw std::system_error(errno, std::generic_category(), "fstat " + table_path.string());
+    }
+
+    header_t header{};
+    if (st.st_size == 0) {
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = format_version;
+        header.slot_size = slot_size;
+        header.capacity = max_slots;
+        header.slot_count.store(initial_slots, std::memory_order_relaxed);
+
+        if (::ftruncate(this->fd.get(),
+                        static_cast<off_t>(slots_offset + initial_slots * slot_size))) {
+            throw std::system_error(errno, std::generic_category(), "ftruncate");
+        }
+        if (::pwrite(this->fd.get(), &header, sizeof(header), 0)
+            != static_cast<ssize_t>(sizeof(header))) {
+            throw std::system_error(errno, std::generic_category(), "pwrite");
+        }
+    } else if (::pread(this->fd.get(), &header, sizeof(header), 0)
+                       != static_cast<ssize_t>(sizeof(header))
+               || std::memcmp(header.magic, magic, sizeof(magic)) != 0
+               || header.version != format_version || header.slot_size != slot_size
+               || header.capacity != max_slots) {
+        throw std::runtime_error("invalid status table " + table_path.string());
+    }
+
+    this->mapped_size = slots_offset + static_cast<std::size_t>(header.capacity) * slot_size;
+    this->table = ::mmap(nullptr,
+                         this->mapped_size,
+                         PROT_READ | PROT_WRITE,
+                         MAP_SHARED,
+                         this->fd.get(),
+                         0);
+    if (this->table == MAP_FAILED) {
+        this->table = nullptr;
+        throw std::system_error(errno, std::generic_category(), "mmap " + table_path.string());
+    }
+}
+
+linyaps_box::impl::status_table::~status_table()
+{
+    if (this->table != nullptr) {
+        ::munmap(this->table, this->mapped_size);
+    }
+}
+
+bool linyaps_box::impl::status_table::exists(const std::filesystem::path &path)
+{
+    std::error_code ec;
+    return std::filesystem::is_regular_file(path / table_name, ec);
+}
+
+void linyaps_box::impl::status_table::write(const container_status_t &status)
+{
+    auto data = encode(status);
+    if (data.size() > sizeof(slot_t::data)) {
+        throw std::runtime_error("status of container " + status.ID
+                                 + " does not fit in a slot of the status table");
+    }
+
+    auto key = key_of(status.ID);
+
+    lock_guard lock(*this);
+
+    auto &header = header_of(this->table);
+    auto count = header.slot_count.load(std::memory_order_relaxed);
+
+    // NOTE: Slots are read directly, as they are changed only with the lock held.
+    std::optional<std::uint32_t> vacant;
+    for (std::uint32_t i = 0; i < count; ++i) {
+        auto current = key_at(this->table, i).load(std::memory_order_relaxed);
+        if (current == 0) {
+            if (!vacant) {
+                vacant = i;
+            }
+            continue;
+        }
+
+        // NOTE: A slot can only stay odd with the lock held if its writer died,
+        // it is cleared and reused.
+        auto &slot = slot_of(this->table, i);
+        if ((slot.sequence.load(std::memory_order_relaxed) & 1) != 0) {
+            LINYAPS_BOX_WARNING() << "Clear slot " << i << " of the status table, "
+                                  << "which was abandoned by its writer";
+            key_at(this->table, i).store(0, std::memory_order_release);
+            store(slot, 0, {});
+            if (!vacant) {
+                vacant = i;
+            }
+            continue;
+        }
+
+        if (current != key) {
+            continue;
+        }
+
+        std::string old(slot.data,
+                        std::min<std::size_t>(slot.size.load(std::memory_order_relaxed),
+                                              sizeof(slot.data)));
+        if (decode_id(old) != status.ID) {
+            continue;
+        }
+
+        auto previous = decode(old).annotations;
+        this->add_index(status.ID, previous, status.annotations);
+        store(slot, key, data);
+        this->remove_index(status.ID, previous, status.annotations);
+        return;
+    }
+
+    if (!vacant) {
+        if (count >= header.capacity) {
+            throw std::runtime_error("status table is full");
+        }
+
+        auto grown = std::min(count * 2, header.capacity);
+        if (::ftruncate(this->fd.get(), static_cast<off_t>(slots_offset + grown * slot_size))) {
+            throw std::system_error(errno, std::generic_category(), "ftruncate");
+        }
+        header.slot_count.store(grown, std::memory_order_release);
+        vacant = count;
+    }
+
+    this->add_index(status.ID, {}, status.annotations);
+
+    // NOTE: The slot is written before it is indexed.
+    store(slot_of(this->table, *vacant), key, data);
+    key_at(this->table, *vacant).store(key, std::memory_order_release);
+}
+
+linyaps_box::container_status_t
+linyaps_box::impl::status_table::read(const std::string &id) const
+{
+    auto key = key_of(id);
+
+    auto count = header_of(this->table).slot_count.load(std::memory_order_acquire);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        if (key_at(this->table, i).load(std::memory_order_acquire) != key) {
+            continue;
+        }
+
+        auto data = copy_slot(slot_of(this->table, i), key);
+        if (!data) {
+            continue;
+        }
+
+        auto status = decode(*data);
+        if (status.ID != id) {
+            continue;
+        }
+
+        if (!is_alive(status)) {
+            status.status = container_status_t::runtime_status::STOPPED;
+        }
+        return status;
+    }
+
+    // NOTE: States written as JSON files before the table was created are read as well,
+    // until their containers remove them.
+    if (std::error_code ec; std::filesystem::exists(this->status_file(id), ec)) {
+        return status_directory::read(id);
+    }
+
+    throw std::runtime_error("container " + id + " not found");
+}
+
+void linyaps_box::impl::status_table::remove(const std::string &id)
+{
+    std::map<std::string, std::string> previous;
+    if (!this->clear_slot(id, [](const container_status_t &) { return true; }, previous)) {
+        status_directory::remove(id);
+        return;
+    }
+
+    std::filesystem::remove(this->control_socket(id));
+    std::filesystem::remove(this->exec_policy(id));
+    this->remove_index(id, previous, {});
+}
+
+bool linyaps_box::impl::status_table::remove_if(
+        const std::string &id, const std::function<bool(const container_status_t &)> &stale)
+{
+    std::map<std::string, std::string> previous;
+    auto cleared = this->clear_slot(id, stale, previous);
+    if (!cleared) {
+        return status_directory::remove_if(id, stale);
+    }
+    if (!*cleared) {
+        return false;
+    }
+
+    std::filesystem::remove(this->control_socket(id));
+    std::filesystem::remove(this->exec_policy(id));
+    this->remove_index(id, previous, {});
+    return true;
+}
+
+std::optional<bool> linyaps_box::impl::status_table::clear_slot(
+        const std::string &id,
+        const std::function<bool(const container_status_t &)> &stale,
+        std::map<std::string, std::string> &previous)
+{
+    auto key = key_of(id);
+
+    lock_guard lock(*this);
+
+    auto count = header_of(this->table).slot_count.load(std::memory_order_relaxed);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        if (key_at(this->table, i).load(std::memory_order_relaxed) != key) {
+            continue;
+        }
+
+        // NOTE: A slot left odd by a writer which died is removed as well.
+        auto &slot = slot_of(this->table, i);
+        std::string old(slot.data,
+                        std::min<std::size_t>(slot.size.load(std::memory_order_relaxed),
+                                              sizeof(slot.data)));
+        if ((slot.sequence.load(std::memory_order_relaxed) & 1) == 0) {
+            if (decode_id(old) != id) {
+                continue;
+            }
+
+            auto status = decode(old);
+            if (!is_alive(status)) {
+                status.status = container_status_t::runtime_status::STOPPED;
+            }
+            if (!stale(status)) {
+                return false;
+            }
+            previous = std::move(status.annotations);
+        }
+
+        key_at(this->table, i).store(0, std::memory_order_release);
+        store(slot, 0, {});
+        return true;
+    }
+
+    return std::nullopt;
+}
+
+std::vector<std::string> linyaps_box::impl::status_table::list() const
+{
+    std::vector<std::string> ret;
+
+    auto count = header_of(this->table).slot_count.load(std::memory_order_acquire);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        if (key_at(this->table, i).load(std::memory_order_acquire) == 0) {
+            continue;
+        }
+
+        auto data = copy_slot(slot_of(this->table, i), 0);
+        if (!data) {
+            continue;
+        }
+
+        try {
+            ret.push_back(decode_id(*data));
+        } catch (const std::exception &e) {
+            LINYAPS_BOX_WARNING() << "Skip slot " << i << " of the status table: " << e.what();
+        }
+    }
+
+    std::set<std::string> ids(ret.begin(), ret.end());
+    for (auto &id : status_directory::list()) {
+        if (ids.count(id) == 0) {
+            ret.push_back(std::move(id));
+        }
+    }
+
+    return ret;
+}
+
+std::vector<linyaps_box::container_status_t> linyaps_box::impl::status_table::snapshot() const
+{
+    std::vector<container_status_t> ret;
+
+    auto count = header_of(this->table).slot_count.load(std::memory_order_acquire);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        if (key_at(this->table, i).load(std::memory_order_acquire) == 0) {
+            continue;
+        }
+
+        auto data = copy_slot(slot_of(this->table, i), 0);
+        if (!data) {
+            continue;
+        }
+
+        try {
+            auto status = decode(*data);
+            if (!is_alive(status)) {
+                status.status = container_status_t::runtime_status::STOPPED;
+            }
+            ret.push_back(std::move(status));
+        } catch (const std::exception &e) {
+            LINYAPS_BOX_WARNING() << "Skip slot " << i << " of the status table: " << e.what();
+        }
+    }
+
+    std::set<std::string> ids;
+    for (const auto &status : ret) {
+        ids.insert(status.ID);
+    }
+    for (auto &status : status_directory::snapshot()) {
+        if (ids.count(status.ID) == 0) {
+            ret.push_back(std::move(status));
+        }
+    }
+
+    std::sort(ret.begin(), ret.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs.ID < rhs.ID;
+    });
+
+    return ret;
+}
+
+std::unique_ptr<linyaps_box::status_directory>
+linyaps_box::impl::open_status_directory(const std::filesystem::path &root)
+{
+    if (status_table::exists(root)) {
+        return std::make_unique<status_table>(root);
+    }
+    return std::make_unique<status_directory>(root);
+}
@@ -0,0 +1,82 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/impl/status_directory.h"
+#include "linyaps_box/utils/file_describer.h"
+
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// States of containers in a single memory-mapped table of fixed-size slots at `status.table`
+// under the root, instead of a JSON file per container.
+//
+// Each slot has a sequence, which is odd while the slot is being written,
+// so readers copy a slot without any lock and retry if the sequence changed.
+// Writers update slots in place, serialized by flock(2) of the table,
+// which also guards allocating free slots and extending the table.
+// A slot which is odd with the lock held was abandoned by a writer which died,
+// it is cleared and reused by the next write.
+//
+// States of containers created before the table, which are JSON files
+// as linyaps_box::impl::status_directory writes, are read and removed as well.
+//
+// Caches and control sockets are the same as linyaps_box::impl::status_directory.
+
+namespace linyaps_box::impl {
+
+class status_table : public status_directory
+{
+public:
+    void write(const container_status_t &status);
+    container_status_t read(const std::string &id) const;
+    void remove(const std::string &id);
+    bool remove_if(const std::string &id,
+                   const std::function<bool(const container_status_t &)> &stale);
+    std::vector<std::string> list() const;
+    std::vector<container_status_t> snapshot() const;
+
+    // Open the table under `path`, which is created if it does not exist.
+    explicit status_table(const std::filesystem::path &path);
+    ~status_table();
+
+    status_table(const status_table &) = delete;
+    status_table &operator=(const status_table &) = delete;
+    status_table(status_table &&) = delete;
+    status_table &operator=(status_table &&) = delete;
+
+    // Whether the table exists under `path`.
+    [[nodiscard]] static bool exists(const std::filesystem::path &path);
+
+private:
+    class lock_guard;
+
+    // Clear the slot of the container `id` if `stale` returns true for its state.
+    // Returns std::nullopt if the container is not in the table, otherwise whether it is cleared,
+    // with annotations of the state in `previous`.
+    std::optional<bool> clear_slot(const std::string &id,
+                                   const std::function<bool(const container_status_t &)> &stale,
+                                   std::map<std::string, std::string> &previous);
+
+    utils::file_descriptor fd;
+    void *table = nullptr;
+    std::size_t mapped_size = 0;
+
+    // NOTE: flock(2) does not exclude threads sharing the file descriptor.
+    std::mutex mutex;
+};
+
+static_assert(!std::is_abstract_v<status_table>);
+
+// The status table under `root` if it exists, otherwise the directory of JSON files.
+[[nodiscard]] std::unique_ptr<linyaps_box::status_directory>
+open_status_directory(const std::filesystem::path &root);
+
+} // namespace linyaps_box::impl
@@ -34,11 +34,13 @@ void linyaps_box::impl::table_printer::print_statuses(const std::vector<containe
     std::cout << std::left << std::setw(max_length + 1) << "NAME" << std::setw(10) << "PID"
               << std::setw(9) << "STATUS" << std::setw(40) << "BUNDLE PATH" << std::setw(31)
               << "CREATED" << std::setw(0) << "OWNER" << std::endl;
+    // NOTE: Lines are not flushed one by one, as there might be thousands of containers.
     for (const auto &s : status) {
         std::cout << std::left << std::setw(max_length) << s.ID << std::setw(10) << s.PID
                   << std::setw(9) << get_status_string(s.status) << std::setw(40) << s.bundle
-                  << std::setw(31) << s.created << std::setw(0) << s.owner << std::endl;
+                  << std::setw(31) << s.created << std::setw(0) << s.owner << '\n';
     }
+    std::cout.flush();
     return;
 }
 
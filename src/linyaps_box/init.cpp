@@ -0,0 +1,159 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/init.h"
+
+#include "linyaps_box/utils/log.h"
+#include "linyaps_box/utils/signalfd.h"
+
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <system_error>
+
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+[[nodiscard]] int exit_code_of(const siginfo_t &info) noexcept
+{
+    if (info.si_code == CLD_EXITED) {
+        return info.si_status;
+    }
+
+    // NOTE: Follow the convention of shells.
+    return 128 + info.si_status;
+}
+
+// Reap all terminated children, returns the exit code of `child` if it exited.
+// Processes spawned by the agent are reported to it.
+[[nodiscard]] std::optional<int> reap_children(pid_t child,
+                                               linyaps_box::agent::server *agent,
+                                               linyaps_box::utils::epoll &epoll)
+{
+    std::optional<int> result;
+
+    while (true) {
+        siginfo_t info{};
+        auto ret = ::waitid(P_ALL, 0, &info, WEXITED | WNOHANG);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ECHILD) {
+                break;
+            }
+            throw std::system_error(errno, std::generic_category(), "waitid");
+        }
+
+        // NOTE: No more children in zombie state.
+        if (info.si_pid == 0) {
+            break;
+        }
+
+        LINYAPS_BOX_DEBUG() << "Init reaped process " << info.si_pid;
+
+        if (info.si_pid == child) {
+            result = exit_code_of(info);
+        } else if (agent != nullptr) {
+            [[maybe_unused]] auto spawned = agent->exited(epoll, info.si_pid, exit_code_of(info));
+        }
+    }
+
+    return result;
+}
+
+} // namespace
+
+sigset_t linyaps_box::init::forwarded_signals() noexcept
+{
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGHUP);
+    return set;
+}
+
+sigset_t linyaps_box::init::block_signals()
+{
+    auto set = forwarded_signals();
+    sigaddset(&set, SIGCHLD);
+
+    sigset_t old;
+    if (sigprocmask(SIG_BLOCK, &set, &old)) {
+        throw std::system_error(errno, std::generic_category(), "sigprocmask");
+    }
+
+    return old;
+}
+
+void linyaps_box::init::run(pid_t child,
+                            utils::file_descriptor control,
+                            exec_policy::policy_t policy,
+                            features::set_t features) noexcept
+try {
+    LINYAPS_BOX_DEBUG() << "Init started, container process PID=" << child;
+
+    // NOTE: This is a no-op if we are PID 1 of a PID namespace,
+    // it makes orphans re-parented to us otherwise.
+    if (prctl(PR_SET_CHILD_SUBREAPER, 1, 0, 0, 0)) {
+        throw std::system_error(errno, std::generic_category(), "prctl PR_SET_CHILD_SUBREAPER");
+    }
+
+    auto set = forwarded_signals();
+    sigaddset(&set, SIGCHLD);
+    auto signal_fd = utils::signalfd(set);
+
+    utils::epoll epoll;
+    epoll.add(signal_fd, EPOLLIN);
+
+    std::optional<agent::server> agent;
+    if (control.get() >= 0) {
+        LINYAPS_BOX_DEBUG() << "Init serves the control socket";
+        agent.emplace(std::move(control), std::move(policy), std::move(features));
+        agent->watch(epoll);
+    }
+    auto *agent_ptr = agent ? &*agent : nullptr;
+
+    // NOTE: The container process might have exited before we watch signals.
+    if (auto code = reap_children(child, agent_ptr, epoll); code) {
+        _exit(*code);
+    }
+
+    while (true) {
+        for (const auto &event : epoll.wait()) {
+            if (event.data.fd != signal_fd.get()) {
+                if (agent) {
+                    agent->handle(epoll, event);
+                }
+                continue;
+            }
+
+            while (auto info = utils::read_signal(signal_fd)) {
+                auto sig = static_cast<int>(info->ssi_signo);
+                if (sig != SIGCHLD) {
+                    LINYAPS_BOX_DEBUG() << "Init forward signal " << sig << " to " << child;
+                    if (::kill(child, sig) && errno != ESRCH) {
+                        throw std::system_error(errno, std::generic_category(), "kill");
+                    }
+                    continue;
+                }
+
+                if (auto code = reap_children(child, agent_ptr, epoll); code) {
+                    LINYAPS_BOX_DEBUG() << "Container process exited with " << *code;
+                    _exit(*code);
+                }
+            }
+        }
+    }
+} catch (const std::exception &e) {
+    std::cerr << "init: " << e.what() << std::endl;
+    _exit(-1);
+} catch (...) {
+    std::cerr << "init: unknown error" << std::endl;
+    _exit(-1);
+}
@@ -0,0 +1,34 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/agent.h"
+#include "linyaps_box/utils/file_describer.h"
+
+#include <csignal>
+
+#include <sys/types.h>
+
+namespace linyaps_box::init {
+
+// Signals that init forwards to the container process.
+sigset_t forwarded_signals() noexcept;
+
+// Block SIGCHLD and the forwarded signals, so that no signal is lost between
+// fork(2) and the first sigwaitinfo(2) in run().
+// The previous signal mask is returned and should be restored in the child.
+sigset_t block_signals();
+
+// Act as the init process of the container:
+// reap every process re-parented to us,
+// forward signals to `child` and exit with the exit status of `child`.
+// The agent serves the control socket `control` if it is valid, restricted by `policy`,
+// and chooses its strategy by `features`.
+[[noreturn]] void run(pid_t child,
+                      utils::file_descriptor control = {},
+                      exec_policy::policy_t policy = {},
+                      features::set_t features = {}) noexcept;
+
+} // namespace linyaps_box::init
@@ -0,0 +1,73 @@
+/*
+ * SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINYAPS_BOX_PLUGIN_H
+#define LINYAPS_BOX_PLUGIN_H
+
+/*
+ * The C ABI of plugin hooks, which are called in the runtime process
+ * instead of executing a program for each hook.
+ *
+ * A hook with `entry` in config.json is a plugin hook:
+ *
+ *     {"path": "/usr/lib/linyaps-box/plugins/foo.so", "entry": "write_config", "args": ["x"]}
+ *
+ * Plugins are trusted as the runtime itself, `path` must be a shared object
+ * directly in the plugin directory of the runtime, see linyaps_box/plugin_loader.h.
+ * The shared object of `path` is loaded with dlopen(3) once by the runtime
+ * before the container process is cloned, and `entry` is called as
+ * linyaps_box_hook_fn in the namespaces of its stage, as an executed hook would be:
+ * prestart, createRuntime, poststart and poststop in the runtime namespace,
+ * createContainer and startContainer in the container namespace.
+ *
+ * The entry returns 0 on success, others fail the hook like a non-zero exit code.
+ * It must not block for long, change the state of the calling process,
+ * or keep pointers of the context after it returns. `timeout` does not apply.
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LINYAPS_BOX_PLUGIN_ABI_VERSION 1
+
+struct linyaps_box_hook_context
+{
+    /* sizeof(struct linyaps_box_hook_context) of the runtime,
+     * fields are only appended in later versions. */
+    uint32_t size;
+    uint32_t abi_version;
+
+    /* The stage of the hook as named in config.json, for example "createRuntime". */
+    const char *stage;
+
+    /* The container ID and the absolute path of its bundle. */
+    const char *id;
+    const char *bundle;
+
+    /* The container process as seen in the namespace of the hook,
+     * 0 after it exited. */
+    pid_t pid;
+
+    /* A pidfd of the container process, -1 if unavailable or in the container namespace. */
+    int pidfd;
+
+    /* `args` and `env` of the hook, both terminated by NULL. */
+    int argc;
+    const char *const *argv;
+    const char *const *envp;
+};
+
+typedef int (*linyaps_box_hook_fn)(const struct linyaps_box_hook_context *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LINYAPS_BOX_PLUGIN_H */
@@ -0,0 +1,175 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/plugin_loader.h"
+
+#include "linyaps_box/utils/log.h"
+
+#include <map>
+#include <mutex>
+#include <optional>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <dlfcn.h>
+#include <sys/stat.h>
+
+namespace {
+
+std::mutex loaded_mutex;
+std::map<std::pair<std::string, std::string>, linyaps_box_hook_fn> loaded;
+
+void check_trusted(const std::filesystem::path &path, mode_t type)
+{
+    struct stat st{};
+    if (::lstat(path.c_str(), &st) != 0) {
+        throw std::system_error(errno, std::generic_category(), "lstat " + path.string());
+    }
+
+    if ((st.st_mode & S_IFMT) != type) {
+        throw std::runtime_error("plugin " + path.string() + " is not a "
+                                 + (type == S_IFDIR ? "directory" : "regular file"));
+    }
+
+    if (st.st_uid != 0) {
+        throw std::runtime_error("plugin " + path.string() + " is not owned by root");
+    }
+
+    if ((st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        throw std::runtime_error("plugin " + path.string() + " is writable by group or others");
+    }
+}
+
+// The filename of `path` of a hook, which must be directly in `directory`.
+[[nodiscard]] std::filesystem::path filename_in(const std::filesystem::path &directory,
+                                            const std::filesystem::path &path)
+{
+    auto normal = path.lexically_normal();
+    if (!normal.is_absolute() || normal.filename().empty()
+        || normal != directory.lexically_normal() / normal.filename()) {
+        throw std::runtime_error("plugin " + path.string() + " is not in "
+                                 + directory.string());
+    }
+
+    return normal.filename();
+}
+
+[[nodiscard]] linyaps_box_hook_fn load_entry(const std::filesystem::path &directory,
+                                             const std::filesystem::path &path,
+                                             const std::string &entry)
+{
+    auto key = std::make_pair(path.string(), entry);
+    if (auto it = loaded.find(key); it != loaded.end()) {
+        return it->second;
+    }
+
+    // NOTE: Only root can replace the directory or the shared object after they are checked.
+    check_trusted(directory, S_IFDIR);
+    check_trusted(path, S_IFREG);
+
+    LINYAPS_BOX_DEBUG() << "Load plugin hook " << entry << " of " << path;
+
+    // NOTE: dlopen(3) keeps a reference count,
+    // the handle is leaked intentionally so the shared object is loaded once.
+    auto *handle = ::dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr) {
+        throw std::runtime_error("dlopen " + path.string() + ": " + ::dlerror());
+    }
+
+    ::dlerror();
+    auto *symbol = ::dlsym(handle, entry.c_str());
+    if (symbol == nullptr) {
+        const auto *error = ::dlerror();
+        throw std::runtime_error("dlsym " + entry + " of " + path.string() + ": "
+                                 + (error ? error : "null symbol"));
+    }
+
+    auto fn = reinterpret_cast<linyaps_box_hook_fn>(symbol);
+    loaded.emplace(std::move(key), fn);
+    return fn;
+}
+
+} // namespace
+
+std::filesystem::path linyaps_box::plugin::default_directory()
+{
+    return LINYAPS_BOX_PLUGIN_DIR;
+}
+
+linyaps_box::plugin::entries_t linyaps_box::plugin::load(const config &config,
+                                                         const std::filesystem::path &directory)
+{
+    const auto &hooks = config.hooks;
+    entries_t result;
+    std::optional<std::filesystem::path> real;
+
+    std::lock_guard<std::mutex> guard(loaded_mutex);
+    for (const auto *list : { &hooks.prestart,
+                              &hooks.create_runtime,
+                              &hooks.create_container,
+                              &hooks.start_container,
+                              &hooks.poststart,
+                              &hooks.poststop }) {
+        for (const auto &hook : *list) {
+            if (!hook.entry) {
+                continue;
+            }
+
+            // NOTE: Symlinks in the directory are resolved,
+            // so it is checked where it really is.
+            if (!real) {
+                real = std::filesystem::canonical(directory);
+            }
+            auto filename = filename_in(directory, hook.path);
+            result.emplace(&hook, load_entry(*real, *real / filename, *hook.entry));
+        }
+    }
+
+    return result;
+}
+
+void linyaps_box::plugin::call(linyaps_box_hook_fn fn,
+                               const config::hooks_t::hook_t &hook,
+                               const call_context_t &context)
+{
+    std::vector<const char *> argv;
+    argv.reserve(hook.args.size() + 1);
+    for (const auto &arg : hook.args) {
+        argv.push_back(arg.c_str());
+    }
+    argv.push_back(nullptr);
+
+    std::vector<std::string> env;
+    env.reserve(hook.env.size());
+    for (const auto &[key, value] : hook.env) {
+        env.push_back(key + "=" + value);
+    }
+    std::vector<const char *> envp;
+    envp.reserve(env.size() + 1);
+    for (const auto &e : env) {
+        envp.push_back(e.c_str());
+    }
+    envp.push_back(nullptr);
+
+    linyaps_box_hook_context ctx{};
+    ctx.size = sizeof(ctx);
+    ctx.abi_version = LINYAPS_BOX_PLUGIN_ABI_VERSION;
+    ctx.stage = context.stage;
+    ctx.id = context.id.c_str();
+    ctx.bundle = context.bundle.c_str();
+    ctx.pid = context.pid;
+    ctx.pidfd = context.pidfd;
+    ctx.argc = static_cast<int>(hook.args.size());
+    ctx.argv = argv.data();
+    ctx.envp = envp.data();
+
+    LINYAPS_BOX_DEBUG() << "Call plugin hook " << *hook.entry << " of " << hook.path;
+
+    auto ret = fn(&ctx);
+    if (ret != 0) {
+        throw std::runtime_error("plugin hook " + *hook.entry + " of " + hook.path.string()
+                                 + " returned " + std::to_string(ret));
+    }
+}
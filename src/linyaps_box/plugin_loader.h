@@ -0,0 +1,53 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/config.h"
+#include "linyaps_box/plugin.h"
+
+#include <filesystem>
+#include <map>
+#include <string>
+
+// Loading and calling plugin hooks, see linyaps_box/plugin.h for the ABI.
+//
+// NOTE: Plugins run in the runtime process with all its privileges,
+// so they are trusted as much as the runtime itself.
+// They are only loaded from a directory configured for the runtime,
+// which must be owned by root and not writable by others,
+// `path` of a hook in config.json can only select one of them.
+
+namespace linyaps_box::plugin {
+
+struct call_context_t
+{
+    const char *stage = nullptr;
+    std::string id;
+    std::string bundle;
+    pid_t pid = 0;
+    int pidfd = -1;
+};
+
+// Entries of plugin hooks keyed by the hooks in the configuration.
+using entries_t = std::map<const config::hooks_t::hook_t *, linyaps_box_hook_fn>;
+
+// The directory of plugins set at build time by linyaps-box_PLUGIN_DIR.
+[[nodiscard]] std::filesystem::path default_directory();
+
+// Load the entries of all plugin hooks of `config` from `directory`,
+// it throws std::runtime_error if a shared object or a symbol is not found,
+// or if a shared object is not a file directly in `directory`,
+// or either of them is not owned by root or is writable by group or others.
+// Shared objects are loaded once per process and never unloaded.
+[[nodiscard]] entries_t load(const config &config, const std::filesystem::path &directory);
+
+// Call the entry of a plugin hook,
+// it throws std::runtime_error if the entry returns non-zero.
+// It takes no lock, so it is safe in the cloned container process.
+void call(linyaps_box_hook_fn fn,
+          const config::hooks_t::hook_t &hook,
+          const call_context_t &context);
+
+} // namespace linyaps_box::plugin
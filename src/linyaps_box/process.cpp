@@ -0,0 +1,192 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/process.h"
+
+#include "linyaps_box/utils/inspect.h"
+#include "linyaps_box/utils/log.h"
+
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h> /* Definition of SYS_* constants */
+#include <unistd.h>
+
+linyaps_box::prepared_process::prepared_process(const config::process_t &process,
+                                                std::optional<seccomp::program_t> seccomp)
+    : process(process)
+    , seccomp_program(std::move(seccomp))
+{
+    validate_process(this->process);
+
+    for (const auto &arg : this->process.args) {
+        this->c_args.push_back(arg.c_str());
+    }
+    this->c_args.push_back(nullptr);
+
+    for (const auto &env : this->process.env) {
+        this->envs.push_back(env.first + "=" + env.second);
+    }
+    for (const auto &env : this->envs) {
+        this->c_env.push_back(env.c_str());
+    }
+    this->c_env.push_back(nullptr);
+
+    if (this->process.oom_score_adj) {
+        this->oom_score_adj = std::to_string(*this->process.oom_score_adj);
+    }
+
+    if (this->process.apparmor_profile) {
+        this->apparmor_exec = "exec " + *this->process.apparmor_profile;
+    }
+}
+
+// Change the AppArmor profile on execve(2) with "exec PROFILE",
+// the interface under apparmor/ is preferred since Linux 5.8.
+static std::pair<int, const char *> apply_apparmor_profile(const std::string &apparmor_exec) noexcept
+{
+    int fd = ::open("/proc/thread-self/attr/apparmor/exec", O_WRONLY | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT) {
+        fd = ::open("/proc/thread-self/attr/exec", O_WRONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        return { errno, "open /proc/thread-self/attr/exec" };
+    }
+
+    auto written = ::write(fd, apparmor_exec.data(), apparmor_exec.size());
+    auto error = errno;
+    ::close(fd);
+    if (written < 0) {
+        return { error, "write /proc/thread-self/attr/exec" };
+    }
+
+    return { 0, nullptr };
+}
+
+std::pair<int, const char *> linyaps_box::prepared_process::execute() const noexcept
+{
+    auto ret = chdir(this->process.cwd.c_str());
+    if (ret) {
+        return { errno, "chdir" };
+    }
+
+    if (this->process.umask) {
+        ::umask(*this->process.umask);
+    }
+
+    // NOTE: Lowering oom_score_adj requires CAP_SYS_RESOURCE,
+    // so it is written before changing credentials.
+    if (this->process.oom_score_adj) {
+        int fd = ::open("/proc/self/oom_score_adj", O_WRONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return { errno, "open /proc/self/oom_score_adj" };
+        }
+        auto written = ::write(fd, this->oom_score_adj.data(), this->oom_score_adj.size());
+        auto error = errno;
+        ::close(fd);
+        if (written < 0) {
+            return { error, "write /proc/self/oom_score_adj" };
+        }
+    }
+
+    // NOTE: Changing the profile is allowed to unconfined processes,
+    // it is applied before credentials like runc does.
+    if (this->process.apparmor_profile) {
+        auto [error, call] = apply_apparmor_profile(this->apparmor_exec);
+        if (error) {
+            return { error, call };
+        }
+    }
+
+    // NOTE: Installing a filter requires no_new_privileges or CAP_SYS_ADMIN,
+    // which is lost by setuid(2), so without no_new_privileges it is installed first
+    // and the filter has to allow the rest of calls, like runc.
+    if (this->seccomp_program && !this->process.no_new_privileges) {
+        ret = seccomp::install(*this->seccomp_program);
+        if (ret) {
+            return { ret, "seccomp" };
+        }
+    }
+
+    // NOTE: The setxid functions of glibc synchronize credentials across
+    // all threads of the process, but after clone(2) the threads of a
+    // multithreaded runtime (for example a launcher using the library)
+    // do not exist in this process, which makes them wait forever.
+    // This process is single threaded, so call the system calls directly.
+    ret = syscall(SYS_setgid, this->process.gid);
+    if (ret) {
+        return { errno, "setgid" };
+    }
+
+    if (this->process.additional_gids) {
+        ret = syscall(SYS_setgroups,
+                      this->process.additional_gids->size(),
+                      this->process.additional_gids->data());
+        if (ret) {
+            return { errno, "setgroups" };
+        }
+    }
+
+    ret = syscall(SYS_setuid, this->process.uid);
+    if (ret) {
+        return { errno, "setuid" };
+    }
+
+    if (this->process.no_new_privileges) {
+        ret = prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0);
+        if (ret) {
+            return { errno, "prctl PR_SET_NO_NEW_PRIVS" };
+        }
+    }
+
+    if (this->seccomp_program && this->process.no_new_privileges) {
+        ret = seccomp::install(*this->seccomp_program);
+        if (ret) {
+            return { ret, "seccomp" };
+        }
+    }
+
+    execvpe(this->c_args[0],
+            const_cast<char *const *>(this->c_args.data()),
+            const_cast<char *const *>(this->c_env.data()));
+
+    return { errno, "execvpe" };
+}
+
+void linyaps_box::execute_process(const config::process_t &process,
+                                  std::optional<seccomp::program_t> seccomp)
+{
+    prepared_process prepared(process, std::move(seccomp));
+
+    LINYAPS_BOX_DEBUG() << "All opened file describers:\n" << linyaps_box::utils::inspect_fds();
+
+    LINYAPS_BOX_DEBUG() << "Execute process";
+
+    auto [error, call] = prepared.execute();
+    throw std::system_error(error, std::generic_category(), call);
+}
+
+void linyaps_box::validate_process(const config::process_t &process)
+{
+    if (process.rlimits) {
+        throw std::invalid_argument("process.rlimits is not supported");
+    }
+
+    const auto &capabilities = process.capabilities;
+    if (capabilities.effective || capabilities.bounding || capabilities.inheritable
+        || capabilities.permitted || capabilities.ambient) {
+        throw std::invalid_argument("process.capabilities is not supported");
+    }
+}
+
+void linyaps_box::check_terminal(const config::process_t &process, int stdin_fd)
+{
+    if (process.terminal && !::isatty(stdin_fd)) {
+        throw std::invalid_argument(
+                "process.terminal requires the standard input to be a terminal");
+    }
+}
@@ -0,0 +1,58 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/config.h"
+#include "linyaps_box/seccomp.h"
+
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace linyaps_box {
+
+// A process prepared to be executed without allocating memory,
+// so that it can be executed by a child created by vfork(2).
+class prepared_process
+{
+public:
+    // Throws if `process` is not supported, see validate_process.
+    explicit prepared_process(const config::process_t &process,
+                              std::optional<seccomp::program_t> seccomp = std::nullopt);
+
+    prepared_process(const prepared_process &) = delete;
+    prepared_process &operator=(const prepared_process &) = delete;
+
+    // Apply the process to the calling process and execute it: cwd, umask, oom_score_adj,
+    // apparmor_profile, credentials, no_new_privileges, seccomp, env and args.
+    // It returns only on failure, with the errno and the failed call.
+    [[nodiscard]] std::pair<int, const char *> execute() const noexcept;
+
+private:
+    config::process_t process;
+    std::optional<seccomp::program_t> seccomp_program;
+    std::vector<std::string> envs;
+    std::vector<const char *> c_args;
+    std::vector<const char *> c_env;
+    std::string oom_score_adj;
+    std::string apparmor_exec;
+};
+
+// Throws if `process` sets rlimits or capabilities, which are not supported,
+// as executing it without them would be less restricted than requested.
+void validate_process(const config::process_t &process);
+
+// Throws if `process` asks for a terminal, and the stdin of the caller,
+// which is passed to the process spawned in a running container, is not one.
+// A terminal is not allocated for such processes.
+void check_terminal(const config::process_t &process, int stdin_fd);
+
+// Apply `process` to the calling process and execute it, see prepared_process.
+// The calling process must be single threaded.
+[[noreturn]] void execute_process(const config::process_t &process,
+                                  std::optional<seccomp::program_t> seccomp = std::nullopt);
+
+} // namespace linyaps_box
@@ -4,6 +4,10 @@
 
 #include "linyaps_box/runtime.h"
 
+#include "linyaps_box/agent.h"
+#include "linyaps_box/events.h"
+#include "linyaps_box/utils/log.h"
+
 linyaps_box::runtime_t::runtime_t(std::unique_ptr<linyaps_box::status_directory> &&status_dir)
     : status_dir_{ std::move(status_dir) }
 {
@@ -25,8 +29,96 @@ std::map<std::string, linyaps_box::container_ref> linyaps_box::runtime_t::contai
     return containers;
 }
 
+std::vector<linyaps_box::container_status_t> linyaps_box::runtime_t::snapshot(bool collect_garbage)
+{
+    auto statuses = this->status_dir_->snapshot();
+    if (collect_garbage) {
+        this->collect_garbage(statuses);
+    }
+    return statuses;
+}
+
+std::vector<linyaps_box::container_status_t>
+linyaps_box::runtime_t::find(const std::string &key, const std::string &value, bool collect_garbage)
+{
+    auto statuses = this->status_dir_->find(key, value);
+    if (collect_garbage) {
+        this->collect_garbage(statuses);
+    }
+    return statuses;
+}
+
+void linyaps_box::runtime_t::collect_garbage(const std::vector<container_status_t> &statuses)
+{
+    // NOTE: A stopped container is removed by its runtime after poststop hooks,
+    // only states of which both the container and the runtime are gone are stale.
+    auto stale = [](const container_status_t &status) {
+        return !is_alive(status) && !is_runtime_alive(status);
+    };
+
+    for (const auto &status : statuses) {
+        if (status.status != container_status_t::runtime_status::STOPPED || !stale(status)) {
+            continue;
+        }
+
+        try {
+            // NOTE: The ID might be taken by a new container since the state was read.
+            if (!this->status_dir_->remove_if(status.ID, stale)) {
+                continue;
+            }
+        } catch (const std::exception &e) {
+            LINYAPS_BOX_WARNING() << "Failed to remove stale state of container " << status.ID
+                                  << ": " << e.what();
+            continue;
+        }
+
+        LINYAPS_BOX_DEBUG() << "Removed stale state of container " << status.ID;
+        events::publish(this->status_dir_->events_journal(),
+                        events::state_changed(status, std::nullopt));
+    }
+}
+
 linyaps_box::container linyaps_box::runtime_t::create_container(
         const linyaps_box::runtime_t::create_container_options_t &options)
 {
-    return container(this->status_dir_, options.ID, options.bundle, options.config);
+    return container(this->status_dir_, options);
+}
+
+linyaps_box::container
+linyaps_box::runtime_t::create_container(const create_container_options_t &options, config config)
+{
+    return container(this->status_dir_, options, std::move(config));
+}
+
+std::optional<linyaps_box::container_ref>
+linyaps_box::runtime_t::find_single_instance(const std::string &key)
+{
+    // NOTE: States left by runtimes which were killed are STOPPED,
+    // even if their PIDs are reused by other processes, see linyaps_box::is_alive.
+    for (const auto &status : this->status_dir_->find(single_instance_annotation, key)) {
+        if (status.status != container_status_t::runtime_status::RUNNING) {
+            continue;
+        }
+
+        auto control_socket = this->status_dir_->control_socket(status.ID);
+        std::error_code ec;
+        if (!std::filesystem::is_socket(control_socket, ec)) {
+            continue;
+        }
+
+        // NOTE: The state is left by a container of which init was killed,
+        // it is removed so the caller starts a new instance.
+        if (!agent::is_listening(control_socket)) {
+            LINYAPS_BOX_WARNING() << "Remove container " << status.ID
+                                  << ", of which the control socket is not served";
+            this->status_dir_->remove(status.ID);
+            events::publish(this->status_dir_->events_journal(),
+                            events::state_changed(status, std::nullopt));
+            continue;
+        }
+
+        return container_ref(this->status_dir_, status.ID);
+    }
+
+    return std::nullopt;
 }
@@ -9,25 +9,48 @@
 #include "linyaps_box/status_directory.h"
 
 #include <memory>
+#include <optional>
 
 namespace linyaps_box {
 
+// runtime_t is the entry point of the library.
+// It is safe to create and run containers from different threads concurrently,
+// see linyaps_box::container for details.
 class runtime_t
 {
 public:
     runtime_t(std::unique_ptr<status_directory> &&status_dir);
     std::map<std::string, container_ref> containers();
 
-    struct create_container_options_t
-    {
-        std::filesystem::path bundle;
-        std::filesystem::path config;
-        std::string ID;
-    };
+    // States of all containers, read in a single pass of the status directory.
+    // If `collect_garbage` is set, states of which the process and the runtime are gone
+    // are removed after they are returned, and "deleted" events are published.
+    // Containers remove their states when they exit, such states are left by runtimes
+    // which were killed.
+    std::vector<container_status_t> snapshot(bool collect_garbage = false);
+
+    // States of containers of which the annotation `key` is `value`,
+    // looked up by the index of the status directory, see status_directory::find.
+    // Stale states are removed as snapshot() does if `collect_garbage` is set.
+    std::vector<container_status_t>
+    find(const std::string &key, const std::string &value, bool collect_garbage = false);
+
+    using create_container_options_t = linyaps_box::create_container_options_t;
 
     container create_container(const create_container_options_t &options);
 
+    // Create a container with an in-memory configuration,
+    // which saves writing and parsing config.json.
+    container create_container(const create_container_options_t &options, config config);
+
+    // Find a running container of which the single instance annotation is `key`,
+    // and can spawn processes by its control socket.
+    // States of containers of which the control socket is not served are removed.
+    std::optional<container_ref> find_single_instance(const std::string &key);
+
 private:
+    void collect_garbage(const std::vector<container_status_t> &statuses);
+
     std::shared_ptr<status_directory> status_dir_;
 };
 
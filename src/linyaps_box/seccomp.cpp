@@ -0,0 +1,404 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/seccomp.h"
+
+#include "linyaps_box/utils/atomic_write.h"
+#include "linyaps_box/utils/digest.h"
+#include "linyaps_box/utils/file_describer.h"
+#include "linyaps_box/utils/log.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <set>
+#include <system_error>
+
+#include <linux/seccomp.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#ifdef LINYAPS_BOX_ENABLE_SECCOMP
+#include <seccomp.h>
+#endif
+
+namespace {
+
+constexpr char magic[8] = { 'L', 'L', 'B', 'O', 'X', 'B', 'P', 'F' };
+
+// NOTE: Bump it on any change of the compilation or of the entry below.
+constexpr std::uint32_t format_version = 2;
+
+// An entry is the header, followed by the profile it is compiled from and the filter.
+struct header_t
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t flags;
+    std::uint64_t profile_size;
+    std::uint64_t length;
+    std::uint64_t checksum;
+};
+
+[[nodiscard]] std::string version()
+{
+#ifdef LINYAPS_BOX_ENABLE_SECCOMP
+    // NOTE: Programs compiled by another libseccomp might differ.
+    const auto *v = seccomp_version();
+    return std::to_string(v->major) + "." + std::to_string(v->minor) + "."
+            + std::to_string(v->micro);
+#else
+    return {};
+#endif
+}
+
+// The canonical form of `seccomp` on this host, which is stored in its entry
+// and compared on a hit, as digests might collide.
+[[nodiscard]] std::string profile(const linyaps_box::config::seccomp_t &seccomp)
+{
+    struct utsname buf{};
+    if (::uname(&buf)) {
+        throw std::system_error(errno, std::generic_category(), "uname");
+    }
+
+    // NOTE: Values are terminated by null characters,
+    // so a sequence of values is not ambiguous.
+    std::string result;
+    auto append = [&result](const std::string &value) {
+        result.append(value);
+        result.push_back('\0');
+    };
+    auto append_strings = [&append](const std::vector<std::string> &values) {
+        append(std::to_string(values.size()));
+        for (const auto &value : values) {
+            append(value);
+        }
+    };
+
+    append(buf.machine);
+    append(version());
+
+    append(seccomp.default_action);
+    append(seccomp.default_errno_ret ? std::to_string(*seccomp.default_errno_ret) : "-");
+    append_strings(seccomp.architectures);
+    append_strings(seccomp.flags);
+
+    append(std::to_string(seccomp.syscalls.size()));
+    for (const auto &syscall : seccomp.syscalls) {
+        append_strings(syscall.names);
+        append(syscall.action);
+        append(syscall.errno_ret ? std::to_string(*syscall.errno_ret) : "-");
+        append(std::to_string(syscall.args.size()));
+        for (const auto &arg : syscall.args) {
+            append(std::to_string(arg.index));
+            append(std::to_string(arg.value));
+            append(std::to_string(arg.value_two));
+            append(arg.op);
+        }
+    }
+
+    return result;
+}
+
+[[nodiscard]] std::uint64_t checksum(const std::string &profile,
+                                     const std::vector<sock_filter> &filter)
+{
+    linyaps_box::utils::digest hash;
+    hash.update(profile.data(), profile.size());
+    hash.update(filter.data(), filter.size() * sizeof(sock_filter));
+    return hash.sum();
+}
+
+// Returns std::nullopt if the entry does not exist, is invalid,
+// or is compiled from another profile.
+[[nodiscard]] std::optional<linyaps_box::seccomp::program_t>
+read_entry(const std::filesystem::path &entry, const std::string &profile)
+{
+    std::ifstream ifs(entry, std::ios::binary);
+    if (!ifs) {
+        return std::nullopt;
+    }
+
+    std::string content{ std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>() };
+
+    header_t header{};
+    if (content.size() < sizeof(header)) {
+        return std::nullopt;
+    }
+    std::memcpy(&header, content.data(), sizeof(header));
+
+    auto size = content.size() - sizeof(header);
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != format_version
+        || header.profile_size != profile.size() || header.length == 0
+        || header.length > BPF_MAXINSNS
+        || profile.size() + header.length * sizeof(sock_filter) != size) {
+        return std::nullopt;
+    }
+
+    if (content.compare(sizeof(header), profile.size(), profile) != 0) {
+        return std::nullopt;
+    }
+
+    linyaps_box::seccomp::program_t program;
+    program.flags = header.flags;
+    program.filter.resize(header.length);
+    std::memcpy(program.filter.data(),
+                content.data() + sizeof(header) + profile.size(),
+                header.length * sizeof(sock_filter));
+    if (checksum(profile, program.filter) != header.checksum) {
+        return std::nullopt;
+    }
+
+    return program;
+}
+
+void write_entry(const std::filesystem::path &entry,
+                 const std::string &profile,
+                 const linyaps_box::seccomp::program_t &program)
+{
+    header_t header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = format_version;
+    header.flags = program.flags;
+    header.profile_size = profile.size();
+    header.length = program.filter.size();
+    header.checksum = checksum(profile, program.filter);
+
+    std::string content(reinterpret_cast<const char *>(&header), sizeof(header));
+    content.append(profile);
+    content.append(reinterpret_cast<const char *>(program.filter.data()),
+                   program.filter.size() * sizeof(sock_filter));
+
+    std::filesystem::create_directories(entry.parent_path());
+    linyaps_box::utils::atomic_write(entry, content);
+}
+
+#ifdef LINYAPS_BOX_ENABLE_SECCOMP
+
+[[nodiscard]] unsigned int parse_flags(const std::vector<std::string> &flags)
+{
+    unsigned int result = 0;
+    for (const auto &flag : flags) {
+        if (flag == "SECCOMP_FILTER_FLAG_TSYNC") {
+            result |= SECCOMP_FILTER_FLAG_TSYNC;
+        } else if (flag == "SECCOMP_FILTER_FLAG_LOG") {
+            result |= SECCOMP_FILTER_FLAG_LOG;
+        } else if (flag == "SECCOMP_FILTER_FLAG_SPEC_ALLOW") {
+            result |= SECCOMP_FILTER_FLAG_SPEC_ALLOW;
+        } else {
+            throw std::runtime_error("unsupported seccomp flag: " + flag);
+        }
+    }
+    return result;
+}
+
+[[nodiscard]] std::uint32_t resolve_action(const std::string &action,
+                                           const std::optional<uint> &errno_ret)
+{
+    if (action == "SCMP_ACT_KILL" || action == "SCMP_ACT_KILL_THREAD") {
+        return SCMP_ACT_KILL;
+    }
+    if (action == "SCMP_ACT_KILL_PROCESS") {
+        return SCMP_ACT_KILL_PROCESS;
+    }
+    if (action == "SCMP_ACT_TRAP") {
+        return SCMP_ACT_TRAP;
+    }
+    if (action == "SCMP_ACT_ERRNO") {
+        return SCMP_ACT_ERRNO(errno_ret.value_or(EPERM));
+    }
+    if (action == "SCMP_ACT_TRACE") {
+        return SCMP_ACT_TRACE(errno_ret.value_or(EPERM));
+    }
+    if (action == "SCMP_ACT_ALLOW") {
+        return SCMP_ACT_ALLOW;
+    }
+    if (action == "SCMP_ACT_LOG") {
+        return SCMP_ACT_LOG;
+    }
+
+    // NOTE: SCMP_ACT_NOTIFY requires a listener, which is not supported.
+    throw std::runtime_error("unsupported seccomp action: " + action);
+}
+
+[[nodiscard]] scmp_compare resolve_op(const std::string &op)
+{
+    const std::pair<const char *, scmp_compare> ops[] = {
+        { "SCMP_CMP_NE", SCMP_CMP_NE }, { "SCMP_CMP_LT", SCMP_CMP_LT },
+        { "SCMP_CMP_LE", SCMP_CMP_LE }, { "SCMP_CMP_EQ", SCMP_CMP_EQ },
+        { "SCMP_CMP_GE", SCMP_CMP_GE }, { "SCMP_CMP_GT", SCMP_CMP_GT },
+        { "SCMP_CMP_MASKED_EQ", SCMP_CMP_MASKED_EQ },
+    };
+    for (const auto &[name, value] : ops) {
+        if (op == name) {
+            return value;
+        }
+    }
+    throw std::runtime_error("unsupported seccomp operator: " + op);
+}
+
+// The token of libseccomp is the lowercase name without the prefix, e.g. SCMP_ARCH_X86_64.
+[[nodiscard]] std::uint32_t resolve_arch(const std::string &arch)
+{
+    constexpr std::string_view prefix = "SCMP_ARCH_";
+    std::string name = arch.rfind(prefix, 0) == 0 ? arch.substr(prefix.size()) : arch;
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+
+    auto token = seccomp_arch_resolve_name(name.c_str());
+    if (token == 0) {
+        throw std::runtime_error("unsupported seccomp architecture: " + arch);
+    }
+    return token;
+}
+
+void add_rule(scmp_filter_ctx ctx,
+              std::uint32_t action,
+              int nr,
+              const std::string &name,
+              const std::vector<scmp_arg_cmp> &args)
+{
+    auto ret = seccomp_rule_add_array(ctx,
+                                      action,
+                                      nr,
+                                      static_cast<unsigned int>(args.size()),
+                                      args.empty() ? nullptr : args.data());
+    if (ret < 0) {
+        throw std::system_error(-ret, std::generic_category(), "seccomp_rule_add " + name);
+    }
+}
+
+#endif
+
+} // namespace
+
+linyaps_box::seccomp::program_t linyaps_box::seccomp::compile(const config::seccomp_t &seccomp)
+{
+#ifdef LINYAPS_BOX_ENABLE_SECCOMP
+    program_t program;
+    program.flags = parse_flags(seccomp.flags);
+
+    auto default_action = resolve_action(seccomp.default_action, seccomp.default_errno_ret);
+    std::unique_ptr<void, decltype(&seccomp_release)> ctx(seccomp_init(default_action),
+                                                          &seccomp_release);
+    if (!ctx) {
+        throw std::runtime_error("seccomp_init failed");
+    }
+
+    for (const auto &arch : seccomp.architectures) {
+        auto ret = seccomp_arch_add(ctx.get(), resolve_arch(arch));
+        if (ret < 0 && ret != -EEXIST) {
+            throw std::system_error(-ret, std::generic_category(), "seccomp_arch_add " + arch);
+        }
+    }
+
+    for (const auto &syscall : seccomp.syscalls) {
+        auto action = resolve_action(syscall.action, syscall.errno_ret);
+        // NOTE: libseccomp rejects rules with the default action, which are redundant.
+        if (action == default_action) {
+            continue;
+        }
+
+        std::vector<scmp_arg_cmp> args;
+        std::set<unsigned int> indexes;
+        for (const auto &arg : syscall.args) {
+            args.push_back({ arg.index, resolve_op(arg.op), arg.value, arg.value_two });
+            indexes.insert(arg.index);
+        }
+
+        for (const auto &name : syscall.names) {
+            auto nr = seccomp_syscall_resolve_name(name.c_str());
+            if (nr == __NR_SCMP_ERROR) {
+                LINYAPS_BOX_DEBUG() << "Skip unknown syscall " << name;
+                continue;
+            }
+
+            // NOTE: A rule compares each argument once at most,
+            // conditions on the same argument are added as separate rules like runc.
+            if (indexes.size() == args.size()) {
+                add_rule(ctx.get(), action, nr, name, args);
+                continue;
+            }
+            for (const auto &arg : args) {
+                add_rule(ctx.get(), action, nr, name, { arg });
+            }
+        }
+    }
+
+    utils::file_descriptor fd(::memfd_create("seccomp", MFD_CLOEXEC));
+    if (fd.get() < 0) {
+        throw std::system_error(errno, std::generic_category(), "memfd_create");
+    }
+    auto ret = seccomp_export_bpf(ctx.get(), fd.get());
+    if (ret < 0) {
+        throw std::system_error(-ret, std::generic_category(), "seccomp_export_bpf");
+    }
+
+    auto size = ::lseek(fd.get(), 0, SEEK_END);
+    if (size <= 0 || size % sizeof(sock_filter) != 0) {
+        throw std::runtime_error("invalid seccomp program of " + std::to_string(size) + " bytes");
+    }
+    program.filter.resize(static_cast<std::size_t>(size) / sizeof(sock_filter));
+    if (::pread(fd.get(), program.filter.data(), static_cast<std::size_t>(size), 0) != size) {
+        throw std::system_error(errno, std::generic_category(), "pread");
+    }
+
+    LINYAPS_BOX_DEBUG() << "Compiled seccomp program of " << program.filter.size()
+                        << " instructions";
+    return program;
+#else
+    (void)seccomp;
+    throw std::runtime_error("seccomp is not supported by this build");
+#endif
+}
+
+linyaps_box::seccomp::program_t linyaps_box::seccomp::load(const std::filesystem::path &cache,
+                                                           const config::seccomp_t &seccomp)
+{
+    auto canonical = profile(seccomp);
+    linyaps_box::utils::digest key;
+    key.update(canonical.data(), canonical.size());
+
+    auto entry = cache / (key.hex() + ".bpf");
+    if (auto program = read_entry(entry, canonical)) {
+        LINYAPS_BOX_DEBUG() << "Load seccomp program from " << entry;
+        return std::move(*program);
+    }
+
+    auto program = compile(seccomp);
+    try {
+        write_entry(entry, canonical, program);
+    } catch (const std::exception &e) {
+        LINYAPS_BOX_WARNING() << "Failed to write seccomp cache " << entry << ": " << e.what();
+    }
+
+    return program;
+}
+
+int linyaps_box::seccomp::install(const program_t &program) noexcept
+{
+    sock_fprog prog{ static_cast<unsigned short>(program.filter.size()),
+                     const_cast<sock_filter *>(program.filter.data()) };
+
+    if (::syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, program.flags, &prog) == 0) {
+        return 0;
+    }
+
+    // NOTE: Kernels before 3.17 have no seccomp(2), which is required for flags.
+    if (errno == ENOSYS && program.flags == 0
+        && ::prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) == 0) {
+        return 0;
+    }
+
+    return errno;
+}
@@ -0,0 +1,44 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/config.h"
+
+#include <filesystem>
+#include <vector>
+
+#include <linux/filter.h>
+
+// Seccomp filters of linux.seccomp, compiled to BPF programs by libseccomp
+// and installed by seccomp(2) right before the container process is executed.
+//
+// Compiling the rules of a large profile takes milliseconds,
+// so programs are cached, named by the digest of the seccomp section,
+// the architecture of the host and the version of libseccomp.
+// An entry holds all of them as well, which are compared on a hit,
+// then the program is read and installed without libseccomp.
+
+namespace linyaps_box::seccomp {
+
+struct program_t
+{
+    std::vector<sock_filter> filter;
+    // SECCOMP_FILTER_FLAG_* of linux.seccomp.flags.
+    unsigned int flags = 0;
+};
+
+// Compile `seccomp` by libseccomp,
+// it throws if the runtime is built without LINYAPS_BOX_ENABLE_SECCOMP.
+[[nodiscard]] program_t compile(const config::seccomp_t &seccomp);
+
+// Load the program of `seccomp` from `cache` if any,
+// otherwise it is compiled and stored to `cache`, failures of which are logged only.
+[[nodiscard]] program_t load(const std::filesystem::path &cache, const config::seccomp_t &seccomp);
+
+// Install `program` to the calling process, returns 0 or the errno.
+// It does not allocate memory, see linyaps_box::prepared_process.
+[[nodiscard]] int install(const program_t &program) noexcept;
+
+} // namespace linyaps_box::seccomp
@@ -3,3 +3,19 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
 
 #include "linyaps_box/status_directory.h"
+
+#include <optional>
+
+void linyaps_box::check_new_id(const status_directory &dir, const std::string &id)
+{
+    std::optional<container_status_t> status;
+    try {
+        status = dir.read(id);
+    } catch (const std::exception &) {
+        return;
+    }
+
+    if (status->status != container_status_t::runtime_status::STOPPED) {
+        throw std::runtime_error("container " + id + " already exists");
+    }
+}
@@ -7,6 +7,7 @@
 #include "linyaps_box/container_status.h"
 #include "linyaps_box/interface.h"
 
+#include <functional>
 #include <vector>
 
 namespace linyaps_box {
@@ -17,5 +18,46 @@ public:
     virtual container_status_t read(const std::string &id) const = 0;
     virtual void remove(const std::string &id) = 0;
     virtual std::vector<std::string> list() const = 0;
+
+    // Remove the state of the container `id` if `stale` returns true for it,
+    // which is read again with writers of the state excluded.
+    // Returns whether the state was removed.
+    virtual bool remove_if(const std::string &id,
+                           const std::function<bool(const container_status_t &)> &stale) = 0;
+
+    // States of all containers read in a single pass, sorted by ID.
+    // States which can not be read are skipped.
+    virtual std::vector<container_status_t> snapshot() const = 0;
+
+    // States of containers of which the annotation `key` is `value`, sorted by ID.
+    // They are looked up by an index of annotations, without reading other states,
+    // unless the index can not be built for states written before it existed.
+    virtual std::vector<container_status_t> find(const std::string &key,
+                                                 const std::string &value) const = 0;
+
+    // The path of the control socket of the container `id`, see linyaps_box::agent.
+    virtual std::filesystem::path control_socket(const std::string &id) const = 0;
+
+    // The path of the exec policy of the container `id`, see linyaps_box::exec_policy.
+    virtual std::filesystem::path exec_policy(const std::string &id) const = 0;
+
+    // The path of the kernel features cache, see linyaps_box::features.
+    virtual std::filesystem::path features_cache() const = 0;
+
+    // The directory of cached hook outputs, see linyaps_box::hook_cache.
+    virtual std::filesystem::path hooks_cache() const = 0;
+
+    // The directory of compiled configurations, see linyaps_box::config_cache.
+    virtual std::filesystem::path config_cache() const = 0;
+
+    // The directory of compiled seccomp filters, see linyaps_box::seccomp.
+    virtual std::filesystem::path seccomp_cache() const = 0;
+
+    // The journal of lifecycle events, see linyaps_box::events.
+    virtual std::filesystem::path events_journal() const = 0;
 };
+
+// Throws if the container `id` exists in `dir` and is not stopped,
+// states of stopped containers are replaced by new ones.
+void check_new_id(const status_directory &dir, const std::string &id);
 } // namespace linyaps_box
@@ -0,0 +1,163 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/sysctl.h"
+
+#include "linyaps_box/utils/file_describer.h"
+#include "linyaps_box/utils/log.h"
+#include "linyaps_box/utils/open_file.h"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+using namespace_type = linyaps_box::config::namespace_t::type_t;
+
+// See ipc_namespaces(7).
+constexpr std::array<std::string_view, 8> ipc_parameters{
+    "kernel.msgmax", "kernel.msgmnb", "kernel.msgmni",  "kernel.sem",
+    "kernel.shmall", "kernel.shmmax", "kernel.shmmni", "kernel.shm_rmid_forced",
+};
+
+// The path of `key` relative to /proc/sys.
+[[nodiscard]] std::filesystem::path to_path(const std::string &key)
+{
+    auto path = key;
+    if (path.find('/') == std::string::npos) {
+        std::replace(path.begin(), path.end(), '.', '/');
+    }
+
+    // NOTE: std::filesystem::path skips empty components, so they are checked on the string.
+    std::string_view rest = path;
+    std::size_t components = 0;
+    while (true) {
+        auto end = rest.find('/');
+        auto component = rest.substr(0, end);
+        if (component.empty() || component == "." || component == "..") {
+            throw std::runtime_error("invalid sysctl " + key);
+        }
+        ++components;
+
+        if (end == std::string_view::npos) {
+            break;
+        }
+        rest.remove_prefix(end + 1);
+    }
+    if (components < 2) {
+        throw std::runtime_error("invalid sysctl " + key);
+    }
+
+    return path;
+}
+
+[[nodiscard]] std::optional<namespace_type> namespace_of(const std::string &key)
+{
+    auto name = to_path(key).string();
+    std::replace(name.begin(), name.end(), '/', '.');
+
+    if (std::find(ipc_parameters.begin(), ipc_parameters.end(), name) != ipc_parameters.end()
+        || name.rfind("fs.mqueue.", 0) == 0) {
+        return namespace_type::IPC;
+    }
+    if (name.rfind("net.", 0) == 0) {
+        return namespace_type::NET;
+    }
+    if (name == "kernel.hostname" || name == "kernel.domainname") {
+        return namespace_type::UTS;
+    }
+
+    return std::nullopt;
+}
+
+[[nodiscard]] const char *namespace_name(namespace_type type)
+{
+    switch (type) {
+    case namespace_type::IPC:
+        return "ipc";
+    case namespace_type::NET:
+        return "network";
+    case namespace_type::UTS:
+        return "uts";
+    default:
+        return "unknown";
+    }
+}
+
+} // namespace
+
+void linyaps_box::sysctl::validate(const config &config)
+{
+    for (const auto &[key, value] : config.sysctl) {
+        auto type = namespace_of(key);
+        if (!type) {
+            throw std::runtime_error("sysctl " + key
+                                     + " is not isolated by a namespace, it would change the host");
+        }
+
+        // NOTE: A joined namespace might be the one of the host,
+        // only namespaces created by the container are trusted.
+        auto created = std::any_of(config.namespaces.begin(),
+                                   config.namespaces.end(),
+                                   [type = *type](const config::namespace_t &ns) {
+                                       return ns.type == type && ns.path.empty();
+                                   });
+        if (!created) {
+            throw std::runtime_error("sysctl " + key + " requires a new "
+                                     + namespace_name(*type) + " namespace");
+        }
+    }
+}
+
+void linyaps_box::sysctl::apply(const std::map<std::string, std::string> &sysctl)
+{
+    if (sysctl.empty()) {
+        return;
+    }
+
+    auto proc_sys = utils::open("/proc/sys", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    std::map<std::filesystem::path, utils::file_descriptor> dirs;
+
+    for (const auto &[key, value] : sysctl) {
+        auto path = to_path(key);
+
+        utils::file_descriptor file;
+        try {
+            auto dir = dirs.find(path.parent_path());
+            if (dir == dirs.end()) {
+                dir = dirs.emplace(path.parent_path(),
+                                   utils::open(proc_sys,
+                                               path.parent_path(),
+                                               O_PATH | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW))
+                              .first;
+            }
+
+            file = utils::open(dir->second, path.filename(), O_WRONLY | O_CLOEXEC | O_NOFOLLOW);
+        } catch (const std::system_error &e) {
+            throw std::system_error(e.code(), "open sysctl " + key);
+        }
+
+        LINYAPS_BOX_DEBUG() << "Write sysctl " << key << "=" << value;
+
+        // NOTE: A parameter is set by a single write(2).
+        ssize_t ret = 0;
+        do {
+            ret = ::write(file.get(), value.data(), value.size());
+        } while (ret < 0 && errno == EINTR);
+        if (ret < 0) {
+            throw std::system_error(errno, std::generic_category(), "write sysctl " + key);
+        }
+        if (static_cast<std::size_t>(ret) != value.size()) {
+            throw std::runtime_error("short write of sysctl " + key);
+        }
+    }
+}
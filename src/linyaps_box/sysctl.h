@@ -0,0 +1,32 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/config.h"
+
+#include <map>
+#include <string>
+
+// Kernel parameters of linux.sysctl, for example `kernel.shmmax` for applications
+// using large shared memory, or `net.core.somaxconn` in a private network namespace.
+//
+// Only parameters isolated by a namespace the container creates are accepted,
+// that is the IPC parameters listed by ipc_namespaces(7), `fs.mqueue.*`, `net.*`,
+// and `kernel.hostname` and `kernel.domainname`. Others would change the host.
+//
+// Keys use `.` as the separator, or `/` if they contain dots like `net.ipv4.conf.eth0.1.*`,
+// the same as sysctl(8).
+
+namespace linyaps_box::sysctl {
+
+// Throws if a parameter of linux.sysctl is invalid,
+// or not isolated by a namespace created by the container.
+void validate(const config &config);
+
+// Write `sysctl` to /proc/sys, in the namespaces of the calling process.
+// Directories are opened once for parameters in them.
+void apply(const std::map<std::string, std::string> &sysctl);
+
+} // namespace linyaps_box::sysctl
@@ -0,0 +1,52 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/utils/digest.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+#include <sys/stat.h>
+
+void linyaps_box::utils::digest::update(const void *data, std::size_t size)
+{
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    for (std::size_t i = 0; i < size; ++i) {
+        this->value ^= bytes[i];
+        this->value *= 0x100000001b3ULL;
+    }
+}
+
+void linyaps_box::utils::digest::update(const std::string &data)
+{
+    this->update(data.data(), data.size() + 1);
+}
+
+void linyaps_box::utils::digest::update_stat(const std::filesystem::path &path)
+{
+    this->update(path.string());
+
+    struct stat buf{};
+    if (::stat(path.c_str(), &buf)) {
+        this->update(std::to_string(errno));
+        return;
+    }
+
+    for (auto value : { static_cast<std::int64_t>(buf.st_dev),
+                        static_cast<std::int64_t>(buf.st_ino),
+                        static_cast<std::int64_t>(buf.st_size),
+                        static_cast<std::int64_t>(buf.st_mtim.tv_sec),
+                        static_cast<std::int64_t>(buf.st_mtim.tv_nsec),
+                        static_cast<std::int64_t>(buf.st_ctim.tv_sec),
+                        static_cast<std::int64_t>(buf.st_ctim.tv_nsec) }) {
+        this->update(&value, sizeof(value));
+    }
+}
+
+std::string linyaps_box::utils::digest::hex() const
+{
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016" PRIx64, this->value);
+    return buffer;
+}
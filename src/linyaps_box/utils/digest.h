@@ -0,0 +1,37 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace linyaps_box::utils {
+
+// A 64-bit FNV-1a digest, which is stable across builds unlike std::hash,
+// for keys of caches in the status directory. It is not cryptographic.
+class digest
+{
+public:
+    void update(const void *data, std::size_t size);
+
+    // The terminating null character is included,
+    // so a sequence of strings is not ambiguous.
+    void update(const std::string &data);
+
+    // Update with the path and the device, inode, size, mtime and ctime of the file,
+    // which change if it is modified or replaced, or with errno if it does not exist.
+    void update_stat(const std::filesystem::path &path);
+
+    [[nodiscard]] std::string hex() const;
+
+    [[nodiscard]] std::uint64_t sum() const { return this->value; }
+
+private:
+    std::uint64_t value = 0xcbf29ce484222325ULL;
+};
+
+} // namespace linyaps_box::utils
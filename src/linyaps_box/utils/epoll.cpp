@@ -0,0 +1,71 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/utils/epoll.h"
+
+#include <array>
+
+linyaps_box::utils::epoll::epoll()
+{
+    auto ret = ::epoll_create1(EPOLL_CLOEXEC);
+    if (ret < 0) {
+        throw std::system_error(errno, std::generic_category(), "epoll_create1");
+    }
+
+    this->fd = file_descriptor(ret);
+}
+
+void linyaps_box::utils::epoll::add(const file_descriptor &fd, uint32_t events)
+{
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = fd.get();
+
+    if (::epoll_ctl(this->fd.get(), EPOLL_CTL_ADD, fd.get(), &event)) {
+        throw std::system_error(errno, std::generic_category(), "epoll_ctl EPOLL_CTL_ADD");
+    }
+}
+
+void linyaps_box::utils::epoll::modify(const file_descriptor &fd, uint32_t events)
+{
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = fd.get();
+
+    if (::epoll_ctl(this->fd.get(), EPOLL_CTL_MOD, fd.get(), &event)) {
+        throw std::system_error(errno, std::generic_category(), "epoll_ctl EPOLL_CTL_MOD");
+    }
+}
+
+void linyaps_box::utils::epoll::remove(const file_descriptor &fd)
+{
+    if (::epoll_ctl(this->fd.get(), EPOLL_CTL_DEL, fd.get(), nullptr)) {
+        throw std::system_error(errno, std::generic_category(), "epoll_ctl EPOLL_CTL_DEL");
+    }
+}
+
+std::vector<epoll_event>
+linyaps_box::utils::epoll::wait(std::optional<std::chrono::steady_clock::time_point> deadline)
+{
+    std::array<epoll_event, 16> events{};
+
+    while (true) {
+        int timeout = -1;
+        if (deadline) {
+            auto remain = std::chrono::ceil<std::chrono::milliseconds>(
+                    *deadline - std::chrono::steady_clock::now());
+            timeout = std::max<int>(0, remain.count());
+        }
+
+        auto ret = ::epoll_wait(this->fd.get(), events.data(), events.size(), timeout);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "epoll_wait");
+        }
+
+        return { events.begin(), events.begin() + ret };
+    }
+}
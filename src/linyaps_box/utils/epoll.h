@@ -0,0 +1,36 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/utils/file_describer.h"
+
+#include <chrono>
+#include <optional>
+#include <vector>
+
+#include <sys/epoll.h>
+
+namespace linyaps_box::utils {
+
+class epoll
+{
+public:
+    epoll();
+
+    void add(const file_descriptor &fd, uint32_t events);
+    void modify(const file_descriptor &fd, uint32_t events);
+    void remove(const file_descriptor &fd);
+
+    // Wait for events until `deadline`, wait forever if `deadline` is empty.
+    // The returned events carry the file descriptor in `data.fd`.
+    // An empty vector is returned on timeout.
+    std::vector<epoll_event>
+    wait(std::optional<std::chrono::steady_clock::time_point> deadline = std::nullopt);
+
+private:
+    file_descriptor fd;
+};
+
+} // namespace linyaps_box::utils
@@ -4,7 +4,6 @@
 
 #include "linyaps_box/utils/inspect.h"
 
-#include <cassert>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
@@ -93,7 +92,11 @@ std::string inspect_fd(const std::filesystem::path &fdinfo_path)
     ss << std::filesystem::read_symlink("/proc/self/fd/" + fdinfo_path.stem().string());
 
     std::ifstream fdinfo(fdinfo_path);
-    assert(fdinfo.is_open());
+    if (!fdinfo.is_open()) {
+        throw std::filesystem::filesystem_error("open",
+                                                fdinfo_path,
+                                                std::error_code(errno, std::generic_category()));
+    }
 
     std::string key;
 
@@ -131,11 +134,20 @@ std::string inspect_fds()
             || entry.path() == "/proc/self/fdinfo/2") {
             continue;
         }
+
+        // NOTE: The file descriptor might be closed by another thread.
+        std::string description;
+        try {
+            description = inspect_fd(entry.path());
+        } catch (const std::filesystem::filesystem_error &) {
+            continue;
+        }
+
         if (!first_line) {
             ss << std::endl;
         }
         first_line = false;
-        ss << entry.path() << " " << inspect_fd(entry.path());
+        ss << entry.path() << " " << description;
     }
 
     return ss.str();
@@ -12,12 +12,17 @@
 #include <sys/time.h>
 #include <unistd.h>
 
-#ifndef LINYAPS_BOX_LOG_DEFAULT_LEVEL
-#define LINYAPS_BOX_LOG_DEFAULT_LEVEL LOG_DEBUG
+#ifndef LINYAPS_BOX_DEFAULT_LOG_LEVEL
+#define LINYAPS_BOX_DEFAULT_LOG_LEVEL LOG_DEBUG
 #endif
 
 namespace linyaps_box::utils {
 
+namespace {
+std::mutex log_mutex;
+bool log_lock_disabled = false;
+} // namespace
+
 template<unsigned int level>
 Logger<level>::~Logger()
 {
@@ -27,6 +32,11 @@ Logger<level>::~Logger()
 
     auto str = this->str();
 
+    std::unique_lock<std::mutex> lock;
+    if (!log_lock_disabled) {
+        lock = lock_log();
+    }
+
     syslog(level, "%s", str.c_str());
 
     if (!stderr_is_a_tty() && !force_log_to_stderr()) {
@@ -66,6 +76,16 @@ template class Logger<LOG_NOTICE>;
 template class Logger<LOG_INFO>;
 template class Logger<LOG_DEBUG>;
 
+std::unique_lock<std::mutex> lock_log()
+{
+    return std::unique_lock<std::mutex>(log_mutex);
+}
+
+void disable_log_lock() noexcept
+{
+    log_lock_disabled = true;
+}
+
 bool force_log_to_stderr()
 {
     static auto result = getenv("LINYAPS_BOX_LOG_FORCE_STDERR");
@@ -83,7 +103,7 @@ static unsigned int get_current_log_level_from_env()
 {
     auto env = getenv("LINYAPS_BOX_LOG_LEVEL");
     if (!env) {
-        return LINYAPS_BOX_LOG_DEFAULT_LEVEL;
+        return LINYAPS_BOX_DEFAULT_LOG_LEVEL;
     }
 
     auto level = atoi(env);
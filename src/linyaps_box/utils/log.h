@@ -6,6 +6,7 @@
 
 #include <sys/syslog.h>
 
+#include <mutex>
 #include <sstream>
 
 #include <syslog.h>
@@ -18,6 +19,14 @@ unsigned int get_current_log_level();
 std::string get_pid_namespace(int pid = 0);
 std::string get_current_commond();
 
+// Log messages are written under a process-wide lock,
+// so that no other thread is holding the lock of syslog(3) or stderr
+// while a process is cloned by a multithreaded program.
+// Hold the lock while calling clone(2),
+// and call disable_log_lock() first in the cloned process.
+[[nodiscard]] std::unique_lock<std::mutex> lock_log();
+void disable_log_lock() noexcept;
+
 template<unsigned int level>
 class Logger : public std::stringstream
 {
@@ -24,7 +24,9 @@ linyaps_box::utils::file_descriptor linyaps_box::utils::mkdir(const file_descrip
 
     file_descriptor current(fd);
 
-    for (const auto &part : path) {
+    // NOTE: An absolute path is relative to `root`,
+    // openat(2) would resolve the root directory of the process instead.
+    for (const auto &part : path.relative_path()) {
         LINYAPS_BOX_DEBUG() << "part=" << part << " mode=0" << std::oct << mode;
 
         if (::mkdirat(current.get(), part.c_str(), mode)) {
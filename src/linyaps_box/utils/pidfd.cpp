@@ -0,0 +1,30 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/utils/pidfd.h"
+
+#include <sys/syscall.h>
+
+#include <csignal>
+
+#include <unistd.h>
+
+linyaps_box::utils::file_descriptor linyaps_box::utils::pidfd_open(pid_t pid, unsigned int flags)
+{
+    // NOTE: Use syscall directly, as pidfd_open(2) is not wrapped by glibc before 2.36.
+    auto fd = ::syscall(SYS_pidfd_open, pid, flags);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "pidfd_open");
+    }
+
+    return file_descriptor(static_cast<int>(fd));
+}
+
+void linyaps_box::utils::pidfd_send_signal(const file_descriptor &pidfd, int signal)
+{
+    auto ret = ::syscall(SYS_pidfd_send_signal, pidfd.get(), signal, nullptr, 0);
+    if (ret < 0) {
+        throw std::system_error(errno, std::generic_category(), "pidfd_send_signal");
+    }
+}
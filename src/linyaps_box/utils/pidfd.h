@@ -0,0 +1,20 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/utils/file_describer.h"
+
+#include <sys/types.h>
+
+namespace linyaps_box::utils {
+
+// Open a pidfd refers to the process `pid`.
+// It throws std::system_error with ENOSYS on kernels older than 5.3,
+// callers check linyaps_box::features::pidfd instead.
+file_descriptor pidfd_open(pid_t pid, unsigned int flags = 0);
+
+void pidfd_send_signal(const file_descriptor &pidfd, int signal);
+
+} // namespace linyaps_box::utils
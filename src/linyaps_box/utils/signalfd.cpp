@@ -0,0 +1,42 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/utils/signalfd.h"
+
+#include <unistd.h>
+
+linyaps_box::utils::file_descriptor linyaps_box::utils::signalfd(const sigset_t &mask)
+{
+    auto fd = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "signalfd");
+    }
+
+    return file_descriptor(fd);
+}
+
+std::optional<signalfd_siginfo> linyaps_box::utils::read_signal(const file_descriptor &fd)
+{
+    while (true) {
+        signalfd_siginfo info{};
+        auto ret = ::read(fd.get(), &info, sizeof(info));
+        if (ret == sizeof(info)) {
+            return info;
+        }
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (ret < 0 && errno == EAGAIN) {
+            return std::nullopt;
+        }
+
+        if (ret < 0) {
+            throw std::system_error(errno, std::generic_category(), "read signalfd");
+        }
+
+        throw std::runtime_error("short read from signalfd");
+    }
+}
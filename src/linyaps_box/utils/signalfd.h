@@ -0,0 +1,23 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/utils/file_describer.h"
+
+#include <optional>
+
+#include <signal.h>
+#include <sys/signalfd.h>
+
+namespace linyaps_box::utils {
+
+// Create a non-blocking signalfd for `mask`,
+// the signals in `mask` should be blocked by the caller.
+file_descriptor signalfd(const sigset_t &mask);
+
+// Read a pending signal from signalfd, returns std::nullopt if there is none.
+std::optional<signalfd_siginfo> read_signal(const file_descriptor &fd);
+
+} // namespace linyaps_box::utils
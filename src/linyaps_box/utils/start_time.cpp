@@ -0,0 +1,71 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "linyaps_box/utils/start_time.h"
+
+#include <array>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+std::optional<std::uint64_t> linyaps_box::utils::process_start_time(pid_t pid)
+{
+    if (pid <= 0) {
+        return std::nullopt;
+    }
+
+    auto path = "/proc/" + std::to_string(pid) + "/stat";
+    auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+
+    // NOTE: The whole line is read at once, as the kernel generates it for each read(2).
+    std::array<char, 1024> buffer{};
+    ssize_t size = 0;
+    do {
+        size = ::read(fd, buffer.data(), buffer.size());
+    } while (size < 0 && errno == EINTR);
+    ::close(fd);
+    if (size <= 0) {
+        return std::nullopt;
+    }
+
+    // NOTE: The command in parentheses may contain spaces and parentheses,
+    // fields after it start from the state, which is the 3rd field.
+    std::string_view stat(buffer.data(), static_cast<std::size_t>(size));
+    auto pos = stat.rfind(')');
+    if (pos == std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    constexpr int start_time_field = 22;
+    int field = 2;
+    std::uint64_t value = 0;
+    bool found = false;
+    for (auto c : stat.substr(pos + 1)) {
+        if (c == ' ') {
+            if (field == start_time_field) {
+                break;
+            }
+            ++field;
+            continue;
+        }
+        if (field != start_time_field) {
+            continue;
+        }
+        if (c < '0' || c > '9') {
+            return std::nullopt;
+        }
+        value = value * 10 + static_cast<std::uint64_t>(c - '0');
+        found = true;
+    }
+
+    if (!found) {
+        return std::nullopt;
+    }
+    return value;
+}
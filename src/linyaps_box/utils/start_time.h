@@ -0,0 +1,19 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+#include <sys/types.h>
+
+namespace linyaps_box::utils {
+
+// The start time of the process `pid` in clock ticks after boot, see proc_pid_stat(5),
+// which tells the process from a later one reusing its PID.
+// Returns std::nullopt if there is no such process.
+[[nodiscard]] std::optional<std::uint64_t> process_start_time(pid_t pid);
+
+} // namespace linyaps_box::utils
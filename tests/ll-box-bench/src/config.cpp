@@ -0,0 +1,171 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+// Compare parsing configurations by the SAX parser,
+// reading from a stream and from a mapped file, with the reference parser building a document,
+// see tests/ll-box-ut/src/config_reference.h,
+// and with loading compiled configurations from a hit of linyaps_box::config_cache.
+//
+// Usage: ll-box-bench-config <CONFIG>... [--count <COUNT>]
+//
+// e.g. ll-box-bench-config tests/ll-box-ut/data/demo/*.json
+//
+// Files failing to parse, such as documents of other formats, are skipped.
+
+#include "config_reference.h"
+#include "linyaps_box/config.h"
+#include "linyaps_box/config_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+std::atomic<std::size_t> allocations{ 0 };
+std::atomic<std::size_t> allocated_bytes{ 0 };
+
+struct result_t
+{
+    double p50;
+    double p99;
+    double allocations;
+    double bytes;
+};
+
+result_t measure(int count, const std::function<void()> &parse)
+{
+    std::vector<double> latencies;
+    latencies.reserve(count);
+
+    std::size_t total_allocations = 0;
+    std::size_t total_bytes = 0;
+
+    for (int i = 0; i < count; ++i) {
+        auto before_allocations = allocations.load();
+        auto before_bytes = allocated_bytes.load();
+
+        auto start = std::chrono::steady_clock::now();
+        parse();
+        std::chrono::duration<double, std::micro> latency =
+                std::chrono::steady_clock::now() - start;
+
+        total_allocations += allocations.load() - before_allocations;
+        total_bytes += allocated_bytes.load() - before_bytes;
+        latencies.push_back(latency.count());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies[static_cast<std::size_t>(p * (latencies.size() - 1))];
+    };
+
+    return { percentile(0.5),
+             percentile(0.99),
+             static_cast<double>(total_allocations) / count,
+             static_cast<double>(total_bytes) / count };
+}
+
+void report(const std::string &name, const result_t &result)
+{
+    std::cout << "  " << name << ": p50 " << result.p50 << "us, p99 " << result.p99 << "us, "
+              << result.allocations << " allocations, " << result.bytes << " bytes" << std::endl;
+}
+
+} // namespace
+
+void *operator new(std::size_t size)
+{
+    ++allocations;
+    allocated_bytes += size;
+    if (auto *ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+int main(int argc, char **argv)
+{
+    int count = 1000;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--count" && i + 1 < argc) {
+            count = std::stoi(argv[++i]);
+            continue;
+        }
+        files.push_back(arg);
+    }
+
+    if (files.empty() || count <= 0) {
+        std::cerr << "Usage: " << argv[0] << " <CONFIG>... [--count <COUNT>]" << std::endl;
+        return 1;
+    }
+
+    char cache_template[] = "/tmp/ll-box-bench-config-XXXXXX";
+    if (mkdtemp(cache_template) == nullptr) {
+        throw std::system_error(errno, std::generic_category(), "mkdtemp");
+    }
+    std::filesystem::path cache = cache_template;
+
+    for (const auto &file : files) {
+        std::string content;
+        {
+            std::ifstream ifs(file);
+            std::stringstream ss;
+            ss << ifs.rdbuf();
+            content = ss.str();
+        }
+
+        try {
+            std::istringstream iss(content);
+            (void)linyaps_box::config::parse(iss);
+        } catch (const std::exception &e) {
+            std::cout << file << ": skipped, " << e.what() << std::endl;
+            continue;
+        }
+
+        std::cout << file << " (" << content.size() << " bytes)" << std::endl;
+
+        // NOTE: Parsers read from the same buffered content, so only parsing is measured.
+        report("sax", measure(count, [&content]() {
+                   std::istringstream iss(content);
+                   (void)linyaps_box::config::parse(iss);
+               }));
+        report("dom", measure(count, [&content]() {
+                   (void)linyaps_box::config_reference::parse(content);
+               }));
+        report("sax-mmap", measure(count, [&file]() {
+                   (void)linyaps_box::config::parse_file(file);
+               }));
+
+        (void)linyaps_box::config_cache::load(cache, file);
+        report("cache-hit", measure(count, [&cache, &file]() {
+                   (void)linyaps_box::config_cache::load(cache, file);
+               }));
+    }
+
+    std::filesystem::remove_all(cache);
+    return 0;
+}
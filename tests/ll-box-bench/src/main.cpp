@@ -0,0 +1,320 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+// Compare launching containers through the library API with spawning ll-box,
+// and executing processes in a running container natively, with nsenter(1)
+// and by the agent of the container.
+//
+// Usage: ll-box-bench <LL_BOX> <BUNDLE> [<COUNT> [<JOBS> [<MAX_LAUNCHES>]]]
+//
+// With MAX_LAUNCHES, a burst of JOBS concurrent launches through the API
+// is measured again with admission control.
+//
+// The process of the bundle should exit immediately, e.g. /bin/true.
+// The exec benchmark keeps a container of the bundle running with /bin/sh.
+// The hooks benchmark adds createRuntime and createContainer hooks doing nothing,
+// executed as /bin/true or called as plugin hooks, see linyaps_box/plugin.h.
+
+#include "linyaps_box/admission.h"
+#include "linyaps_box/impl/status_directory.h"
+#include "linyaps_box/runtime.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+namespace {
+
+void measure(const std::string &name,
+             int count,
+             int jobs,
+             const std::function<bool(int index)> &launch)
+{
+    std::atomic<int> next{ 0 };
+    std::atomic<int> failed{ 0 };
+
+    std::mutex mutex;
+    std::vector<double> latencies;
+    latencies.reserve(count);
+
+    auto begin = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < jobs; ++i) {
+        workers.emplace_back([&]() {
+            for (auto index = next++; index < count; index = next++) {
+                auto start = std::chrono::steady_clock::now();
+                if (!launch(index)) {
+                    ++failed;
+                }
+                std::chrono::duration<double, std::milli> latency =
+                        std::chrono::steady_clock::now() - start;
+
+                std::lock_guard<std::mutex> guard(mutex);
+                latencies.push_back(latency.count());
+            }
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        if (latencies.empty()) {
+            return 0.0;
+        }
+        return latencies[static_cast<std::size_t>(p * (latencies.size() - 1))];
+    };
+
+    std::cout << name << ": " << count << " launches in " << elapsed.count() << "s, "
+              << count / elapsed.count() << " launches/s, p50 " << percentile(0.5) << "ms, p99 "
+              << percentile(0.99) << "ms, " << failed << " failed" << std::endl;
+}
+
+bool launch_by_api(linyaps_box::runtime_t &runtime,
+                   const std::filesystem::path &bundle,
+                   const linyaps_box::config &config,
+                   int index)
+try {
+    linyaps_box::runtime_t::create_container_options_t options;
+    options.bundle = bundle;
+    options.ID = "bench-api-" + std::to_string(index);
+    options.forward_signals = false;
+    // NOTE: The build directory must be owned by root to load the plugin,
+    // as plugins are only loaded from trusted directories.
+    options.plugin_dir = std::filesystem::path(LL_BOX_BENCH_PLUGIN).parent_path();
+
+    auto container = runtime.create_container(options, config);
+    return container.run(container.get_config().process) == 0;
+} catch (const std::exception &e) {
+    std::cerr << "launch " << index << ": " << e.what() << std::endl;
+    return false;
+}
+
+bool wait_success(pid_t pid)
+{
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+bool spawn_and_wait(const std::vector<const char *> &argv)
+{
+    pid_t pid = -1;
+    auto ret = posix_spawnp(&pid,
+                            argv[0],
+                            nullptr,
+                            nullptr,
+                            const_cast<char *const *>(argv.data()),
+                            environ);
+    if (ret) {
+        std::cerr << "posix_spawnp " << argv[0] << ": " << strerror(ret) << std::endl;
+        return false;
+    }
+
+    return wait_success(pid);
+}
+
+bool launch_by_cli(const std::string &ll_box,
+                   const std::filesystem::path &root,
+                   const std::filesystem::path &bundle,
+                   int index)
+{
+    auto id = "bench-cli-" + std::to_string(index);
+    auto config = (bundle / "config.json").string();
+    return spawn_and_wait({
+            ll_box.c_str(), "--root", root.c_str(),   "run",     "--bundle",
+            bundle.c_str(), "--config", config.c_str(), id.c_str(), nullptr,
+    });
+}
+
+bool exec_by_api(linyaps_box::container_ref &container, const linyaps_box::config::process_t &process)
+{
+    auto pid = fork();
+    if (pid < 0) {
+        std::cerr << "fork: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (pid == 0) {
+        try {
+            container.exec(process);
+        } catch (const std::exception &e) {
+            std::cerr << "exec: " << e.what() << std::endl;
+        }
+        _exit(1);
+    }
+
+    return wait_success(pid);
+}
+
+// NOTE: --all skips the namespaces which are the same as ours,
+// like the native implementation does.
+bool exec_by_nsenter(pid_t target, const linyaps_box::config::process_t &process)
+{
+    auto pid = std::to_string(target);
+    // NOTE: --wdns is not available before util-linux 2.40.
+    auto wd = "--wd=" + process.cwd.string();
+    std::vector<const char *> argv{
+        "nsenter", "--target", pid.c_str(), "--all", wd.c_str(), "--preserve-credentials", "--",
+    };
+    for (const auto &arg : process.args) {
+        argv.push_back(arg.c_str());
+    }
+    argv.push_back(nullptr);
+
+    return spawn_and_wait(argv);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+try {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <LL_BOX> <BUNDLE> [<COUNT> [<JOBS> [<MAX_LAUNCHES>]]]" << std::endl;
+        return 1;
+    }
+
+    std::string ll_box = argv[1];
+    auto bundle = std::filesystem::absolute(argv[2]);
+    int count = argc > 3 ? std::atoi(argv[3]) : 100;
+    int jobs = argc > 4 ? std::atoi(argv[4]) : 1;
+    int max_launches = argc > 5 ? std::atoi(argv[5]) : 0;
+
+    char root_template[] = "/tmp/ll-box-bench-XXXXXX";
+    if (mkdtemp(root_template) == nullptr) {
+        throw std::system_error(errno, std::generic_category(), "mkdtemp");
+    }
+    std::filesystem::path root = root_template;
+
+    auto config = linyaps_box::config::parse_file(bundle / "config.json");
+
+    linyaps_box::runtime_t runtime(std::make_unique<linyaps_box::impl::status_directory>(root));
+
+    measure("api", count, jobs, [&](int index) {
+        return launch_by_api(runtime, bundle, config, index);
+    });
+
+    if (max_launches > 0) {
+        linyaps_box::admission::options_t admission_options;
+        admission_options.max_launches = max_launches;
+
+        measure("api-admitted", count, jobs, [&](int index) {
+            auto slot = linyaps_box::admission::acquire(root / "admission", admission_options);
+            return launch_by_api(runtime, bundle, config, index);
+        });
+    }
+
+    {
+        auto with_hooks = [&config](const linyaps_box::config::hooks_t::hook_t &hook) {
+            auto result = config;
+            for (int i = 0; i < 2; ++i) {
+                result.hooks.create_runtime.push_back(hook);
+                result.hooks.create_container.push_back(hook);
+            }
+            return result;
+        };
+
+        linyaps_box::config::hooks_t::hook_t exec_hook;
+        exec_hook.path = "/bin/true";
+        exec_hook.args = { "true" };
+        auto exec_config = with_hooks(exec_hook);
+
+        measure("hooks-exec", count, jobs, [&](int index) {
+            return launch_by_api(runtime, bundle, exec_config, index);
+        });
+
+        linyaps_box::config::hooks_t::hook_t plugin_hook;
+        plugin_hook.path = LL_BOX_BENCH_PLUGIN;
+        plugin_hook.args = { "ll_box_bench_hook" };
+        plugin_hook.entry = "ll_box_bench_hook";
+        auto plugin_config = with_hooks(plugin_hook);
+
+        measure("hooks-plugin", count, jobs, [&](int index) {
+            return launch_by_api(runtime, bundle, plugin_config, index);
+        });
+    }
+
+    measure("cli", count, jobs, [&](int index) {
+        return launch_by_cli(ll_box, root, bundle, index);
+    });
+
+    {
+        auto idle_config = config;
+        idle_config.process.args = { "/bin/sh", "-c", "while :; do sleep 1; done" };
+
+        linyaps_box::runtime_t::create_container_options_t options;
+        options.bundle = bundle;
+        options.ID = "bench-exec";
+        options.forward_signals = false;
+
+        auto container = runtime.create_container(options, idle_config);
+        auto running = container.start(container.get_config().process);
+
+        measure("exec-api", count, jobs, [&](int) {
+            return exec_by_api(container, config.process);
+        });
+
+        measure("exec-nsenter", count, jobs, [&](int) {
+            return exec_by_nsenter(running.pid(), config.process);
+        });
+
+        running.kill(SIGKILL);
+        [[maybe_unused]] auto code = running.wait();
+    }
+
+    {
+        auto idle_config = config;
+        idle_config.process.args = { "/bin/sh", "-c", "while :; do sleep 1; done" };
+
+        linyaps_box::runtime_t::create_container_options_t options;
+        options.bundle = bundle;
+        options.ID = "bench-exec-agent";
+        options.forward_signals = false;
+        options.control_socket = true;
+
+        auto container = runtime.create_container(options, idle_config);
+        auto running = container.start(container.get_config().process);
+
+        measure("exec-agent", count, jobs, [&](int) {
+            return exec_by_api(container, config.process);
+        });
+
+        running.kill(SIGKILL);
+        [[maybe_unused]] auto code = running.wait();
+    }
+
+    std::filesystem::remove_all(root);
+
+    return 0;
+} catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+}
@@ -0,0 +1,12 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+// A plugin hook doing nothing, compared with executing /bin/true as a hook.
+
+#include "linyaps_box/plugin.h"
+
+extern "C" int ll_box_bench_hook(const struct linyaps_box_hook_context *context)
+{
+    return context->abi_version == LINYAPS_BOX_PLUGIN_ABI_VERSION ? 0 : 1;
+}
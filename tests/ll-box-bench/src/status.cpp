@@ -0,0 +1,183 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+// Compare the status directory of JSON files with the memory-mapped status table,
+// writing, updating, reading, listing, taking snapshots and finding by annotation
+// the states of thousands of containers, and reading while other threads update the states.
+//
+// Usage: ll-box-bench-status [--count <COUNT>] [--writers <WRITERS>]
+//
+// e.g. ll-box-bench-status --count 4096 --writers 4
+
+#include "linyaps_box/impl/status_directory.h"
+#include "linyaps_box/impl/status_table.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+struct result_t
+{
+    double p50;
+    double p99;
+    double total;
+};
+
+result_t measure(int count, const std::function<void(int)> &operation)
+{
+    std::vector<double> latencies;
+    latencies.reserve(count);
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        operation(i);
+        std::chrono::duration<double, std::micro> latency =
+                std::chrono::steady_clock::now() - start;
+        latencies.push_back(latency.count());
+    }
+    std::chrono::duration<double, std::milli> total = std::chrono::steady_clock::now() - begin;
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies[static_cast<std::size_t>(p * (latencies.size() - 1))];
+    };
+
+    return { percentile(0.5), percentile(0.99), total.count() };
+}
+
+void report(const std::string &name, const result_t &result)
+{
+    std::cout << "  " << name << ": p50 " << result.p50 << "us, p99 " << result.p99 << "us, total "
+              << result.total << "ms" << std::endl;
+}
+
+linyaps_box::container_status_t make_status(int index)
+{
+    linyaps_box::container_status_t status{};
+    status.ID = "bench-" + std::to_string(index);
+    status.PID = getpid();
+    status.status = linyaps_box::container_status_t::runtime_status::CREATING;
+    status.bundle = "/var/lib/linglong/bundles/" + status.ID;
+    status.owner = getuid();
+    status.annotations["org.openatom.linyaps.box.bench"] = std::to_string(index);
+    return status;
+}
+
+void run(const std::string &name, linyaps_box::status_directory &dir, int count, int writers)
+{
+    std::cout << name << " (" << count << " containers)" << std::endl;
+
+    report("write", measure(count, [&dir](int index) {
+               dir.write(make_status(index));
+           }));
+    report("update", measure(count, [&dir](int index) {
+               auto status = make_status(index);
+               status.status = linyaps_box::container_status_t::runtime_status::RUNNING;
+               dir.write(status);
+           }));
+    report("read", measure(count, [&dir](int index) {
+               (void)dir.read("bench-" + std::to_string(index));
+           }));
+    report("list", measure(10, [&dir, count](int) {
+               if (dir.list().size() != static_cast<std::size_t>(count)) {
+                   throw std::runtime_error("unexpected number of containers");
+               }
+           }));
+    report("find", measure(count, [&dir](int index) {
+               if (dir.find("org.openatom.linyaps.box.bench", std::to_string(index)).size() != 1) {
+                   throw std::runtime_error("unexpected number of containers");
+               }
+           }));
+    report("snapshot", measure(10, [&dir, count](int) {
+               if (dir.snapshot().size() != static_cast<std::size_t>(count)) {
+                   throw std::runtime_error("unexpected number of containers");
+               }
+           }));
+
+    // NOTE: Each writer updates its own containers,
+    // as the directory does not support concurrent writes of the same container.
+    std::atomic<bool> done{ false };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < writers; ++i) {
+        threads.emplace_back([&dir, &done, count, writers, i]() {
+            for (int index = i; !done.load(); index = (index + writers) % count) {
+                auto status = make_status(index);
+                status.status = linyaps_box::container_status_t::runtime_status::RUNNING;
+                dir.write(status);
+            }
+        });
+    }
+    report("read-while-writing", measure(count, [&dir](int index) {
+               (void)dir.read("bench-" + std::to_string(index));
+           }));
+    done = true;
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    report("remove", measure(count, [&dir](int index) {
+               dir.remove("bench-" + std::to_string(index));
+           }));
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int count = 4096;
+    int writers = 4;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--count" && i + 1 < argc) {
+            count = std::stoi(argv[++i]);
+        } else if (arg == "--writers" && i + 1 < argc) {
+            writers = std::stoi(argv[++i]);
+        } else {
+            count = 0;
+            break;
+        }
+    }
+
+    if (count <= 0 || writers < 0) {
+        std::cerr << "Usage: " << argv[0] << " [--count <COUNT>] [--writers <WRITERS>]"
+                  << std::endl;
+        return 1;
+    }
+    writers = std::min(writers, count);
+
+    for (auto table : { false, true }) {
+        char root_template[] = "/tmp/ll-box-bench-status-XXXXXX";
+        if (mkdtemp(root_template) == nullptr) {
+            throw std::system_error(errno, std::generic_category(), "mkdtemp");
+        }
+        std::filesystem::path root = root_template;
+
+        std::unique_ptr<linyaps_box::status_directory> dir;
+        if (table) {
+            dir = std::make_unique<linyaps_box::impl::status_table>(root);
+        } else {
+            dir = std::make_unique<linyaps_box::impl::status_directory>(root);
+        }
+        run(table ? "table" : "directory", *dir, count, writers);
+
+        dir.reset();
+        std::filesystem::remove_all(root);
+    }
+
+    return 0;
+}
@@ -0,0 +1,145 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "gtest/gtest.h"
+#include "linyaps_box/admission.h"
+#include "temp_dir_test.h"
+
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace {
+
+using namespace std::chrono_literals;
+
+class AdmissionTest : public linyaps_box::test::TempDirTest
+{
+protected:
+    AdmissionTest()
+        : TempDirTest("admission")
+    {
+    }
+
+    void SetUp() override
+    {
+        TempDirTest::SetUp();
+        std::filesystem::create_directories(dir / "queue");
+    }
+
+    [[nodiscard]] linyaps_box::admission::options_t options(int priority = 0) const
+    {
+        linyaps_box::admission::options_t options;
+        options.max_launches = 1;
+        options.priority = priority;
+        // NOTE: The pressure of the machine running tests must not matter.
+        options.pressure_threshold = 101;
+        return options;
+    }
+
+    [[nodiscard]] std::size_t queued() const
+    {
+        std::size_t count = 0;
+        for (const auto &entry : std::filesystem::directory_iterator(dir / "queue")) {
+            count += entry.path().filename().string().front() != '.';
+        }
+        return count;
+    }
+
+    void wait_queued(std::size_t count) const
+    {
+        auto deadline = std::chrono::steady_clock::now() + 5s;
+        while (queued() < count && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(10ms);
+        }
+        ASSERT_EQ(queued(), count);
+    }
+};
+
+} // namespace
+
+TEST_F(AdmissionTest, HigherPriorityFirst)
+{
+    auto held = linyaps_box::admission::acquire(dir, options());
+
+    std::mutex mutex;
+    std::vector<int> order;
+    auto launch = [this, &mutex, &order](int priority) {
+        auto slot = linyaps_box::admission::acquire(dir, options(priority));
+        std::lock_guard lock(mutex);
+        order.push_back(priority);
+    };
+
+    std::thread low(launch, 0);
+    wait_queued(1);
+    std::thread high(launch, 10);
+    wait_queued(2);
+
+    held.release();
+    low.join();
+    high.join();
+
+    EXPECT_EQ(order, (std::vector<int>{ 10, 0 }));
+}
+
+TEST_F(AdmissionTest, StaleTicketIsSkipped)
+{
+    // NOTE: An unlocked ticket ahead of us, as left by a launcher which crashed.
+    auto stale = dir / "queue" / "0000-00000000000000000000-1-0";
+    ::close(::open(stale.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0600));
+
+    auto admitted = std::async(std::launch::async, [this] {
+        return linyaps_box::admission::acquire(dir, options());
+    });
+    ASSERT_EQ(admitted.wait_for(5s), std::future_status::ready);
+    admitted.get();
+
+    EXPECT_FALSE(std::filesystem::exists(stale));
+}
+
+TEST_F(AdmissionTest, LockedTicketIsWaited)
+{
+    auto ahead = dir / "queue" / "0000-00000000000000000000-1-0";
+    int fd = ::open(ahead.c_str(), O_RDONLY | O_CREAT | O_CLOEXEC, 0600);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(::flock(fd, LOCK_EX), 0);
+
+    auto admitted = std::async(std::launch::async, [this] {
+        return linyaps_box::admission::acquire(dir, options());
+    });
+    EXPECT_EQ(admitted.wait_for(300ms), std::future_status::timeout);
+
+    ::close(fd);
+    ASSERT_EQ(admitted.wait_for(5s), std::future_status::ready);
+    admitted.get();
+}
+
+TEST_F(AdmissionTest, PressureHoldsEverySlot)
+{
+    if (!linyaps_box::admission::pressure()) {
+        GTEST_SKIP() << "PSI is not supported";
+    }
+
+    auto opts = options();
+    opts.max_launches = 3;
+    opts.pressure_threshold = -1;
+
+    auto first = linyaps_box::admission::acquire(dir, opts);
+
+    auto admitted = std::async(std::launch::async, [this, opts] {
+        return linyaps_box::admission::acquire(dir, opts);
+    });
+    EXPECT_EQ(admitted.wait_for(300ms), std::future_status::timeout);
+
+    first.release();
+    ASSERT_EQ(admitted.wait_for(5s), std::future_status::ready);
+    admitted.get();
+}
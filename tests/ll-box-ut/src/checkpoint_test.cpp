@@ -0,0 +1,187 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "gtest/gtest.h"
+#include "linyaps_box/checkpoint.h"
+#include "linyaps_box/impl/status_directory.h"
+#include "nlohmann/json.hpp"
+#include "temp_dir_test.h"
+
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+
+#include <unistd.h>
+
+namespace {
+
+class CheckpointTest : public linyaps_box::test::TempDirTest
+{
+protected:
+    CheckpointTest()
+        : TempDirTest("checkpoint")
+    {
+    }
+
+    void SetUp() override
+    {
+        TempDirTest::SetUp();
+        std::filesystem::create_directories(dir / "bundle" / "rootfs");
+        std::filesystem::create_directories(dir / "image");
+
+        std::ofstream(dir / "bundle" / "config.json")
+                << R"({"ociVersion": "1.0.0", "root": {"path": "rootfs"},
+                      "process": {"args": ["/bin/true"], "cwd": "/",
+                                  "user": {"uid": 0, "gid": 0}}})";
+    }
+
+    void write_manifest(const nlohmann::json &j) const
+    {
+        std::ofstream(dir / "image" / "ll-box.json") << j.dump();
+    }
+
+    // Restore by a fake criu running `script` with `action`, `images` and `pidfile` set.
+    [[nodiscard]] linyaps_box::checkpoint::restored_t restore(const std::string &script) const
+    {
+        auto criu = dir / "criu";
+        std::ofstream(criu) << R"(#!/bin/sh
+action=$1
+while [ $# -gt 0 ]; do
+    case $1 in
+    --images-dir) images=$2 ;;
+    --pidfile) pidfile=$2 ;;
+    esac
+    shift
+done
+)" << script;
+        std::filesystem::permissions(criu, std::filesystem::perms::owner_all);
+        write_manifest({ { "version", 1 }, { "digest", "" } });
+
+        linyaps_box::checkpoint::options_t options;
+        options.criu = criu.string();
+        options.lazy_pages = true;
+        options.lazy_pages_timeout = std::chrono::milliseconds(200);
+        auto config = linyaps_box::config::parse_file(dir / "bundle" / "config.json");
+        return linyaps_box::checkpoint::restore(dir / "bundle", config, dir / "image", options);
+    }
+
+    // The lazy-pages daemon of the fake criu, which writes its PID to the image directory.
+    [[nodiscard]] pid_t lazy_pages() const
+    {
+        pid_t pid = -1;
+        std::ifstream(dir / "image" / "lazy-pages.pid") >> pid;
+        return pid;
+    }
+
+    [[nodiscard]] static bool reaped(pid_t pid) { return ::kill(pid, 0) < 0 && errno == ESRCH; }
+
+    [[nodiscard]] std::string digest_of(const std::filesystem::path &bundle) const
+    {
+        auto config_path = linyaps_box::checkpoint::config_path(bundle, "");
+        auto config = linyaps_box::config::parse_file(config_path);
+        return linyaps_box::checkpoint::digest(bundle, config_path, config);
+    }
+};
+
+} // namespace
+
+TEST_F(CheckpointTest, ConfigPath)
+{
+    EXPECT_EQ(linyaps_box::checkpoint::config_path(dir / "bundle", ""),
+              dir / "bundle" / "config.json");
+    EXPECT_EQ(linyaps_box::checkpoint::config_path(dir / "bundle", "/other/config.json"),
+              "/other/config.json");
+    EXPECT_TRUE(linyaps_box::checkpoint::config_path("bundle", "").is_absolute());
+}
+
+TEST_F(CheckpointTest, DigestIgnoresHowTheBundleIsReferred)
+{
+    auto absolute = digest_of(dir / "bundle");
+
+    auto cwd = std::filesystem::current_path();
+    std::filesystem::current_path(dir);
+    auto relative = digest_of("bundle");
+    auto dotted = digest_of("./bundle/../bundle");
+    std::filesystem::current_path(cwd);
+
+    EXPECT_EQ(absolute, relative);
+    EXPECT_EQ(absolute, dotted);
+}
+
+TEST_F(CheckpointTest, Valid)
+{
+    auto digest = digest_of(dir / "bundle");
+    EXPECT_FALSE(linyaps_box::checkpoint::valid(dir / "image", digest));
+
+    write_manifest({ { "version", 1 }, { "digest", digest } });
+    EXPECT_TRUE(linyaps_box::checkpoint::valid(dir / "image", digest));
+    EXPECT_FALSE(linyaps_box::checkpoint::valid(dir / "image", "other"));
+
+    // NOTE: Manifests of another format are never restored.
+    write_manifest({ { "digest", digest } });
+    EXPECT_FALSE(linyaps_box::checkpoint::valid(dir / "image", digest));
+    write_manifest({ { "version", 2 }, { "digest", digest } });
+    EXPECT_FALSE(linyaps_box::checkpoint::valid(dir / "image", digest));
+}
+
+TEST_F(CheckpointTest, ExistingIDIsRejected)
+{
+    linyaps_box::impl::status_directory status_dir(dir / "state");
+    EXPECT_NO_THROW(linyaps_box::check_new_id(status_dir, "app"));
+
+    linyaps_box::container_status_t status{};
+    status.ID = "app";
+    status.PID = getpid();
+    status.status = linyaps_box::container_status_t::runtime_status::RUNNING;
+    status.bundle = dir / "bundle";
+    status_dir.write(status);
+    EXPECT_THROW(linyaps_box::check_new_id(status_dir, "app"), std::runtime_error);
+
+    // NOTE: A state left by a runtime which was killed is replaced.
+    status.PID = INT_MAX;
+    status_dir.write(status);
+    EXPECT_NO_THROW(linyaps_box::check_new_id(status_dir, "app"));
+}
+
+TEST_F(CheckpointTest, LazyPagesAreWaitedWithTimeout)
+{
+    auto begin = std::chrono::steady_clock::now();
+    EXPECT_THROW((void)restore(R"(
+[ "$action" = lazy-pages ] && echo $$ > "$images/lazy-pages.pid" && exec sleep 10
+exit 1)"),
+                 std::runtime_error);
+    EXPECT_LT(std::chrono::steady_clock::now() - begin, std::chrono::seconds(5));
+    ASSERT_GT(lazy_pages(), 0);
+    EXPECT_TRUE(reaped(lazy_pages()));
+
+    EXPECT_THROW((void)restore("exit 1"), std::runtime_error);
+}
+
+TEST_F(CheckpointTest, LazyPagesAreReleased)
+{
+    constexpr auto lazy_pages_ready = R"(
+if [ "$action" = lazy-pages ]; then
+    echo $$ > "$images/lazy-pages.pid"
+    touch "$images/lazy-pages.socket"
+    exec sleep 10
+fi
+)";
+
+    // NOTE: The daemon is reaped if the restore fails.
+    EXPECT_THROW((void)restore(std::string(lazy_pages_ready) + "exit 1"), std::runtime_error);
+    ASSERT_GT(lazy_pages(), 0);
+    EXPECT_TRUE(reaped(lazy_pages()));
+
+    auto restored = restore(std::string(lazy_pages_ready) + R"(sleep 10 &
+echo $! > "$pidfile")");
+    EXPECT_EQ(restored.lazy_pages, lazy_pages());
+    EXPECT_FALSE(reaped(restored.lazy_pages));
+    ASSERT_GT(restored.pid, 0);
+    ::kill(restored.pid, SIGKILL);
+
+    linyaps_box::checkpoint::release(restored);
+    EXPECT_TRUE(reaped(restored.lazy_pages));
+}
@@ -0,0 +1,231 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "gtest/gtest.h"
+#include "linyaps_box/config_cache.h"
+#include "temp_dir_test.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+std::string read(const std::filesystem::path &path)
+{
+    std::ifstream ifs(path);
+    return { std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>() };
+}
+
+linyaps_box::config parse(const std::string &source)
+{
+    std::istringstream iss(source);
+    return linyaps_box::config::parse(iss);
+}
+
+// NOTE: data/demo has no hooks nor annotations.
+constexpr auto hooks_config = R"({
+    "ociVersion": "1.2.0",
+    "root": {"path": "rootfs", "readonly": true},
+    "process": {"args": ["/bin/sh"], "cwd": "/", "user": {"uid": 1000, "gid": 1000}},
+    "hooks": {
+        "prestart": [{"path": "/bin/true", "args": ["true"], "env": ["A=1"], "timeout": 3}],
+        "createContainer": [
+            {"path": "/usr/lib/linyaps-box/plugins/a.so", "args": ["a"], "entry": "a"}
+        ]
+    },
+    "annotations": {"org.example.key": "value"}
+})";
+
+// Sources of configurations supported by the parser, keyed by their names.
+std::vector<std::pair<std::string, std::string>> sources()
+{
+    std::vector<std::pair<std::string, std::string>> result{ { "hooks", hooks_config } };
+    for (const auto &entry : std::filesystem::directory_iterator("data/demo")) {
+        if (entry.path().extension() != ".json") {
+            continue;
+        }
+
+        auto source = read(entry.path());
+        try {
+            (void)parse(source);
+            result.emplace_back(entry.path().string(), std::move(source));
+        } catch (const std::exception &) {
+        }
+    }
+    return result;
+}
+
+class ConfigCacheTest : public linyaps_box::test::TempDirTest
+{
+protected:
+    ConfigCacheTest()
+        : TempDirTest("config-cache")
+    {
+    }
+
+    void SetUp() override
+    {
+        TempDirTest::SetUp();
+    }
+
+    // Load `hooks_config` from the read end of a pipe moved to `fd`, or any free one if -1.
+    [[nodiscard]] linyaps_box::config load_pipe(int fd = -1) const
+    {
+        int fds[2];
+        EXPECT_EQ(::pipe2(fds, O_CLOEXEC), 0);
+        std::string source = hooks_config;
+        EXPECT_EQ(::write(fds[1], source.data(), source.size()),
+                  static_cast<ssize_t>(source.size()));
+        ::close(fds[1]);
+
+        int saved = -1;
+        if (fd >= 0) {
+            saved = ::dup(fd);
+            ::dup2(fds[0], fd);
+            ::close(fds[0]);
+        } else {
+            fd = fds[0];
+        }
+
+        auto config = linyaps_box::config_cache::load(dir / "cache", fd);
+        if (saved >= 0) {
+            ::dup2(saved, fd);
+            ::close(saved);
+        } else {
+            ::close(fd);
+        }
+        return config;
+    }
+
+    [[nodiscard]] std::vector<std::filesystem::path> entries() const
+    {
+        std::vector<std::filesystem::path> result;
+        for (const auto &entry : std::filesystem::directory_iterator(dir / "cache")) {
+            result.push_back(entry.path());
+        }
+        return result;
+    }
+};
+
+} // namespace
+
+TEST_F(ConfigCacheTest, RoundTrip)
+{
+    auto configs = sources();
+    ASSERT_GT(configs.size(), 1);
+
+    for (const auto &[name, source] : configs) {
+        SCOPED_TRACE(name);
+        auto config = parse(source);
+        auto entry = linyaps_box::config_cache::compile(config, source);
+
+        auto decoded = linyaps_box::config_cache::decode(entry.data(), entry.size(), source);
+        ASSERT_TRUE(decoded.has_value());
+
+        // NOTE: All fields are encoded, so equal encodings mean equal configurations.
+        EXPECT_EQ(linyaps_box::config_cache::compile(*decoded, source), entry);
+        EXPECT_EQ(decoded->process.args, config.process.args);
+        EXPECT_EQ(decoded->root.path, config.root.path);
+        EXPECT_EQ(decoded->mounts.size(), config.mounts.size());
+        EXPECT_EQ(decoded->annotations, config.annotations);
+        EXPECT_EQ(decoded->hooks.prestart.size(), config.hooks.prestart.size());
+        EXPECT_EQ(decoded->hooks.create_container.size(), config.hooks.create_container.size());
+    }
+}
+
+TEST_F(ConfigCacheTest, CorruptedEntriesAreRejected)
+{
+    for (const auto &[name, source] : sources()) {
+        SCOPED_TRACE(name);
+        auto entry = linyaps_box::config_cache::compile(parse(source), source);
+
+        for (std::size_t i = 0; i < entry.size(); ++i) {
+            auto corrupted = entry;
+            corrupted[i] = static_cast<char>(corrupted[i] ^ 0x01);
+            EXPECT_FALSE(linyaps_box::config_cache::decode(corrupted.data(),
+                                                           corrupted.size(),
+                                                           source))
+                    << "byte " << i;
+        }
+
+        for (std::size_t size = 0; size < entry.size(); ++size) {
+            EXPECT_FALSE(linyaps_box::config_cache::decode(entry.data(), size, source))
+                    << "size " << size;
+        }
+
+        auto appended = entry + '\0';
+        EXPECT_FALSE(
+                linyaps_box::config_cache::decode(appended.data(), appended.size(), source));
+
+        auto other = source + ' ';
+        EXPECT_FALSE(linyaps_box::config_cache::decode(entry.data(), entry.size(), other));
+    }
+}
+
+TEST_F(ConfigCacheTest, LoadReplacesCorruptedEntries)
+{
+    auto path = dir / "config.json";
+    std::ofstream(path) << hooks_config;
+    auto expected = parse(read(path));
+
+    auto config = linyaps_box::config_cache::load(dir / "cache", path);
+    EXPECT_EQ(config.process.args, expected.process.args);
+    auto stored = entries();
+    ASSERT_EQ(stored.size(), 1);
+    auto entry = read(stored.front());
+
+    std::ofstream(stored.front(), std::ios::binary | std::ios::trunc) << entry.substr(0, 16);
+    config = linyaps_box::config_cache::load(dir / "cache", path);
+    EXPECT_EQ(config.process.args, expected.process.args);
+    EXPECT_EQ(read(stored.front()), entry);
+}
+
+TEST_F(ConfigCacheTest, LoadFromFileDescriptors)
+{
+    auto path = dir / "config.json";
+    std::ofstream(path) << hooks_config;
+    auto expected = parse(hooks_config);
+    (void)linyaps_box::config_cache::load(dir / "cache", path);
+
+    // NOTE: A hit by a file descriptor shares the entry of the path.
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    ASSERT_GE(fd, 0);
+    auto config = linyaps_box::config_cache::load(dir / "cache", fd);
+    ::close(fd);
+    EXPECT_EQ(config.process.args, expected.process.args);
+    EXPECT_EQ(entries().size(), 1);
+
+    config = load_pipe();
+    EXPECT_EQ(config.process.args, expected.process.args);
+
+    // NOTE: `--config -` reads stdin.
+    config = load_pipe(STDIN_FILENO);
+    EXPECT_EQ(config.process.args, expected.process.args);
+
+    // A sealed memfd is mapped, an unsealed one is read.
+    for (auto sealed : { false, true }) {
+        SCOPED_TRACE(sealed ? "sealed" : "unsealed");
+        fd = ::memfd_create("config", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        ASSERT_GE(fd, 0);
+        std::string source = hooks_config;
+        ASSERT_EQ(::write(fd, source.data(), source.size()), static_cast<ssize_t>(source.size()));
+        if (sealed) {
+            ASSERT_EQ(::fcntl(fd, F_ADD_SEALS, F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW), 0);
+        }
+        config = linyaps_box::config_cache::load(dir / "cache", fd);
+        ::close(fd);
+        EXPECT_EQ(config.process.args, expected.process.args);
+    }
+
+    EXPECT_EQ(entries().size(), 1);
+}
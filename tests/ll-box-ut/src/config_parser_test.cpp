@@ -0,0 +1,210 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "config_reference.h"
+#include "gtest/gtest.h"
+#include "linyaps_box/config.h"
+#include "linyaps_box/config_cache.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr auto process = R"("process": {"cwd": "/", "args": ["sh"], "user": {"uid": 0, "gid": 0}})";
+
+std::string document(const std::string &members)
+{
+    return R"({"ociVersion": "1.2.0", "root": {"path": "rootfs"}, )" + members + "}";
+}
+
+std::string with_process(const std::string &members)
+{
+    return document(std::string(process) + ", " + members);
+}
+
+// The entry compiled from the configuration parsed by `parse`, or the message of the error
+// without the JSON pointer, which the reference parser does not report.
+template<typename Parse>
+std::string result(Parse parse, const std::string &source)
+{
+    try {
+        return "config: " + linyaps_box::config_cache::compile(parse(source), source);
+    } catch (const std::exception &e) {
+        static const std::regex pointer(R"(\(/[^)]*\) )");
+        return std::string("error: ") + std::regex_replace(e.what(), pointer, "");
+    }
+}
+
+void expect_same(const std::string &source)
+{
+    auto sax = result([](const std::string &s) { return linyaps_box::config::parse(s); }, source);
+    auto reference = result(linyaps_box::config_reference::parse, source);
+    EXPECT_EQ(sax, reference) << source;
+}
+
+std::string error(const std::string &source)
+{
+    try {
+        (void)linyaps_box::config::parse(source);
+    } catch (const std::exception &e) {
+        return e.what();
+    }
+    return {};
+}
+
+} // namespace
+
+TEST(ConfigParser, MatchesReferenceOnDemo)
+{
+    for (const auto &entry : std::filesystem::directory_iterator("data/demo")) {
+        if (entry.path().extension() != ".json") {
+            continue;
+        }
+
+        std::ifstream ifs(entry.path());
+        expect_same({ std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>() });
+    }
+}
+
+TEST(ConfigParser, MatchesReferenceOnValid)
+{
+    const std::vector<std::string> sources{
+        document(process),
+        with_process(R"("linux": null, "hooks": null, "mounts": null)"),
+        with_process(R"("linux": {"namespaces": null, "uidMappings": null, "seccomp": null})"),
+        document(R"("process": {"terminal": true, "consoleSize": {"height": 24, "width": 80},
+                    "cwd": "/home", "env": ["A=1", "B=a=b"], "args": ["sh", "-c", "true"],
+                    "noNewPrivileges": true, "oomScoreAdj": -100,
+                    "user": {"uid": 1000, "gid": 1000, "umask": 18, "additionalGids": [1, 2]}})"),
+        // NOTE: consoleSize is ignored without terminal.
+        document(R"("process": {"consoleSize": {"height": "24"}, "cwd": "/", "args": [],
+                    "user": {"uid": 0, "gid": 0}})"),
+        with_process(R"("linux": {
+            "namespaces": [{"type": "pid"}, {"type": "mount"}, {"type": "user"},
+                           {"type": "network", "path": "/proc/1/ns/net"}, {"type": "ipc"},
+                           {"type": "uts"}, {"type": "cgroup"}],
+            "uidMappings": [{"hostID": 1000, "containerID": 0, "size": 1}],
+            "gidMappings": [{"hostID": 1000, "containerID": 0, "size": 1}],
+            "seccomp": {"defaultAction": "SCMP_ACT_ALLOW", "defaultErrnoRet": 1,
+                        "architectures": ["SCMP_ARCH_X86_64"], "flags": ["SECCOMP_FILTER_FLAG_LOG"],
+                        "syscalls": [{"names": ["ptrace"], "action": "SCMP_ACT_ERRNO",
+                                      "errnoRet": 1, "args": null},
+                                     {"names": ["personality"], "action": "SCMP_ACT_ALLOW",
+                                      "args": [{"index": 0, "value": 8, "valueTwo": 0,
+                                                "op": "SCMP_CMP_EQ"}]}]},
+            "sysctl": {"net.ipv4.ip_forward": "1"},
+            "resources": {"cpu": {"shares": 512}}
+        })"),
+        with_process(R"("hooks": {
+            "prestart": [{"path": "/bin/true", "args": ["true"], "env": ["A=1"], "timeout": 3}],
+            "createRuntime": null,
+            "createContainer": [{"path": "/usr/lib/a.so", "args": ["a"], "entry": "a"}],
+            "startContainer": [], "poststart": [{"path": "/bin/true", "args": []}],
+            "poststop": [{"path": "/bin/false", "args": ["false"]}], "unknown": 1
+        })"),
+        with_process(R"("mounts": [
+            {"destination": "/proc", "type": "proc", "source": "proc"},
+            {"destination": "/tmp", "type": "tmpfs", "options": ["nosuid", "rprivate",
+                                                                 "mode=755", "size=65536k"]},
+            {"destination": "/home", "type": "bind", "source": "/home", "options": ["rbind", "ro"]}
+        ])"),
+        // NOTE: Annotations of other types than string are skipped.
+        with_process(R"("annotations": {"a": "1", "b": 2, "c": null, "d": {"e": "f"}, "g": []})"),
+        with_process(R"("unknown": {"nested": [1, {"a": null}]}, "root": {"path": "/", "x": []})"),
+    };
+
+    for (const auto &source : sources) {
+        expect_same(source);
+        EXPECT_EQ(error(source), "") << source;
+    }
+}
+
+TEST(ConfigParser, MatchesReferenceOnInvalid)
+{
+    const std::vector<std::string> sources{
+        "[]",
+        "{",
+        R"({"root": {"path": "rootfs"}, )" + std::string(process) + "}",
+        R"({"ociVersion": "2.0.0", "root": {"path": "rootfs"}, )" + std::string(process) + "}",
+        R"({"ociVersion": "1.2.0", )" + std::string(process) + "}",
+        R"({"ociVersion": "1.2.0", "root": {"path": "rootfs", "readonly": "yes"}, )"
+                + std::string(process) + "}",
+        document(R"("process": null)"),
+        document(R"("process": {"args": ["sh"], "user": {"uid": 0, "gid": 0}})"),
+        document(R"("process": {"cwd": 1, "args": ["sh"], "user": {"uid": 0, "gid": 0}})"),
+        document(R"("process": {"cwd": "/", "args": "sh", "user": {"uid": 0, "gid": 0}})"),
+        document(R"("process": {"cwd": "/", "args": ["sh", 1], "user": {"uid": 0, "gid": 0}})"),
+        document(R"("process": {"cwd": "/", "args": ["sh"], "env": ["A"],
+                    "user": {"uid": 0, "gid": 0}})"),
+        document(R"("process": {"cwd": "/", "args": ["sh"], "user": {"uid": "0", "gid": 0}})"),
+        document(R"("process": {"cwd": "/", "args": ["sh"]})"),
+        document(R"("process": {"terminal": null, "cwd": "/", "args": ["sh"],
+                    "user": {"uid": 0, "gid": 0}})"),
+        document(R"("process": {"terminal": true, "consoleSize": {"height": 1}, "cwd": "/",
+                    "args": ["sh"], "user": {"uid": 0, "gid": 0}})"),
+        document(R"("process": {"terminal": true, "consoleSize": {"height": "1", "width": 1},
+                    "cwd": "/", "args": ["sh"], "user": {"uid": 0, "gid": 0}})"),
+        document(R"("process": {"consoleSize": 1, "cwd": "/", "args": ["sh"],
+                    "user": {"uid": 0, "gid": 0}})"),
+        with_process(R"("linux": [])"),
+        with_process(R"("linux": {"namespaces": [{"path": "/proc/1/ns/pid"}]})"),
+        with_process(R"("linux": {"namespaces": [{"type": "time"}]})"),
+        with_process(R"("linux": {"namespaces": [1]})"),
+        with_process(R"("linux": {"namespaces": {"type": "pid"}})"),
+        with_process(R"("linux": {"uidMappings": [{"hostID": 0, "containerID": 0}]})"),
+        with_process(R"("linux": {"gidMappings": [{"hostID": 0, "containerID": 0, "size": -}]})"),
+        with_process(R"("linux": {"seccomp": {}})"),
+        with_process(R"("linux": {"seccomp": {"defaultAction": "SCMP_ACT_ALLOW",
+                                              "architectures": null}})"),
+        with_process(R"("linux": {"seccomp": {"defaultAction": "SCMP_ACT_ALLOW",
+                                              "syscalls": [{"names": ["read"]}]}})"),
+        with_process(R"("linux": {"seccomp": {"defaultAction": "SCMP_ACT_ALLOW",
+                                              "syscalls": [{"action": "SCMP_ACT_ALLOW"}]}})"),
+        with_process(R"("linux": {"seccomp": {"defaultAction": "SCMP_ACT_ALLOW",
+                        "syscalls": [{"names": ["read"], "action": "SCMP_ACT_ALLOW",
+                                      "args": [{"index": 0, "value": 1}]}]}})"),
+        with_process(R"("linux": {"sysctl": {"net.ipv4.ip_forward": 1}})"),
+        with_process(R"("linux": {"sysctl": null})"),
+        with_process(R"("hooks": [])"),
+        with_process(R"("hooks": {"prestart": [{"path": "/bin/true"}]})"),
+        with_process(R"("hooks": {"poststop": [{"args": []}]})"),
+        with_process(R"("hooks": {"prestart": [{"path": "/bin/true", "args": [], "timeout": 0}]})"),
+        with_process(R"("hooks": {"prestart": [{"path": "/bin/true", "args": [], "env": ["A"]}]})"),
+        with_process(R"("hooks": {"prestart": [{"path": "/bin/true", "args": [], "entry": 1}]})"),
+        with_process(R"("mounts": [{"destination": "/proc"}])"),
+        with_process(R"("mounts": [{"type": "proc", "options": "ro"}])"),
+        with_process(R"("mounts": [{"type": "proc", "source": null}])"),
+        with_process(R"("mounts": {})"),
+        with_process(R"("annotations": [])"),
+        with_process(R"("annotations": null)"),
+    };
+
+    for (const auto &source : sources) {
+        expect_same(source);
+        EXPECT_NE(error(source), "") << source;
+    }
+}
+
+TEST(ConfigParser, ReportsPointers)
+{
+    EXPECT_EQ(error(document(R"("process": {"cwd": "/", "args": ["sh"],
+                                            "user": {"uid": "0", "gid": 0}})")),
+              "[json.exception.type_error.302] (/process/user/uid) type must be number, but is "
+              "string");
+    EXPECT_EQ(error(document(R"("process": {"cwd": "/", "args": ["sh"]})")),
+              "[json.exception.type_error.302] (/process/user/uid) type must be number, but is "
+              "null");
+    EXPECT_EQ(error(with_process(R"("mounts": [{"type": "proc"}, {"type": "a", "options": [1]}])")),
+              "[json.exception.type_error.302] (/mounts/1/options/0) type must be string, but is "
+              "number");
+    EXPECT_EQ(error(with_process(R"("linux": {"sysctl": {"a/b~c": 1}})")),
+              "[json.exception.type_error.302] (/linux/sysctl/a~1b~0c) type must be string, but is "
+              "number");
+    EXPECT_EQ(error("[]"), "[json.exception.type_error.302] type must be object, but is array");
+}
@@ -0,0 +1,327 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "config_reference.h"
+
+#include "linyaps_box/utils/semver.h"
+#include "nlohmann/json.hpp"
+
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+using json = nlohmann::json;
+
+// NOTE: Type errors are thrown by nlohmann::json itself, requesting the expected type.
+json &object(json &value)
+{
+    if (!value.is_object()) {
+        (void)value.get<json::object_t>();
+    }
+    return value;
+}
+
+// The object of `key` in `parent`, which is created empty if absent,
+// so its required members are reported as null.
+json &object(json &parent, const char *key)
+{
+    auto it = parent.find(key);
+    if (it == parent.end()) {
+        return parent[key] = json::object();
+    }
+    return object(*it);
+}
+
+// Whether `parent` has `key` which is not null, as nullable objects and arrays of objects
+// are absent if null.
+bool has(const json &parent, const char *key)
+{
+    auto it = parent.find(key);
+    return it != parent.end() && !it->is_null();
+}
+
+json &array(json &value)
+{
+    if (!value.is_array()) {
+        (void)value.get<json::array_t>();
+    }
+    return value;
+}
+
+void add_env(std::map<std::string, std::string> &env, const json &entries)
+{
+    for (const auto &e : entries.get<std::vector<std::string>>()) {
+        auto pos = e.find('=');
+        if (pos == std::string::npos) {
+            throw std::runtime_error("invalid env entry: " + e);
+        }
+        env[e.substr(0, pos)] = e.substr(pos + 1);
+    }
+}
+
+void parse_process(json &j, linyaps_box::config &cfg)
+{
+    auto &process = object(j, "process");
+
+    if (process.contains("terminal")) {
+        cfg.process.terminal = process["terminal"].get<bool>();
+    }
+
+    if (process.contains("consoleSize")) {
+        auto &console = object(process["consoleSize"]);
+        if (cfg.process.terminal) {
+            cfg.process.console.height = console["height"].get<uint>();
+            cfg.process.console.width = console["width"].get<uint>();
+        }
+    }
+
+    cfg.process.cwd = process["cwd"].get<std::string>();
+
+    if (process.contains("env")) {
+        add_env(cfg.process.env, process["env"]);
+    }
+
+    cfg.process.args = process["args"].get<std::vector<std::string>>();
+
+    if (process.contains("noNewPrivileges")) {
+        cfg.process.no_new_privileges = process["noNewPrivileges"].get<bool>();
+    }
+
+    if (process.contains("oomScoreAdj")) {
+        cfg.process.oom_score_adj = process["oomScoreAdj"].get<int>();
+    }
+
+    auto &user = object(process, "user");
+    cfg.process.uid = user["uid"].get<uid_t>();
+    cfg.process.gid = user["gid"].get<gid_t>();
+    if (user.contains("umask")) {
+        cfg.process.umask = user["umask"].get<mode_t>();
+    }
+    if (user.contains("additionalGids")) {
+        cfg.process.additional_gids = user["additionalGids"].get<std::vector<gid_t>>();
+    }
+}
+
+linyaps_box::config::namespace_t parse_namespace(json &ns)
+{
+    linyaps_box::config::namespace_t n;
+    if (!object(ns).contains("type")) {
+        throw std::runtime_error("property `type` is REQUIRED for linux namespaces");
+    }
+
+    using type_t = linyaps_box::config::namespace_t::type_t;
+    auto type = ns["type"].get<std::string>();
+    if (type == "pid") {
+        n.type = type_t::PID;
+    } else if (type == "network") {
+        n.type = type_t::NET;
+    } else if (type == "ipc") {
+        n.type = type_t::IPC;
+    } else if (type == "uts") {
+        n.type = type_t::UTS;
+    } else if (type == "mount") {
+        n.type = type_t::MOUNT;
+    } else if (type == "user") {
+        n.type = type_t::USER;
+    } else if (type == "cgroup") {
+        n.type = type_t::CGROUP;
+    } else {
+        throw std::runtime_error("unsupported namespace type: " + type);
+    }
+
+    if (ns.contains("path")) {
+        n.path = ns["path"].get<std::string>();
+    }
+    return n;
+}
+
+std::vector<linyaps_box::config::id_mapping_t> parse_id_mappings(json &mappings)
+{
+    std::vector<linyaps_box::config::id_mapping_t> result;
+    for (auto &m : array(mappings)) {
+        linyaps_box::config::id_mapping_t mapping;
+        object(m);
+        mapping.host_id = m["hostID"].get<uid_t>();
+        mapping.container_id = m["containerID"].get<uid_t>();
+        mapping.size = m["size"].get<size_t>();
+        result.push_back(mapping);
+    }
+    return result;
+}
+
+linyaps_box::config::seccomp_t parse_seccomp(json &j)
+{
+    linyaps_box::config::seccomp_t seccomp;
+    seccomp.default_action = j["defaultAction"].get<std::string>();
+    if (j.contains("defaultErrnoRet")) {
+        seccomp.default_errno_ret = j["defaultErrnoRet"].get<uint>();
+    }
+    if (j.contains("architectures")) {
+        seccomp.architectures = j["architectures"].get<std::vector<std::string>>();
+    }
+    if (j.contains("flags")) {
+        seccomp.flags = j["flags"].get<std::vector<std::string>>();
+    }
+    if (!has(j, "syscalls")) {
+        return seccomp;
+    }
+
+    for (auto &s : array(j["syscalls"])) {
+        linyaps_box::config::seccomp_t::syscall_t syscall;
+        object(s);
+        syscall.names = s["names"].get<std::vector<std::string>>();
+        syscall.action = s["action"].get<std::string>();
+        if (s.contains("errnoRet")) {
+            syscall.errno_ret = s["errnoRet"].get<uint>();
+        }
+        if (has(s, "args")) {
+            for (auto &a : array(s["args"])) {
+                linyaps_box::config::seccomp_t::syscall_t::arg_t arg;
+                object(a);
+                arg.index = a["index"].get<uint>();
+                arg.value = a["value"].get<std::uint64_t>();
+                if (a.contains("valueTwo")) {
+                    arg.value_two = a["valueTwo"].get<std::uint64_t>();
+                }
+                arg.op = a["op"].get<std::string>();
+                syscall.args.push_back(std::move(arg));
+            }
+        }
+        seccomp.syscalls.push_back(std::move(syscall));
+    }
+    return seccomp;
+}
+
+void parse_linux(json &j, linyaps_box::config &cfg)
+{
+    if (!has(j, "linux")) {
+        return;
+    }
+    auto &linux = object(j["linux"]);
+
+    if (has(linux, "namespaces")) {
+        for (auto &ns : array(linux["namespaces"])) {
+            cfg.namespaces.push_back(parse_namespace(ns));
+        }
+    }
+
+    if (has(linux, "uidMappings")) {
+        cfg.uid_mappings = parse_id_mappings(linux["uidMappings"]);
+    }
+    if (has(linux, "gidMappings")) {
+        cfg.gid_mappings = parse_id_mappings(linux["gidMappings"]);
+    }
+
+    if (has(linux, "seccomp")) {
+        cfg.seccomp = parse_seccomp(object(linux["seccomp"]));
+    }
+
+    if (linux.contains("sysctl")) {
+        cfg.sysctl = object(linux["sysctl"]).get<std::map<std::string, std::string>>();
+    }
+}
+
+std::vector<linyaps_box::config::hooks_t::hook_t> parse_hooks(json &hooks, const char *key)
+{
+    std::vector<linyaps_box::config::hooks_t::hook_t> result;
+    if (!has(hooks, key)) {
+        return result;
+    }
+
+    for (auto &h : array(hooks[key])) {
+        linyaps_box::config::hooks_t::hook_t hook;
+        object(h);
+        hook.path = h["path"].get<std::string>();
+        hook.args = h["args"].get<std::vector<std::string>>();
+        if (h.contains("env")) {
+            add_env(hook.env, h["env"]);
+        }
+        if (h.contains("timeout")) {
+            hook.timeout = h["timeout"].get<int>();
+            if (*hook.timeout <= 0) {
+                throw std::runtime_error("hook timeout must be greater than zero");
+            }
+        }
+        if (h.contains("entry")) {
+            hook.entry = h["entry"].get<std::string>();
+        }
+        result.push_back(std::move(hook));
+    }
+    return result;
+}
+
+void parse_mounts(json &j, linyaps_box::config &cfg)
+{
+    if (!has(j, "mounts")) {
+        return;
+    }
+
+    for (auto &m : array(j["mounts"])) {
+        linyaps_box::config::mount_t mount;
+        object(m);
+        if (m.contains("source")) {
+            mount.source = m["source"].get<std::string>();
+        }
+        if (m.contains("destination")) {
+            mount.destination = m["destination"].get<std::string>();
+        }
+        mount.type = m["type"].get<std::string>();
+        if (m.contains("options")) {
+            std::tie(mount.flags, mount.propagation_flags, mount.data) =
+                    linyaps_box::config::mount_t::parse_options(
+                            m["options"].get<std::vector<std::string>>());
+        }
+        cfg.mounts.push_back(std::move(mount));
+    }
+}
+
+} // namespace
+
+linyaps_box::config linyaps_box::config_reference::parse(std::string_view source)
+{
+    auto j = json::parse(source.begin(), source.end());
+    object(j);
+
+    auto semver = linyaps_box::utils::semver(j["ociVersion"].get<std::string>());
+    if (!linyaps_box::utils::semver("1.2.0").is_compatible_with(semver)) {
+        throw std::runtime_error("unsupported OCI version: " + semver.to_string());
+    }
+
+    linyaps_box::config cfg;
+    parse_process(j, cfg);
+    parse_linux(j, cfg);
+
+    if (has(j, "hooks")) {
+        auto &hooks = object(j["hooks"]);
+        cfg.hooks.prestart = parse_hooks(hooks, "prestart");
+        cfg.hooks.create_runtime = parse_hooks(hooks, "createRuntime");
+        cfg.hooks.create_container = parse_hooks(hooks, "createContainer");
+        cfg.hooks.start_container = parse_hooks(hooks, "startContainer");
+        cfg.hooks.poststart = parse_hooks(hooks, "poststart");
+        cfg.hooks.poststop = parse_hooks(hooks, "poststop");
+    }
+
+    parse_mounts(j, cfg);
+
+    auto &root = object(j, "root");
+    cfg.root.path = root["path"].get<std::string>();
+    if (root.contains("readonly")) {
+        cfg.root.readonly = root["readonly"].get<bool>();
+    }
+
+    if (j.contains("annotations")) {
+        // NOTE: Annotations of other types than string are skipped.
+        for (const auto &item : object(j["annotations"]).items()) {
+            if (item.value().is_string()) {
+                cfg.annotations[item.key()] = item.value().get<std::string>();
+            }
+        }
+    }
+
+    return cfg;
+}
@@ -0,0 +1,23 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "linyaps_box/config.h"
+
+#include <string_view>
+
+// The reference parser of configurations, building a document of nlohmann::json
+// and reading it by pointers as the runtime did before the SAX parser.
+//
+// It accepts and rejects the same configurations as linyaps_box::config::parse,
+// with the same messages except JSON pointers, which nlohmann::json only reports
+// if it is built with JSON_DIAGNOSTICS.
+// Configurations with more than one error might be reported by another one.
+
+namespace linyaps_box::config_reference {
+
+[[nodiscard]] config parse(std::string_view source);
+
+} // namespace linyaps_box::config_reference
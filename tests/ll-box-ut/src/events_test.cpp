@@ -0,0 +1,203 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "gtest/gtest.h"
+#include "linyaps_box/events.h"
+#include "linyaps_box/impl/status_directory.h"
+#include "temp_dir_test.h"
+
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+linyaps_box::container_status_t status_of(const std::string &id, pid_t pid)
+{
+    linyaps_box::container_status_t status{};
+    status.ID = id;
+    status.PID = pid;
+    status.status = linyaps_box::container_status_t::runtime_status::CREATING;
+    status.bundle = "/bundle";
+    status.created = "2025-01-01T00:00:00Z";
+    return status;
+}
+
+linyaps_box::events::event_t event_of(const std::string &type, const std::string &id)
+{
+    linyaps_box::events::event_t event;
+    event.type = type;
+    event.ID = id;
+    return event;
+}
+
+class EventsTest : public linyaps_box::test::TempDirTest
+{
+protected:
+    EventsTest()
+        : TempDirTest("events")
+    {
+    }
+
+    void SetUp() override
+    {
+        TempDirTest::SetUp();
+        status_dir = std::make_unique<linyaps_box::impl::status_directory>(dir);
+    }
+
+    std::unique_ptr<linyaps_box::impl::status_directory> status_dir;
+};
+
+} // namespace
+
+TEST_F(EventsTest, StateChanged)
+{
+    auto created = status_of("app", 1);
+    auto event = linyaps_box::events::state_changed(std::nullopt, created);
+    EXPECT_EQ(event.type, "created");
+    EXPECT_EQ(event.ID, "app");
+    EXPECT_EQ(event.fields.at("pid"), 1);
+    EXPECT_EQ(event.fields.at("bundle"), "/bundle");
+
+    // NOTE: Only the status and the fields which changed are carried.
+    auto running = created;
+    running.PID = 2;
+    running.status = linyaps_box::container_status_t::runtime_status::RUNNING;
+    event = linyaps_box::events::state_changed(created, running);
+    EXPECT_EQ(event.type, "started");
+    EXPECT_EQ(event.fields, (nlohmann::json{ { "pid", 2 }, { "status", "running" } }));
+
+    auto annotated = running;
+    annotated.annotations = { { "key", "value" } };
+    event = linyaps_box::events::state_changed(running, annotated);
+    EXPECT_EQ(event.type, "updated");
+    EXPECT_EQ(event.fields.at("annotations"), (nlohmann::json{ { "key", "value" } }));
+    EXPECT_FALSE(event.fields.contains("pid"));
+
+    auto stopped = annotated;
+    stopped.status = linyaps_box::container_status_t::runtime_status::STOPPED;
+    event = linyaps_box::events::state_changed(annotated, stopped);
+    EXPECT_EQ(event.type, "stopped");
+    EXPECT_EQ(event.fields, (nlohmann::json{ { "status", "stopped" } }));
+
+    event = linyaps_box::events::state_changed(stopped, std::nullopt);
+    EXPECT_EQ(event.type, "deleted");
+    EXPECT_EQ(event.ID, "app");
+
+    EXPECT_THROW((void)linyaps_box::events::state_changed(std::nullopt, std::nullopt),
+                 std::invalid_argument);
+}
+
+TEST_F(EventsTest, RoundTrip)
+{
+    auto event = event_of("exit", "app");
+    event.fields["exitCode"] = 137;
+    auto read = linyaps_box::events::from_string(linyaps_box::events::to_string(event));
+    EXPECT_EQ(read.type, event.type);
+    EXPECT_EQ(read.ID, event.ID);
+    EXPECT_EQ(read.fields, event.fields);
+
+    EXPECT_THROW((void)linyaps_box::events::from_string("{}"), std::exception);
+}
+
+TEST_F(EventsTest, JournalIsRotated)
+{
+    constexpr std::size_t rotate_size = 4096;
+
+    auto journal = status_dir->events_journal();
+    auto rotated = journal;
+    rotated += ".1";
+
+    linyaps_box::events::monitor monitor(*status_dir);
+    auto publish = [&journal](const std::string &type) {
+        linyaps_box::events::publish(journal, event_of(type, "app"), rotate_size);
+    };
+    auto wait = [&monitor](std::size_t count) {
+        std::vector<linyaps_box::events::event_t> events;
+        while (events.size() < count) {
+            auto more = monitor.wait();
+            events.insert(events.end(), more.begin(), more.end());
+        }
+        return events;
+    };
+
+    std::size_t count = 0;
+    for (; !std::filesystem::exists(journal) || std::filesystem::file_size(journal) < rotate_size;
+         ++count) {
+        publish("updated");
+    }
+    publish("exit");
+
+    EXPECT_GE(std::filesystem::file_size(rotated), rotate_size);
+    EXPECT_LT(std::filesystem::file_size(journal), rotate_size);
+
+    // NOTE: The monitor follows the journal across the rotation.
+    auto events = wait(count + 1);
+    ASSERT_EQ(events.size(), count + 1);
+    EXPECT_EQ(events.front().type, "updated");
+    EXPECT_EQ(events.back().type, "exit");
+    EXPECT_EQ(events.back().ID, "app");
+
+    // NOTE: A rotated journal is replaced, so the size of the journals is bounded.
+    // Empty lines are skipped.
+    std::ofstream(journal, std::ios::app) << "\n\n";
+    count = 0;
+    for (; std::filesystem::file_size(journal) < rotate_size; ++count) {
+        publish("updated");
+    }
+    publish("oom");
+    EXPECT_LT(std::filesystem::file_size(rotated), 2 * rotate_size);
+    EXPECT_LT(std::filesystem::file_size(journal), rotate_size);
+
+    events = wait(count + 1);
+    ASSERT_EQ(events.size(), count + 1);
+    EXPECT_EQ(events.back().type, "oom");
+}
+
+TEST_F(EventsTest, MonitorReportsStoppedProcesses)
+{
+    auto pid = ::fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        ::pause();
+        ::_exit(0);
+    }
+
+    auto status = status_of("app", pid);
+    status.status = linyaps_box::container_status_t::runtime_status::RUNNING;
+    status_dir->write(status);
+
+    // NOTE: Events published before the monitor is created are not reported.
+    linyaps_box::events::publish(status_dir->events_journal(), event_of("exit", "old"));
+    linyaps_box::events::monitor monitor(*status_dir);
+
+    ::kill(pid, SIGKILL);
+    ::waitpid(pid, nullptr, 0);
+
+    auto events = monitor.wait();
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_EQ(events.front().type, "stopped");
+    EXPECT_EQ(events.front().ID, "app");
+    EXPECT_EQ(events.front().fields.at("pid"), pid);
+
+    // NOTE: The runtime reporting it later is not reported again.
+    auto stopped = status;
+    stopped.status = linyaps_box::container_status_t::runtime_status::STOPPED;
+    linyaps_box::events::publish(status_dir->events_journal(),
+                                 linyaps_box::events::state_changed(status, stopped));
+    linyaps_box::events::publish(status_dir->events_journal(),
+                                 linyaps_box::events::state_changed(stopped, std::nullopt));
+
+    events = monitor.wait();
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_EQ(events.front().type, "deleted");
+    EXPECT_EQ(events.front().ID, "app");
+}
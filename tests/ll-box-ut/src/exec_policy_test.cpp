@@ -0,0 +1,113 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "gtest/gtest.h"
+#include "linyaps_box/exec_policy.h"
+
+#include <filesystem>
+
+#include <unistd.h>
+
+namespace {
+
+linyaps_box::exec_policy::policy_t user_policy()
+{
+    linyaps_box::exec_policy::policy_t policy;
+    policy.uid = 1000;
+    policy.gid = 1000;
+    policy.additional_gids = { 10, 20 };
+    policy.no_new_privileges = true;
+    return policy;
+}
+
+linyaps_box::config::process_t process_of(uid_t uid, gid_t gid)
+{
+    linyaps_box::config::process_t process;
+    process.uid = uid;
+    process.gid = gid;
+    process.no_new_privileges = true;
+    return process;
+}
+
+} // namespace
+
+TEST(ExecPolicy, RootAllowsAnyUser)
+{
+    linyaps_box::exec_policy::policy_t policy;
+    EXPECT_NO_THROW(linyaps_box::exec_policy::check(policy, process_of(1000, 1000)));
+    EXPECT_NO_THROW(linyaps_box::exec_policy::check(policy, process_of(0, 0)));
+}
+
+TEST(ExecPolicy, UserIsAFloor)
+{
+    auto policy = user_policy();
+    EXPECT_NO_THROW(linyaps_box::exec_policy::check(policy, process_of(1000, 1000)));
+    EXPECT_THROW(linyaps_box::exec_policy::check(policy, process_of(0, 0)), std::runtime_error);
+    EXPECT_THROW(linyaps_box::exec_policy::check(policy, process_of(1000, 0)), std::runtime_error);
+
+    auto process = process_of(1000, 1000);
+    process.additional_gids = std::vector<gid_t>{ 1000, 20 };
+    EXPECT_NO_THROW(linyaps_box::exec_policy::check(policy, process));
+    process.additional_gids = std::vector<gid_t>{ 0 };
+    EXPECT_THROW(linyaps_box::exec_policy::check(policy, process), std::runtime_error);
+}
+
+TEST(ExecPolicy, NoNewPrivilegesIsKept)
+{
+    auto policy = user_policy();
+    auto process = process_of(1000, 1000);
+    process.no_new_privileges = false;
+    EXPECT_THROW(linyaps_box::exec_policy::check(policy, process), std::runtime_error);
+
+    policy.no_new_privileges = false;
+    EXPECT_NO_THROW(linyaps_box::exec_policy::check(policy, process));
+}
+
+TEST(ExecPolicy, RoundTrip)
+{
+    auto path = std::filesystem::temp_directory_path()
+            / ("ll-box-exec-policy-" + std::to_string(getpid()));
+
+    auto policy = user_policy();
+    linyaps_box::seccomp::program_t program;
+    program.flags = 1;
+    program.filter = { { 0x20, 0, 0, 4 }, { 0x15, 1, 2, 0xc000003e }, { 0x06, 0, 0, 0x7fff0000 } };
+    policy.seccomp = program;
+    linyaps_box::exec_policy::write(path, policy);
+
+    auto read = linyaps_box::exec_policy::read(path);
+    std::filesystem::remove(path);
+
+    EXPECT_EQ(read.uid, policy.uid);
+    EXPECT_EQ(read.gid, policy.gid);
+    EXPECT_EQ(read.additional_gids, policy.additional_gids);
+    EXPECT_EQ(read.no_new_privileges, policy.no_new_privileges);
+    ASSERT_TRUE(read.seccomp.has_value());
+    EXPECT_EQ(read.seccomp->flags, program.flags);
+    ASSERT_EQ(read.seccomp->filter.size(), program.filter.size());
+    for (std::size_t i = 0; i < program.filter.size(); ++i) {
+        EXPECT_EQ(read.seccomp->filter[i].code, program.filter[i].code);
+        EXPECT_EQ(read.seccomp->filter[i].jt, program.filter[i].jt);
+        EXPECT_EQ(read.seccomp->filter[i].jf, program.filter[i].jf);
+        EXPECT_EQ(read.seccomp->filter[i].k, program.filter[i].k);
+    }
+}
+
+#ifndef LINYAPS_BOX_ENABLE_SECCOMP
+TEST(ExecPolicy, SeccompIsRequired)
+{
+    linyaps_box::config config;
+    config.seccomp = linyaps_box::config::seccomp_t{};
+    EXPECT_THROW(
+            [[maybe_unused]] auto policy = linyaps_box::exec_policy::from_config(config, "/"),
+            std::runtime_error);
+}
+#endif
+
+TEST(ExecPolicy, MissingPolicyFails)
+{
+    EXPECT_THROW(
+            [[maybe_unused]] auto policy = linyaps_box::exec_policy::read("/nonexistent/policy"),
+            std::runtime_error);
+}
@@ -0,0 +1,185 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "gtest/gtest.h"
+#include "linyaps_box/config.h"
+#include "linyaps_box/hook_cache.h"
+#include "nlohmann/json.hpp"
+#include "temp_dir_test.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr auto create_container = "org.openatom.linyaps.box.hook-cache.createContainer.0";
+constexpr auto start_container = "org.openatom.linyaps.box.hook-cache.startContainer.0";
+
+linyaps_box::config make_config(const nlohmann::json &annotations)
+{
+    nlohmann::json j = {
+        { "ociVersion", "1.0.0" },
+        { "root", { { "path", "rootfs" } } },
+        { "process",
+          { { "args", { "/bin/true" } },
+            { "cwd", "/" },
+            { "user", { { "uid", 0 }, { "gid", 0 } } } } },
+        { "mounts",
+          { { { "destination", "/usr" },
+              { "type", "bind" },
+              { "source", "/usr" },
+              { "options", { "rbind", "ro" } } } } },
+        { "hooks",
+          { { "createContainer", { { { "path", "/bin/true" }, { "args", { "true" } } } } },
+            { "startContainer", { { { "path", "/bin/true" }, { "args", { "true" } } } } } } },
+        { "annotations", annotations },
+    };
+    std::istringstream iss(j.dump());
+    return linyaps_box::config::parse(iss);
+}
+
+std::string declaration(const std::string &output)
+{
+    return nlohmann::json{ { "inputs", nlohmann::json::array() }, { "outputs", { output } } }
+            .dump();
+}
+
+std::string read(const std::filesystem::path &path)
+{
+    std::ifstream ifs(path);
+    return { std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>() };
+}
+
+class HookCacheTest : public linyaps_box::test::TempDirTest
+{
+protected:
+    HookCacheTest()
+        : TempDirTest("hook-cache")
+    {
+    }
+
+    void SetUp() override
+    {
+        TempDirTest::SetUp();
+        std::filesystem::create_directories(dir / "bundle" / "rootfs" / "etc");
+        std::filesystem::create_directories(dir / "cache");
+    }
+};
+
+} // namespace
+
+TEST_F(HookCacheTest, OutputsAreRestrictedToTheContainer)
+{
+    auto bundle = dir / "bundle";
+    auto parse = [&bundle](const char *annotation, const std::string &output) {
+        return linyaps_box::hook_cache::parse(make_config({ { annotation, declaration(output) } }),
+                                              bundle);
+    };
+
+    EXPECT_NO_THROW(parse(create_container, (bundle / "rootfs/etc/ld.so.cache").string()));
+    EXPECT_NO_THROW(parse(create_container, (bundle / "generated").string()));
+    EXPECT_NO_THROW(parse(start_container, "/etc/ld.so.cache"));
+
+    EXPECT_THROW(parse(create_container, "/etc/ld.so.cache"), std::runtime_error);
+    EXPECT_THROW(parse(create_container, (bundle / "rootfs/../../x").string()),
+                 std::runtime_error);
+    EXPECT_THROW(parse(create_container, bundle.string()), std::runtime_error);
+    EXPECT_THROW(parse(create_container, (bundle / "rootfs/usr/lib/x").string()),
+                 std::runtime_error);
+    EXPECT_THROW(parse(start_container, "/usr/lib/x"), std::runtime_error);
+    EXPECT_THROW(parse(start_container, "/"), std::runtime_error);
+}
+
+TEST_F(HookCacheTest, KeyCoversTheHook)
+{
+    linyaps_box::hook_cache::declaration_t decl;
+    decl.outputs = { dir / "bundle" / "out" };
+
+    linyaps_box::config::hooks_t::hook_t hook;
+    hook.path = "/bin/true";
+    hook.args = { "true", "a" };
+    auto key = linyaps_box::hook_cache::key(hook, "createContainer.0", decl);
+
+    auto other = hook;
+    other.args = { "truea" };
+    EXPECT_NE(linyaps_box::hook_cache::key(other, "createContainer.0", decl).name, key.name);
+
+    other = hook;
+    other.env = { { "A", "1" } };
+    EXPECT_NE(linyaps_box::hook_cache::key(other, "createContainer.0", decl).name, key.name);
+
+    EXPECT_EQ(linyaps_box::hook_cache::key(hook, "createContainer.0", decl).content, key.content);
+}
+
+TEST_F(HookCacheTest, StoreAndRestore)
+{
+    auto output = dir / "bundle" / "rootfs" / "etc" / "out";
+    std::ofstream(output) << "generated";
+
+    linyaps_box::hook_cache::declaration_t decl;
+    decl.outputs = { output };
+    linyaps_box::config::hooks_t::hook_t hook;
+    hook.path = "/bin/true";
+    auto key = linyaps_box::hook_cache::key(hook, "createContainer.0", decl);
+
+    linyaps_box::hook_cache::store(dir / "cache", key, decl);
+    std::filesystem::remove(output);
+
+    ASSERT_TRUE(linyaps_box::hook_cache::restore(dir / "cache", key, decl));
+    EXPECT_EQ(read(output), "generated");
+
+    // NOTE: An entry of the same name but another key is never restored.
+    auto collided = key;
+    collided.content += " ";
+    EXPECT_FALSE(linyaps_box::hook_cache::restore(dir / "cache", collided, decl));
+}
+
+TEST_F(HookCacheTest, OutputsThroughSymlinksAreRefused)
+{
+    std::filesystem::create_directories(dir / "outside");
+    std::filesystem::create_directory_symlink(dir / "outside", dir / "bundle" / "rootfs" / "link");
+    std::ofstream(dir / "outside" / "out") << "generated";
+
+    linyaps_box::hook_cache::declaration_t decl;
+    decl.outputs = { dir / "bundle" / "rootfs" / "link" / "out" };
+    linyaps_box::config::hooks_t::hook_t hook;
+    hook.path = "/bin/true";
+    auto key = linyaps_box::hook_cache::key(hook, "createContainer.0", decl);
+
+    linyaps_box::hook_cache::store(dir / "cache", key, decl);
+    EXPECT_FALSE(linyaps_box::hook_cache::restore(dir / "cache", key, decl));
+    EXPECT_EQ(read(dir / "outside" / "out"), "generated");
+}
+
+TEST_F(HookCacheTest, LeastRecentlyUsedEntriesAreEvicted)
+{
+    constexpr std::size_t size = 64 * 1024;
+    linyaps_box::config::hooks_t::hook_t hook;
+    hook.path = "/bin/true";
+
+    std::vector<linyaps_box::hook_cache::key_t> keys;
+    for (int i = 0; i < 3; ++i) {
+        auto output = dir / "bundle" / ("out" + std::to_string(i));
+        std::ofstream(output) << std::string(size, 'x');
+
+        linyaps_box::hook_cache::declaration_t decl;
+        decl.outputs = { output };
+        keys.push_back(
+                linyaps_box::hook_cache::key(hook, "createContainer." + std::to_string(i), decl));
+
+        // NOTE: Entries are ordered by their times of use.
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        linyaps_box::hook_cache::store(dir / "cache", keys.back(), decl, 2 * size + size / 4);
+    }
+
+    EXPECT_FALSE(std::filesystem::exists(dir / "cache" / keys[0].name));
+    EXPECT_TRUE(std::filesystem::exists(dir / "cache" / keys[1].name));
+    EXPECT_TRUE(std::filesystem::exists(dir / "cache" / keys[2].name));
+}
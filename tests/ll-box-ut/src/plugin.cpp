@@ -0,0 +1,17 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+// A plugin hook loaded by plugin_loader_test.cpp,
+// it fails unless it is called with an absolute bundle.
+
+#include "linyaps_box/plugin.h"
+
+extern "C" int ll_box_ut_hook(const struct linyaps_box_hook_context *context)
+{
+    if (context->abi_version != LINYAPS_BOX_PLUGIN_ABI_VERSION) {
+        return 1;
+    }
+
+    return context->bundle != nullptr && context->bundle[0] == '/' ? 0 : 2;
+}
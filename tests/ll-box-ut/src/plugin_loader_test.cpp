@@ -0,0 +1,118 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "gtest/gtest.h"
+#include "linyaps_box/plugin_loader.h"
+#include "temp_dir_test.h"
+
+#include <filesystem>
+
+#include <unistd.h>
+
+namespace {
+
+class PluginLoaderTest : public linyaps_box::test::TempDirTest
+{
+protected:
+    PluginLoaderTest()
+        : TempDirTest("plugin-loader")
+    {
+    }
+
+    void SetUp() override
+    {
+        TempDirTest::SetUp();
+        std::filesystem::create_directories(dir / "plugins" / "sub");
+        std::filesystem::permissions(dir / "plugins",
+                                     std::filesystem::perms::owner_all
+                                             | std::filesystem::perms::group_read
+                                             | std::filesystem::perms::group_exec
+                                             | std::filesystem::perms::others_read
+                                             | std::filesystem::perms::others_exec);
+    }
+
+    // NOTE: Each test uses its own shared object,
+    // as shared objects are only checked when they are loaded the first time.
+    [[nodiscard]] std::filesystem::path install(const std::string &name) const
+    {
+        auto path = dir / "plugins" / name;
+        std::filesystem::copy_file(LL_BOX_UT_PLUGIN, path);
+        std::filesystem::permissions(path,
+                                     std::filesystem::perms::owner_read
+                                             | std::filesystem::perms::owner_write
+                                             | std::filesystem::perms::group_read
+                                             | std::filesystem::perms::others_read);
+        return path;
+    }
+
+    static linyaps_box::config config_of(const std::filesystem::path &path)
+    {
+        linyaps_box::config::hooks_t::hook_t hook;
+        hook.path = path;
+        hook.args = { "ll_box_ut_hook" };
+        hook.entry = "ll_box_ut_hook";
+
+        linyaps_box::config config;
+        config.hooks.prestart.push_back(hook);
+        return config;
+    }
+};
+
+} // namespace
+
+TEST_F(PluginLoaderTest, LoadAndCall)
+{
+    if (geteuid() != 0) {
+        GTEST_SKIP() << "plugins are only loaded from directories owned by root";
+    }
+
+    auto config = config_of(install("load.so"));
+    auto entries = linyaps_box::plugin::load(config, dir / "plugins");
+    ASSERT_EQ(entries.size(), 1);
+
+    const auto &hook = config.hooks.prestart.front();
+    linyaps_box::plugin::call_context_t context;
+    context.stage = "prestart";
+    context.id = "test";
+    context.bundle = dir.string();
+    EXPECT_NO_THROW(linyaps_box::plugin::call(entries.at(&hook), hook, context));
+
+    context.bundle = "bundle";
+    EXPECT_THROW(linyaps_box::plugin::call(entries.at(&hook), hook, context), std::runtime_error);
+}
+
+TEST_F(PluginLoaderTest, OnlyPluginsInTheDirectory)
+{
+    std::filesystem::copy_file(LL_BOX_UT_PLUGIN, dir / "outside.so");
+    std::filesystem::copy_file(LL_BOX_UT_PLUGIN, dir / "plugins" / "sub" / "outside.so");
+    auto load = [this](const std::filesystem::path &path) {
+        return linyaps_box::plugin::load(config_of(path), dir / "plugins");
+    };
+
+    EXPECT_THROW(load(dir / "outside.so"), std::runtime_error);
+    EXPECT_THROW(load(dir / "plugins" / ".." / "outside.so"), std::runtime_error);
+    EXPECT_THROW(load(dir / "plugins" / "sub" / "outside.so"), std::runtime_error);
+    EXPECT_THROW(load("outside.so"), std::runtime_error);
+    EXPECT_THROW(load(dir / "plugins" / ".."), std::runtime_error);
+
+    // NOTE: Configurations without plugin hooks never need the directory.
+    EXPECT_TRUE(linyaps_box::plugin::load(linyaps_box::config{}, dir / "nonexistent").empty());
+}
+
+TEST_F(PluginLoaderTest, UntrustedPluginsAreRejected)
+{
+    auto path = install("untrusted.so");
+    std::filesystem::permissions(path,
+                                 std::filesystem::perms::others_write,
+                                 std::filesystem::perm_options::add);
+    EXPECT_THROW(linyaps_box::plugin::load(config_of(path), dir / "plugins"), std::runtime_error);
+
+    std::filesystem::permissions(path,
+                                 std::filesystem::perms::others_write,
+                                 std::filesystem::perm_options::remove);
+    std::filesystem::permissions(dir / "plugins",
+                                 std::filesystem::perms::group_write,
+                                 std::filesystem::perm_options::add);
+    EXPECT_THROW(linyaps_box::plugin::load(config_of(path), dir / "plugins"), std::runtime_error);
+}
@@ -0,0 +1,227 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "gtest/gtest.h"
+#include "linyaps_box/agent.h"
+#include "linyaps_box/command/list.h"
+#include "linyaps_box/events.h"
+#include "linyaps_box/impl/status_table.h"
+#include "linyaps_box/runtime.h"
+#include "linyaps_box/utils/start_time.h"
+#include "nlohmann/json.hpp"
+#include "temp_dir_test.h"
+
+#include <algorithm>
+#include <climits>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+linyaps_box::container_status_t status_of(const std::string &id, pid_t runtime_pid)
+{
+    linyaps_box::container_status_t status{};
+    status.ID = id;
+    // NOTE: The container is gone, as if its runtime was killed.
+    status.PID = INT_MAX;
+    status.status = linyaps_box::container_status_t::runtime_status::RUNNING;
+    status.bundle = "/bundle";
+    status.created = "2025-01-01T00:00:00Z";
+    status.runtime_pid = runtime_pid;
+    status.runtime_start_time = linyaps_box::utils::process_start_time(runtime_pid).value_or(0);
+    return status;
+}
+
+linyaps_box::container_status_t running(const std::string &id,
+                                        const std::map<std::string, std::string> &annotations)
+{
+    auto status = status_of(id, getpid());
+    status.PID = getpid();
+    status.annotations = annotations;
+    return status;
+}
+
+std::vector<std::string> ids_of(const std::vector<linyaps_box::container_status_t> &statuses)
+{
+    std::vector<std::string> ids;
+    std::transform(statuses.begin(),
+                   statuses.end(),
+                   std::back_inserter(ids),
+                   [](const auto &status) { return status.ID; });
+    return ids;
+}
+
+std::vector<linyaps_box::events::event_t> events_of(const std::filesystem::path &journal)
+{
+    std::vector<linyaps_box::events::event_t> events;
+    std::ifstream ifs(journal);
+    for (std::string line; std::getline(ifs, line);) {
+        events.push_back(linyaps_box::events::from_string(line));
+    }
+    return events;
+}
+
+class RuntimeTest : public linyaps_box::test::TempDirTest
+{
+protected:
+    RuntimeTest()
+        : TempDirTest("runtime")
+    {
+    }
+
+    void SetUp() override
+    {
+        TempDirTest::SetUp();
+    }
+
+    void collect_garbage(std::unique_ptr<linyaps_box::status_directory> status_dir) const
+    {
+        auto journal = status_dir->events_journal();
+        status_dir->write(status_of("stale", INT_MAX));
+        status_dir->write(status_of("stopping", getpid()));
+
+        linyaps_box::runtime_t runtime(std::move(status_dir));
+        EXPECT_EQ(runtime.snapshot(true).size(), 2);
+
+        // NOTE: The runtime of `stopping` is still running its poststop hooks.
+        auto statuses = runtime.snapshot();
+        ASSERT_EQ(statuses.size(), 1);
+        EXPECT_EQ(statuses.front().ID, "stopping");
+
+        auto events = events_of(journal);
+        ASSERT_EQ(events.size(), 1);
+        EXPECT_EQ(events.front().type, "deleted");
+        EXPECT_EQ(events.front().ID, "stale");
+    }
+
+    // Drop the index, as states written by older versions are not indexed.
+    void drop_index() const { std::filesystem::remove_all(dir / "index"); }
+
+};
+
+} // namespace
+
+TEST_F(RuntimeTest, CollectGarbageOfStatusDirectory)
+{
+    collect_garbage(std::make_unique<linyaps_box::impl::status_directory>(dir));
+}
+
+TEST_F(RuntimeTest, CollectGarbageOfStatusTable)
+{
+    collect_garbage(std::make_unique<linyaps_box::impl::status_table>(dir));
+}
+
+TEST_F(RuntimeTest, FindByIndex)
+{
+    linyaps_box::impl::status_directory status_dir(dir);
+    status_dir.write(running("a", { { "app", "x" }, { "user", "1" } }));
+    status_dir.write(running("b", { { "app", "x" } }));
+    status_dir.write(running("c", { { "app", "y" } }));
+    EXPECT_EQ(ids_of(status_dir.find("app", "x")), (std::vector<std::string>{ "a", "b" }));
+
+    // NOTE: Entries of changed annotations are moved.
+    status_dir.write(running("b", { { "app", "y" } }));
+    EXPECT_EQ(ids_of(status_dir.find("app", "x")), std::vector<std::string>{ "a" });
+    EXPECT_EQ(ids_of(status_dir.find("app", "y")), (std::vector<std::string>{ "b", "c" }));
+
+    status_dir.remove("a");
+    EXPECT_TRUE(status_dir.find("app", "x").empty());
+    EXPECT_TRUE(status_dir.find("user", "1").empty());
+
+    // NOTE: Names of long annotations are digests.
+    std::string value(1024, '/');
+    status_dir.write(running("d", { { "app", value } }));
+    EXPECT_EQ(ids_of(status_dir.find("app", value)), std::vector<std::string>{ "d" });
+    EXPECT_TRUE(status_dir.find("app", value.substr(1)).empty());
+}
+
+TEST_F(RuntimeTest, IndexIsBuiltForOlderStates)
+{
+    linyaps_box::impl::status_directory(dir).write(running("a", { { "app", "x" } }));
+    linyaps_box::impl::status_table(dir).write(running("b", { { "app", "x" } }));
+    drop_index();
+
+    linyaps_box::impl::status_table status_dir(dir);
+    EXPECT_EQ(ids_of(status_dir.find("app", "x")), (std::vector<std::string>{ "a", "b" }));
+    EXPECT_TRUE(std::filesystem::exists(dir / "index" / ".built"));
+}
+
+TEST_F(RuntimeTest, FindWithoutIndex)
+{
+    linyaps_box::impl::status_directory status_dir(dir);
+    status_dir.write(running("a", { { "app", "x" } }));
+    status_dir.write(running("b", { { "app", "y" } }));
+    drop_index();
+
+    // NOTE: The index can not be built, so all states are read instead.
+    std::ofstream(dir / "index");
+    EXPECT_EQ(ids_of(status_dir.find("app", "x")), std::vector<std::string>{ "a" });
+}
+
+TEST_F(RuntimeTest, FindSingleInstance)
+{
+    auto status_dir = std::make_unique<linyaps_box::impl::status_directory>(dir);
+    auto served = status_dir->control_socket("served");
+    auto unserved = status_dir->control_socket("unserved");
+    status_dir->write(running("served", { { linyaps_box::single_instance_annotation, "app" } }));
+    status_dir->write(
+            running("unserved", { { linyaps_box::single_instance_annotation, "stale" } }));
+    auto journal = status_dir->events_journal();
+    drop_index();
+
+    auto listener = linyaps_box::agent::listen(served);
+    linyaps_box::agent::listen(unserved);
+
+    linyaps_box::runtime_t runtime(std::move(status_dir));
+    auto container = runtime.find_single_instance("app");
+    ASSERT_TRUE(container.has_value());
+    EXPECT_EQ(container->status().ID, "served");
+    EXPECT_FALSE(runtime.find_single_instance("other").has_value());
+
+    // NOTE: The state of which the control socket is not served is removed.
+    EXPECT_FALSE(runtime.find_single_instance("stale").has_value());
+    EXPECT_EQ(ids_of(runtime.snapshot()), std::vector<std::string>{ "served" });
+    auto events = events_of(journal);
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_EQ(events.front().type, "deleted");
+    EXPECT_EQ(events.front().ID, "unserved");
+}
+
+TEST_F(RuntimeTest, ListFilter)
+{
+    linyaps_box::impl::status_directory status_dir(dir);
+    status_dir.write(running("a", { { "app", "x" }, { "user", "1" } }));
+    status_dir.write(running("b", { { "app", "x" }, { "user", "2" } }));
+    status_dir.write(running("c", { { "app", "y" }, { "user", "1" } }));
+
+    auto list = [this](std::vector<std::string> filters) {
+        linyaps_box::command::list_options options;
+        options.output_format = linyaps_box::command::list_options::output_format_t::json;
+        options.filters = std::move(filters);
+
+        testing::internal::CaptureStdout();
+        EXPECT_EQ(linyaps_box::command::list(dir, options), 0);
+        std::vector<std::string> ids;
+        for (const auto &status : nlohmann::json::parse(testing::internal::GetCapturedStdout())) {
+            ids.push_back(status.at("id"));
+        }
+        return ids;
+    };
+
+    EXPECT_EQ(list({}), (std::vector<std::string>{ "a", "b", "c" }));
+    EXPECT_EQ(list({ "app=x" }), (std::vector<std::string>{ "a", "b" }));
+    EXPECT_EQ(list({ "app=x", "user=1" }), std::vector<std::string>{ "a" });
+    EXPECT_TRUE(list({ "app=z" }).empty());
+    EXPECT_TRUE(list({ "app=x=" }).empty());
+
+    linyaps_box::command::list_options options;
+    options.filters = { "app" };
+    EXPECT_THROW((void)linyaps_box::command::list(dir, options), std::runtime_error);
+}
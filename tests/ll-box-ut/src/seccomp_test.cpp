@@ -1,64 +1,171 @@
-/*
- * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
- *
- * SPDX-License-Identifier: LGPL-3.0-or-later
- */
+// SPDX-FileCopyrightText: 2022-2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
 
 #if LINYAPS_BOX_ENABLE_SECCOMP
 
-#include <gtest/gtest.h>
+#include "gtest/gtest.h"
+#include "linyaps_box/config.h"
+#include "linyaps_box/seccomp.h"
+#include "nlohmann/json.hpp"
 
-#include "container/seccomp.h"
-#include "util/oci_runtime.h"
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 
-#include <seccomp.h>
 #include <sys/klog.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
-#include <climits>
+namespace {
 
-TEST(OCI, libseccomp)
+// NOTE: The demo configurations have no process.user, which is required.
+linyaps_box::config::seccomp_t load_seccomp(const std::string &path)
 {
-    auto seccompArch = seccomp_arch_resolve_name("x86_64");
-    EXPECT_EQ(seccompArch, SCMP_ARCH_X86_64);
+    std::ifstream ifs(path);
+    auto j = nlohmann::json::parse(ifs);
+    j["process"]["user"] = { { "uid", 0 }, { "gid", 0 } };
+
+    std::istringstream iss(j.dump());
+    auto config = linyaps_box::config::parse(iss);
+    EXPECT_TRUE(config.seccomp.has_value());
+    return *config.seccomp;
 }
 
-TEST(OCI, Seccomp)
+// Install `program` in a child, which exits with the errno of `fn` or 0.
+int errno_with_filter(const linyaps_box::seccomp::program_t &program, int (*fn)())
 {
-    const size_t bufSize = 1024;
-    char buf[bufSize];
-
-    auto filepath = "data/demo/config-seccomp.json";
-    auto r = linglong::fromFile(filepath);
-
-    EXPECT_EQ(ConfigSeccomp(r.linux.seccomp), 0);
+    auto pid = fork();
+    if (pid == 0) {
+        if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) || linyaps_box::seccomp::install(program)) {
+            _exit(255);
+        }
+        _exit(fn() < 0 ? errno : 0);
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
 
-    getcwd(buf, bufSize);
-    EXPECT_EQ(errno, EPERM);
+} // namespace
 
-    r.linux.seccomp->defaultAction = "INVALID_ACTION";
-    EXPECT_EQ(ConfigSeccomp(r.linux.seccomp), -1);
+TEST(Seccomp, Parse)
+{
+    auto seccomp = load_seccomp("data/demo/config-seccomp-default.json");
+
+    EXPECT_EQ(seccomp.default_action, "SCMP_ACT_ALLOW");
+    ASSERT_EQ(seccomp.architectures.size(), 1);
+    EXPECT_EQ(seccomp.architectures[0], "SCMP_ARCH_X86");
+    ASSERT_EQ(seccomp.syscalls.size(), 3);
+    EXPECT_EQ(seccomp.syscalls[1].names[0], "clone");
+    ASSERT_EQ(seccomp.syscalls[1].args.size(), 1);
+    EXPECT_EQ(seccomp.syscalls[1].args[0].value, 268435456);
+    EXPECT_EQ(seccomp.syscalls[1].args[0].op, "SCMP_CMP_MASKED_EQ");
 }
 
-TEST(OCI, SeccompDefault)
+TEST(Seccomp, Install)
 {
-    const size_t bufSize = 1024;
-    char buf[bufSize];
-
-    auto filepath = "data/demo/config-seccomp-default.json";
-    auto r = linglong::fromFile(filepath);
-
-    EXPECT_EQ(ConfigSeccomp(r.linux.seccomp), 0);
+    auto program = linyaps_box::seccomp::compile(load_seccomp("data/demo/config-seccomp.json"));
+    EXPECT_FALSE(program.filter.empty());
+
+    EXPECT_EQ(errno_with_filter(program,
+                                []() {
+                                    char buf[PATH_MAX];
+                                    return getcwd(buf, sizeof(buf)) ? 0 : -1;
+                                }),
+              EPERM);
+    EXPECT_EQ(errno_with_filter(program, []() { return chdir("/"); }), 0);
+}
 
-    klogctl(2, buf, bufSize);
-    EXPECT_EQ(errno, EPERM);
+TEST(Seccomp, InstallDefault)
+{
+    auto program =
+            linyaps_box::seccomp::compile(load_seccomp("data/demo/config-seccomp-default.json"));
+
+    EXPECT_EQ(errno_with_filter(program,
+                                []() {
+                                    char buf[1024];
+                                    return klogctl(2, buf, sizeof(buf));
+                                }),
+              EPERM);
+}
 
-    // reset seccomp
-    filepath = "data/demo/config-seccomp.json";
-    r = linglong::fromFile(filepath);
+TEST(Seccomp, InvalidAction)
+{
+    auto seccomp = load_seccomp("data/demo/config-seccomp.json");
+    seccomp.default_action = "INVALID_ACTION";
+    EXPECT_THROW((void)linyaps_box::seccomp::compile(seccomp), std::runtime_error);
+}
 
-    EXPECT_EQ(ConfigSeccomp(r.linux.seccomp), 0);
+TEST(Seccomp, Cache)
+{
+    char cache_template[] = "/tmp/ll-box-ut-seccomp-XXXXXX";
+    ASSERT_NE(mkdtemp(cache_template), nullptr);
+    std::filesystem::path cache = cache_template;
+
+    auto seccomp = load_seccomp("data/demo/config-seccomp-default.json");
+    auto compiled = linyaps_box::seccomp::compile(seccomp);
+    auto stored = linyaps_box::seccomp::load(cache, seccomp);
+    ASSERT_EQ(std::distance(std::filesystem::directory_iterator(cache),
+                            std::filesystem::directory_iterator()),
+              1);
+
+    auto entry = std::filesystem::directory_iterator(cache)->path();
+    auto loaded = linyaps_box::seccomp::load(cache, seccomp);
+    ASSERT_EQ(loaded.filter.size(), compiled.filter.size());
+    EXPECT_EQ(std::memcmp(loaded.filter.data(),
+                          compiled.filter.data(),
+                          compiled.filter.size() * sizeof(sock_filter)),
+              0);
+
+    // A corrupted entry is compiled again.
+    {
+        std::fstream fs(entry, std::ios::in | std::ios::out | std::ios::binary);
+        fs.seekp(-1, std::ios::end);
+        fs.put('\xff');
+    }
+    auto recompiled = linyaps_box::seccomp::load(cache, seccomp);
+    EXPECT_EQ(recompiled.filter.size(), compiled.filter.size());
+    EXPECT_EQ(std::memcmp(recompiled.filter.data(),
+                          compiled.filter.data(),
+                          compiled.filter.size() * sizeof(sock_filter)),
+              0);
+
+    std::filesystem::remove_all(cache);
+}
 
-    klogctl(2, buf, bufSize);
-    EXPECT_EQ(errno, EPERM);
+TEST(Seccomp, CacheComparesProfile)
+{
+    char cache_template[] = "/tmp/ll-box-ut-seccomp-XXXXXX";
+    ASSERT_NE(mkdtemp(cache_template), nullptr);
+    std::filesystem::path cache = cache_template;
+
+    auto seccomp = load_seccomp("data/demo/config-seccomp.json");
+    auto other = load_seccomp("data/demo/config-seccomp-default.json");
+    (void)linyaps_box::seccomp::load(cache, seccomp);
+    auto entry = std::filesystem::directory_iterator(cache)->path();
+    std::filesystem::rename(entry, cache / "entry");
+    (void)linyaps_box::seccomp::load(cache, other);
+    auto other_entry = std::filesystem::directory_iterator(cache)->path();
+    if (other_entry == cache / "entry") {
+        other_entry = (++std::filesystem::directory_iterator(cache))->path();
+    }
+
+    // NOTE: An entry of another profile is never used, as if the digests collided.
+    std::filesystem::rename(cache / "entry", other_entry);
+    auto compiled = linyaps_box::seccomp::compile(other);
+    auto loaded = linyaps_box::seccomp::load(cache, other);
+    ASSERT_EQ(loaded.filter.size(), compiled.filter.size());
+    EXPECT_EQ(std::memcmp(loaded.filter.data(),
+                          compiled.filter.data(),
+                          compiled.filter.size() * sizeof(sock_filter)),
+              0);
+
+    std::filesystem::remove_all(cache);
 }
+
 #endif
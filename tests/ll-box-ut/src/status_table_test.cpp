@@ -0,0 +1,209 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "gtest/gtest.h"
+#include "linyaps_box/impl/status_table.h"
+#include "linyaps_box/utils/start_time.h"
+#include "temp_dir_test.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// NOTE: The layout of status.table, see status_table.cpp.
+constexpr off_t index_offset = 4096;
+constexpr off_t slots_offset = index_offset + 65536 * sizeof(std::uint64_t);
+constexpr off_t slot_size = 4096;
+
+linyaps_box::container_status_t status_of(const std::string &id, const std::string &value = "")
+{
+    linyaps_box::container_status_t status{};
+    status.ID = id;
+    status.PID = getpid();
+    status.status = linyaps_box::container_status_t::runtime_status::RUNNING;
+    status.bundle = "/bundle";
+    status.created = "2025-01-01T00:00:00Z";
+    status.annotations = { { "key", value } };
+    return status;
+}
+
+class StatusTableTest : public linyaps_box::test::TempDirTest
+{
+protected:
+    StatusTableTest()
+        : TempDirTest("status-table")
+    {
+    }
+
+    void SetUp() override
+    {
+        TempDirTest::SetUp();
+    }
+
+    [[nodiscard]] std::uint32_t sequence(std::uint32_t slot) const
+    {
+        std::uint32_t value = 0;
+        int fd = ::open((dir / "status.table").c_str(), O_RDONLY | O_CLOEXEC);
+        EXPECT_EQ(::pread(fd, &value, sizeof(value), slots_offset + slot * slot_size),
+                  static_cast<ssize_t>(sizeof(value)));
+        ::close(fd);
+        return value;
+    }
+
+    // Leave `slot` odd, as a writer which died while writing it does.
+    void abandon(std::uint32_t slot) const
+    {
+        auto value = sequence(slot) | 1;
+        int fd = ::open((dir / "status.table").c_str(), O_WRONLY | O_CLOEXEC);
+        EXPECT_EQ(::pwrite(fd, &value, sizeof(value), slots_offset + slot * slot_size),
+                  static_cast<ssize_t>(sizeof(value)));
+        ::close(fd);
+    }
+
+    [[nodiscard]] std::uint64_t key_at(std::uint32_t slot) const
+    {
+        std::uint64_t value = 0;
+        int fd = ::open((dir / "status.table").c_str(), O_RDONLY | O_CLOEXEC);
+        EXPECT_EQ(::pread(fd, &value, sizeof(value), index_offset + slot * sizeof(value)),
+                  static_cast<ssize_t>(sizeof(value)));
+        ::close(fd);
+        return value;
+    }
+};
+
+} // namespace
+
+TEST_F(StatusTableTest, WriteReadRemove)
+{
+    linyaps_box::impl::status_table table(dir);
+    table.write(status_of("a", "1"));
+    table.write(status_of("b"));
+    table.write(status_of("a", "2"));
+
+    EXPECT_EQ(table.read("a").annotations.at("key"), "2");
+    EXPECT_EQ(table.list().size(), 2);
+    EXPECT_EQ(table.find("key", "2").size(), 1);
+    EXPECT_TRUE(table.find("key", "1").empty());
+
+    table.remove("a");
+    EXPECT_THROW((void)table.read("a"), std::runtime_error);
+    ASSERT_EQ(table.snapshot().size(), 1);
+    EXPECT_EQ(table.snapshot().front().ID, "b");
+}
+
+TEST_F(StatusTableTest, AbandonedSlotIsReused)
+{
+    linyaps_box::impl::status_table table(dir);
+    table.write(status_of("a", "1"));
+    abandon(0);
+
+    table.write(status_of("a", "2"));
+    EXPECT_EQ(sequence(0) % 2, 0);
+    EXPECT_EQ(table.read("a").annotations.at("key"), "2");
+    EXPECT_EQ(table.list(), std::vector<std::string>{ "a" });
+
+    // NOTE: No slot of the container is left behind.
+    table.remove("a");
+    EXPECT_EQ(key_at(0), 0);
+    EXPECT_EQ(key_at(1), 0);
+    EXPECT_TRUE(table.list().empty());
+}
+
+TEST_F(StatusTableTest, ConcurrentWriters)
+{
+    constexpr int writers = 4;
+    constexpr int rounds = 50;
+
+    {
+        linyaps_box::impl::status_table table(dir);
+    }
+
+    // NOTE: Each writer has its own table, as launchers in different processes do.
+    std::atomic<bool> done{ false };
+    std::atomic<int> torn{ 0 };
+    std::thread reader([this, &done, &torn]() {
+        linyaps_box::impl::status_table table(dir);
+        while (!done) {
+            for (const auto &status : table.snapshot()) {
+                if (status.annotations.at("key") != status.ID) {
+                    ++torn;
+                }
+            }
+        }
+    });
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < writers; ++i) {
+        threads.emplace_back([this, i]() {
+            linyaps_box::impl::status_table table(dir);
+            for (int j = 0; j < rounds; ++j) {
+                auto id = std::to_string(i) + "-" + std::to_string(j);
+                table.write(status_of(id, id));
+                if (j % 2 == 0) {
+                    table.remove(id);
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    done = true;
+    reader.join();
+
+    EXPECT_EQ(torn, 0);
+    linyaps_box::impl::status_table table(dir);
+    EXPECT_EQ(table.list().size(), writers * rounds / 2);
+    for (const auto &status : table.snapshot()) {
+        EXPECT_EQ(status.annotations.at("key"), status.ID);
+    }
+}
+
+TEST_F(StatusTableTest, JsonStatesAreRead)
+{
+    linyaps_box::impl::status_directory(dir).write(status_of("json"));
+
+    linyaps_box::impl::status_table table(dir);
+    table.write(status_of("table"));
+
+    EXPECT_EQ(table.read("json").ID, "json");
+    auto ids = table.list();
+    std::sort(ids.begin(), ids.end());
+    EXPECT_EQ(ids, (std::vector<std::string>{ "json", "table" }));
+    EXPECT_EQ(table.snapshot().size(), 2);
+    EXPECT_EQ(table.find("key", "").size(), 2);
+
+    table.remove("json");
+    EXPECT_FALSE(std::filesystem::exists(dir / "json.json"));
+    EXPECT_EQ(table.list(), std::vector<std::string>{ "table" });
+}
+
+TEST_F(StatusTableTest, StartTimesAreWrittenAsRecorded)
+{
+    linyaps_box::impl::status_table table(dir);
+    auto status = status_of("a");
+    status.start_time = linyaps_box::utils::process_start_time(getpid()).value_or(0);
+    status.runtime_pid = getpid();
+    status.runtime_start_time = status.start_time;
+    table.write(status);
+
+    auto stored = table.read("a");
+    EXPECT_EQ(stored.start_time, status.start_time);
+    EXPECT_EQ(stored.runtime_start_time, status.runtime_start_time);
+    EXPECT_NE(stored.status, linyaps_box::container_status_t::runtime_status::STOPPED);
+
+    // NOTE: A process reusing PID is told by the start time recorded with it.
+    status.start_time += 1;
+    table.write(status);
+    EXPECT_EQ(table.read("a").status, linyaps_box::container_status_t::runtime_status::STOPPED);
+}
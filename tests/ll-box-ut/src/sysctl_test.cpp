@@ -0,0 +1,116 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "gtest/gtest.h"
+#include "linyaps_box/sysctl.h"
+
+#include <fstream>
+#include <string>
+
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+linyaps_box::config config_of(const std::map<std::string, std::string> &sysctl,
+                              std::vector<linyaps_box::config::namespace_t> namespaces)
+{
+    linyaps_box::config config;
+    config.sysctl = sysctl;
+    config.namespaces = std::move(namespaces);
+    return config;
+}
+
+linyaps_box::config::namespace_t new_namespace(linyaps_box::config::namespace_t::type_t type)
+{
+    linyaps_box::config::namespace_t ns;
+    ns.type = type;
+    return ns;
+}
+
+// Run `fn` in a child in new IPC and UTS namespaces, returns its exit code.
+int in_namespaces(int (*fn)())
+{
+    auto pid = fork();
+    if (pid == 0) {
+        if (unshare(CLONE_NEWIPC | CLONE_NEWUTS) != 0) {
+            _exit(255);
+        }
+        _exit(fn());
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+} // namespace
+
+TEST(Sysctl, OnlyNamespacedParameters)
+{
+    using type = linyaps_box::config::namespace_t::type_t;
+    auto validate = [](const std::string &key, type ns) {
+        linyaps_box::sysctl::validate(config_of({ { key, "1" } }, { new_namespace(ns) }));
+    };
+
+    EXPECT_NO_THROW(validate("kernel.shmmax", type::IPC));
+    EXPECT_NO_THROW(validate("fs.mqueue.msg_max", type::IPC));
+    EXPECT_NO_THROW(validate("net.core.somaxconn", type::NET));
+    EXPECT_NO_THROW(validate("net/ipv4/conf/eth0.1/forwarding", type::NET));
+    EXPECT_NO_THROW(validate("kernel.hostname", type::UTS));
+
+    EXPECT_THROW(validate("kernel.pid_max", type::IPC), std::runtime_error);
+    EXPECT_THROW(validate("vm.swappiness", type::IPC), std::runtime_error);
+    EXPECT_THROW(validate("kernel.shmmax", type::NET), std::runtime_error);
+}
+
+TEST(Sysctl, JoinedNamespacesAreNotTrusted)
+{
+    auto ipc = new_namespace(linyaps_box::config::namespace_t::type_t::IPC);
+    ipc.path = "/proc/1/ns/ipc";
+    EXPECT_THROW(linyaps_box::sysctl::validate(config_of({ { "kernel.shmmax", "1" } }, { ipc })),
+                 std::runtime_error);
+}
+
+TEST(Sysctl, InvalidKeys)
+{
+    auto net = new_namespace(linyaps_box::config::namespace_t::type_t::NET);
+    for (const auto *key :
+         { "net", "/net/core/somaxconn", "net/../kernel/pid_max", "net..core", "net.core." }) {
+        SCOPED_TRACE(key);
+        EXPECT_THROW(linyaps_box::sysctl::validate(config_of({ { key, "1" } }, { net })),
+                     std::runtime_error);
+        EXPECT_THROW(linyaps_box::sysctl::apply({ { key, "1" } }), std::runtime_error);
+    }
+}
+
+TEST(Sysctl, Apply)
+{
+    if (geteuid() != 0) {
+        GTEST_SKIP() << "creating namespaces requires root";
+    }
+
+    EXPECT_EQ(in_namespaces([]() {
+                  linyaps_box::sysctl::apply({ { "kernel.hostname", "ll-box-sysctl" },
+                                               { "kernel/shmmni", "1024" } });
+
+                  char hostname[64]{};
+                  gethostname(hostname, sizeof(hostname) - 1);
+                  std::string shmmni;
+                  std::ifstream("/proc/sys/kernel/shmmni") >> shmmni;
+                  return std::string(hostname) == "ll-box-sysctl" && shmmni == "1024" ? 0 : 1;
+              }),
+              0);
+
+    EXPECT_EQ(in_namespaces([]() {
+                  try {
+                      linyaps_box::sysctl::apply({ { "kernel.nonexistent", "1" } });
+                  } catch (const std::system_error &) {
+                      return 0;
+                  }
+                  return 1;
+              }),
+              0);
+}
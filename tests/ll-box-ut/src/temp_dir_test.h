@@ -0,0 +1,38 @@
+// SPDX-FileCopyrightText: 2025 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#pragma once
+
+#include "gtest/gtest.h"
+
+#include <filesystem>
+#include <string>
+
+#include <unistd.h>
+
+namespace linyaps_box::test {
+
+// A fixture with an empty directory `dir` for each test, which is removed after the test.
+// It is named after the fixture and the PID, so tests run in parallel by ctest do not share it.
+class TempDirTest : public ::testing::Test
+{
+protected:
+    explicit TempDirTest(const std::string &name)
+        : dir(std::filesystem::temp_directory_path()
+              / ("ll-box-" + name + "-" + std::to_string(getpid())))
+    {
+    }
+
+    void SetUp() override
+    {
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+    }
+
+    void TearDown() override { std::filesystem::remove_all(dir); }
+
+    std::filesystem::path dir;
+};
+
+} // namespace linyaps_box::test